@@ -7,12 +7,15 @@
 #include "ns3/netanim-module.h"
 #include "ns3/global-route-manager.h"
 #include "ns3/tmix-scenario-helper.h"
+#include "ns3/tmix-sweep-helper.h"
 
 using namespace ns3;
 
 int main (int argc, char *argv[])
 {
+  uint32_t workers = 0;
   CommandLine cmd;
+  cmd.AddValue ("workers", "Number of experiment/TCP variant runs to execute in parallel (0: one per processor)", workers);
   cmd.Parse (argc,argv);
   bool twosided = false;
   double cvecPortion = 1.0;
@@ -58,13 +61,23 @@ int main (int argc, char *argv[])
   tmixScenario Accesslink;
   Accesslink.setexptParameters(twosided,cvecPortion,numPairs,cvecsPerPair,bottleneck_bw,bottleneck_delay,edge_bw);
   
+  TmixSweep sweep;
+  if (workers > 0)
+    {
+      sweep.SetNWorkers (workers);
+    }
+
   for(uint32_t i=0;i<3;i++)
   {
     Accesslink.settmixParameters(scale[i], testtime[i], warmup[i], tmixBaseCVName, findstats, findtarget, prefillT[i], BottleneckCapacity, maxrtt, targetload[i], targetdirection, mss, pktoh, shufbalancetol, shufloadtol);
-    Accesslink.runScenario("Accesslink",edgedelay,bufferLimit,i);
-
+    sweep.AddExperiment (Accesslink, "Accesslink", edgedelay, bufferLimit, i);
   }
 
+  if (sweep.Run () > 0)
+    {
+      return 1;
+    }
+
   return 0;
 }
 
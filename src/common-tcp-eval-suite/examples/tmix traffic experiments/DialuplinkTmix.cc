@@ -6,13 +6,16 @@
 #include "ns3/netanim-module.h"
 #include "ns3/global-route-manager.h"
 #include "ns3/tmix-scenario-helper.h"
+#include "ns3/tmix-sweep-helper.h"
 
 
 using namespace ns3;
 
 int main (int argc, char *argv[])
 {
+  uint32_t workers = 0;
   CommandLine cmd;
+  cmd.AddValue ("workers", "Number of experiment/TCP variant runs to execute in parallel (0: one per processor)", workers);
   cmd.Parse (argc,argv);
   bool twosided = false;
   double cvecPortion = 1.0;
@@ -62,12 +65,23 @@ int main (int argc, char *argv[])
   Dialuplink.setexptParameters(twosided,cvecPortion,numPairs,cvecsPerPair,bottleneck_bw,bottleneck_delay,edge_bw);
   
 
+  TmixSweep sweep;
+  if (workers > 0)
+    {
+      sweep.SetNWorkers (workers);
+    }
+
   for(uint32_t i=0;i<3;i++)
   {
     Dialuplink.settmixParameters(scale[i], testtime[i], warmup[i], tmixBaseCVName, findstats, findtarget, prefillT[i], BottleneckCapacity, maxrtt, targetload[i], targetdirection, mss, pktoh, shufbalancetol, shufloadtol);
-    Dialuplink.runScenario("Dialuplink",edgedelay,bufferLimit,i);
+    sweep.AddExperiment (Dialuplink, "Dialuplink", edgedelay, bufferLimit, i);
   }
 
+  if (sweep.Run () > 0)
+    {
+      return 1;
+    }
+
   
 
   
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <stdio.h>
 
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
@@ -22,96 +23,56 @@ tmixScenario::~tmixScenario()
 
 }
 
-void tmixScenario::AddCvecsToPairs (Ptr<TmixTopology> tmix, bool twosided, double portion, uint32_t numPairs, uint32_t cvecsPerPair,double edgedelay[], std::vector<std::string> tmixBaseCVName)
+void tmixScenario::AddCvecsToPairs (Ptr<TmixTopology> tmix, bool twosided, double portion, uint32_t numPairs, uint32_t cvecsPerPair,double edgedelay[], Ptr<const TmixCvecCorpus> corpus)
 {
- uint32_t i,j, flowsPerNode=3;
+  uint32_t i, j, flowsPerNode = 3;
   std::vector<TmixTopology::TmixNodePair> leftNodes;
   std::vector<TmixTopology::TmixNodePair> rightNodes;
- 
-  Tmix::ConnectionVector cvec1;
 
   Ptr<UniformRandomVariable> rnd = CreateObject<UniformRandomVariable> ();
-  char fileNameOut[] = "scratch/outbound.ns";
-  std::string fileNameIn[9];
 
-  system("ls \"tmixtraces\" > files.txt");
-  system("g++ utils/cvec-orig2alt.cpp -o cvec");
-  system("awk 'BEGIN{i=0;} {if ($0 ~ /.*shuf/){var=substr($0,0,5); system(\"./cvec tmixtraces/\"$0\" tmixtraces/\"var\".ns\");i++;system(\"rm tmixtraces/\"$0);}}' files.txt ");
-  
+  tmix->AssignNodes (numPairs, numPairs);
 
-  std::ifstream cvecFileIn[9];
-  std::ifstream cvecFileOut;
-  for(i=0;i<9;i++)
-  {
-    fileNameIn[i]=(tmixBaseCVName[i]+".ns");
-    cvecFileIn[i].open (fileNameIn[i]); 
-
-    if (!cvecFileIn[i])
-    {
-      std::exit (0);
-    }
-
-  }
-
-     if (twosided)
+  for (uint32_t i = 0; i < numPairs; i++)
     {
-      cvecFileOut.open (fileNameOut);
-      if (!cvecFileOut)
-        {  
-          std::exit (0);
+      for (uint32_t j = 0; j < numPairs; j++)
+        {
+          leftNodes.push_back (tmix->NewPair (TmixTopology::LEFT, Seconds (edgedelay[i]), Seconds (edgedelay[j + 3]), i, j));
         }
     }
 
-    tmix->AssignNodes(numPairs,numPairs);
-
-    for(uint32_t i=0;i<numPairs;i++)
-    {
-      for(uint32_t j=0;j<numPairs;j++)
-      {
-        leftNodes.push_back (tmix->NewPair (TmixTopology::LEFT, Seconds(edgedelay[i]), Seconds(edgedelay[j+3]), i,j));
-      }
-    }
-
- 
   if (twosided)
     {
-
-      for(uint32_t i=0;i<numPairs;i++)
-    {
-      for(uint32_t j=0;j<numPairs;j++)
-      {
-        leftNodes.push_back (tmix->NewPair (TmixTopology::RIGHT, Seconds(edgedelay[j]), Seconds(edgedelay[i+3]), i,j));
-      }
-    }
-
-
-    }  
-  for (i = 0; i < numPairs * cvecsPerPair*flowsPerNode; i += numPairs)
-    {
-      j=0; 
-      for (std::vector<TmixTopology::TmixNodePair>::const_iterator itr = leftNodes.begin ();
-           itr != leftNodes.end (); ++itr ,++j)
-        { 
-          if (Tmix::ParseConnectionVector (cvecFileIn[j], cvec1) && (rnd->GetValue () < portion))
-            {  
-                (itr->helper)->AddConnectionVector (cvec1);
+      for (uint32_t i = 0; i < numPairs; i++)
+        {
+          for (uint32_t j = 0; j < numPairs; j++)
+            {
+              rightNodes.push_back (tmix->NewPair (TmixTopology::RIGHT, Seconds (edgedelay[j]), Seconds (edgedelay[i + 3]), i, j));
             }
         }
     }
- 
-  if (twosided)
+
+  // Pair j takes its connection vectors in order from source j; the
+  // right pairs continue where the left ones stopped.
+  NS_ABORT_MSG_IF (corpus->GetNSources () < leftNodes.size (), "Not enough traces for " << leftNodes.size () << " node pairs");
+  std::vector<uint64_t> next (corpus->GetNSources (), 0);
+  std::vector<TmixTopology::TmixNodePair>* sides[] = { &leftNodes, &rightNodes };
+  for (uint32_t side = 0; side < 2; side++)
     {
-      for (i = 0; i < numPairs * cvecsPerPair*flowsPerNode; i += numPairs)
+      for (i = 0; i < numPairs * cvecsPerPair * flowsPerNode; i += numPairs)
         {
-          j=0; 
-          for (std::vector<TmixTopology::TmixNodePair>::const_iterator itr = rightNodes.begin ();
-               itr != rightNodes.end (); ++itr, ++j)
+          j = 0;
+          for (std::vector<TmixTopology::TmixNodePair>::const_iterator itr = sides[side]->begin ();
+               itr != sides[side]->end (); ++itr, ++j)
             {
-
-              if (Tmix::ParseConnectionVector (cvecFileIn[j], cvec1) && (rnd->GetValue () < portion))
-
-                { 
-                  (itr->helper)->AddConnectionVector (cvec1);
+              if (next[j] < corpus->GetNCvecs (j) && (rnd->GetValue () < portion))
+                {
+                  (itr->helper)->AddConnectionVector (corpus->GetReader (j), corpus->GetCursor (j, next[j]));
+                }
+              // Skipped connection vectors are consumed as well.
+              if (next[j] < corpus->GetNCvecs (j))
+                {
+                  next[j]++;
                 }
             }
         }
@@ -163,42 +124,77 @@ tmixScenario::DestroyTrace (Ptr<TmixTopology> tmix)
 }
 
 
-void tmixScenario::runScenario(std:: string scenarioName, double edgedelay[],float bufferLimit,uint32_t expt_num)
+namespace {
+const char* const transport_prot[] = { "ns3::TcpNewReno", "ns3::TcpHybla","ns3::TcpHighSpeed","ns3::TcpVegas", "ns3::TcpScalable","ns3::TcpHtcp", "ns3::TcpVeno", "ns3::TcpBic", "ns3::TcpYeah", "ns3::TcpIllinois","ns3::TcpWestwood", "ns3::TcpWestwoodPlus"} ;
+}
+
+uint32_t
+tmixScenario::GetNVariants ()
+{
+  return sizeof (transport_prot) / sizeof (transport_prot[0]);
+}
+
+std::string
+tmixScenario::GetVariantName (uint32_t variant)
+{
+  NS_ASSERT (variant < GetNVariants ());
+  return transport_prot[variant];
+}
+
+std::string
+tmixScenario::GetOutputDirectory (std::string scenarioName, uint32_t expt_num)
+{
+  return "tcp-eval-output/" + scenarioName + "/EXPT-" + std::to_string (expt_num + 1);
+}
 
+Ptr<TmixCvecCorpus>
+tmixScenario::PrepareTraces ()
 {
-  std::string fileName = "";
+  // The shuffled traces are written in the binary format and loaded
+  // once; every TCP variant schedules connection vectors straight from
+  // the shared mappings.
+  ts.SetOutputFormat (TmixShufWriter::BINARY);
+  m_shuffled = ts.ShuffleTraces (Scale,Simtime,Binsecs,TmixBaseCVName,Findstats,Findtarget,PrefillT,Bps,CcTmixSrcs,Maxrtt,Targetload,Targetdirection,Longflowthresh,Mss,Pktoh,Balancetol,Loadtol);
+  Ptr<TmixCvecCorpus> corpus = Create<TmixCvecCorpus> ();
+  for (std::vector<std::string>::const_iterator it = m_shuffled.begin (); it != m_shuffled.end (); ++it)
+    {
+      if (!corpus->AddSource (*it))
+        {
+          NS_FATAL_ERROR ("Could not load shuffled trace " << *it);
+        }
+    }
+  return corpus;
+}
 
-  ts.ShuffleTraces (Scale,Simtime,Binsecs,TmixBaseCVName,Findstats,Findtarget,PrefillT,Bps,CcTmixSrcs,Maxrtt,Targetload,Targetdirection,Longflowthresh,Mss,Pktoh,Balancetol,Loadtol);
+void
+tmixScenario::RemoveTraces ()
+{
+  for (std::vector<std::string>::const_iterator it = m_shuffled.begin (); it != m_shuffled.end (); ++it)
+    {
+      remove (it->c_str ());
+    }
+  m_shuffled.clear ();
+}
 
+void tmixScenario::runVariant(std::string scenarioName, double edgedelay[],float bufferLimit,uint32_t expt_num, uint32_t variant, Ptr<const TmixCvecCorpus> corpus)
+{
   TypeId tid;
-  std::string transport_prot[] = { "ns3::TcpNewReno", "ns3::TcpHybla","ns3::TcpHighSpeed","ns3::TcpVegas", "ns3::TcpScalable","ns3::TcpHtcp", "ns3::TcpVeno", "ns3::TcpBic", "ns3::TcpYeah", "ns3::TcpIllinois","ns3::TcpWestwood", "ns3::TcpWestwoodPlus"} ;
-   
-  
- // Main Container of all nodes in the topology
-  for (uint32_t i = 0; i < 12; ++i)
-  {
-   //Select TCP variant       Use lookup by name
+  std::string tcpName = GetVariantName (variant);
 
-    if (i == 11)
+  //Select TCP variant       Use lookup by name
+  if (tcpName == "ns3::TcpWestwoodPlus")
     {
       std::cout<<"\nTCP WestwoodPlus is not supported by Tmix yet";
       //Config::SetDefault ("ns3::TcpL4Protocol::SocketType", TypeIdValue (TcpWestwood::GetTypeId ()));
       //Config::SetDefault ("ns3::TcpWestwood::ProtocolType", EnumValue (TcpWestwood::WESTWOODPLUS));
     }
-    else
+  else
     {
-      tid = TypeId::LookupByName (transport_prot[i]);
+      tid = TypeId::LookupByName (tcpName);
       Config::SetDefault ("ns3::TcpL4Protocol::SocketType", TypeIdValue (tid));
     }
-    
-    fileName = "tcp-eval-output/"+ scenarioName + "/EXPT-"+std::to_string(expt_num+1);
 
-    char temp[200] ;
-    system("if test tcp-eval-output ; then mkdir tcp-eval-output; fi");
-    sprintf(temp,"if test tcp-eval-output/%s ; then mkdir tcp-eval-output/%s; fi",scenarioName.c_str(),scenarioName.c_str());
-    system(temp);
-    sprintf(temp,"if test %s ; then mkdir %s; fi",fileName.c_str(),fileName.c_str());
-    system(temp);
+  SystemPath::MakeDirectories (GetOutputDirectory (scenarioName, expt_num));
 
   InternetStackHelper internet;
   Ptr<TmixToplogyParameters> ttp = Create<TmixToplogyParameters>();
@@ -208,10 +204,10 @@ void tmixScenario::runScenario(std:: string scenarioName, double edgedelay[],flo
   ttp->SetRouterDeviceOutRate(DataRate (bottleneck_bw));
   ttp->SetRouterOutQueueLimit(bufferLimit);
   ttp->SetCenterChannelDelay(MicroSeconds (bottleneck_delay));
-  Ptr<TmixTopology> tmix = Create<TmixTopology> (internet,ttp, scenarioName, transport_prot[i], expt_num);
+  Ptr<TmixTopology> tmix = Create<TmixTopology> (internet,ttp, scenarioName, tcpName, expt_num);
+
+  AddCvecsToPairs (tmix, twosided, cvecPortion, numPairs,cvecsPerPair, edgedelay, corpus);
 
-  AddCvecsToPairs (tmix, twosided, cvecPortion, numPairs,cvecsPerPair, edgedelay, TmixBaseCVName);
-  
   GlobalRouteManager::BuildGlobalRoutingDatabase ();
   GlobalRouteManager::InitializeRoutes ();
 
@@ -220,14 +216,22 @@ void tmixScenario::runScenario(std:: string scenarioName, double edgedelay[],flo
   Simulator::Run ();
   Simulator::Destroy ();
 
-
-  tmix->Summary(scenarioName, transport_prot[i], expt_num);
+  tmix->Summary(scenarioName, tcpName, expt_num);
 }
-for(uint32_t i=0;i<9;i++)
+
+void tmixScenario::runScenario(std:: string scenarioName, double edgedelay[],float bufferLimit,uint32_t expt_num)
 {
-        std::string var = "rm "+TmixBaseCVName[i]+".ns";
-	system(var.c_str());
-}
+  Ptr<TmixCvecCorpus> corpus = PrepareTraces ();
+
+  // Main Container of all nodes in the topology
+  for (uint32_t i = 0; i < GetNVariants (); ++i)
+    {
+      runVariant (scenarioName, edgedelay, bufferLimit, expt_num, i, corpus);
+    }
+
+  // Drop the shuffled traces once all variants have run.
+  corpus = 0;
+  RemoveTraces ();
 }
 
 }
@@ -1,11 +1,15 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
+#ifndef TMIX_SCENARIO_HELPER_H
+#define TMIX_SCENARIO_HELPER_H
+
 #include "ns3/core-module.h"
 #include "ns3/tmix-helper.h"
 #include "ns3/tmix-ns2-style-trace-helper.h"
 #include "ns3/netanim-module.h"
 #include "ns3/global-route-manager.h"
 #include "ns3/tmix-shuffle.h"
+#include "ns3/tmix-cvec-corpus.h"
 
 namespace ns3
 {
@@ -16,9 +20,33 @@ public:
 
         ~tmixScenario();
 
-        void AddCvecsToPairs (Ptr<TmixTopology> tmix, bool twosided, double portion, uint32_t numPairs, uint32_t cvecsPerPair,double edgedelay[], std::vector<std::string> tmixBaseCVName);
+        void AddCvecsToPairs (Ptr<TmixTopology> tmix, bool twosided, double portion, uint32_t numPairs, uint32_t cvecsPerPair,double edgedelay[], Ptr<const TmixCvecCorpus> corpus);
 
         void runScenario(std:: string scenarioName, double edgedelay[],float bufferLimit, uint32_t expt_num);
+
+        /**
+         * Shuffle the traces for the current tmix parameters and load them.
+         * This may adjust the scale and the simulation time, so it must
+         * run before runVariant.
+         */
+        Ptr<TmixCvecCorpus> PrepareTraces ();
+
+        /// Delete the trace files written by PrepareTraces.
+        void RemoveTraces ();
+
+        /**
+         * Run one experiment with one TCP variant over traces loaded by
+         * PrepareTraces.  This runs (and destroys) the simulator, so
+         * concurrent runs must live in separate processes.
+         */
+        void runVariant(std::string scenarioName, double edgedelay[],float bufferLimit, uint32_t expt_num, uint32_t variant, Ptr<const TmixCvecCorpus> corpus);
+
+        /// \return the number of TCP variants each experiment is run with.
+        static uint32_t GetNVariants ();
+        /// \return the TypeId name of the given TCP variant.
+        static std::string GetVariantName (uint32_t variant);
+        /// \return the directory the results of an experiment are written to.
+        static std::string GetOutputDirectory (std::string scenarioName, uint32_t expt_num);
         void setexptParameters(bool two_sided, double cvec_Portion, uint32_t num_Pairs, uint32_t cvecs_PerPair, std::string bot_bw, uint32_t bot_delay,std::string Edge_bw);
         void settmixParameters(double scale, double testtime, double warmup, std::vector<std::string> tmixBaseCVName, bool findstats, bool findtarget, double prefillT, double BottleneckCapacity, int32_t maxrtt, double targetload, ns3::TmixShuffle::direction targetdirection, int32_t mss, int32_t pktoh, double balancetol, double loadtol);
         void DestroyTrace (Ptr<TmixTopology> tmix);
@@ -51,5 +79,9 @@ private:
         double Loadtol;
         double Maxtrace;
         TmixShuffle ts;
+        /// Trace files written by the last PrepareTraces.
+        std::vector<std::string> m_shuffled;
 };
 }
+
+#endif
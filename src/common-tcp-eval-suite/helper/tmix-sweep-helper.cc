@@ -0,0 +1,193 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "tmix-sweep-helper.h"
+#include "ns3/log.h"
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TmixSweep");
+
+TmixSweep::TmixSweep ()
+{
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+  m_nWorkers = n > 0 ? n : 1;
+}
+
+TmixSweep::~TmixSweep ()
+{
+}
+
+void
+TmixSweep::SetNWorkers (uint32_t workers)
+{
+  NS_ASSERT (workers > 0);
+  m_nWorkers = workers;
+}
+
+void
+TmixSweep::AddExperiment (const tmixScenario& scenario, std::string scenarioName,
+                          const double edgedelay[6], float bufferLimit, uint32_t exptNum)
+{
+  Experiment experiment;
+  experiment.scenario = scenario;
+  experiment.scenarioName = scenarioName;
+  experiment.edgedelay.assign (edgedelay, edgedelay + 6);
+  experiment.bufferLimit = bufferLimit;
+  experiment.exptNum = exptNum;
+  m_experiments.push_back (experiment);
+}
+
+void
+TmixSweep::PrepareTraces (Experiment& experiment)
+{
+  experiment.corpus = experiment.scenario.PrepareTraces ();
+}
+
+void
+TmixSweep::RemoveTraces (Experiment& experiment)
+{
+  experiment.corpus = 0;
+  experiment.scenario.RemoveTraces ();
+}
+
+void
+TmixSweep::RunVariant (Experiment& experiment, uint32_t variant)
+{
+  experiment.scenario.runVariant (experiment.scenarioName, &experiment.edgedelay[0],
+                                  experiment.bufferLimit, experiment.exptNum, variant,
+                                  experiment.corpus);
+}
+
+void
+TmixSweep::RunJob (Experiment& experiment, uint32_t variant)
+{
+  std::string dir = tmixScenario::GetOutputDirectory (experiment.scenarioName, experiment.exptNum);
+  SystemPath::MakeDirectories (dir);
+  std::string tcpName = tmixScenario::GetVariantName (variant);
+  if (tcpName.compare (0, 5, "ns3::") == 0)
+    {
+      tcpName = tcpName.substr (5);
+    }
+  std::string log = dir + "/" + tcpName + ".log";
+  std::cout.flush ();
+  std::cerr.flush ();
+  int fd = open (log.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0)
+    {
+      // NS_LOG output goes to std::clog, which shares stderr.
+      dup2 (fd, STDOUT_FILENO);
+      dup2 (fd, STDERR_FILENO);
+      close (fd);
+    }
+  RunVariant (experiment, variant);
+  std::cout.flush ();
+  // Skip the parent's static destructors and atexit handlers.
+  _exit (0);
+}
+
+uint32_t
+TmixSweep::Run ()
+{
+  NS_LOG_FUNCTION (this);
+  for (std::vector<Experiment>::iterator it = m_experiments.begin (); it != m_experiments.end (); ++it)
+    {
+      PrepareTraces (*it);
+    }
+
+  uint32_t nVariants = tmixScenario::GetNVariants ();
+  uint32_t nJobs = m_experiments.size () * nVariants;
+  std::map<pid_t, uint32_t> running;
+  uint32_t next = 0;
+  uint32_t failed = 0;
+  while (next < nJobs || !running.empty ())
+    {
+      while (next < nJobs && running.size () < m_nWorkers)
+        {
+          Experiment& experiment = m_experiments[next / nVariants];
+          uint32_t variant = next % nVariants;
+          std::cout.flush ();
+          pid_t pid = fork ();
+          if (pid == 0)
+            {
+              RunJob (experiment, variant);
+            }
+          if (pid < 0)
+            {
+              NS_FATAL_ERROR ("Could not fork a sweep worker");
+            }
+          NS_LOG_INFO ("Started " << experiment.scenarioName << " EXPT-" << experiment.exptNum + 1
+                       << " " << tmixScenario::GetVariantName (variant) << " as " << pid);
+          running[pid] = next++;
+        }
+
+      int status;
+      pid_t pid = wait (&status);
+      if (pid < 0)
+        {
+          NS_FATAL_ERROR ("Lost track of the sweep workers");
+        }
+      std::map<pid_t, uint32_t>::iterator job = running.find (pid);
+      if (job == running.end ())
+        {
+          continue;
+        }
+      const Experiment& experiment = m_experiments[job->second / nVariants];
+      std::string tcpName = tmixScenario::GetVariantName (job->second % nVariants);
+      if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+          std::cerr << experiment.scenarioName << " EXPT-" << experiment.exptNum + 1 << " "
+                    << tcpName << " failed, see its log in "
+                    << tmixScenario::GetOutputDirectory (experiment.scenarioName, experiment.exptNum) << std::endl;
+          failed++;
+        }
+      running.erase (job);
+    }
+
+  for (std::vector<Experiment>::iterator it = m_experiments.begin (); it != m_experiments.end (); ++it)
+    {
+      RemoveTraces (*it);
+    }
+  MergeSummaries ();
+  return failed;
+}
+
+void
+TmixSweep::MergeSummaries () const
+{
+  std::set<std::string> truncated;
+  for (std::vector<Experiment>::const_iterator it = m_experiments.begin (); it != m_experiments.end (); ++it)
+    {
+      std::string summary = "tcp-eval-output/" + it->scenarioName + "/summary.dat";
+      std::ios::openmode mode = std::ios::out | std::ios::app;
+      if (truncated.insert (summary).second)
+        {
+          mode = std::ios::out | std::ios::trunc;
+        }
+      std::ofstream out (summary.c_str (), mode);
+      std::string dir = tmixScenario::GetOutputDirectory (it->scenarioName, it->exptNum);
+      for (uint32_t variant = 0; variant < tmixScenario::GetNVariants (); variant++)
+        {
+          std::string tcpName = tmixScenario::GetVariantName (variant);
+          std::ifstream in ((dir + "/" + tcpName + "_AverageData.dat").c_str ());
+          out << "EXPT-" << it->exptNum + 1 << " " << tcpName << "\n";
+          if (in)
+            {
+              out << in.rdbuf () << "\n";
+            }
+          else
+            {
+              out << "(no results)\n\n";
+            }
+        }
+    }
+}
+
+}
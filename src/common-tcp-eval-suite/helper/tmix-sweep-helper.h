@@ -0,0 +1,99 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#ifndef TMIX_SWEEP_HELPER_H
+#define TMIX_SWEEP_HELPER_H
+
+#include "tmix-scenario-helper.h"
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \brief Runs the (scenario x experiment x TCP variant) jobs of the
+ * common TCP evaluation suite on several worker processes.
+ *
+ * Each experiment is added with a snapshot of its tmixScenario.  Run()
+ * first shuffles and loads the traces of every experiment in the calling
+ * process, then forks one child per (experiment, variant) job, keeping
+ * at most SetNWorkers() of them alive.  Children inherit the loaded
+ * corpora read-only, run their simulation and write their results into
+ * tmixScenario::GetOutputDirectory(); the standard output and error of
+ * every job go to \<TCP variant\>.log in that directory, named after
+ * the variant without its ns3:: prefix.  Once all jobs are done, the
+ * per-variant averages of each scenario are merged into
+ * tcp-eval-output/\<scenario\>/summary.dat.
+ *
+ * The simulator must not have been run in the calling process.
+ */
+class TmixSweep
+{
+public:
+  TmixSweep ();
+  virtual ~TmixSweep ();
+
+  /**
+   * Number of jobs run concurrently.
+   *
+   * Default: the number of online processors.
+   */
+  void SetNWorkers (uint32_t workers);
+
+  /**
+   * Add an experiment, to be run with every TCP variant.
+   *
+   * \param scenario Scenario with its experiment and tmix parameters
+   * set; it is copied, so it can be reconfigured for the next experiment.
+   * \param scenarioName Name of the scenario, used for the output paths.
+   * \param edgedelay The six edge link delays (s).
+   * \param bufferLimit Bottleneck queue limit.
+   * \param exptNum Index of the experiment within its scenario.
+   */
+  void AddExperiment (const tmixScenario& scenario, std::string scenarioName,
+                      const double edgedelay[6], float bufferLimit, uint32_t exptNum);
+
+  /**
+   * Run all jobs and merge their summaries.
+   * \return the number of jobs that failed.
+   */
+  uint32_t Run ();
+
+protected:
+  struct Experiment
+  {
+    tmixScenario scenario;
+    std::string scenarioName;
+    std::vector<double> edgedelay;
+    float bufferLimit;
+    uint32_t exptNum;
+    Ptr<TmixCvecCorpus> corpus;
+  };
+
+  /**
+   * Shuffle and load the traces of an experiment, before its jobs are
+   * forked.
+   */
+  virtual void PrepareTraces (Experiment& experiment);
+
+  /// Drop the traces of an experiment once all its jobs are done.
+  virtual void RemoveTraces (Experiment& experiment);
+
+  /**
+   * Run the simulation of one job, in its child.  The child exits with
+   * status 0 once this returns.
+   */
+  virtual void RunVariant (Experiment& experiment, uint32_t variant);
+
+private:
+  /// Run one job in a freshly forked child; never returns.
+  void RunJob (Experiment& experiment, uint32_t variant);
+
+  /// Append the average data of every job to the summary of its scenario.
+  void MergeSummaries () const;
+
+  uint32_t m_nWorkers;
+  std::vector<Experiment> m_experiments;
+};
+
+}
+#endif
@@ -0,0 +1,183 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "bottleneck-delay-collector.h"
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BottleneckDelayCollector");
+
+BottleneckDelayCollector::BottleneckDelayCollector ()
+  : m_hasPending (false),
+    m_windowSum (0),
+    m_windowCount (0),
+    m_meanSum (0),
+    m_meanCount (0)
+{
+}
+
+BottleneckDelayCollector::~BottleneckDelayCollector ()
+{
+  m_reportEvent.Cancel ();
+}
+
+void
+BottleneckDelayCollector::Install (Ptr<QueueDisc> queue)
+{
+  NS_LOG_FUNCTION (this << queue);
+  Uninstall ();
+  m_queue = queue;
+  m_queue->TraceConnectWithoutContext ("Dequeue", MakeCallback (&BottleneckDelayCollector::PacketDequeue, this));
+  m_queue->TraceConnectWithoutContext ("Requeue", MakeCallback (&BottleneckDelayCollector::PacketRequeue, this));
+}
+
+void
+BottleneckDelayCollector::Uninstall ()
+{
+  if (m_queue)
+    {
+      m_queue->TraceDisconnectWithoutContext ("Dequeue", MakeCallback (&BottleneckDelayCollector::PacketDequeue, this));
+      m_queue->TraceDisconnectWithoutContext ("Requeue", MakeCallback (&BottleneckDelayCollector::PacketRequeue, this));
+      m_queue = 0;
+    }
+  CommitPending ();
+  m_reportEvent.Cancel ();
+}
+
+void
+BottleneckDelayCollector::EnableIntervalReports (Time interval, Ptr<OutputStreamWrapper> stream)
+{
+  NS_ASSERT (interval.IsStrictlyPositive ());
+  m_reportInterval = interval;
+  m_reportStream = stream;
+  m_interval.Reset ();
+  m_reportEvent.Cancel ();
+  m_reportEvent = Simulator::Schedule (m_reportInterval, &BottleneckDelayCollector::ReportInterval, this);
+}
+
+void
+BottleneckDelayCollector::EnableMeanReports (Time window, Ptr<OutputStreamWrapper> stream)
+{
+  m_meanWindow = window;
+  m_meanStream = stream;
+  m_windowStart = Time::Min ();
+  m_windowSum = 0;
+  m_windowCount = 0;
+  m_meanSum = 0;
+  m_meanCount = 0;
+}
+
+double
+BottleneckDelayCollector::GetAverageReportedMean () const
+{
+  return m_meanSum / m_meanCount;
+}
+
+void
+BottleneckDelayCollector::Record (Time sojourn)
+{
+  m_run.Record (sojourn);
+  m_interval.Record (sojourn);
+}
+
+const SojournHistogram&
+BottleneckDelayCollector::GetRunHistogram () const
+{
+  return m_run;
+}
+
+const SojournHistogram&
+BottleneckDelayCollector::GetIntervalHistogram () const
+{
+  return m_interval;
+}
+
+void
+BottleneckDelayCollector::ResetInterval ()
+{
+  m_interval.Reset ();
+}
+
+void
+BottleneckDelayCollector::WritePercentiles (std::ostream& os, const SojournHistogram& histogram)
+{
+  os << histogram.GetCount ()
+     << " " << histogram.GetMean ().GetSeconds ()
+     << " " << histogram.GetPercentile (50).GetSeconds ()
+     << " " << histogram.GetPercentile (95).GetSeconds ()
+     << " " << histogram.GetPercentile (99).GetSeconds ()
+     << " " << histogram.GetPercentile (99.9).GetSeconds ()
+     << " " << histogram.GetMax ().GetSeconds ();
+}
+
+void
+BottleneckDelayCollector::PacketDequeue (Ptr<const QueueItem> item)
+{
+  Ptr<const QueueDiscItem> qdItem = DynamicCast<const QueueDiscItem> (item);
+  if (qdItem)
+    {
+      CommitPending ();
+      m_pending = Simulator::Now () - qdItem->GetTimeStamp ();
+      m_pendingAt = Simulator::Now ();
+      m_hasPending = true;
+    }
+}
+
+void
+BottleneckDelayCollector::PacketRequeue (Ptr<const QueueItem> item)
+{
+  // The packet did not leave: it is recorded when it is dequeued again.
+  m_hasPending = false;
+}
+
+void
+BottleneckDelayCollector::CommitPending ()
+{
+  if (m_hasPending)
+    {
+      m_hasPending = false;
+      Record (m_pending);
+      RecordMean (m_pendingAt, m_pending);
+    }
+}
+
+void
+BottleneckDelayCollector::RecordMean (Time at, Time sojourn)
+{
+  if (!m_meanStream)
+    {
+      return;
+    }
+  if (m_windowStart == Time::Min () || at - m_windowStart > m_meanWindow)
+    {
+      m_windowStart = at;
+      if (m_windowCount > 0)
+        {
+          double mean = m_windowSum / m_windowCount;
+          m_meanSum += mean;
+          m_meanCount++;
+          *m_meanStream->GetStream () << at.GetSeconds () << " " << mean << "\n";
+        }
+      m_windowSum = 0;
+      m_windowCount = 0;
+    }
+  m_windowCount++;
+  m_windowSum += sojourn.GetMilliSeconds ();
+}
+
+void
+BottleneckDelayCollector::ReportInterval ()
+{
+  // A requeue follows its dequeue in the same event, so the packet
+  // dequeued last has left by now.
+  CommitPending ();
+  std::ostream& os = *m_reportStream->GetStream ();
+  os << Simulator::Now ().GetSeconds () << " ";
+  WritePercentiles (os, m_interval);
+  os << "\n";
+  m_interval.Reset ();
+  m_reportEvent = Simulator::Schedule (m_reportInterval, &BottleneckDelayCollector::ReportInterval, this);
+}
+
+}
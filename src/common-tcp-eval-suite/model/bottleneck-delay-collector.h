@@ -0,0 +1,106 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#ifndef BOTTLENECK_DELAY_COLLECTOR_H
+#define BOTTLENECK_DELAY_COLLECTOR_H
+
+#include "sojourn-histogram.h"
+#include "ns3/queue-disc.h"
+#include "ns3/output-stream-wrapper.h"
+#include "ns3/event-id.h"
+#include "ns3/simple-ref-count.h"
+#include <ostream>
+
+namespace ns3 {
+
+/**
+ * \brief Collects the sojourn time of every packet leaving a queue disc.
+ *
+ * Sojourn times are computed from the enqueue timestamp that QueueDisc
+ * stores in every QueueDiscItem, so no packet tags are needed.  Each
+ * value is recorded in a histogram for the whole run and in one for the
+ * current interval; with EnableIntervalReports the percentiles of every
+ * interval are written to a stream as the simulation goes.
+ *
+ * A queue disc fires its Dequeue trace again for a packet it requeued
+ * because the device queue was stopped, when the packet is dequeued
+ * once more.  The last dequeued packet is therefore held until the
+ * next dequeue: a Requeue trace in between drops it, so that only the
+ * dequeue which hands the packet to the device is recorded.
+ */
+class BottleneckDelayCollector : public SimpleRefCount<BottleneckDelayCollector>
+{
+public:
+  BottleneckDelayCollector ();
+  ~BottleneckDelayCollector ();
+
+  /// Start recording the packets dequeued from the given queue disc.
+  void Install (Ptr<QueueDisc> queue);
+
+  /// Stop recording, after recording the last dequeued packet.
+  void Uninstall ();
+
+  /**
+   * Write one line with the end time, count and percentiles of every
+   * interval of the given length to the stream, from now on.
+   */
+  void EnableIntervalReports (Time interval, Ptr<OutputStreamWrapper> stream);
+
+  /**
+   * Write the mean sojourn time, in whole milliseconds per packet, of
+   * every window of packets to the stream, from now on.  A window
+   * starts with the first packet dequeued more than the given time
+   * after the start of the previous one, and its line, stamped with
+   * that time, is written when the next window starts.
+   */
+  void EnableMeanReports (Time window, Ptr<OutputStreamWrapper> stream);
+
+  /// \return the average of the means written by the mean reports.
+  double GetAverageReportedMean () const;
+
+  /// Record one sojourn time.
+  void Record (Time sojourn);
+
+  /// \return the histogram of the whole run.
+  const SojournHistogram& GetRunHistogram () const;
+
+  /// \return the histogram of the current interval.
+  const SojournHistogram& GetIntervalHistogram () const;
+
+  /// Start a new interval.
+  void ResetInterval ();
+
+  /**
+   * Write the count, mean, p50, p95, p99, p99.9 and max (in seconds) of a
+   * histogram on one line, separated by spaces.
+   */
+  static void WritePercentiles (std::ostream& os, const SojournHistogram& histogram);
+
+private:
+  void PacketDequeue (Ptr<const QueueItem> item);
+  void PacketRequeue (Ptr<const QueueItem> item);
+  /// Record the sojourn time of the last dequeued packet, if any.
+  void CommitPending ();
+  void ReportInterval ();
+  /// Add a sojourn time dequeued at the given time to the mean reports.
+  void RecordMean (Time at, Time sojourn);
+
+  Ptr<QueueDisc> m_queue;
+  SojournHistogram m_run;
+  SojournHistogram m_interval;
+  Time m_reportInterval;
+  Ptr<OutputStreamWrapper> m_reportStream;
+  EventId m_reportEvent;
+  bool m_hasPending;  //!< Whether a dequeued packet is not recorded yet
+  Time m_pending;     //!< The sojourn time of that packet
+  Time m_pendingAt;   //!< When that packet was dequeued
+  Time m_meanWindow;
+  Ptr<OutputStreamWrapper> m_meanStream;
+  Time m_windowStart;     //!< Start of the current mean window
+  double m_windowSum;     //!< Sum of the window's sojourn times, in ms
+  uint32_t m_windowCount;
+  double m_meanSum;       //!< Sum of the means written so far
+  uint32_t m_meanCount;
+};
+
+}
+#endif
@@ -0,0 +1,141 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "sojourn-histogram.h"
+#include "ns3/assert.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ns3 {
+
+namespace {
+/// \return floor (log2 (v)) for v > 0.
+uint32_t
+Log2 (uint64_t v)
+{
+  uint32_t r = 0;
+  for (uint32_t shift = 32; shift > 0; shift >>= 1)
+    {
+      if (v >> shift)
+        {
+          v >>= shift;
+          r += shift;
+        }
+    }
+  return r;
+}
+}
+
+SojournHistogram::SojournHistogram (Time resolution, Time highest, uint32_t subBucketBits)
+  : m_resolution (resolution.GetTimeStep ()),
+    m_subBucketBits (subBucketBits),
+    m_subBucketCount (1ULL << subBucketBits),
+    m_total (0),
+    m_max (0),
+    m_sum (0)
+{
+  NS_ASSERT (m_resolution > 0 && subBucketBits >= 1 && subBucketBits < 32);
+  uint64_t highestUnits = std::max<int64_t> (highest.GetTimeStep () / m_resolution, 1);
+  m_counts.resize (GetIndex (highestUnits) + 1, 0);
+}
+
+uint32_t
+SojournHistogram::GetIndex (uint64_t units) const
+{
+  if (units < m_subBucketCount)
+    {
+      return units;
+    }
+  // Keep the b most significant bits of the value.
+  uint32_t shift = Log2 (units) - (m_subBucketBits - 1);
+  uint64_t subBucket = units >> shift;
+  return m_subBucketCount + (shift - 1) * (m_subBucketCount / 2) + (subBucket - m_subBucketCount / 2);
+}
+
+uint64_t
+SojournHistogram::GetHighestEquivalent (uint32_t index) const
+{
+  if (index < m_subBucketCount)
+    {
+      return index;
+    }
+  uint32_t shift = (index - m_subBucketCount) / (m_subBucketCount / 2) + 1;
+  uint64_t subBucket = (index - m_subBucketCount) % (m_subBucketCount / 2) + m_subBucketCount / 2;
+  return ((subBucket + 1) << shift) - 1;
+}
+
+void
+SojournHistogram::Record (Time value)
+{
+  int64_t ts = std::max<int64_t> (value.GetTimeStep (), 0);
+  uint32_t index = std::min<uint64_t> (GetIndex (ts / m_resolution), m_counts.size () - 1);
+  m_counts[index]++;
+  m_total++;
+  m_max = std::max (m_max, ts);
+  m_sum += ts;
+}
+
+void
+SojournHistogram::Add (const SojournHistogram& other)
+{
+  NS_ASSERT (other.m_counts.size () == m_counts.size () && other.m_resolution == m_resolution);
+  for (uint32_t i = 0; i < m_counts.size (); i++)
+    {
+      m_counts[i] += other.m_counts[i];
+    }
+  m_total += other.m_total;
+  m_max = std::max (m_max, other.m_max);
+  m_sum += other.m_sum;
+}
+
+void
+SojournHistogram::Reset ()
+{
+  std::fill (m_counts.begin (), m_counts.end (), 0);
+  m_total = 0;
+  m_max = 0;
+  m_sum = 0;
+}
+
+uint64_t
+SojournHistogram::GetCount () const
+{
+  return m_total;
+}
+
+Time
+SojournHistogram::GetMean () const
+{
+  return m_total == 0 ? Time (0) : TimeStep ((uint64_t) (m_sum / m_total));
+}
+
+Time
+SojournHistogram::GetMax () const
+{
+  return TimeStep (m_max);
+}
+
+Time
+SojournHistogram::GetPercentile (double percentile) const
+{
+  if (m_total == 0)
+    {
+      return Time (0);
+    }
+  percentile = std::min (std::max (percentile, 0.0), 100.0);
+  uint64_t rank = std::max<uint64_t> ((uint64_t) std::ceil (percentile / 100.0 * m_total), 1);
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < m_counts.size (); i++)
+    {
+      seen += m_counts[i];
+      if (seen >= rank)
+        {
+          // Values are only known to the resolution; never report more
+          // than what was actually seen.
+          int64_t value = GetHighestEquivalent (i) * m_resolution;
+          return TimeStep (std::min (value, m_max));
+        }
+    }
+  return TimeStep (m_max);
+}
+
+}
@@ -0,0 +1,75 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#ifndef SOJOURN_HISTOGRAM_H
+#define SOJOURN_HISTOGRAM_H
+
+#include "ns3/nstime.h"
+#include <stdint.h>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \brief Log-linear (HDR-style) histogram of delays.
+ *
+ * Values are counted in units of the resolution.  Below 2^b units every
+ * value has its own bucket; above, each power of two is split into 2^(b-1)
+ * buckets, so every recorded value is known to within a relative error of
+ * 2^(1-b) (under 1% for the default b = 8).  The number of buckets only
+ * depends on the resolution, the highest trackable value and b, so
+ * memory stays constant however many values are recorded.  Values above
+ * the highest trackable one are counted in the last bucket.
+ */
+class SojournHistogram
+{
+public:
+  /**
+   * \param resolution Smallest distinguishable delay.
+   * \param highest Highest delay tracked with full precision.
+   * \param subBucketBits Precision b; 2^b values are tracked exactly.
+   */
+  SojournHistogram (Time resolution = MicroSeconds (1), Time highest = Seconds (100),
+                    uint32_t subBucketBits = 8);
+
+  /// Count one delay.
+  void Record (Time value);
+
+  /// Add all counts of another histogram with the same layout.
+  void Add (const SojournHistogram& other);
+
+  /// Forget all recorded values.
+  void Reset ();
+
+  /// \return the number of recorded values.
+  uint64_t GetCount () const;
+
+  /// \return the mean of the recorded values.
+  Time GetMean () const;
+
+  /// \return the largest recorded value.
+  Time GetMax () const;
+
+  /**
+   * \param percentile Percentile to compute, between 0 and 100.
+   * \return the highest value equivalent (within the precision of the
+   * histogram) to the given percentile, or zero if nothing was recorded.
+   */
+  Time GetPercentile (double percentile) const;
+
+private:
+  /// \return the bucket of a value in resolution units.
+  uint32_t GetIndex (uint64_t units) const;
+  /// \return the highest value, in resolution units, counted by a bucket.
+  uint64_t GetHighestEquivalent (uint32_t index) const;
+
+  int64_t m_resolution;           //!< Resolution, in Time units
+  uint32_t m_subBucketBits;       //!< Precision b
+  uint64_t m_subBucketCount;      //!< 2^b
+  std::vector<uint64_t> m_counts; //!< Count of every bucket
+  uint64_t m_total;               //!< Number of recorded values
+  int64_t m_max;                  //!< Largest recorded value, in Time units
+  double m_sum;                   //!< Sum of the recorded values, in Time units
+};
+
+}
+#endif
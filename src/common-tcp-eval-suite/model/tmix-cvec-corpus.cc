@@ -0,0 +1,88 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "tmix-cvec-corpus.h"
+#include "ns3/log.h"
+#include <fstream>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TmixCvecCorpus");
+
+TmixCvecCorpus::TmixCvecCorpus ()
+{
+}
+
+bool
+TmixCvecCorpus::AddSource (const std::string& filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+  std::string binary = filename;
+  if (!Tmix::BinaryCvecReader::IsBinaryCvecFile (filename))
+    {
+      std::ifstream in (filename.c_str ());
+      std::string first;
+      if (!(in >> first))
+        {
+          NS_LOG_WARN ("Could not read trace " << filename);
+          return false;
+        }
+      in.seekg (0);
+      // Original traces start with SEQ or CONC, ns-2 ones with S or C.
+      Tmix::TextCvecFormat format = first.size () > 1 ? Tmix::ORIGINAL_FORMAT : Tmix::ALT_FORMAT;
+      binary = filename + ".bcvec";
+      Tmix::ConvertToBinaryCvec (in, format, binary);
+      m_converted.push_back (binary);
+    }
+
+  Source source;
+  source.reader = Create<Tmix::BinaryCvecReader> ();
+  if (!source.reader->Open (binary))
+    {
+      return false;
+    }
+  source.cursors.reserve (source.reader->GetNCvecs ());
+  Tmix::BinaryCvecReader::View view;
+  uint64_t cursor = source.reader->Begin ();
+  for (uint64_t next = cursor; source.reader->Next (next, view); cursor = next)
+    {
+      source.cursors.push_back (cursor);
+    }
+  NS_LOG_LOGIC ("Loaded " << source.cursors.size () << " connection vectors from " << filename);
+  m_sources.push_back (source);
+  return true;
+}
+
+uint32_t
+TmixCvecCorpus::GetNSources () const
+{
+  return m_sources.size ();
+}
+
+Ptr<const Tmix::BinaryCvecReader>
+TmixCvecCorpus::GetReader (uint32_t source) const
+{
+  NS_ASSERT (source < m_sources.size ());
+  return m_sources[source].reader;
+}
+
+uint64_t
+TmixCvecCorpus::GetNCvecs (uint32_t source) const
+{
+  NS_ASSERT (source < m_sources.size ());
+  return m_sources[source].cursors.size ();
+}
+
+uint64_t
+TmixCvecCorpus::GetCursor (uint32_t source, uint64_t cvec) const
+{
+  NS_ASSERT (source < m_sources.size () && cvec < m_sources[source].cursors.size ());
+  return m_sources[source].cursors[cvec];
+}
+
+const std::vector<std::string>&
+TmixCvecCorpus::GetConvertedFiles () const
+{
+  return m_converted;
+}
+
+}
@@ -0,0 +1,67 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#ifndef TMIX_CVEC_CORPUS_H
+#define TMIX_CVEC_CORPUS_H
+
+#include "ns3/tmix-binary-cvec.h"
+#include "ns3/simple-ref-count.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \brief Set of connection vector traces loaded once and shared by
+ * several simulation runs.
+ *
+ * Every source is held as a memory-mapped binary cvec file together with
+ * the offset of each of its records, so a run can pick connection
+ * vectors by index and hand them to TmixHelper::AddConnectionVector
+ * without parsing anything.  Text sources are converted to the binary
+ * format once, next to the original file.
+ */
+class TmixCvecCorpus : public SimpleRefCount<TmixCvecCorpus>
+{
+public:
+  TmixCvecCorpus ();
+
+  /**
+   * Load a trace as the next source.  Binary cvec files are mapped as
+   * they are.  Text files in the original (SEQ/CONC) or ns-2 (S/C)
+   * format are converted to \<filename\>.bcvec first.
+   *
+   * \param filename Path of the trace.
+   * \return false if the trace could not be read.
+   */
+  bool AddSource (const std::string& filename);
+
+  /// \return the number of sources loaded.
+  uint32_t GetNSources () const;
+
+  /// \return the reader of the given source.
+  Ptr<const Tmix::BinaryCvecReader> GetReader (uint32_t source) const;
+
+  /// \return the number of connection vectors in the given source.
+  uint64_t GetNCvecs (uint32_t source) const;
+
+  /// \return the reader cursor of the given connection vector of a source.
+  uint64_t GetCursor (uint32_t source, uint64_t cvec) const;
+
+  /// \return the binary files created by AddSource for text sources.
+  const std::vector<std::string>& GetConvertedFiles () const;
+
+private:
+  struct Source
+  {
+    Ptr<Tmix::BinaryCvecReader> reader;
+    /// Cursor of every record, in file order.
+    std::vector<uint64_t> cursors;
+  };
+
+  std::vector<Source> m_sources;
+  std::vector<std::string> m_converted;
+};
+
+}
+#endif
@@ -0,0 +1,101 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "tmix-shuf-writer.h"
+#include "ns3/log.h"
+#include <sstream>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TmixShufWriter");
+
+/// Size of the user-space buffer behind each text output file.
+static const size_t SHUF_WRITE_BUFFER = 1 << 20;
+
+TmixShufWriter::TmixShufWriter ()
+  : m_format (ORIGINAL)
+{
+}
+
+TmixShufWriter::~TmixShufWriter ()
+{
+  Close ();
+}
+
+bool
+TmixShufWriter::Open (const std::string& filename, Format format)
+{
+  NS_LOG_FUNCTION (this << filename << format);
+  Close ();
+  m_format = format;
+  if (m_format == BINARY)
+    {
+      return m_binary.Open (filename);
+    }
+  m_buffer.resize (SHUF_WRITE_BUFFER);
+  m_out.rdbuf ()->pubsetbuf (&m_buffer[0], m_buffer.size ());
+  m_out.open (filename.c_str (), std::ios::out | std::ios::trunc);
+  if (!m_out)
+    {
+      NS_LOG_WARN ("Could not open " << filename << " for writing");
+      return false;
+    }
+  return true;
+}
+
+void
+TmixShufWriter::WriteConnection (const std::vector<std::string>& lines)
+{
+  if (m_format == BINARY)
+    {
+      WritePending (false);
+      for (std::vector<std::string>::const_iterator l = lines.begin (); l != lines.end (); ++l)
+        {
+          m_pending.append (*l);
+          m_pending.push_back ('\n');
+        }
+      return;
+    }
+  for (std::vector<std::string>::const_iterator l = lines.begin (); l != lines.end (); ++l)
+    {
+      std::string::size_type len = l->size ();
+      if (len > 0 && (*l)[len - 1] == '\n')
+        {
+          len--;
+        }
+      m_out.write (l->data (), len);
+      m_out.put ('\n');
+    }
+}
+
+void
+TmixShufWriter::WritePending (bool endOfTrace)
+{
+  if (m_pending.empty ())
+    {
+      return;
+    }
+  std::stringstream text (m_pending);
+  Tmix::ConnectionVector cvec;
+  if (Tmix::ParseOriginalConnectionVector (text, cvec, endOfTrace))
+    {
+      m_binary.Write (cvec);
+    }
+  else
+    {
+      NS_LOG_WARN ("Dropping connection that could not be parsed: " << m_pending.substr (0, m_pending.find ('\n')));
+    }
+  m_pending.clear ();
+}
+
+void
+TmixShufWriter::Close ()
+{
+  WritePending (true);
+  m_binary.Close ();
+  if (m_out.is_open ())
+    {
+      m_out.close ();
+    }
+}
+
+}
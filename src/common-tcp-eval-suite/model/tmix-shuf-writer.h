@@ -0,0 +1,71 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#ifndef TMIX_SHUF_WRITER_H
+#define TMIX_SHUF_WRITER_H
+
+#include "ns3/tmix-binary-cvec.h"
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \brief Output sink for one shuffled trace.
+ *
+ * The output file is opened (and truncated) once and every kept
+ * connection is appended through a large user-space buffer.  In
+ * ORIGINAL format the connection lines are copied as they are; in
+ * BINARY format each connection is converted to a
+ * Tmix::ConnectionVector and stored with Tmix::BinaryCvecWriter, so the
+ * result can be loaded without running the cvec converter.
+ */
+class TmixShufWriter
+{
+public:
+  enum Format
+  {
+    ORIGINAL,
+    BINARY
+  };
+
+  TmixShufWriter ();
+  ~TmixShufWriter ();
+
+  /**
+   * Create (or truncate) the output file.
+   * \return false if it could not be opened.
+   */
+  bool Open (const std::string& filename, Format format);
+
+  /**
+   * Append one connection, given as its lines in the original format
+   * (header first). Trailing newlines on the lines are optional.
+   *
+   * In BINARY format the connection is converted the same way a
+   * conversion of the whole ORIGINAL file would, so the last connection
+   * written is only stored by Close().
+   */
+  void WriteConnection (const std::vector<std::string>& lines);
+
+  /// Flush and close the output file.
+  void Close ();
+
+private:
+  TmixShufWriter (const TmixShufWriter&);
+  TmixShufWriter& operator= (const TmixShufWriter&);
+
+  /// Convert and write m_pending to the binary file.
+  void WritePending (bool endOfTrace);
+
+  Format m_format;
+  std::ofstream m_out;
+  std::vector<char> m_buffer;
+  Tmix::BinaryCvecWriter m_binary;
+  /// Last connection given in BINARY format, written once it is known
+  /// whether it ends the trace.
+  std::string m_pending;
+};
+
+}
+#endif
@@ -1,10 +1,13 @@
 #include "tmix-shuffle.h"
 #include "ns3/log.h"
 #include <vector>
+#include <algorithm>
+#include <float.h>
 #include <math.h> 
 #include <fstream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 namespace ns3 {
 
@@ -28,6 +31,8 @@ TmixShuffle::TmixShuffle ()
   m_mssI = 0;
   m_mssA = 0;
   m_rStartStream = 0;
+  m_incrementalSearch = true;
+  m_outputFormat = TmixShufWriter::ORIGINAL;
 }
 
 TmixShuffle::~TmixShuffle ()
@@ -51,6 +56,156 @@ void TmixShuffle::NextStream ()
   //m_srng->SetStream (m_srng->GetStream()+1);
 }
 
+void TmixShuffle::SetIncrementalSearch (bool incremental)
+{
+  m_incrementalSearch = incremental;
+}
+
+void TmixShuffle::SetOutputFormat (TmixShufWriter::Format format)
+{
+  m_outputFormat = format;
+}
+
+void TmixShuffle::BuildLoadProfile (const std::vector<std::string>& tmixBaseCVName, int mss)
+{
+  NS_LOG_FUNCTION (this);
+  struct ConnLoad
+  {
+    double start;
+    double bytesI;
+    double bytesA;
+    bool operator< (const ConnLoad& rhs) const
+    {
+      return start < rhs.start;
+    }
+  };
+  std::vector<ConnLoad> conns;
+  for (std::vector<std::string>::const_iterator cvf = tmixBaseCVName.begin (); cvf != tmixBaseCVName.end (); ++cvf)
+    {
+      const char *pos;
+      const char *end;
+      GetTraceIndex (*cvf).GetRange (-DBL_MAX, DBL_MAX, pos, end);
+      double mssI = mss;
+      double mssA = mss;
+      bool firstburstI = false;
+      bool firstburstA = false;
+      while (pos < end)
+        {
+          const char *eol = (const char *) memchr (pos, '\n', end - pos);
+          const char *next = eol ? eol + 1 : end;
+          const char *line = pos;
+          pos = next;
+          // Value following the first field, as sscanf ("%*s%f") would read it.
+          const char *field = line;
+          while (field < next && (*field == ' ' || *field == '\t'))
+            {
+              field++;
+            }
+          while (field < next && *field != ' ' && *field != '\t' && *field != '\n')
+            {
+              field++;
+            }
+          char *after;
+          double value = strtod (field, &after);
+          if (line[0] == 'S' || line[0] == 'C')
+            {
+              ConnLoad conn;
+              conn.start = value;
+              conn.bytesI = 0;
+              conn.bytesA = 0;
+              conns.push_back (conn);
+              firstburstI = true;
+              firstburstA = true;
+            }
+          else if (conns.empty ())
+            {
+              continue;
+            }
+          else if (line[0] == '>' || (line[0] == 'c' && line[1] == '>'))
+            {
+              double oh = ceil (1.0 * value / mssI) * m_pktoh + 2.0 * firstburstI * m_pktoh;
+              conns.back ().bytesI += value + oh;
+              conns.back ().bytesA += oh;
+              firstburstI = false;
+            }
+          else if (line[0] == '<' || (line[0] == 'c' && line[1] == '<'))
+            {
+              double oh = ceil (1.0 * value / mssA) * m_pktoh + 2.0 * firstburstA * m_pktoh;
+              conns.back ().bytesA += value + oh;
+              conns.back ().bytesI += oh;
+              firstburstA = false;
+            }
+          else if (line[0] == 'm')
+            {
+              mssI = value;
+              mssA = strtod (after, NULL);
+            }
+        }
+    }
+  std::sort (conns.begin (), conns.end ());
+
+  m_profileStart.resize (conns.size ());
+  m_profileCumI.assign (1, 0.0);
+  m_profileCumA.assign (1, 0.0);
+  for (size_t i = 0; i < conns.size (); i++)
+    {
+      m_profileStart[i] = conns[i].start;
+      m_profileCumI.push_back (m_profileCumI.back () + conns[i].bytesI);
+      m_profileCumA.push_back (m_profileCumA.back () + conns[i].bytesA);
+    }
+  NS_LOG_LOGIC ("Load profile built from " << conns.size () << " connections");
+}
+
+void TmixShuffle::FillBinsFromProfile (double scale, int totalbins)
+{
+  // A connection starting at unscaled time t lands in bin
+  // (scale * t - prefill) / binsize, so bin b holds the connections
+  // starting in [(prefill + b * binsize) / scale, (prefill + (b + 1) * binsize) / scale).
+  m_binConnDataListI.assign (totalbins, 0.0);
+  m_binConnDataListA.assign (totalbins, 0.0);
+  m_numSbinsI = totalbins;
+  m_numSbinsA = totalbins;
+  std::vector<double>::iterator lo = std::lower_bound (m_profileStart.begin (), m_profileStart.end (), m_prefillus / scale);
+  for (int b = 0; b < totalbins; b++)
+    {
+      std::vector<double>::iterator hi = std::lower_bound (lo, m_profileStart.end (), (m_prefillus + (b + 1) * m_binSizeus) / scale);
+      size_t first = lo - m_profileStart.begin ();
+      size_t last = hi - m_profileStart.begin ();
+      m_binConnDataListI[b] = m_profileCumI[last] - m_profileCumI[first];
+      m_binConnDataListA[b] = m_profileCumA[last] - m_profileCumA[first];
+      lo = hi;
+    }
+}
+
+void TmixShuffle::PadBins (int nbins)
+{
+  if ((int) m_binConnDataListI.size () < nbins)
+    {
+      m_binConnDataListI.resize (nbins, 0.0);
+      m_numSbinsI = nbins - 1;
+    }
+  if ((int) m_binConnDataListA.size () < nbins)
+    {
+      m_binConnDataListA.resize (nbins, 0.0);
+      m_numSbinsA = nbins - 1;
+    }
+}
+
+const TmixTraceIndex&
+TmixShuffle::GetTraceIndex (const std::string& basename)
+{
+  std::map<std::string, TmixTraceIndex>::iterator it = m_traceIndex.find (basename);
+  if (it == m_traceIndex.end ())
+    {
+      it = m_traceIndex.insert (std::make_pair (basename, TmixTraceIndex ())).first;
+      if (!it->second.Load (basename + ".orig"))
+        {
+          NS_LOG_WARN ("Trace " << basename << ".orig could not be read; treating it as empty.");
+        }
+    }
+  return it->second;
+}
+
 std::vector<int> TmixShuffle::FisherYatesShuffle (std::vector<int> binlist, int reqlen)
 {
   int len = binlist.size ();
@@ -187,6 +342,10 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
   if (findtarget)
     {
       findstats = true;
+      if (m_incrementalSearch)
+        {
+          BuildLoadProfile (tmixBaseCVName, mss);
+        }
     }
   bool looparound = true;
   double highscale = 0.0;
@@ -201,15 +360,21 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
   double Sum_prefill_overheadI;
   double Sum_prefill_overheadA;
   std::vector<int>::iterator bs;
+  int lastbin = 0;
   int num_conns;
   int prefill_bins;
   while ( looparound )
     {
+      // While searching incrementally the bin totals come from the load
+      // profile; the traces are only sliced once the scale is final.
+      bool profiled = findtarget && m_incrementalSearch;
       double concur = 1.0 > (ccTmixSrcs * 500.0 / scale * maxrtt) ? 1.0 : 500.0 / scale * maxrtt;
       m_bpus = 1.0 * bps / 8 / concur / (1000000);
       int num_balance = 0;
       outfilelist.clear ();
-      std::map<std::string, std::string> shufFid;
+      // One buffered writer per output trace, only opened for the pass
+      // that actually writes.
+      std::map<std::string, TmixShufWriter> shufFid;
       for (std::vector<std::string>::iterator it = tmixBaseCVName.begin (); it != tmixBaseCVName.end (); ++it)
         {
           //int found = (int) it->find_last_of ("/\\");
@@ -217,10 +382,12 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
           sprintf (str_scale, "%f",scale);
           std::string tempx = std::string (str_scale);
           //std::string ofname = it->substr (found + 1) + tempx + ".shuf";
-          std::string ofname = it->substr (0) + tempx + ".shuf";
+          std::string ofname = it->substr (0) + tempx + (m_outputFormat == TmixShufWriter::BINARY ? ".bcvec" : ".shuf");
           outfilelist.push_back (ofname);
-          shufFid[*it] = ofname;
-          //(shufFid[*it]).open(ofname.c_str(), std::ios::out | std::ios::trunc );
+          if (!findtarget)
+            {
+              shufFid[*it].Open (ofname, m_outputFormat);
+            }
         }
       int tracelength = 3000;
       int totalbins = (int)ceil (1.0 * scale * tracelength / binsecs);
@@ -256,6 +423,10 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
       m_binConnDataListA.clear ();
       m_numSbinsI = 0;
       m_numSbinsA = 0;
+      if (profiled)
+        {
+          FillBinsFromProfile (scale, totalbins);
+        }
       for (bs = baseseq.begin (); bs != baseseq.end (); ++bs)
         {
 
@@ -266,7 +437,7 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
           for (std::vector<std::string>::iterator cvf = tmixBaseCVName.begin (); cvf != tmixBaseCVName.end (); ++cvf)
             {
 
-              if (!findstats)
+              if (!findstats || profiled)
                 {
                   continue;
                 }
@@ -274,16 +445,11 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
               int lower_time = nbs * scale_binsize_us;
               int upper_time = (nbs + 1) * scale_binsize_us;
               int offset_time = (nbs - *bs) * scale_binsize_us;
-              char str_lower_time[200];
-              char str_upper_time[200];
-              sprintf (str_lower_time,"%d", lower_time);
-              sprintf (str_upper_time,"%d", upper_time);
-              std::string p1 = "awk \'BEGIN { out=0 } {if ($1 ~ /^[SC]/) {if ($2 >=";
-              std::string p2 = ") { if ($2 < ";
-              std::string p3 = ") {out=1; print $0;} else {out=0; exit;}}} else { if (out) print $0}} END{}\' ";
-              std::string p4 = ".orig";
-              std::string cmd = p1 + std::string (str_lower_time) + p2 + std::string (str_upper_time) + p3 + *cvf + p4;
-              FILE* cvfFid = popen (cmd.c_str (), "r");
+              // Slice the bin out of the in-memory index of the
+              // original trace instead of re-reading it with awk.
+              const char *pos;
+              const char *end;
+              GetTraceIndex (*cvf).GetRange (lower_time, upper_time, pos, end);
               m_connDataI = 0.0;
               m_connDataA = 0.0;
               m_OverheadEstI = 0.0;
@@ -298,12 +464,15 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
               bool writethis = false;
               bool firstburstI = false;
               bool firstburstA = false;
-              char *line = NULL;
-              size_t len = 0;
-              ssize_t read;
+              std::string lineBuf;
               double newConnTime = 0;
-              while ((read = getline (&line, &len, cvfFid)) != -1)
+              while (pos < end)
                 {
+                  const char *eol = (const char *) memchr (pos, '\n', end - pos);
+                  const char *next = eol ? eol + 1 : end;
+                  lineBuf.assign (pos, next);
+                  pos = next;
+                  const char *line = lineBuf.c_str ();
                   if (line[0] == 'S' || line[0] == 'C')
                     {
                       firstburstI = true;
@@ -332,13 +501,7 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
                             {
                               if (!findtarget)
                                 {
-                                  for (std::vector<std::string>::iterator co = connout.begin (); co != connout.end (); ++co)
-                                    {
-                                      std::ofstream x;
-                                      x.open(shufFid[*cvf].c_str(), std::ofstream::out | std::ofstream::app);
-                                      x << co->c_str () << "\n";
-                                      x.close();
-                                    }
+                                  shufFid[*cvf].WriteConnection (connout);
                                 }
                               writethis = false;
                             }
@@ -389,43 +552,38 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
                     {
                       if (line[0] == '>' ||(line[0] == 'c' && line[1] == '>'))
                         {
-                          char *l1 = NULL;
                           float l2;
-                          sscanf (line,"%s%f", l1, &l2);
+                          sscanf (line,"%*s%f", &l2);
                           ProcessBurst (l2, INITIATOR, firstburstI);
                           firstburstI = 0;
                         }
                       else if (line[0] == '<' ||(line[0] == 'c' && line[1] == '<'))
                         {
-                          char *l1 = NULL;
                           float l2;
-                          sscanf (line,"%s%f", l1, &l2);
+                          sscanf (line,"%*s%f", &l2);
                           ProcessBurst (l2, ACCEPTOR, firstburstA);
                           firstburstA = 0;
                         }
                       else if (line[0] == 't' && line[1] == '>')
                         {
-                          char *l1 = NULL;
                           float l2;
-                          sscanf (line,"%s%f", l1, &l2);
+                          sscanf (line,"%*s%f", &l2);
                           idleI += l2;
                           m_burstTEstI += l2;
                           m_lastidleI = l2;
                         }
                       else if (line[0] == 't' && line[1] == '<')
                         {
-                          char *l1 = NULL;
                           float l2;
-                          sscanf (line,"%s%f", l1, &l2);
+                          sscanf (line,"%*s%f", &l2);
                           idleA += l2;
                           m_burstTEstA += l2;
                           m_lastidleA = l2;
                         }
                       else if (line[0] == 't')
                         {
-                          char *l1 = NULL;
                           float l2;
-                          sscanf (line,"%s%f", l1, &l2);
+                          sscanf (line,"%*s%f", &l2);
                           idleI += l2;
                           m_burstTEstI += l2;
                           m_lastidleI = l2;
@@ -435,17 +593,15 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
                         }
                       else if (line[0] == 'm')
                         {
-                          char *l1 = NULL;
                           float l2;
                           float l3;
-                          sscanf (line,"%s%f%f", l1, &l2, &l3);
+                          sscanf (line,"%*s%f%f", &l2, &l3);
                           m_mssI = l2;
                           m_mssA = l3;
                         }
                       connout.push_back (line);
                     }
                 }
-              pclose (cvfFid);
             }
 
           if (findtarget && targetload > 0 && *bs > minbins + prefill_bins)
@@ -454,6 +610,7 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
               int third = bcdl_length / 3;
               int working_length = bcdl_length - third;
               int mid = working_length / 2 + third;
+              PadBins (bcdl_length);
               std::vector <double> connB_l;
               std::vector <double> connB_u;
               double avB_l = 0;
@@ -509,14 +666,16 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
                 }
             }
         }
+      lastbin = (bs != baseseq.end ()) ? *bs : totalbins;
       if (!findtarget)
         {
           looparound = false;
         }
       else
         {
-          int bl = *bs - prefill_bins;
+          int bl = lastbin - prefill_bins;
           int third = bl / 3;
+          PadBins (bl);
           double est_load;
           std::vector <double> ur;
           double ursum = 0;
@@ -623,7 +782,7 @@ std::vector<std::string> TmixShuffle::ShuffleTraces (double& scale, double& simt
 
     }
   m_connArrRate = 1.0 * num_conns / simtime;
-  m_bl =  *bs - prefill_bins;
+  m_bl =  lastbin - prefill_bins;
   m_sumPrefillValI = Sum_prefill_dataI + Sum_prefill_overheadI;
   m_sumPrefillValA = Sum_prefill_dataA + Sum_prefill_overheadA;
   return outfilelist;
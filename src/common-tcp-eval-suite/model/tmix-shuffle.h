@@ -1,4 +1,7 @@
 #include "ns3/random-variable-stream.h"
+#include "tmix-trace-index.h"
+#include "tmix-shuf-writer.h"
+#include <map>
 #include <vector>
 #include <string>
 
@@ -39,10 +42,54 @@ public:
 
   void ProcessBurst (double data, direction dir, int first);
 
+  /**
+   * If true (the default), a findtarget search estimates the load at
+   * each candidate scale from per-connection byte totals computed once
+   * from the original traces, and the traces are only sliced and
+   * written for the final scale.  If false, every candidate scale
+   * re-slices all of the traces.
+   */
+  void SetIncrementalSearch (bool incremental);
+
+  /**
+   * Format of the shuffled traces. ORIGINAL (the default) writes
+   * \<basename\>\<scale\>.shuf text files in the original format;
+   * BINARY writes \<basename\>\<scale\>.bcvec binary cvec files.
+   */
+  void SetOutputFormat (TmixShufWriter::Format format);
+
   std::vector<std::string> ShuffleTraces (double& scale, double& simtime, double binsecs, std::vector<std::string> tmixBaseCVName, bool findstats, bool findtarget, double prefillT, double bps, int ccTmixSrcs, int maxrtt, double targetload, direction targetdirection, double longflowthresh, int mss, int pktoh, double balancetol, double loadtol);
 
 private:
+  /**
+   * \return the index of the original trace \<basename\>.orig, reading
+   * and indexing it the first time it is asked for.
+   */
+  const TmixTraceIndex& GetTraceIndex (const std::string& basename);
+
+  /**
+   * Compute the unscaled start time and the initiator/acceptor bytes
+   * (data plus estimated overhead, as ProcessBurst counts them) of every
+   * connection in the given traces.
+   */
+  void BuildLoadProfile (const std::vector<std::string>& tmixBaseCVName, int mss);
+
+  /**
+   * Fill m_binConnDataListI/A for the given scale from the load profile
+   * without touching the traces.
+   */
+  void FillBinsFromProfile (double scale, int totalbins);
+
+  /**
+   * Make m_binConnDataListI/A at least nbins long.  AddBurstStats only
+   * grows them up to the last bin a burst reached, while the load
+   * estimates read every bin up to the current one.
+   */
+  void PadBins (int nbins);
+
   //Ptr<RandomVariableStream> m_srng;
+  /// Indexed original traces, by base name. Loaded once and reused across scales.
+  std::map<std::string, TmixTraceIndex> m_traceIndex;
   std::vector <double> m_binConnDataListI;
   std::vector <double> m_binConnDataListA;
   double m_burstTEstI;
@@ -71,6 +118,14 @@ private:
   double m_bl;
   double m_sumPrefillValI;
   double m_sumPrefillValA;
+  bool m_incrementalSearch;
+  TmixShufWriter::Format m_outputFormat;
+  /// Unscaled start times (us) of all connections in all traces, sorted.
+  std::vector<double> m_profileStart;
+  /// Running totals of initiator bytes over m_profileStart (one extra leading zero).
+  std::vector<double> m_profileCumI;
+  /// Running totals of acceptor bytes over m_profileStart (one extra leading zero).
+  std::vector<double> m_profileCumA;
 };
 
 }
@@ -37,7 +37,6 @@
  */
 
 #include "tmix-topology.h"
-#include "ns3/eval-ts.h" 
 
 #include "ns3/node-container.h"
 #include "ns3/ipv4-address-helper.h"
@@ -59,37 +58,6 @@ namespace ns3 {
  * Out parameters: tmixDevice, routerDevice, address
  */
 
- void
-TmixTopology::PacketEnqueueF (Ptr<const QueueItem> item)
-{
-  Ptr<Packet> p = item->GetPacket ();       
-  EvalTimestampTag tag;    
-  p->AddPacketTag (tag);
-}
-
-void
-TmixTopology::PacketDequeueF (Ptr<const QueueItem> item)
-{
-  Ptr<Packet> p = item->GetPacket ();      
-  EvalTimestampTag tag;   
-  p->RemovePacketTag (tag);   
-  Time delta = Simulator::Now () - tag.GetTxTime ();     
-  if (m_lastQDrecordF == Time::Min () || Simulator::Now () - m_lastQDrecordF > MilliSeconds (10))
-    {
-      m_lastQDrecordF = Simulator::Now ();
-      if (m_numQDrecordF > 0)
-        {
-            m_QDrecordTotalF += (m_QDrecordF*1.0)/(m_numQDrecordF*1.0);
-            m_numQDrecordTotalF ++;
-            *m_QDfileF->GetStream ()<< Simulator::Now ().GetSeconds () << " "<< (m_QDrecordF*1.0)/(m_numQDrecordF*1.0)<< "\n";
-        }
-      m_QDrecordF = 0;
-      m_numQDrecordF = 0;
-    }
-  m_numQDrecordF++;
-  m_QDrecordF += delta.GetMilliSeconds ();
-}
-
 void
 TmixTopology::PacketSizeF (Ptr<const Packet> packet)
 {
@@ -112,37 +80,6 @@ TmixTopology::PacketSizeF (Ptr<const Packet> packet)
   m_TPrecordF += packet->GetSize ();
 
 }
-void
-TmixTopology::PacketEnqueueR (Ptr<const QueueItem> item)
-{
-  Ptr<Packet> p = item->GetPacket ();       
-  EvalTimestampTag tag;    
-  p->AddPacketTag (tag);
-}
-
-void
-TmixTopology::PacketDequeueR (Ptr<const QueueItem> item)
-{
-  Ptr<Packet> p = item->GetPacket ();      
-  EvalTimestampTag tag;   
-  p->RemovePacketTag (tag);   
-  Time delta = Simulator::Now () - tag.GetTxTime ();     
-  if (m_lastQDrecordR == Time::Min () || Simulator::Now () - m_lastQDrecordR > MilliSeconds (10))
-    {
-      m_lastQDrecordR = Simulator::Now ();
-      if (m_numQDrecordR > 0)
-        {
-            m_QDrecordTotalR += (m_QDrecordR*1.0)/(m_numQDrecordR*1.0);
-            m_numQDrecordTotalR ++;
-            *m_QDfileR->GetStream ()<< Simulator::Now ().GetSeconds () << " "<< (m_QDrecordR*1.0)/(m_numQDrecordR*1.0)<< "\n";
-        }
-      m_QDrecordR = 0;
-      m_numQDrecordR = 0;
-    }
-  m_numQDrecordR++;
-  m_QDrecordR += delta.GetMilliSeconds ();
-}
-
 void
 TmixTopology::PacketSizeR (Ptr<const Packet> packet)
 {
@@ -171,24 +108,28 @@ TmixTopology::Summary (std::string ScenarioName, std::string TcpName, uint32_t e
 {
   AsciiTraceHelper asciiQD;
   m_Avgfile = asciiQD.CreateFileStream (std::string("tcp-eval-output/"+ScenarioName+"/EXPT-"+std::to_string(expt_num+1)+"/"+TcpName+"_AverageData.dat").c_str());
-  *m_Avgfile->GetStream ()<< "\nFORWARD:\nAverage Queue Delay:  "<< (m_QDrecordTotalF)/(m_numQDrecordTotalF)<< "\n";
+  *m_Avgfile->GetStream ()<< "\nFORWARD:\nAverage Queue Delay:  "<< m_delayF->GetAverageReportedMean ()<< "\n";
   *m_Avgfile->GetStream ()<< "\nAverage ThroughPut:  "<< (m_TPrecordTotalF)/m_TPTotalF<< "\n";
   *m_Avgfile->GetStream ()<< "\nAverage PacketDrop:  "<< (TotaldroppedPacketsF)/Total_numdPktsF<< "\n";
-  *m_Avgfile->GetStream ()<< "\nREVERSE:\nAverage Queue Delay:  "<< (m_QDrecordTotalR)/(m_numQDrecordTotalR)<< "\n";
+  *m_Avgfile->GetStream ()<< "\nQueue Delay (count mean p50 p95 p99 p99.9 max):  ";
+  BottleneckDelayCollector::WritePercentiles (*m_Avgfile->GetStream (), m_delayF->GetRunHistogram ());
+  *m_Avgfile->GetStream ()<< "\n";
+  *m_Avgfile->GetStream ()<< "\nREVERSE:\nAverage Queue Delay:  "<< m_delayR->GetAverageReportedMean ()<< "\n";
   *m_Avgfile->GetStream ()<< "\nAverage ThroughPut:  "<< (m_TPrecordTotalR)/m_TPTotalR<< "\n";
   *m_Avgfile->GetStream ()<< "\nAverage PacketDrop:  "<< (TotaldroppedPacketsR)/Total_numdPktsR<< "\n";
+  *m_Avgfile->GetStream ()<< "\nQueue Delay (count mean p50 p95 p99 p99.9 max):  ";
+  BottleneckDelayCollector::WritePercentiles (*m_Avgfile->GetStream (), m_delayR->GetRunHistogram ());
+  *m_Avgfile->GetStream ()<< "\n";
 }
 
 void
 TmixTopology::DestroyConnection ()
 {
-  queueF->TraceDisconnectWithoutContext ("Enqueue", MakeCallback (&TmixTopology::PacketEnqueueF, this));
-  queueF->TraceDisconnectWithoutContext ("Dequeue", MakeCallback (&TmixTopology::PacketDequeueF, this));
   DeviceF->TraceDisconnectWithoutContext ("PhyTxBegin", MakeCallback (&TmixTopology::PacketSizeF, this));
 
-  queueR->TraceDisconnectWithoutContext ("Enqueue", MakeCallback (&TmixTopology::PacketEnqueueR, this));
-  queueR->TraceDisconnectWithoutContext ("Dequeue", MakeCallback (&TmixTopology::PacketDequeueR, this));
   DeviceR->TraceDisconnectWithoutContext ("PhyTxBegin", MakeCallback (&TmixTopology::PacketSizeR, this));
+  m_delayF->Uninstall ();
+  m_delayR->Uninstall ();
 }
 
 
@@ -266,21 +207,17 @@ TmixTopology::ConnectRouter (Ptr<Node> router, Ptr<PointToPointChannel> channel,
       
     if( side == LEFT)
     {
-      queuedisc->TraceConnectWithoutContext ("Enqueue", MakeCallback (&TmixTopology::PacketEnqueueF, this));
-      queuedisc->TraceConnectWithoutContext ("Dequeue", MakeCallback (&TmixTopology::PacketDequeueF, this));
       device->TraceConnectWithoutContext ("PhyTxBegin", MakeCallback (&TmixTopology::PacketSizeF, this));
            
       queueF = queuedisc;
       DeviceF = device;
-      m_QDrecordF = 0;
-      m_numQDrecordF = 0;
-      m_QDrecordTotalF = 0;
-      m_numQDrecordTotalF =0;
+      AsciiTraceHelper asciiQP;
+      m_delayF = Create<BottleneckDelayCollector> ();
+      m_delayF->Install (queuedisc);
+      m_delayF->EnableIntervalReports (Seconds (1), asciiQP.CreateFileStream (std::string("tcp-eval-output/"+ScenarioName+"/EXPT-"+std::to_string(expt_num+1)+"/"+TcpName+"_qdelpctF.dat").c_str()));
+      m_delayF->EnableMeanReports (MilliSeconds (10), asciiQP.CreateFileStream (std::string("tcp-eval-output/"+ScenarioName+"/EXPT-"+std::to_string(expt_num+1)+"/"+TcpName+"_qdelF.dat").c_str()));
       m_TPrecordTotalF =0;
       m_TPTotalF =0;
-      m_lastQDrecordF = Time::Min ();
-      AsciiTraceHelper asciiQD;
-      m_QDfileF = asciiQD.CreateFileStream (std::string("tcp-eval-output/"+ScenarioName+"/EXPT-"+std::to_string(expt_num+1)+"/"+TcpName+"_qdelF.dat").c_str());
       m_TPrecordF = 0;
       m_lastTPrecordF = Time::Min ();
       AsciiTraceHelper asciiTP;
@@ -293,20 +230,16 @@ TmixTopology::ConnectRouter (Ptr<Node> router, Ptr<PointToPointChannel> channel,
     }
     else
     {
-      queuedisc->TraceConnectWithoutContext ("Enqueue", MakeCallback (&TmixTopology::PacketEnqueueR, this));
-      queuedisc->TraceConnectWithoutContext ("Dequeue", MakeCallback (&TmixTopology::PacketDequeueR, this));
       device->TraceConnectWithoutContext ("PhyTxBegin", MakeCallback (&TmixTopology::PacketSizeR, this));
       queueR = queuedisc;
       DeviceR = device;
-      m_QDrecordR = 0;
-      m_numQDrecordR = 0;
-      m_QDrecordTotalR = 0;
-      m_numQDrecordTotalR =0;
+      AsciiTraceHelper asciiQP;
+      m_delayR = Create<BottleneckDelayCollector> ();
+      m_delayR->Install (queuedisc);
+      m_delayR->EnableIntervalReports (Seconds (1), asciiQP.CreateFileStream (std::string("tcp-eval-output/"+ScenarioName+"/EXPT-"+std::to_string(expt_num+1)+"/"+TcpName+"_qdelpctR.dat").c_str()));
+      m_delayR->EnableMeanReports (MilliSeconds (10), asciiQP.CreateFileStream (std::string("tcp-eval-output/"+ScenarioName+"/EXPT-"+std::to_string(expt_num+1)+"/"+TcpName+"_qdelR.dat").c_str()));
       m_TPrecordTotalR =0;
       m_TPTotalR =0;
-      m_lastQDrecordR = Time::Min ();
-      AsciiTraceHelper asciiQD;
-      m_QDfileR = asciiQD.CreateFileStream (std::string("tcp-eval-output/"+ScenarioName+"/EXPT-"+std::to_string(expt_num+1)+"/"+TcpName+"_qdelR.dat").c_str());
       m_TPrecordR = 0;
       m_lastTPrecordR = Time::Min ();
       AsciiTraceHelper asciiTP;
@@ -52,6 +52,7 @@
 #include "ns3/ipv4-address-helper.h"
 #include "ns3/internet-stack-helper.h"
 #include "ns3/tmix-topology-parameter.h"
+#include "ns3/bottleneck-delay-collector.h"
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
 #include "ns3/internet-module.h"
@@ -253,16 +254,15 @@ private:
                  Ptr<DelayBox> delayBox, Ptr<DelayBoxPointToPointNetDevice>& device,
                  Ipv4AddressHelper& addresses, Ipv4Address& routerAddress, Ptr<QueueDisc>& queuedisc,InitiatorSide side, std::string ScenarioName, std::string TcpName, uint32_t expt_num);
 
-  void PacketEnqueueF (Ptr<const QueueItem> item);
-  void PacketDequeueF (Ptr<const QueueItem> item);
   void PacketSizeF (Ptr<const Packet> packet);
-  void PacketEnqueueR (Ptr<const QueueItem> item);
-  void PacketDequeueR (Ptr<const QueueItem> item);
   void PacketSizeR (Ptr<const Packet> packet);
 
   Ptr<Node> m_leftRouter, m_rightRouter;
   Ptr<PointToPointChannel> m_centerChannel;
 
+  /// Sojourn times at the forward and reverse bottleneck queues
+  Ptr<BottleneckDelayCollector> m_delayF, m_delayR;
+
   /// The single instance of DelayBox shared among all nodes in this topology.
   Ptr<DelayBox> m_delayBox;
 
@@ -291,19 +291,12 @@ private:
   
   Ptr<QueueDisc> m_leftRouterQueueDisc; 
   Ptr<QueueDisc> m_rightRouterQueueDisc;
-  std::map<Ptr<const QueueItem>, Time> enqueueTime;
   NodeContainer leftNodes;
   NodeContainer rightNodes;
   Ptr<OutputStreamWrapper> m_Avgfile;
 
   Ptr<QueueDisc> queueF;
   Ptr<DelayBoxPointToPointNetDevice> DeviceF;
-  double m_QDrecordF;
-  double m_QDrecordTotalF;
-  uint64_t m_numQDrecordF;
-  uint64_t m_numQDrecordTotalF;
-  Time m_lastQDrecordF;
-  Ptr<OutputStreamWrapper> m_QDfileF;
   uint64_t m_TPrecordF;
   double m_TPrecordTotalF;
   uint64_t m_TPTotalF;
@@ -316,12 +309,6 @@ private:
 
   Ptr<QueueDisc> queueR;
   Ptr<DelayBoxPointToPointNetDevice> DeviceR;
-  double m_QDrecordR;
-  double m_QDrecordTotalR;
-  uint64_t m_numQDrecordR;
-  uint64_t m_numQDrecordTotalR;
-  Time m_lastQDrecordR;
-  Ptr<OutputStreamWrapper> m_QDfileR;
   uint64_t m_TPrecordR;
   double m_TPrecordTotalR;
   uint64_t m_TPTotalR;
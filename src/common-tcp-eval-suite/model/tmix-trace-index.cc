@@ -0,0 +1,100 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "tmix-trace-index.h"
+#include "ns3/log.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string.h>
+#include <stdlib.h>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TmixTraceIndex");
+
+TmixTraceIndex::TmixTraceIndex ()
+  : m_sorted (true)
+{
+}
+
+bool
+TmixTraceIndex::Load (const std::string& filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+  m_data.clear ();
+  m_startTimes.clear ();
+  m_offsets.clear ();
+  m_sorted = true;
+
+  std::ifstream in (filename.c_str (), std::ios::in | std::ios::binary);
+  if (!in)
+    {
+      NS_LOG_WARN ("Could not open trace " << filename);
+      return false;
+    }
+  m_data.assign (std::istreambuf_iterator<char> (in), std::istreambuf_iterator<char> ());
+
+  const char *data = m_data.c_str ();
+  size_t size = m_data.size ();
+  size_t pos = 0;
+  while (pos < size)
+    {
+      const char *eol = (const char *) memchr (data + pos, '\n', size - pos);
+      size_t next = eol ? (eol - data) + 1 : size;
+      // Like awk's $1, skip leading blanks before looking at the first field.
+      size_t field = pos;
+      while (field < next && (data[field] == ' ' || data[field] == '\t'))
+        {
+          field++;
+        }
+      if (field < next && (data[field] == 'S' || data[field] == 'C'))
+        {
+          // Skip the first field; the second one is the start time.
+          while (field < next && data[field] != ' ' && data[field] != '\t')
+            {
+              field++;
+            }
+          double startTime = strtod (data + field, NULL);
+          if (!m_startTimes.empty () && startTime < m_startTimes.back ())
+            {
+              m_sorted = false;
+            }
+          m_startTimes.push_back (startTime);
+          m_offsets.push_back (pos);
+        }
+      pos = next;
+    }
+  NS_LOG_LOGIC ("Indexed " << m_startTimes.size () << " connections in " << filename << (m_sorted ? "" : " (unsorted)"));
+  return true;
+}
+
+void
+TmixTraceIndex::GetRange (double lower, double upper, const char*& begin, const char*& end) const
+{
+  size_t first;
+  size_t last;
+  if (m_sorted)
+    {
+      first = std::lower_bound (m_startTimes.begin (), m_startTimes.end (), lower) - m_startTimes.begin ();
+      last = std::lower_bound (m_startTimes.begin () + first, m_startTimes.end (), upper) - m_startTimes.begin ();
+    }
+  else
+    {
+      for (first = 0; first < m_startTimes.size () && m_startTimes[first] < lower; first++)
+        {
+        }
+      for (last = first; last < m_startTimes.size () && m_startTimes[last] < upper; last++)
+        {
+        }
+    }
+  begin = m_data.c_str () + (first < m_offsets.size () ? m_offsets[first] : m_data.size ());
+  end = m_data.c_str () + (last < m_offsets.size () ? m_offsets[last] : m_data.size ());
+}
+
+uint32_t
+TmixTraceIndex::GetNConnections () const
+{
+  return m_startTimes.size ();
+}
+
+}
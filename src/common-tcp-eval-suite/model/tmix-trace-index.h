@@ -0,0 +1,68 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#ifndef TMIX_TRACE_INDEX_H
+#define TMIX_TRACE_INDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \brief In-memory index of an original (Felix format) Tmix trace.
+ *
+ * The whole trace is read into memory once and the byte offset and
+ * start time of every connection header (lines beginning with 'S' or
+ * 'C') are recorded.  Extracting all connections starting within a
+ * time window is then a range lookup instead of a full scan of the
+ * file.
+ */
+class TmixTraceIndex
+{
+public:
+  TmixTraceIndex ();
+
+  /**
+   * Read and index the given trace file, replacing any previous
+   * contents.
+   *
+   * \param filename Path of the trace to load.
+   * \return false if the file could not be read.
+   */
+  bool Load (const std::string& filename);
+
+  /**
+   * Find the text of all connections whose start time lies in
+   * [lower, upper) microseconds, i.e. the same lines that
+   *
+   * \code
+   * awk '{if ($1 ~ /^[SC]/) {if ($2 >= lower) { if ($2 < upper) ... else exit}}}'
+   * \endcode
+   *
+   * used to print.  Connections are expected to be sorted by start
+   * time; unsorted traces fall back to a linear scan.
+   *
+   * \param lower Lower bound (inclusive) on the start time.
+   * \param upper Upper bound (exclusive) on the start time.
+   * \param begin Out: first byte of the matching text.
+   * \param end Out: one past the last byte of the matching text.
+   */
+  void GetRange (double lower, double upper, const char*& begin, const char*& end) const;
+
+  /// \return the number of connections in the trace.
+  uint32_t GetNConnections () const;
+
+private:
+  /// Raw contents of the trace.
+  std::string m_data;
+  /// Start time (us) of each connection, in file order.
+  std::vector<double> m_startTimes;
+  /// Byte offset of each connection header within m_data.
+  std::vector<size_t> m_offsets;
+  /// Whether m_startTimes is non-decreasing.
+  bool m_sorted;
+};
+
+}
+#endif
@@ -0,0 +1,935 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "ns3/tmix-trace-index.h"
+#include "ns3/tmix-cvec-corpus.h"
+#include "ns3/tmix-shuf-writer.h"
+#include "ns3/tmix-shuffle.h"
+#include "ns3/sojourn-histogram.h"
+#include "ns3/bottleneck-delay-collector.h"
+#include "ns3/tmix-topology.h"
+#include "ns3/tmix-topology-parameter.h"
+#include "ns3/tmix-ns2-style-trace-helper.h"
+#include "ns3/tmix-sweep-helper.h"
+#include "ns3/global-route-manager.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/point-to-point-net-device.h"
+#include "ns3/point-to-point-channel.h"
+#include "ns3/drop-tail-queue.h"
+#include "ns3/traffic-control-helper.h"
+#include "ns3/trace-helper.h"
+#include "ns3/udp-socket-factory.h"
+#include "ns3/socket.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/uinteger.h"
+#include "ns3/ipv4-address-generator.h"
+#include "ns3/simulator.h"
+#include "ns3/abort.h"
+#include "ns3/system-path.h"
+#include "ns3/test.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace ns3;
+
+class TmixTraceIndexTestCase : public TestCase
+{
+public:
+  TmixTraceIndexTestCase ();
+  virtual ~TmixTraceIndexTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+TmixTraceIndexTestCase::TmixTraceIndexTestCase ()
+  : TestCase ("Slice bins out of an indexed original trace")
+{
+}
+
+TmixTraceIndexTestCase::~TmixTraceIndexTestCase ()
+{
+}
+
+void
+TmixTraceIndexTestCase::DoRun (void)
+{
+  std::string filename = CreateTempDirFilename ("trace.orig");
+  std::ofstream out (filename.c_str ());
+  out << "# comment before the first connection\n"
+      << "SEQ 100 1 2 3\n"
+      << "> 826\n"
+      << "t 534\n"
+      << "< 1213\n"
+      << "SEQ 250 1 4 5\n"
+      << "> 10\n"
+      << "CONC 250 1 1 6 7\n"
+      << "c> 396\n"
+      << "SEQ 900 1 8 9\n"
+      << "> 20";
+  out.close ();
+
+  TmixTraceIndex index;
+  NS_TEST_ASSERT_MSG_EQ (index.Load (filename), true, "Trace could not be loaded");
+  NS_TEST_ASSERT_MSG_EQ (index.GetNConnections (), 4, "Wrong number of connections indexed");
+
+  const char *begin;
+  const char *end;
+  index.GetRange (0, 100, begin, end);
+  NS_TEST_ASSERT_MSG_EQ (std::string (begin, end), "", "Empty bin should have no text");
+
+  index.GetRange (100, 250, begin, end);
+  NS_TEST_ASSERT_MSG_EQ (std::string (begin, end), "SEQ 100 1 2 3\n> 826\nt 534\n< 1213\n",
+                         "Lower bound is inclusive, upper bound exclusive");
+
+  index.GetRange (200, 900, begin, end);
+  NS_TEST_ASSERT_MSG_EQ (std::string (begin, end), "SEQ 250 1 4 5\n> 10\nCONC 250 1 1 6 7\nc> 396\n",
+                         "Connections with equal start times belong to the same bin");
+
+  index.GetRange (900, 10000, begin, end);
+  NS_TEST_ASSERT_MSG_EQ (std::string (begin, end), "SEQ 900 1 8 9\n> 20",
+                         "Last bin should extend to the end of the trace");
+
+  index.GetRange (10000, 20000, begin, end);
+  NS_TEST_ASSERT_MSG_EQ ((end - begin), 0, "Bin past the end of the trace should be empty");
+
+  remove (filename.c_str ());
+}
+
+class TmixCvecCorpusTestCase : public TestCase
+{
+public:
+  TmixCvecCorpusTestCase ();
+  virtual ~TmixCvecCorpusTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+TmixCvecCorpusTestCase::TmixCvecCorpusTestCase ()
+  : TestCase ("Load an original trace into a shared cvec corpus")
+{
+}
+
+TmixCvecCorpusTestCase::~TmixCvecCorpusTestCase ()
+{
+}
+
+void
+TmixCvecCorpusTestCase::DoRun (void)
+{
+  std::string filename = CreateTempDirFilename ("trace.shuf");
+  std::ofstream out (filename.c_str ());
+  out << "SEQ 100 1 2 3\n"
+      << "w 64800 6432\n"
+      << "r 1000\n"
+      << "> 826\n"
+      << "t 534\n"
+      << "< 1213\n"
+      << "SEQ 250 1 4 5\n"
+      << "w 8760 6656\n"
+      << "r 2000\n"
+      << "> 10\n";
+  out.close ();
+
+  Ptr<TmixCvecCorpus> corpus = Create<TmixCvecCorpus> ();
+  NS_TEST_ASSERT_MSG_EQ (corpus->AddSource (filename), true, "Trace could not be loaded");
+  NS_TEST_ASSERT_MSG_EQ (corpus->GetNSources (), 1, "Wrong number of sources");
+  NS_TEST_ASSERT_MSG_EQ (corpus->GetNCvecs (0), 2, "Wrong number of connection vectors");
+  NS_TEST_ASSERT_MSG_EQ (corpus->GetConvertedFiles ().size (), 1, "Text trace should have been converted");
+
+  Tmix::BinaryCvecReader::View view;
+  uint64_t cursor = corpus->GetCursor (0, 1);
+  NS_TEST_ASSERT_MSG_EQ (corpus->GetReader (0)->Next (cursor, view), true, "Second record not found");
+  NS_TEST_ASSERT_MSG_EQ (view.GetStartTime (), MicroSeconds (250), "Second record has the wrong start time");
+  NS_TEST_ASSERT_MSG_EQ (view.header->id1, 4, "Second record has the wrong id");
+
+  std::string converted = corpus->GetConvertedFiles ()[0];
+  corpus = 0;
+  remove (converted.c_str ());
+  remove (filename.c_str ());
+}
+
+class TmixShufWriterTestCase : public TestCase
+{
+public:
+  TmixShufWriterTestCase ();
+  virtual ~TmixShufWriterTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+TmixShufWriterTestCase::TmixShufWriterTestCase ()
+  : TestCase ("Write a shuffled trace as text and as binary cvecs")
+{
+}
+
+TmixShufWriterTestCase::~TmixShufWriterTestCase ()
+{
+}
+
+void
+TmixShufWriterTestCase::DoRun (void)
+{
+  std::vector<std::vector<std::string> > connections (3);
+  connections[0].push_back ("SEQ 100 1 2 3");
+  connections[0].push_back ("> 826");
+  connections[0].push_back ("t 534");
+  connections[0].push_back ("< 1213");
+  connections[1].push_back ("CONC 250 1 1 6 7\n");
+  connections[1].push_back ("c> 396\n");
+  connections[1].push_back ("t< 505\n");
+  connections[1].push_back ("c< 190\n");
+  connections[2].push_back ("SEQ 900 1 8 9");
+  connections[2].push_back ("> 20");
+
+  std::string textFilename = CreateTempDirFilename ("trace.shuf");
+  std::string binaryFilename = CreateTempDirFilename ("trace.bcvec");
+  std::string convertedFilename = CreateTempDirFilename ("converted.bcvec");
+  TmixShufWriter text;
+  TmixShufWriter binary;
+  NS_TEST_ASSERT_MSG_EQ (text.Open (textFilename, TmixShufWriter::ORIGINAL), true, "Text file could not be opened");
+  NS_TEST_ASSERT_MSG_EQ (binary.Open (binaryFilename, TmixShufWriter::BINARY), true, "Binary file could not be opened");
+  for (size_t i = 0; i < connections.size (); i++)
+    {
+      text.WriteConnection (connections[i]);
+      binary.WriteConnection (connections[i]);
+    }
+  text.Close ();
+  binary.Close ();
+
+  std::ifstream in (textFilename.c_str ());
+  NS_TEST_ASSERT_MSG_EQ (Tmix::ConvertToBinaryCvec (in, Tmix::ORIGINAL_FORMAT, convertedFilename), 3,
+                         "Text trace should convert to three connection vectors");
+  in.close ();
+
+  Tmix::BinaryCvecReader written;
+  Tmix::BinaryCvecReader converted;
+  NS_TEST_ASSERT_MSG_EQ (written.Open (binaryFilename), true, "Binary trace could not be read");
+  NS_TEST_ASSERT_MSG_EQ (converted.Open (convertedFilename), true, "Converted trace could not be read");
+  NS_TEST_ASSERT_MSG_EQ (written.GetNCvecs (), 3, "Wrong number of connection vectors written");
+  NS_TEST_ASSERT_MSG_EQ (written.GetNAdus (), converted.GetNAdus (), "Both paths should give the same ADUs");
+
+  uint64_t writtenCursor = written.Begin ();
+  uint64_t convertedCursor = converted.Begin ();
+  Tmix::BinaryCvecReader::View view;
+  std::vector<Tmix::ConnectionVector> cvecs (3);
+  for (size_t i = 0; i < cvecs.size (); i++)
+    {
+      Tmix::ConnectionVector expected;
+      NS_TEST_ASSERT_MSG_EQ (converted.Next (convertedCursor, view), true, "Converted record not found");
+      view.ToConnectionVector (expected);
+      NS_TEST_ASSERT_MSG_EQ (written.Next (writtenCursor, view), true, "Written record not found");
+      view.ToConnectionVector (cvecs[i]);
+      NS_TEST_EXPECT_MSG_EQ (cvecs[i].type, expected.type, "Connection " << i << " has the wrong type");
+      NS_TEST_EXPECT_MSG_EQ (cvecs[i].startTime, expected.startTime, "Connection " << i << " has the wrong start time");
+      NS_TEST_EXPECT_MSG_EQ (cvecs[i].id1, expected.id1, "Connection " << i << " has the wrong id");
+      NS_TEST_ASSERT_MSG_EQ (cvecs[i].adus.size (), expected.adus.size (), "Connection " << i << " has the wrong ADUs");
+      for (size_t j = 0; j < expected.adus.size (); j++)
+        {
+          NS_TEST_EXPECT_MSG_EQ ((cvecs[i].adus[j] == expected.adus[j]), true,
+                                 "ADU " << j << " of connection " << i << " differs");
+        }
+    }
+
+  // Only the last connection of the trace is closed without a wait time.
+  NS_TEST_EXPECT_MSG_EQ (cvecs[0].adus.size (), 2, "First connection should not get a FIN");
+  NS_TEST_EXPECT_MSG_EQ (cvecs[1].adus.size (), 2, "Second connection should not get a FIN");
+  NS_TEST_ASSERT_MSG_EQ (cvecs[2].adus.size (), 2, "Last connection should get a FIN");
+  NS_TEST_EXPECT_MSG_EQ (cvecs[2].adus[1].size, 0, "Last connection should get a FIN");
+  NS_TEST_EXPECT_MSG_EQ (cvecs[2].adus[1].sendWaitTime, MicroSeconds (1), "FIN should follow the last ADU");
+
+  written.Close ();
+  converted.Close ();
+  remove (textFilename.c_str ());
+  remove (binaryFilename.c_str ());
+  remove (convertedFilename.c_str ());
+}
+
+class TmixShuffleSearchTestCase : public TestCase
+{
+public:
+  TmixShuffleSearchTestCase ();
+  virtual ~TmixShuffleSearchTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  /**
+   * Search the scale giving the target load on the trace.
+   * \param incremental Whether to search on the load profile.
+   * \return the scale found
+   */
+  double FindScale (bool incremental);
+
+  std::string m_basename; //!< The trace, without its .orig suffix
+};
+
+TmixShuffleSearchTestCase::TmixShuffleSearchTestCase ()
+  : TestCase ("Search the scale of a trace on its load profile")
+{
+}
+
+TmixShuffleSearchTestCase::~TmixShuffleSearchTestCase ()
+{
+}
+
+double
+TmixShuffleSearchTestCase::FindScale (bool incremental)
+{
+  TmixShuffle shuffle;
+  shuffle.SetIncrementalSearch (incremental);
+  double scale = 1.0;
+  double simtime = 100;
+  std::vector<std::string> traces (1, m_basename);
+  std::vector<std::string> written = shuffle.ShuffleTraces (scale, simtime, 10, traces, true, true, 0, 1e6, 1, 0,
+                                                            10, TmixShuffle::BOTH, 10, 1460, 40, 0.05, 0.02);
+  for (std::vector<std::string>::const_iterator it = written.begin (); it != written.end (); ++it)
+    {
+      remove (it->c_str ());
+    }
+  return scale;
+}
+
+void
+TmixShuffleSearchTestCase::DoRun (void)
+{
+  // One connection every 2 s on average for 2100 s, of varied sizes;
+  // every 50th one sends a response that lasts several bins.
+  m_basename = CreateTempDirFilename ("search");
+  std::ofstream out ((m_basename + ".orig").c_str ());
+  for (uint32_t i = 0; i < 1050; i++)
+    {
+      out << "SEQ " << 2000000 * i + (i * 7919) % 2000000 << " 1 " << i << " 0\n"
+          << "> " << 500 + (i % 7) * 100 << "\n"
+          << "t 20000\n"
+          << "< " << (i % 50 ? 5000 + (i % 13) * 3000 : 4000000) << "\n";
+    }
+  out.close ();
+
+  double full = FindScale (false);
+  double profiled = FindScale (true);
+  NS_TEST_ASSERT_MSG_NE (full, 1.0, "The search should move the scale");
+  // The profile counts each connection in the bin it starts in, where
+  // the full search spreads its bursts over the bins they last.
+  NS_TEST_EXPECT_MSG_EQ_TOL (profiled, full, full * 0.05, "Both searches should find the same scale");
+
+  remove ((m_basename + ".orig").c_str ());
+}
+
+class SojournHistogramTestCase : public TestCase
+{
+public:
+  SojournHistogramTestCase ();
+  virtual ~SojournHistogramTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SojournHistogramTestCase::SojournHistogramTestCase ()
+  : TestCase ("Percentiles of a log-linear sojourn time histogram")
+{
+}
+
+SojournHistogramTestCase::~SojournHistogramTestCase ()
+{
+}
+
+void
+SojournHistogramTestCase::DoRun (void)
+{
+  SojournHistogram histogram (MicroSeconds (1), Seconds (10), 8);
+  NS_TEST_ASSERT_MSG_EQ (histogram.GetPercentile (99), Time (0), "Empty histogram should report zero");
+
+  // 1 ms .. 10 s in 1 ms steps
+  for (uint32_t i = 1; i <= 10000; i++)
+    {
+      histogram.Record (MilliSeconds (i));
+    }
+  NS_TEST_ASSERT_MSG_EQ (histogram.GetCount (), 10000, "Wrong number of values");
+  NS_TEST_ASSERT_MSG_EQ (histogram.GetMax (), Seconds (10), "Wrong maximum");
+
+  double percentiles[] = { 50, 95, 99, 99.9 };
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      double exact = percentiles[i] / 100 * 10;
+      double reported = histogram.GetPercentile (percentiles[i]).GetSeconds ();
+      NS_TEST_ASSERT_MSG_EQ_TOL (reported, exact, exact / 100, "p" << percentiles[i] << " outside the histogram precision");
+      NS_TEST_ASSERT_MSG_GT_OR_EQ (reported, exact - 1e-9, "Percentiles should not be underestimated");
+    }
+  NS_TEST_ASSERT_MSG_EQ (histogram.GetPercentile (100), Seconds (10), "p100 should be the maximum");
+
+  // Small values are exact
+  SojournHistogram small (MicroSeconds (1), Seconds (10), 8);
+  small.Record (MicroSeconds (7));
+  small.Record (MicroSeconds (9));
+  NS_TEST_ASSERT_MSG_EQ (small.GetPercentile (50), MicroSeconds (7), "Values below 2^b units should be exact");
+
+  // Values above the tracked range are clamped, not lost
+  small.Record (Seconds (1000));
+  NS_TEST_ASSERT_MSG_EQ (small.GetCount (), 3, "Out of range value should still be counted");
+
+  histogram.Add (small);
+  NS_TEST_ASSERT_MSG_EQ (histogram.GetCount (), 10003, "Merged histogram has the wrong count");
+  histogram.Reset ();
+  NS_TEST_ASSERT_MSG_EQ (histogram.GetCount (), 0, "Reset histogram should be empty");
+}
+
+/**
+ * A point-to-point device with a second, unused, transmission queue.
+ * A queue disc dequeues packets for a multi-queue device even when
+ * the queue of the packet is stopped, and requeues them.
+ */
+class TwoQueuePointToPointNetDevice : public PointToPointNetDevice
+{
+protected:
+  virtual void NotifyNewAggregate (void)
+  {
+    Ptr<NetDeviceQueueInterface> ndqi = GetObject<NetDeviceQueueInterface> ();
+    if (ndqi && ndqi->GetNTxQueues () == 0)
+      {
+        ndqi->SetTxQueuesN (2);
+      }
+    PointToPointNetDevice::NotifyNewAggregate ();
+  }
+};
+
+class BottleneckDelayRequeueTestCase : public TestCase
+{
+public:
+  BottleneckDelayRequeueTestCase ();
+  virtual ~BottleneckDelayRequeueTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Received (Ptr<Socket> socket);
+  void SendBurst (Ptr<Socket> socket, uint32_t nPackets);
+
+  uint32_t m_nReceived;
+};
+
+BottleneckDelayRequeueTestCase::BottleneckDelayRequeueTestCase ()
+  : TestCase ("Requeued packets are recorded once, when they leave")
+{
+}
+
+BottleneckDelayRequeueTestCase::~BottleneckDelayRequeueTestCase ()
+{
+}
+
+void
+BottleneckDelayRequeueTestCase::Received (Ptr<Socket> socket)
+{
+  while (socket->Recv ())
+    {
+      m_nReceived++;
+    }
+}
+
+void
+BottleneckDelayRequeueTestCase::SendBurst (Ptr<Socket> socket, uint32_t nPackets)
+{
+  for (uint32_t i = 0; i < nPackets; i++)
+    {
+      socket->Send (Create<Packet> (1000));
+    }
+}
+
+void
+BottleneckDelayRequeueTestCase::DoRun (void)
+{
+  m_nReceived = 0;
+  NodeContainer nodes;
+  nodes.Create (2);
+  Ptr<PointToPointChannel> channel = CreateObject<PointToPointChannel> ();
+  NetDeviceContainer devices;
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      Ptr<PointToPointNetDevice> device = CreateObject<TwoQueuePointToPointNetDevice> ();
+      device->SetAddress (Mac48Address::Allocate ());
+      device->SetDataRate (DataRate ("1Mbps"));
+      // A device queue of one packet is full, and stopped, all the time.
+      Ptr<DropTailQueue> queue = CreateObject<DropTailQueue> ();
+      queue->SetMode (Queue::QUEUE_MODE_PACKETS);
+      queue->SetAttribute ("MaxPackets", UintegerValue (1));
+      device->SetQueue (queue);
+      device->Attach (channel);
+      nodes.Get (i)->AddDevice (device);
+      devices.Add (device);
+    }
+
+  InternetStackHelper internet;
+  internet.Install (nodes);
+  TrafficControlHelper tch;
+  tch.SetRootQueueDisc ("ns3::PfifoFastQueueDisc");
+  Ptr<QueueDisc> queueDisc = tch.Install (devices.Get (0)).Get (0);
+  Ipv4AddressHelper addresses ("10.250.1.0", "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = addresses.Assign (devices);
+
+  Ptr<BottleneckDelayCollector> collector = Create<BottleneckDelayCollector> ();
+  collector->Install (queueDisc);
+  std::string meanName = CreateTempDirFilename ("qdel.dat");
+  AsciiTraceHelper ascii;
+  collector->EnableMeanReports (MilliSeconds (10), ascii.CreateFileStream (meanName));
+
+  Ptr<Socket> sink = Socket::CreateSocket (nodes.Get (1), UdpSocketFactory::GetTypeId ());
+  sink->Bind (InetSocketAddress (Ipv4Address::GetAny (), 9));
+  sink->SetRecvCallback (MakeCallback (&BottleneckDelayRequeueTestCase::Received, this));
+  Ptr<Socket> socket = Socket::CreateSocket (nodes.Get (0), UdpSocketFactory::GetTypeId ());
+  socket->Connect (InetSocketAddress (interfaces.GetAddress (1), 9));
+  // One packet to resolve the address first, then a burst.
+  const uint32_t nPackets = 20;
+  Simulator::Schedule (Seconds (1), &BottleneckDelayRequeueTestCase::SendBurst, this, socket, 1);
+  Simulator::Schedule (Seconds (2), &BottleneckDelayRequeueTestCase::SendBurst, this, socket, nPackets);
+  Simulator::Run ();
+
+  collector->Uninstall ();
+  uint32_t nRequeued = queueDisc->GetTotalRequeuedPackets ();
+  uint32_t nQueued = queueDisc->GetTotalReceivedPackets () - queueDisc->GetTotalDroppedPackets ();
+  uint32_t nRecorded = collector->GetRunHistogram ().GetCount ();
+  double averageMean = collector->GetAverageReportedMean ();
+  collector = 0;
+  socket->Close ();
+  sink->Close ();
+  socket = 0;
+  sink = 0;
+  Simulator::Destroy ();
+  Ipv4AddressGenerator::Reset ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_nReceived, nPackets + 1, "Every packet should have been delivered");
+  NS_TEST_ASSERT_MSG_GT (nRequeued, 0, "The test should make the queue disc requeue packets");
+  NS_TEST_ASSERT_MSG_EQ (nRecorded, nQueued, "Each packet through the queue disc should be recorded once");
+
+  // The burst leaves one packet every 8 ms, so each 10 ms window
+  // holds two of them.
+  std::ifstream means (meanName.c_str ());
+  double time;
+  double mean;
+  double lastTime = 0;
+  double sum = 0;
+  uint32_t nMeans = 0;
+  while (means >> time >> mean)
+    {
+      NS_TEST_ASSERT_MSG_GT (time, lastTime, "Mean reports out of order");
+      lastTime = time;
+      sum += mean;
+      nMeans++;
+    }
+  NS_TEST_ASSERT_MSG_GT (nMeans, 5, "Too few mean reports");
+  NS_TEST_ASSERT_MSG_EQ_TOL (averageMean, sum / nMeans, 1e-6, "Average of the reported means");
+}
+
+/**
+ * TmixTopology writes its statistics under tcp-eval-output/ in the
+ * working directory; the topology tests run in their temporary
+ * directory, so that nothing is left in the source tree.
+ */
+class TmixTopologyTestBase : public TestCase
+{
+public:
+  TmixTopologyTestBase (std::string name);
+  virtual ~TmixTopologyTestBase ();
+
+protected:
+  /**
+   * Move to the temporary directory of the test case and create a
+   * topology there.
+   * \return the topology
+   */
+  Ptr<TmixTopology> CreateTopology (void);
+  /**
+   * Tear the simulation down and come back to the original working
+   * directory.
+   */
+  void DestroyTopology (void);
+
+  Ptr<TmixTopology> m_tmix; //!< The topology under test
+  std::string m_cwd;        //!< The original working directory
+};
+
+TmixTopologyTestBase::TmixTopologyTestBase (std::string name)
+  : TestCase (name)
+{
+}
+
+TmixTopologyTestBase::~TmixTopologyTestBase ()
+{
+}
+
+Ptr<TmixTopology>
+TmixTopologyTestBase::CreateTopology (void)
+{
+  char cwd[PATH_MAX];
+  m_cwd = getcwd (cwd, sizeof (cwd)) ? cwd : ".";
+  std::string dir = CreateTempDirFilename ("");
+  NS_ABORT_MSG_UNLESS (chdir (dir.c_str ()) == 0, "Cannot enter " << dir);
+  SystemPath::MakeDirectories ("tcp-eval-output/test/EXPT-1");
+
+  InternetStackHelper internet;
+  Ptr<TmixToplogyParameters> ttp = Create<TmixToplogyParameters> ();
+  m_tmix = Create<TmixTopology> (internet, ttp, "test", "TcpNewReno", 0);
+  return m_tmix;
+}
+
+void
+TmixTopologyTestBase::DestroyTopology (void)
+{
+  m_tmix->DestroyConnection ();
+  m_tmix = 0;
+  Simulator::Destroy ();
+  // The topologies of the test cases use the same networks.
+  Ipv4AddressGenerator::Reset ();
+  NS_ABORT_MSG_UNLESS (chdir (m_cwd.c_str ()) == 0, "Cannot go back to " << m_cwd);
+}
+
+class TmixTopologyTestCase : public TmixTopologyTestBase
+{
+public:
+  TmixTopologyTestCase ();
+  virtual ~TmixTopologyTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+TmixTopologyTestCase::TmixTopologyTestCase ()
+  : TmixTopologyTestBase ("Creates nodes and checks if they have been created")
+{
+}
+
+TmixTopologyTestCase::~TmixTopologyTestCase ()
+{
+}
+
+void
+TmixTopologyTestCase::DoRun (void)
+{
+  uint32_t numLeft = 3, numRight = 4;
+  Ptr<TmixTopology> tmix = CreateTopology ();
+  tmix->AssignNodes (numLeft + numRight, numLeft + numRight);
+  for (uint32_t i = 0; i < numLeft; i++)
+    {
+      tmix->NewPair (TmixTopology::LEFT, MilliSeconds (1), MilliSeconds (1), i, i);
+    }
+  for (uint32_t i = numLeft; i < numLeft + numRight; i++)
+    {
+      tmix->NewPair (TmixTopology::RIGHT, MilliSeconds (1), MilliSeconds (1), i, i);
+    }
+  uint32_t nLeftPairs = tmix->LeftPairs ().size ();
+  uint32_t nRightPairs = tmix->RightPairs ().size ();
+  TmixTopology::NodeType initiatorType = tmix->NodeTypeByAddress (tmix->RightPairs ()[0].initiatorAddress);
+  DestroyTopology ();
+
+  NS_TEST_ASSERT_MSG_EQ (nLeftPairs, numLeft, "No of nodes being created not equal to the specified number at LEFT");
+  NS_TEST_ASSERT_MSG_EQ (nRightPairs, numRight, "No of nodes being created not equal to the specified number at RIGHT");
+  NS_TEST_ASSERT_MSG_EQ (initiatorType, TmixTopology::RIGHT_INITIATOR, "Initiator of a RIGHT pair has the wrong node type");
+}
+
+/// The first connection vector of the inbound.ns trace from UNC, Chapel Hill
+static const char * const g_uncFirstCvec =
+  "S 3412 1 21217 555381\n"
+  "w 64800 6432\n"
+  "r 1118156\n"
+  "l 0.000000 0.000000\n"
+  "I 0 0 253\n"
+  "A 0 123693 510\n"
+  "A 6308497 0 0\n";
+
+class TmixTrafficTestCase : public TmixTopologyTestBase
+{
+public:
+  TmixTrafficTestCase ();
+  virtual ~TmixTrafficTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// \return the fields of an ns-2 trace line, with the packet uid masked
+  static std::string MaskUid (std::string line);
+};
+
+TmixTrafficTestCase::TmixTrafficTestCase ()
+  : TmixTopologyTestBase ("Creates traffic and checks if they have been created")
+{
+}
+
+TmixTrafficTestCase::~TmixTrafficTestCase ()
+{
+}
+
+void
+TmixTrafficTestCase::DoRun (void)
+{
+  SetDataDir (NS_TEST_SOURCEDIR);
+  std::ifstream reffile (CreateDataDirFilename ("tmix-ref.txt").c_str ());
+  std::string ref;
+  std::getline (reffile, ref);
+  NS_TEST_ASSERT_MSG_EQ (ref.empty (), false, "Reference trace could not be read");
+
+  std::istringstream cvecText (g_uncFirstCvec);
+  Tmix::ConnectionVector cvec;
+  NS_TEST_ASSERT_MSG_EQ (Tmix::ParseConnectionVector (cvecText, cvec), true, "Cvec parsed");
+
+  std::string outName = CreateTempDirFilename ("out.txt");
+  std::ofstream outfile (outName.c_str ());
+  Ptr<TmixTopology> tmix = CreateTopology ();
+  // The trace helper traces one pair on each side.
+  tmix->AssignNodes (2, 2);
+  TmixTopology::TmixNodePair pair = tmix->NewPair (TmixTopology::LEFT, MilliSeconds (1), MilliSeconds (1), 0, 0);
+  tmix->NewPair (TmixTopology::RIGHT, MilliSeconds (1), MilliSeconds (1), 1, 1);
+  pair.helper->AddConnectionVector (cvec);
+  {
+    Tmix::Ns2StyleTraceHelper ost (tmix, outfile);
+    ost.Install ();
+
+    GlobalRouteManager::BuildGlobalRoutingDatabase ();
+    GlobalRouteManager::InitializeRoutes ();
+
+    Simulator::Stop (Seconds (10));
+    Simulator::Run ();
+  }
+  DestroyTopology ();
+  outfile.close ();
+
+  std::ifstream out (outName.c_str ());
+  std::string line;
+  uint32_t nLines = 0;
+  while (std::getline (out, line))
+    {
+      NS_TEST_ASSERT_MSG_EQ (MaskUid (line), MaskUid (ref), "Trace line " << nLines << " does not match the reference");
+      std::getline (reffile, ref);
+      nLines++;
+    }
+  NS_TEST_ASSERT_MSG_EQ (reffile.eof (), true, "Trace is shorter than the reference");
+  NS_TEST_ASSERT_MSG_GT (nLines, 1, "Trace is empty");
+}
+
+std::string
+TmixTrafficTestCase::MaskUid (std::string line)
+{
+  // The 12th field is the uid of the packet, which depends on the
+  // packets the tests run before have created.
+  std::istringstream in (line);
+  std::ostringstream out;
+  std::string field;
+  for (uint32_t i = 0; in >> field; i++)
+    {
+      out << (i == 11 ? "*" : field) << " ";
+    }
+  return out.str ();
+}
+
+/**
+ * The traffic scenario traced in TEXT and in BINARY mode at once; the
+ * converted binary trace must be the text trace, byte for byte.
+ */
+class TmixBinaryTraceTestCase : public TmixTopologyTestBase
+{
+public:
+  TmixBinaryTraceTestCase ();
+  virtual ~TmixBinaryTraceTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+TmixBinaryTraceTestCase::TmixBinaryTraceTestCase ()
+  : TmixTopologyTestBase ("Converted binary traces match text traces")
+{
+}
+
+TmixBinaryTraceTestCase::~TmixBinaryTraceTestCase ()
+{
+}
+
+void
+TmixBinaryTraceTestCase::DoRun (void)
+{
+  std::istringstream cvecText (g_uncFirstCvec);
+  Tmix::ConnectionVector cvec;
+  NS_TEST_ASSERT_MSG_EQ (Tmix::ParseConnectionVector (cvecText, cvec), true, "Cvec parsed");
+
+  std::string textName = CreateTempDirFilename ("trace.txt");
+  std::string binaryName = CreateTempDirFilename ("trace.bin");
+  std::ofstream textFile (textName.c_str ());
+  std::ofstream binaryFile (binaryName.c_str (), std::ios::binary);
+  Ptr<TmixTopology> tmix = CreateTopology ();
+  tmix->AssignNodes (2, 2);
+  TmixTopology::TmixNodePair pair = tmix->NewPair (TmixTopology::LEFT, MilliSeconds (1), MilliSeconds (1), 0, 0);
+  tmix->NewPair (TmixTopology::RIGHT, MilliSeconds (1), MilliSeconds (1), 1, 1);
+  pair.helper->AddConnectionVector (cvec);
+  {
+    // Both helpers see the same events, with the same packet uids.
+    Tmix::Ns2StyleTraceHelper text (tmix, textFile);
+    Tmix::Ns2StyleTraceHelper binary (tmix, binaryFile, Tmix::Ns2StyleTraceHelper::BINARY);
+    text.Install ();
+    binary.Install ();
+
+    GlobalRouteManager::BuildGlobalRoutingDatabase ();
+    GlobalRouteManager::InitializeRoutes ();
+
+    Simulator::Stop (Seconds (10));
+    Simulator::Run ();
+  }
+  DestroyTopology ();
+  textFile.close ();
+  binaryFile.close ();
+
+  std::ifstream textIn (textName.c_str ());
+  std::ostringstream expected;
+  expected << textIn.rdbuf ();
+  std::ifstream binaryIn (binaryName.c_str (), std::ios::binary);
+  std::ostringstream converted;
+  int64_t nEvents = Tmix::ConvertBinaryNs2Trace (binaryIn, converted);
+
+  std::string expectedText = expected.str ();
+  NS_TEST_ASSERT_MSG_GT (nEvents, 1, "Binary trace has no events");
+  NS_TEST_ASSERT_MSG_EQ (nEvents, std::count (expectedText.begin (), expectedText.end (), '\n'),
+                         "Binary and text traces hold different numbers of events");
+  NS_TEST_ASSERT_MSG_EQ ((converted.str () == expectedText), true, "Converted binary trace differs from the text trace");
+
+  std::istringstream notBinary (expectedText);
+  std::ostringstream ignored;
+  NS_TEST_ASSERT_MSG_EQ (Tmix::ConvertBinaryNs2Trace (notBinary, ignored), -1, "A text trace was converted");
+}
+
+/**
+ * A sweep whose jobs only write their average data and a line on
+ * stderr; the job of the second TCP variant fails.
+ */
+class TrivialSweep : public TmixSweep
+{
+public:
+  TrivialSweep ()
+    : m_nPrepared (0),
+      m_nRemoved (0)
+  {
+  }
+
+  uint32_t m_nPrepared; //!< Number of experiments prepared
+  uint32_t m_nRemoved;  //!< Number of experiments whose traces were removed
+
+private:
+  virtual void PrepareTraces (Experiment& experiment)
+  {
+    m_nPrepared++;
+  }
+
+  virtual void RemoveTraces (Experiment& experiment)
+  {
+    m_nRemoved++;
+  }
+
+  virtual void RunVariant (Experiment& experiment, uint32_t variant)
+  {
+    std::cerr << "job " << experiment.exptNum << " " << variant << std::endl;
+    if (variant == 1)
+      {
+        _exit (1);
+      }
+    std::string dir = tmixScenario::GetOutputDirectory (experiment.scenarioName, experiment.exptNum);
+    std::ofstream out ((dir + "/" + tmixScenario::GetVariantName (variant) + "_AverageData.dat").c_str ());
+    out << "average " << experiment.exptNum << " " << variant;
+  }
+};
+
+class TmixSweepTestCase : public TestCase
+{
+public:
+  TmixSweepTestCase ();
+  virtual ~TmixSweepTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+TmixSweepTestCase::TmixSweepTestCase ()
+  : TestCase ("Fork the jobs of a sweep and merge their summaries")
+{
+}
+
+TmixSweepTestCase::~TmixSweepTestCase ()
+{
+}
+
+void
+TmixSweepTestCase::DoRun (void)
+{
+  char cwd[PATH_MAX];
+  std::string oldCwd = getcwd (cwd, sizeof (cwd)) ? cwd : ".";
+  std::string dir = CreateTempDirFilename ("");
+  NS_ABORT_MSG_UNLESS (chdir (dir.c_str ()) == 0, "Cannot enter " << dir);
+
+  TrivialSweep sweep;
+  sweep.SetNWorkers (3);
+  tmixScenario scenario;
+  double edgedelay[6] = { 0, 0, 0, 0, 0, 0 };
+  sweep.AddExperiment (scenario, "sweep", edgedelay, 100, 0);
+  sweep.AddExperiment (scenario, "sweep", edgedelay, 100, 1);
+  uint32_t failed = sweep.Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (failed, 2, "The job of the second variant should fail in both experiments");
+  NS_TEST_EXPECT_MSG_EQ (sweep.m_nPrepared, 2, "Each experiment should be prepared once");
+  NS_TEST_EXPECT_MSG_EQ (sweep.m_nRemoved, 2, "Each experiment should be cleaned up once");
+
+  std::ostringstream expected;
+  for (uint32_t expt = 0; expt < 2; expt++)
+    {
+      for (uint32_t variant = 0; variant < tmixScenario::GetNVariants (); variant++)
+        {
+          expected << "EXPT-" << expt + 1 << " " << tmixScenario::GetVariantName (variant) << "\n";
+          if (variant == 1)
+            {
+              expected << "(no results)\n\n";
+            }
+          else
+            {
+              expected << "average " << expt << " " << variant << "\n";
+            }
+        }
+    }
+  std::ifstream summary ("tcp-eval-output/sweep/summary.dat");
+  std::ostringstream merged;
+  merged << summary.rdbuf ();
+  NS_TEST_EXPECT_MSG_EQ (merged.str (), expected.str (), "Summaries should be merged in job order");
+
+  // Logs are named without the ns3:: prefix and hold stderr too.
+  std::ifstream log ("tcp-eval-output/sweep/EXPT-2/TcpHybla.log");
+  std::ostringstream logText;
+  logText << log.rdbuf ();
+  NS_TEST_EXPECT_MSG_EQ (logText.str (), "job 1 1\n", "Failed job should have its stderr in its log");
+
+  NS_ABORT_MSG_UNLESS (chdir (oldCwd.c_str ()) == 0, "Cannot go back to " << oldCwd);
+}
+
+class CommonTcpEvalSuiteTestSuite : public TestSuite
+{
+public:
+  CommonTcpEvalSuiteTestSuite ();
+};
+
+CommonTcpEvalSuiteTestSuite::CommonTcpEvalSuiteTestSuite ()
+  : TestSuite ("common-tcp-eval-suite", UNIT)
+{
+  AddTestCase (new TmixTraceIndexTestCase, TestCase::QUICK);
+  AddTestCase (new TmixCvecCorpusTestCase, TestCase::QUICK);
+  AddTestCase (new TmixShufWriterTestCase, TestCase::QUICK);
+  AddTestCase (new TmixShuffleSearchTestCase, TestCase::QUICK);
+  AddTestCase (new SojournHistogramTestCase, TestCase::QUICK);
+  AddTestCase (new BottleneckDelayRequeueTestCase, TestCase::QUICK);
+  AddTestCase (new TmixTopologyTestCase, TestCase::QUICK);
+  AddTestCase (new TmixTrafficTestCase, TestCase::QUICK);
+  AddTestCase (new TmixBinaryTraceTestCase, TestCase::QUICK);
+  AddTestCase (new TmixSweepTestCase, TestCase::QUICK);
+}
+
+static CommonTcpEvalSuiteTestSuite commonTcpEvalSuiteTestSuite;
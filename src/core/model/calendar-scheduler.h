@@ -22,6 +22,7 @@
 #define CALENDAR_SCHEDULER_H
 
 #include "scheduler.h"
+#include "event-memory.h"
 #include <stdint.h>
 #include <list>
 
@@ -130,8 +131,11 @@ private:
    */
   void DoInsert (const Scheduler::Event &ev);
 
-  /** Calendar bucket type: a list of Events. */
-  typedef std::list<Scheduler::Event> Bucket;
+  /**
+   * Calendar bucket type: a list of Events, whose nodes come from
+   * the EventMemory free lists.
+   */
+  typedef std::list<Scheduler::Event, EventMemoryAllocator<Scheduler::Event> > Bucket;
   
   /** Array of buckets. */
   Bucket *m_buckets;
@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include "simple-ref-count.h"
+#include "event-memory.h"
 
 /**
  * \file
@@ -66,6 +67,30 @@ public:
    */
   bool IsCancelled (void);
 
+  /**
+   * Allocate the memory of an event from the EventMemory free lists.
+   *
+   * \param [in] size The size of the event.
+   * \returns the memory for the event.
+   */
+  static void *operator new (std::size_t size)
+  {
+    return EventMemory::Allocate (size);
+  }
+  /**
+   * Give the memory of an event back to the EventMemory free lists.
+   *
+   * The destructor is virtual, so \pname{size} is the size of the
+   * most derived class.
+   *
+   * \param [in] p The memory of the event.
+   * \param [in] size The size of the event.
+   */
+  static void operator delete (void *p, std::size_t size)
+  {
+    EventMemory::Deallocate (p, size);
+  }
+
 protected:
   /**
    * Implementation for Invoke().
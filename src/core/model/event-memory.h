@@ -0,0 +1,156 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef EVENT_MEMORY_H
+#define EVENT_MEMORY_H
+
+#include "memory-pool.h"
+#include <cstddef>
+#include <ostream>
+
+/**
+ * \file
+ * \ingroup events
+ * ns3::EventMemory and ns3::EventMemoryAllocator declarations.
+ */
+
+namespace ns3 {
+
+/**
+ * \ingroup events
+ * \brief The MemoryPool of the simulation events.
+ *
+ * Every EventImpl, and the nodes of the MapScheduler, ListScheduler
+ * and CalendarScheduler containers, are allocated here.  The common
+ * events, a member function or a function with a few arguments, are
+ * well under 256 bytes, so their allocation from a free list is
+ * inlined into Simulator::Schedule: in steady state scheduling an
+ * event pops a free list instead of calling the heap.
+ */
+class EventMemory
+{
+public:
+  /** Usage statistics, for the calling thread. */
+  typedef MemoryPool::Stats Stats;
+
+  /**
+   * Allocate a block.
+   * \param [in] size The number of bytes needed.
+   * \returns the block, suitably aligned for any type.
+   */
+  static void *Allocate (std::size_t size)
+  {
+    return MemoryPool::Allocate (MemoryPool::EVENTS, size);
+  }
+  /**
+   * Release a block.
+   * \param [in] block The block.
+   * \param [in] size The size it was allocated with.
+   */
+  static void Deallocate (void *block, std::size_t size)
+  {
+    MemoryPool::Deallocate (MemoryPool::EVENTS, block, size);
+  }
+  /**
+   * Turn the event free lists of the calling thread on or off.
+   * \param [in] enable Whether to use the free lists.
+   * \see MemoryPool::Enable
+   */
+  static void Enable (bool enable)
+  {
+    MemoryPool::Enable (MemoryPool::EVENTS, enable);
+  }
+  /**
+   * \returns the statistics of the calling thread.
+   */
+  static Stats GetStats (void)
+  {
+    return MemoryPool::GetStats (MemoryPool::EVENTS);
+  }
+  /**
+   * Print the statistics of the calling thread.
+   * \param [in] os The output stream.
+   */
+  static void PrintStats (std::ostream &os)
+  {
+    MemoryPool::PrintStats (MemoryPool::EVENTS, os);
+  }
+};
+
+/**
+ * \ingroup events
+ * \brief A standard allocator of EventMemory blocks, for the node
+ * based containers of the schedulers.
+ *
+ * \tparam T \deduced The type of the allocated objects.
+ */
+template <typename T>
+class EventMemoryAllocator
+{
+public:
+  /** The type of the allocated objects. */
+  typedef T value_type;
+
+  EventMemoryAllocator ()
+  {
+  }
+  /**
+   * Rebinding constructor.
+   * \param [in] o The allocator to copy.
+   */
+  template <typename U>
+  EventMemoryAllocator (const EventMemoryAllocator<U> &o)
+  {
+  }
+  /**
+   * \param [in] n The number of objects.
+   * \returns storage for \pname{n} objects.
+   */
+  T *allocate (std::size_t n)
+  {
+    return static_cast<T *> (EventMemory::Allocate (n * sizeof (T)));
+  }
+  /**
+   * \param [in] p The storage returned by allocate (\pname{n}).
+   * \param [in] n The number of objects.
+   */
+  void deallocate (T *p, std::size_t n)
+  {
+    EventMemory::Deallocate (p, n * sizeof (T));
+  }
+  /**
+   * \tparam U \deduced The allocated type of the other allocator.
+   * \returns true: all instances share the same memory.
+   */
+  template <typename U>
+  bool operator == (const EventMemoryAllocator<U> &) const
+  {
+    return true;
+  }
+  /**
+   * \tparam U \deduced The allocated type of the other allocator.
+   * \returns false: all instances share the same memory.
+   */
+  template <typename U>
+  bool operator != (const EventMemoryAllocator<U> &) const
+  {
+    return false;
+  }
+};
+
+} // namespace ns3
+
+#endif /* EVENT_MEMORY_H */
@@ -0,0 +1,230 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "four-ary-heap-scheduler.h"
+#include "event-impl.h"
+#include "assert.h"
+#include "log.h"
+#include <algorithm>
+
+/**
+ * \file
+ * \ingroup scheduler
+ * Implementation of ns3::FourAryHeapScheduler class.
+ */
+
+namespace {
+
+/**
+ * \param [in] ev An event.
+ * \returns the key of \pname{ev}.
+ */
+inline const ns3::Scheduler::EventKey &
+KeyOf (const ns3::Scheduler::Event &ev)
+{
+  return ev.key;
+}
+
+/**
+ * \param [in] key A key.
+ * \returns \pname{key}.
+ */
+inline const ns3::Scheduler::EventKey &
+KeyOf (const ns3::Scheduler::EventKey &key)
+{
+  return key;
+}
+
+/**
+ * Move an item up the heap to its place.
+ *
+ * \param [in,out] heap The heap.
+ * \param [in] i The index of the item.
+ */
+template <typename T>
+void
+SiftUp (std::vector<T> &heap, std::size_t i)
+{
+  T item = heap[i];
+  while (i > 0)
+    {
+      std::size_t parent = (i - 1) / 4;
+      if (!(KeyOf (item) < KeyOf (heap[parent])))
+        {
+          break;
+        }
+      heap[i] = heap[parent];
+      i = parent;
+    }
+  heap[i] = item;
+}
+
+/**
+ * Move an item down the heap to its place.
+ *
+ * \param [in,out] heap The heap.
+ * \param [in] i The index of the item.
+ */
+template <typename T>
+void
+SiftDown (std::vector<T> &heap, std::size_t i)
+{
+  std::size_t n = heap.size ();
+  T item = heap[i];
+  while (true)
+    {
+      std::size_t first = 4 * i + 1;
+      if (first >= n)
+        {
+          break;
+        }
+      std::size_t last = std::min (first + 4, n);
+      std::size_t smallest = first;
+      for (std::size_t child = first + 1; child < last; child++)
+        {
+          if (KeyOf (heap[child]) < KeyOf (heap[smallest]))
+            {
+              smallest = child;
+            }
+        }
+      if (!(KeyOf (heap[smallest]) < KeyOf (item)))
+        {
+          break;
+        }
+      heap[i] = heap[smallest];
+      i = smallest;
+    }
+  heap[i] = item;
+}
+
+/**
+ * Insert an item in a heap.
+ *
+ * \param [in,out] heap The heap.
+ * \param [in] item The item.
+ */
+template <typename T>
+void
+Push (std::vector<T> &heap, const T &item)
+{
+  heap.push_back (item);
+  SiftUp (heap, heap.size () - 1);
+}
+
+/**
+ * Remove the smallest item of a heap.
+ *
+ * \param [in,out] heap The heap, not empty.
+ */
+template <typename T>
+void
+Pop (std::vector<T> &heap)
+{
+  heap.front () = heap.back ();
+  heap.pop_back ();
+  if (!heap.empty ())
+    {
+      SiftDown (heap, 0);
+    }
+}
+
+} // unnamed namespace
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("FourAryHeapScheduler");
+
+NS_OBJECT_ENSURE_REGISTERED (FourAryHeapScheduler);
+
+TypeId
+FourAryHeapScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::FourAryHeapScheduler")
+    .SetParent<Scheduler> ()
+    .SetGroupName ("Core")
+    .AddConstructor<FourAryHeapScheduler> ()
+  ;
+  return tid;
+}
+
+FourAryHeapScheduler::FourAryHeapScheduler ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+FourAryHeapScheduler::~FourAryHeapScheduler ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+FourAryHeapScheduler::Insert (const Event &ev)
+{
+  NS_LOG_FUNCTION (this << &ev);
+  Push (m_heap, ev);
+}
+
+bool
+FourAryHeapScheduler::IsEmpty (void) const
+{
+  NS_LOG_FUNCTION (this);
+  return m_heap.empty ();
+}
+
+Scheduler::Event
+FourAryHeapScheduler::PeekNext (void) const
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT (!m_heap.empty ());
+  return m_heap.front ();
+}
+
+Scheduler::Event
+FourAryHeapScheduler::RemoveNext (void)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT (!m_heap.empty ());
+  Event next = m_heap.front ();
+  Pop (m_heap);
+  Purge ();
+  return next;
+}
+
+void
+FourAryHeapScheduler::Remove (const Event &ev)
+{
+  NS_LOG_FUNCTION (this << &ev);
+  NS_ASSERT (m_removed.size () < m_heap.size ());
+  Push (m_removed, ev.key);
+  Purge ();
+}
+
+void
+FourAryHeapScheduler::Purge (void)
+{
+  // Every removed key is in m_heap, so the smallest one is never
+  // smaller than the top of m_heap.  The top is removed if they are
+  // the same event.
+  while (!m_removed.empty ()
+         && m_removed.front ().m_uid == m_heap.front ().key.m_uid)
+    {
+      NS_ASSERT (m_removed.front ().m_ts == m_heap.front ().key.m_ts);
+      Pop (m_removed);
+      Pop (m_heap);
+    }
+}
+
+} // namespace ns3
@@ -0,0 +1,88 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef FOUR_ARY_HEAP_SCHEDULER_H
+#define FOUR_ARY_HEAP_SCHEDULER_H
+
+#include "scheduler.h"
+#include <stdint.h>
+#include <vector>
+
+/**
+ * \file
+ * \ingroup scheduler
+ * Declaration of ns3::FourAryHeapScheduler class.
+ */
+
+namespace ns3 {
+
+/**
+ * \ingroup scheduler
+ * \brief a 4-ary heap event scheduler with lazy removal
+ *
+ * The events live in one contiguous std::vector managed as a heap
+ * where every node has four children.  The heap is half as deep as a
+ * binary heap, and the four children of a node share a cache line or
+ * two, so both sifting up after Insert and sifting down after
+ * RemoveNext touch few cache lines.  Nothing is allocated per event.
+ *
+ * Remove does not search the heap for the event.  It pushes the key
+ * of the event on a second heap of removed keys, and an event whose
+ * key is on both heaps is dropped when it reaches the top.  Remove is
+ * thus O(log n) instead of the O(n) of HeapScheduler.  The cancelled
+ * timers of the TCP sockets do not even go through Remove: they stay
+ * in the heap, as with every scheduler, until their time.
+ *
+ * Select it with the "SchedulerType" global value set to
+ * "ns3::FourAryHeapScheduler".
+ */
+class FourAryHeapScheduler : public Scheduler
+{
+public:
+  /**
+   *  Register this type.
+   *  \return The object TypeId.
+   */
+  static TypeId GetTypeId (void);
+
+  /** Constructor. */
+  FourAryHeapScheduler ();
+  /** Destructor. */
+  virtual ~FourAryHeapScheduler ();
+
+  // Inherited
+  virtual void Insert (const Scheduler::Event &ev);
+  virtual bool IsEmpty (void) const;
+  virtual Scheduler::Event PeekNext (void) const;
+  virtual Scheduler::Event RemoveNext (void);
+  virtual void Remove (const Scheduler::Event &ev);
+
+private:
+  /**
+   * Drop the removed events from the top of the heap, so that the
+   * top is always a live event.
+   */
+  void Purge (void);
+
+  /** The events, live or removed, managed as a 4-ary heap. */
+  std::vector<Scheduler::Event> m_heap;
+  /** The keys of the removed events still in m_heap, managed as a 4-ary heap. */
+  std::vector<Scheduler::EventKey> m_removed;
+};
+
+} // namespace ns3
+
+#endif /* FOUR_ARY_HEAP_SCHEDULER_H */
@@ -0,0 +1,233 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "memory-pool.h"
+#include "assert.h"
+#include <new>
+
+/**
+ * \file
+ * \ingroup core
+ * ns3::MemoryPool definitions.
+ */
+
+namespace ns3 {
+
+thread_local struct MemoryPool::ThreadCache MemoryPool::m_cache;
+
+thread_local struct MemoryPool::Cleanup MemoryPool::m_cleanup;
+
+MemoryPool::Cleanup::Cleanup ()
+{
+  m_cache.cleanupRegistered = true;
+  for (uint32_t pool = 0; pool < N_POOLS; pool++)
+    {
+      m_cache.pooling[pool] = !m_cache.disabled[pool];
+    }
+}
+
+MemoryPool::Cleanup::~Cleanup ()
+{
+  m_cache.destroyed = true;
+  for (uint32_t pool = 0; pool < N_POOLS; pool++)
+    {
+      m_cache.pooling[pool] = false;
+      Flush (static_cast<enum Pool> (pool));
+    }
+}
+
+uint32_t
+MemoryPool::GetClass (std::size_t size)
+{
+  if (size <= MAX_SMALL_SIZE)
+    {
+      return size == 0 ? 0 : (size - 1) / SMALL_STEP;
+    }
+  uint32_t cls = N_SMALL_CLASSES;
+  uint32_t classSize = 2 * MAX_SMALL_SIZE;
+  while (classSize < size)
+    {
+      classSize <<= 1;
+      cls++;
+    }
+  return cls;
+}
+
+uint32_t
+MemoryPool::GetClassSize (uint32_t cls)
+{
+  if (cls < N_SMALL_CLASSES)
+    {
+      return SMALL_STEP * (cls + 1);
+    }
+  return (2 * MAX_SMALL_SIZE) << (cls - N_SMALL_CLASSES);
+}
+
+uint32_t
+MemoryPool::GetMaxLength (uint32_t cls)
+{
+  uint32_t length = MAX_FREE_BYTES / GetClassSize (cls);
+  return length < MIN_FREE_BLOCKS ? MIN_FREE_BLOCKS : length;
+}
+
+uint32_t
+MemoryPool::GetCapacity (uint32_t size)
+{
+  if (size > MAX_CLASS_SIZE)
+    {
+      return size;
+    }
+  return GetClassSize (GetClass (size));
+}
+
+void
+MemoryPool::RegisterCleanup (void)
+{
+  if (!m_cache.cleanupRegistered)
+    {
+      // odr-use constructs it, and registers its destructor with the
+      // exit of this thread.
+      static_cast<void> (&m_cleanup);
+    }
+}
+
+void *
+MemoryPool::AllocateSlow (enum Pool pool, std::size_t size)
+{
+  NS_ASSERT (pool < N_POOLS);
+  struct ThreadCache &cache = m_cache;
+  struct Stats &stats = cache.stats[pool];
+  if (++stats.inUse > stats.peak)
+    {
+      stats.peak = stats.inUse;
+    }
+  if (size > MAX_CLASS_SIZE)
+    {
+      stats.misses++;
+      return ::operator new (size);
+    }
+  uint32_t cls = GetClass (size);
+  FreeBlock *block = cache.freeList[pool][cls];
+  if (block != 0)
+    {
+      cache.freeList[pool][cls] = block->next;
+      cache.length[pool][cls]--;
+      stats.hits++;
+      return block;
+    }
+  if (!cache.disabled[pool])
+    {
+      RegisterCleanup ();
+    }
+  stats.misses++;
+  // allocate the whole size class, so that the block can be reused
+  return ::operator new (GetClassSize (cls));
+}
+
+void
+MemoryPool::DeallocateSlow (enum Pool pool, void *block, std::size_t size)
+{
+  NS_ASSERT (pool < N_POOLS);
+  struct ThreadCache &cache = m_cache;
+  cache.stats[pool].inUse--;
+  if (size <= MAX_CLASS_SIZE && !cache.disabled[pool])
+    {
+      // a block allocated by another thread may be the first one this
+      // thread sees
+      RegisterCleanup ();
+      uint32_t cls = GetClass (size);
+      if (cache.pooling[pool] && cache.length[pool][cls] < GetMaxLength (cls))
+        {
+          FreeBlock *free = static_cast<FreeBlock *> (block);
+          free->next = cache.freeList[pool][cls];
+          cache.freeList[pool][cls] = free;
+          cache.length[pool][cls]++;
+          return;
+        }
+    }
+  ::operator delete (block);
+}
+
+void
+MemoryPool::Enable (enum Pool pool, bool enable)
+{
+  NS_ASSERT (pool < N_POOLS);
+  struct ThreadCache &cache = m_cache;
+  cache.disabled[pool] = !enable;
+  cache.pooling[pool] = enable && cache.cleanupRegistered && !cache.destroyed;
+  if (!enable)
+    {
+      Flush (pool);
+    }
+}
+
+void
+MemoryPool::Flush (enum Pool pool)
+{
+  struct ThreadCache &cache = m_cache;
+  for (uint32_t cls = 0; cls < N_CLASSES; cls++)
+    {
+      FreeBlock *block = cache.freeList[pool][cls];
+      while (block != 0)
+        {
+          FreeBlock *next = block->next;
+          ::operator delete (block);
+          block = next;
+        }
+      cache.freeList[pool][cls] = 0;
+      cache.length[pool][cls] = 0;
+    }
+}
+
+struct MemoryPool::Stats
+MemoryPool::GetStats (enum Pool pool)
+{
+  NS_ASSERT (pool < N_POOLS);
+  return m_cache.stats[pool];
+}
+
+const char *
+MemoryPool::GetPoolName (enum Pool pool)
+{
+  switch (pool)
+    {
+    case EVENTS:
+      return "EventImpl";
+    case BUFFER:
+      return "Buffer";
+    case METADATA:
+      return "PacketMetadata";
+    case BYTE_TAGS:
+      return "ByteTagList";
+    case PACKET_TAGS:
+      return "PacketTagList";
+    default:
+      break;
+    }
+  return "unknown";
+}
+
+void
+MemoryPool::PrintStats (enum Pool pool, std::ostream &os)
+{
+  struct Stats stats = GetStats (pool);
+  os << "hits=" << stats.hits
+     << " misses=" << stats.misses
+     << " inUse=" << stats.inUse
+     << " peak=" << stats.peak;
+}
+
+} // namespace ns3
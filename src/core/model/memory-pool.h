@@ -0,0 +1,268 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MEMORY_POOL_H
+#define MEMORY_POOL_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <ostream>
+
+/**
+ * \file
+ * \ingroup core
+ * ns3::MemoryPool declaration.
+ */
+
+namespace ns3 {
+
+/**
+ * \ingroup core
+ * \brief Per-thread, size-classed free lists for the memory of the
+ * simulation events and of the packet internals.
+ *
+ * Requests are rounded up to a size class: multiples of 16 bytes up to
+ * 256 bytes, then powers of two up to 64 KiB.  Larger requests go
+ * straight to the heap.  A released block waits on a free list of the
+ * calling thread for the next request of its pool and size class.
+ * Requests of up to 256 bytes served from a free list are inlined into
+ * the caller.
+ *
+ * Every thread has its own free list per pool and size class, so
+ * neither allocation nor release takes a lock, and a block may be
+ * released by another thread than the one which allocated it: it then
+ * joins the free lists of the releasing thread.  The free lists of a
+ * thread are given back to the heap when the thread exits.
+ *
+ * The statistics are kept per thread too and describe the calling
+ * thread only.
+ *
+ * EventMemory and PacketMemory are the interfaces of the users.
+ */
+class MemoryPool
+{
+public:
+  /** The users of the free lists, each with its own lists and statistics. */
+  enum Pool
+  {
+    EVENTS = 0,  //!< EventImpl and the scheduler containers
+    BUFFER,      //!< Buffer::Data
+    METADATA,    //!< PacketMetadata::Data
+    BYTE_TAGS,   //!< ByteTagListData
+    PACKET_TAGS, //!< PacketTagList::TagData
+    N_POOLS      //!< Number of pools
+  };
+
+  /** Usage statistics of a pool, for the calling thread. */
+  struct Stats
+  {
+    uint64_t hits;   //!< Allocations served from a free list.
+    uint64_t misses; //!< Allocations served by the heap.
+    int64_t inUse;   //!< Blocks allocated minus blocks released; negative if other threads allocated some of the released blocks.
+    int64_t peak;    //!< Highest value of inUse.
+  };
+
+  /**
+   * \param [in] size A number of bytes.
+   * \returns the number of bytes a block allocated for \pname{size}
+   *          bytes really holds.
+   */
+  static uint32_t GetCapacity (uint32_t size);
+  /**
+   * Allocate a block of at least \pname{size} bytes.
+   *
+   * \param [in] pool The pool to allocate from.
+   * \param [in] size The number of bytes needed; the block holds
+   *        GetCapacity (size) bytes.
+   * \returns the block, suitably aligned for any type.
+   */
+  inline static void *Allocate (enum Pool pool, std::size_t size);
+  /**
+   * Give a block back to its pool.
+   *
+   * \param [in] pool The pool it was allocated from.
+   * \param [in] block The block.
+   * \param [in] size The size it was allocated with, or its capacity.
+   */
+  inline static void Deallocate (enum Pool pool, void *block, std::size_t size);
+  /**
+   * Turn the free lists of a pool on or off, for the calling thread.
+   *
+   * When off, every block of \pname{pool} comes from and goes back to
+   * the heap.  This is only useful to measure what the free lists save.
+   *
+   * \param [in] pool A pool.
+   * \param [in] enable Whether to use the free lists.
+   */
+  static void Enable (enum Pool pool, bool enable);
+  /**
+   * \param [in] pool A pool.
+   * \returns the statistics of \pname{pool} for the calling thread.
+   */
+  static struct Stats GetStats (enum Pool pool);
+  /**
+   * \param [in] pool A pool.
+   * \returns the name of \pname{pool}.
+   */
+  static const char *GetPoolName (enum Pool pool);
+  /**
+   * Print the statistics of a pool for the calling thread.
+   * \param [in] pool A pool.
+   * \param [in] os The output stream.
+   */
+  static void PrintStats (enum Pool pool, std::ostream &os);
+
+private:
+  /** Size classes. */
+  enum
+  {
+    SMALL_STEP = 16,      //!< Size difference of two consecutive small classes.
+    N_SMALL_CLASSES = 16, //!< Number of small classes, up to 256 bytes.
+    N_CLASSES = N_SMALL_CLASSES + 8, //!< Number of size classes: the small ones, then 512 bytes to 64 KiB.
+    MAX_SMALL_SIZE = SMALL_STEP * N_SMALL_CLASSES, //!< Largest block of a small class.
+    MAX_CLASS_SIZE = 65536,  //!< Size of the largest size class.
+    MAX_FREE_BYTES = 1 << 20, //!< Bytes a free list may hold before blocks go back to the heap.
+    MIN_FREE_BLOCKS = 16     //!< Blocks a free list may hold, whatever their size.
+  };
+  /** A block on a free list. */
+  struct FreeBlock
+  {
+    FreeBlock *next; //!< Next free block of the same pool and size class.
+  };
+  /**
+   * The free lists of a thread.
+   *
+   * Trivially constructible and destructible, so that it is zero
+   * initialized and can still be used from the destructors which run
+   * after Cleanup.
+   */
+  struct ThreadCache
+  {
+    FreeBlock *freeList[N_POOLS][N_CLASSES]; //!< Free blocks.
+    uint32_t length[N_POOLS][N_CLASSES];     //!< Length of each free list.
+    struct Stats stats[N_POOLS];             //!< Statistics.
+    bool pooling[N_POOLS];    //!< Released blocks go on the free lists.
+    bool disabled[N_POOLS];   //!< Enable (false) was called.
+    bool cleanupRegistered;   //!< The free lists will be released at thread exit.
+    bool destroyed;           //!< The free lists were released at thread exit.
+  };
+
+  /**
+   * \param [in] size A number of bytes, at most MAX_CLASS_SIZE.
+   * \returns the smallest size class holding \pname{size} bytes.
+   */
+  static uint32_t GetClass (std::size_t size);
+  /**
+   * \param [in] cls A size class.
+   * \returns the size of the blocks of \pname{cls}.
+   */
+  static uint32_t GetClassSize (uint32_t cls);
+  /**
+   * \param [in] cls A size class.
+   * \returns the number of blocks a free list of \pname{cls} may hold.
+   */
+  static uint32_t GetMaxLength (uint32_t cls);
+  /**
+   * Allocate a block the inlined path cannot provide.
+   * \param [in] pool The pool to allocate from.
+   * \param [in] size The number of bytes needed.
+   * \returns the block.
+   */
+  static void *AllocateSlow (enum Pool pool, std::size_t size);
+  /**
+   * Release a block the inlined path does not take.
+   * \param [in] pool The pool it was allocated from.
+   * \param [in] block The block.
+   * \param [in] size The size it was allocated with.
+   */
+  static void DeallocateSlow (enum Pool pool, void *block, std::size_t size);
+  /**
+   * Give the free lists of a pool of the calling thread back to the heap.
+   * \param [in] pool A pool.
+   */
+  static void Flush (enum Pool pool);
+  /** Start caching blocks in the calling thread. */
+  static void RegisterCleanup (void);
+
+  /** Releases the free lists of a thread when it exits. */
+  struct Cleanup
+  {
+    Cleanup ();
+    ~Cleanup ();
+  };
+
+  /** The free lists of the calling thread. */
+  static thread_local struct ThreadCache m_cache;
+  /** Constructed by the first block a thread caches. */
+  static thread_local struct Cleanup m_cleanup;
+};
+
+} // namespace ns3
+
+/********************************************************************
+ *  Implementation of the inline functions
+ ********************************************************************/
+
+namespace ns3 {
+
+void *
+MemoryPool::Allocate (enum Pool pool, std::size_t size)
+{
+  if (size - 1 < MAX_SMALL_SIZE)
+    {
+      struct ThreadCache &cache = m_cache;
+      std::size_t cls = (size - 1) / SMALL_STEP;
+      FreeBlock *block = cache.freeList[pool][cls];
+      if (block != 0)
+        {
+          struct Stats &stats = cache.stats[pool];
+          cache.freeList[pool][cls] = block->next;
+          cache.length[pool][cls]--;
+          stats.hits++;
+          if (++stats.inUse > stats.peak)
+            {
+              stats.peak = stats.inUse;
+            }
+          return block;
+        }
+    }
+  return AllocateSlow (pool, size);
+}
+
+void
+MemoryPool::Deallocate (enum Pool pool, void *block, std::size_t size)
+{
+  if (size - 1 < MAX_SMALL_SIZE)
+    {
+      struct ThreadCache &cache = m_cache;
+      std::size_t cls = (size - 1) / SMALL_STEP;
+      if (cache.pooling[pool]
+          && cache.length[pool][cls] < MAX_FREE_BYTES / (SMALL_STEP * (cls + 1)))
+        {
+          FreeBlock *free = static_cast<FreeBlock *> (block);
+          free->next = cache.freeList[pool][cls];
+          cache.freeList[pool][cls] = free;
+          cache.length[pool][cls]++;
+          cache.stats[pool].inUse--;
+          return;
+        }
+    }
+  DeallocateSlow (pool, block, size);
+}
+
+} // namespace ns3
+
+#endif /* MEMORY_POOL_H */
@@ -0,0 +1,127 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "recording-scheduler.h"
+#include "map-scheduler.h"
+#include "object-factory.h"
+#include "string.h"
+#include "nstime.h"
+#include "fatal-error.h"
+#include "log.h"
+#include <iomanip>
+
+/**
+ * \file
+ * \ingroup scheduler
+ * Implementation of ns3::RecordingScheduler class.
+ */
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("RecordingScheduler");
+
+NS_OBJECT_ENSURE_REGISTERED (RecordingScheduler);
+
+TypeId
+RecordingScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::RecordingScheduler")
+    .SetParent<Scheduler> ()
+    .SetGroupName ("Core")
+    .AddConstructor<RecordingScheduler> ()
+    .AddAttribute ("Scheduler",
+                   "The scheduler the events are handed to.",
+                   TypeIdValue (MapScheduler::GetTypeId ()),
+                   MakeTypeIdAccessor (&RecordingScheduler::m_schedulerType),
+                   MakeTypeIdChecker ())
+    .AddAttribute ("FileName",
+                   "The file the delays of the inserted events are written to.",
+                   StringValue ("scheduler-events.txt"),
+                   MakeStringAccessor (&RecordingScheduler::m_fileName),
+                   MakeStringChecker ())
+  ;
+  return tid;
+}
+
+RecordingScheduler::RecordingScheduler ()
+  : m_now (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+RecordingScheduler::~RecordingScheduler ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+Ptr<Scheduler>
+RecordingScheduler::GetScheduler (void) const
+{
+  if (m_scheduler == 0)
+    {
+      ObjectFactory factory;
+      factory.SetTypeId (m_schedulerType);
+      m_scheduler = factory.Create<Scheduler> ();
+      m_file.open (m_fileName.c_str ());
+      if (!m_file)
+        {
+          NS_FATAL_ERROR ("Cannot open " << m_fileName);
+        }
+      m_file << std::setprecision (12);
+    }
+  return m_scheduler;
+}
+
+void
+RecordingScheduler::Insert (const Event &ev)
+{
+  NS_LOG_FUNCTION (this << &ev);
+  Ptr<Scheduler> scheduler = GetScheduler ();
+  m_file << TimeStep (ev.key.m_ts - m_now).GetSeconds () << "\n";
+  scheduler->Insert (ev);
+}
+
+bool
+RecordingScheduler::IsEmpty (void) const
+{
+  NS_LOG_FUNCTION (this);
+  return GetScheduler ()->IsEmpty ();
+}
+
+Scheduler::Event
+RecordingScheduler::PeekNext (void) const
+{
+  NS_LOG_FUNCTION (this);
+  return GetScheduler ()->PeekNext ();
+}
+
+Scheduler::Event
+RecordingScheduler::RemoveNext (void)
+{
+  NS_LOG_FUNCTION (this);
+  Event next = GetScheduler ()->RemoveNext ();
+  m_now = next.key.m_ts;
+  return next;
+}
+
+void
+RecordingScheduler::Remove (const Event &ev)
+{
+  NS_LOG_FUNCTION (this << &ev);
+  GetScheduler ()->Remove (ev);
+}
+
+} // namespace ns3
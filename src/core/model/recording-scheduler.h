@@ -0,0 +1,92 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef RECORDING_SCHEDULER_H
+#define RECORDING_SCHEDULER_H
+
+#include "scheduler.h"
+#include "type-id.h"
+#include "ptr.h"
+#include <stdint.h>
+#include <fstream>
+#include <string>
+
+/**
+ * \file
+ * \ingroup scheduler
+ * Declaration of ns3::RecordingScheduler class.
+ */
+
+namespace ns3 {
+
+/**
+ * \ingroup scheduler
+ * \brief a scheduler which writes the delay of every inserted event to
+ * a file
+ *
+ * It hands every call to another scheduler, chosen with the
+ * "Scheduler" attribute, and writes on a line of the file given by the
+ * "FileName" attribute the delay, in seconds, between the current
+ * simulation time and the time of each inserted event.  The file is
+ * the trace utils/bench-simulator reads with its --file argument, so
+ * that the schedulers can be compared on the events of a real
+ * simulation, for example:
+ *
+ * \code
+ *   ./AccesslinkTmix --SchedulerType=ns3::RecordingScheduler \
+ *       --ns3::RecordingScheduler::FileName=access.events
+ *   ./bench-simulator --file=access.events --quad
+ * \endcode
+ */
+class RecordingScheduler : public Scheduler
+{
+public:
+  /**
+   *  Register this type.
+   *  \return The object TypeId.
+   */
+  static TypeId GetTypeId (void);
+
+  /** Constructor. */
+  RecordingScheduler ();
+  /** Destructor. */
+  virtual ~RecordingScheduler ();
+
+  // Inherited
+  virtual void Insert (const Scheduler::Event &ev);
+  virtual bool IsEmpty (void) const;
+  virtual Scheduler::Event PeekNext (void) const;
+  virtual Scheduler::Event RemoveNext (void);
+  virtual void Remove (const Scheduler::Event &ev);
+
+private:
+  /**
+   * Create the scheduler and open the file, on first use since the
+   * attributes are set after construction.
+   * \returns the scheduler the calls are handed to.
+   */
+  Ptr<Scheduler> GetScheduler (void) const;
+
+  TypeId m_schedulerType;           //!< The type of m_scheduler.
+  std::string m_fileName;           //!< The name of the trace file.
+  mutable Ptr<Scheduler> m_scheduler; //!< The scheduler the calls are handed to.
+  mutable std::ofstream m_file;     //!< The trace file.
+  uint64_t m_now;                   //!< The time of the last removed event.
+};
+
+} // namespace ns3
+
+#endif /* RECORDING_SCHEDULER_H */
@@ -23,6 +23,8 @@
 #include "ns3/heap-scheduler.h"
 #include "ns3/map-scheduler.h"
 #include "ns3/calendar-scheduler.h"
+#include "ns3/four-ary-heap-scheduler.h"
+#include "ns3/event-memory.h"
 
 using namespace ns3;
 
@@ -459,6 +461,47 @@ SimulatorTemplateTestCase::DoRun (void)
   Simulator::Destroy ();
 }
 
+class EventMemoryTestCase : public TestCase
+{
+public:
+  EventMemoryTestCase ();
+  virtual void DoRun (void);
+  void Chain (uint32_t n);
+};
+
+EventMemoryTestCase::EventMemoryTestCase ()
+  : TestCase ("Check that scheduling reuses event memory")
+{
+}
+
+void
+EventMemoryTestCase::Chain (uint32_t n)
+{
+  if (n > 0)
+    {
+      Simulator::Schedule (MicroSeconds (1), &EventMemoryTestCase::Chain, this, n - 1);
+    }
+}
+
+void
+EventMemoryTestCase::DoRun (void)
+{
+  Simulator::SetScheduler (ObjectFactory ("ns3::MapScheduler"));
+  // fill the free lists
+  Simulator::Schedule (Seconds (0), &EventMemoryTestCase::Chain, this, 10);
+  Simulator::Run ();
+
+  EventMemory::Stats before = EventMemory::GetStats ();
+  Simulator::Schedule (Seconds (0), &EventMemoryTestCase::Chain, this, 1000);
+  Simulator::Run ();
+  EventMemory::Stats after = EventMemory::GetStats ();
+  NS_TEST_EXPECT_MSG_EQ (after.misses, before.misses, "Scheduling an event used the heap");
+  NS_TEST_EXPECT_MSG_GT (after.hits, before.hits + 1000, "Events were not allocated from the free lists");
+  NS_TEST_EXPECT_MSG_EQ (after.inUse, before.inUse, "Event memory leaked");
+
+  Simulator::Destroy ();
+}
+
 class SimulatorTestSuite : public TestSuite
 {
 public:
@@ -475,5 +518,8 @@ public:
     AddTestCase (new SimulatorEventsTestCase (factory), TestCase::QUICK);
     factory.SetTypeId (CalendarScheduler::GetTypeId ());
     AddTestCase (new SimulatorEventsTestCase (factory), TestCase::QUICK);
+    factory.SetTypeId (FourAryHeapScheduler::GetTypeId ());
+    AddTestCase (new SimulatorEventsTestCase (factory), TestCase::QUICK);
+    AddTestCase (new EventMemoryTestCase, TestCase::QUICK);
   }
 } g_simulatorTestSuite;
@@ -70,9 +70,12 @@ DelayBoxNetDeviceT<ND>::GetTypeId ()
 
 template<class ND>
 DelayBoxNetDeviceT<ND>::DelayBoxNetDeviceT ()
-  : m_delayBox (CreateObject<DelayBox> ())
+  : m_delayBox (CreateObject<DelayBox> ()),
+    m_delayedPackets (0),
+    m_delayedBytes (0),
+    m_backlogBytes (0),
+    m_txEndConnected (false)
 {
-  m_inwaiting = 0;
 }
 
 template<class ND>
@@ -85,46 +88,207 @@ bool
 DelayBoxNetDeviceT<ND>::Send (Ptr<Packet> packet, const Address& dest,
                               uint16_t protocolNumber)
 {
-  return this->ND::Send (packet, dest, protocolNumber);
   if (m_delayBox)
     {
-      m_inwaiting += packet->GetSize ();
-      m_inwaitingp ++;
-      Ptr<Queue> qu = this->ND::GetQueue ();
-      Ptr<NetDeviceQueue> txq;
-      if (this->ND::GetQueueInterface ())
+      if (!m_admission.empty () || !HasRoom (packet->GetSize ()))
         {
-          txq = this->ND::GetQueueInterface ()->GetTxQueue (0);
+          // The device woke the queue disc while DelayBox still holds
+          // its share of the queue limit; the queue disc has already
+          // let go of the packet, so hold it until DelayBox releases one.
+          Released held;
+          held.packet = packet;
+          held.dest = dest;
+          held.protocolNumber = protocolNumber;
+          m_admission.push_back (held);
+          StopTxQueue ();
+          return true;
         }
-      Callback<void> send = MakeCallback (
-          &DelayBoxNetDeviceT<ND>::SendWithoutDelay, this).Bind (packet).Bind (
-          dest).Bind (protocolNumber);
-      if (m_delayBox->Delay (send, static_cast<Ptr<const Packet> > (packet)))
-        {
-          m_delayBoxEnqueueTrace (packet);
-     if (txq)
+      return Admit (packet, dest, protocolNumber);
+    }
+  else
+    {
+      m_delayBoxEnqueueTrace (packet);
+      Forward (packet, dest, protocolNumber);
+      return true;
+    }
+}
+
+template<class ND>
+bool
+DelayBoxNetDeviceT<ND>::Admit (Ptr<Packet> packet, const Address& dest,
+                               uint16_t protocolNumber)
+{
+  m_delayedPackets++;
+  m_delayedBytes += packet->GetSize ();
+  Callback<void> send = MakeCallback (
+      &DelayBoxNetDeviceT<ND>::SendWithoutDelay, this).Bind (packet).Bind (
+      dest).Bind (protocolNumber);
+  if (m_delayBox->Delay (send, static_cast<Ptr<const Packet> > (packet)))
+    {
+      m_delayBoxEnqueueTrace (packet);
+      if (!HasRoom (this->ND::GetMtu ()))
         {
-          if ((qu->GetMode () == Queue::QUEUE_MODE_PACKETS &&
-               m_inwaitingp + qu->GetNPackets () >= qu->GetMaxPackets ()) ||
-              (qu->GetMode () == Queue::QUEUE_MODE_BYTES &&
-               m_inwaiting + qu->GetNBytes () + this->ND::GetMtu () > qu->GetMaxBytes ()))
-            {
-              txq->Stop ();
-            }
-        }
-          return true;
+          StopTxQueue ();
         }
-      else
+      return true;
+    }
+  m_delayedPackets--;
+  m_delayedBytes -= packet->GetSize ();
+  m_delayBoxDropTrace (packet);
+  return false;
+}
+
+template<class ND>
+void
+DelayBoxNetDeviceT<ND>::SendWithoutDelay (Ptr<Packet> packet, const Address& dest,
+                                          uint16_t protocolNumber)
+{
+  NS_ASSERT (m_delayedPackets > 0);
+  m_delayedPackets--;
+  m_delayedBytes -= packet->GetSize ();
+  Forward (packet, dest, protocolNumber);
+  while (!m_admission.empty () && HasRoom (m_admission.front ().packet->GetSize ()))
+    {
+      Released held = m_admission.front ();
+      m_admission.pop_front ();
+      Admit (held.packet, held.dest, held.protocolNumber);
+    }
+}
+
+template<class ND>
+void
+DelayBoxNetDeviceT<ND>::Forward (Ptr<Packet> packet, const Address& dest,
+                                 uint16_t protocolNumber)
+{
+  Ptr<NetDeviceQueue> txq = GetTxQueue ();
+  if (!m_backlog.empty () || !DeviceHasRoom (packet->GetSize ()))
+    {
+      Released released;
+      released.packet = packet;
+      released.dest = dest;
+      released.protocolNumber = protocolNumber;
+      m_backlog.push_back (released);
+      m_backlogBytes += packet->GetSize ();
+      StopTxQueue ();
+      return;
+    }
+  // The queue may have been stopped on behalf of the backlog, which
+  // is empty now; the underlying device asserts that it is running
+  // and stops it again itself if this packet fills its queue.
+  if (txq)
+    {
+      txq->Start ();
+    }
+  this->ND::Send (packet, dest, protocolNumber);
+  if (!HasRoom (this->ND::GetMtu ()))
+    {
+      StopTxQueue ();
+    }
+}
+
+template<class ND>
+void
+DelayBoxNetDeviceT<ND>::StopTxQueue (void)
+{
+  if (!m_txEndConnected)
+    {
+      m_txEndConnected = this->TraceConnectWithoutContext ("PhyTxEnd",
+        MakeCallback (&DelayBoxNetDeviceT<ND>::NotifyTxEnd, this));
+      NS_ASSERT_MSG (m_txEndConnected, "Underlying NetDevice has no PhyTxEnd trace source");
+    }
+  Ptr<NetDeviceQueue> txq = GetTxQueue ();
+  if (txq)
+    {
+      txq->Stop ();
+    }
+}
+
+template<class ND>
+void
+DelayBoxNetDeviceT<ND>::NotifyTxEnd (Ptr<const Packet> packet)
+{
+  // PhyTxEnd fires in the middle of the device's transmit-complete
+  // handler, which is about to dequeue the next packet itself; only
+  // touch the device once it is done.
+  Ptr<NetDeviceQueue> txq = GetTxQueue ();
+  if ((!m_backlog.empty () || (txq && txq->IsStopped ())) && !m_drainEvent.IsRunning ())
+    {
+      m_drainEvent = Simulator::ScheduleNow (&DelayBoxNetDeviceT<ND>::DrainBacklog, this);
+    }
+}
+
+template<class ND>
+void
+DelayBoxNetDeviceT<ND>::DrainBacklog (void)
+{
+  Ptr<NetDeviceQueue> txq = GetTxQueue ();
+  while (!m_backlog.empty () && DeviceHasRoom (m_backlog.front ().packet->GetSize ()))
+    {
+      Released released = m_backlog.front ();
+      m_backlog.pop_front ();
+      m_backlogBytes -= released.packet->GetSize ();
+      if (txq)
         {
-          m_delayBoxDropTrace (packet);
-          return false;
+          txq->Start ();
         }
+      this->ND::Send (released.packet, released.dest, released.protocolNumber);
     }
-  else
+  if (!txq)
     {
-      m_delayBoxEnqueueTrace (packet);
-      return this->ND::Send (packet, dest, protocolNumber);
+      return;
+    }
+  if (!m_backlog.empty () || !m_admission.empty () || !HasRoom (this->ND::GetMtu ()))
+    {
+      txq->Stop ();
+    }
+  else if (txq->IsStopped () && DeviceHasRoom (this->ND::GetMtu ()))
+    {
+      txq->Wake ();
+    }
+}
+
+template<class ND>
+bool
+DelayBoxNetDeviceT<ND>::HasRoom (uint32_t size) const
+{
+  Ptr<Queue> queue = this->ND::GetQueue ();
+  if (!queue)
+    {
+      return true;
+    }
+  if (queue->GetMode () == Queue::QUEUE_MODE_PACKETS)
+    {
+      return m_delayedPackets + m_backlog.size () + queue->GetNPackets () < queue->GetMaxPackets ();
+    }
+  return m_delayedBytes + m_backlogBytes + queue->GetNBytes () + size <= queue->GetMaxBytes ();
+}
+
+template<class ND>
+bool
+DelayBoxNetDeviceT<ND>::DeviceHasRoom (uint32_t size) const
+{
+  Ptr<Queue> queue = this->ND::GetQueue ();
+  if (!queue)
+    {
+      return true;
+    }
+  if (queue->GetMode () == Queue::QUEUE_MODE_PACKETS)
+    {
+      return queue->GetNPackets () < queue->GetMaxPackets ();
+    }
+  return queue->GetNBytes () + size <= queue->GetMaxBytes ();
+}
+
+template<class ND>
+Ptr<NetDeviceQueue>
+DelayBoxNetDeviceT<ND>::GetTxQueue (void)
+{
+  Ptr<NetDeviceQueueInterface> queueInterface = this->ND::GetQueueInterface ();
+  if (queueInterface)
+    {
+      return queueInterface->GetTxQueue (0);
     }
+  return 0;
 }
 
 /////////////////////////////////////////////////////////
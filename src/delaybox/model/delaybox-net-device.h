@@ -52,6 +52,8 @@
 #include "ns3/core-module.h"
 #include "delaybox.h"
 
+#include <deque>
+
 namespace ns3 {
 
 /**
@@ -131,11 +133,19 @@ public:
    *         underlying NetDevice and false if it was dropped due to
    *         DelayBox rules.  If there is no instance of DelayBox
    *         attached, acts like PointToPointNetDevice::Send.
+   *
+   * Packets held back by DelayBox and released packets waiting in
+   * the backlog count against the limit of the underlying device's
+   * queue: once they fill it the NetDeviceQueue is stopped, so the
+   * queue disc above holds (and drops) further packets.  A packet sent
+   * anyway, because the device woke the queue disc, waits until
+   * DelayBox releases one.  If a packet is released while the device
+   * queue itself is full it is kept in a backlog instead of being
+   * dropped, until the device has room again.
    */
   virtual bool
   Send (Ptr<Packet> packet, const Address& dest, uint16_t protocolNumber);
-  uint32_t m_inwaiting;
-  uint32_t m_inwaitingp;
+
   /**
    * \return Instance of DelayBox used to classify and delay packets.
    */
@@ -155,27 +165,114 @@ public:
     m_delayBox = delayBox;
   }
 
+  /**
+   * \return Number of packets accepted by Send() which DelayBox is
+   * still holding back.
+   */
+  uint32_t
+  GetNDelayedPackets () const
+  {
+    return m_delayedPackets;
+  }
+
+  /**
+   * \return Number of packets whose delay has expired but which are
+   * waiting for room in the underlying NetDevice's queue.
+   */
+  uint32_t
+  GetNBackloggedPackets () const
+  {
+    return m_backlog.size ();
+  }
+
 private:
+  /**
+   * Called by DelayBox once the packet's delay has expired.
+   */
   void
   SendWithoutDelay (Ptr<Packet> packet, const Address& dest,
-                    uint16_t protocolNumber)
+                    uint16_t protocolNumber);
+
+  /**
+   * Hand a packet to DelayBox and stop the NetDeviceQueue if it has
+   * used up the rest of the device queue limit.
+   *
+   * \return false if the DelayBox rule dropped the packet
+   */
+  bool
+  Admit (Ptr<Packet> packet, const Address& dest, uint16_t protocolNumber);
+
+  /**
+   * Hand a packet to the underlying NetDevice, or append it to the
+   * backlog if the device queue is full or older packets are still
+   * waiting.  While the backlog is not empty the NetDeviceQueue is
+   * kept stopped, so the queue disc holds on to further packets.
+   */
+  void
+  Forward (Ptr<Packet> packet, const Address& dest, uint16_t protocolNumber);
+
+  /**
+   * Move packets from the backlog to the underlying NetDevice while
+   * it has room, and wake the queue disc once the backlog is empty.
+   */
+  void
+  DrainBacklog (void);
+
+  /**
+   * Stop the NetDeviceQueue until NotifyTxEnd finds room again.
+   */
+  void
+  StopTxQueue (void);
+
+  /**
+   * PhyTxEnd trace sink; the device queue has just lost a packet.
+   */
+  void
+  NotifyTxEnd (Ptr<const Packet> packet);
+
+  /**
+   * \return true if the underlying NetDevice's queue can take
+   * another packet of the given size without overflowing.
+   */
+  bool
+  DeviceHasRoom (uint32_t size) const;
+
+  /**
+   * \return true if the packets held by DelayBox, the backlog and
+   * the underlying NetDevice's queue leave room under the device
+   * queue limit for another packet of the given size.
+   */
+  bool
+  HasRoom (uint32_t size) const;
+
+  Ptr<NetDeviceQueue>
+  GetTxQueue (void);
+
+  /// A packet waiting for DelayBox or for the device queue.
+  struct Released
   {
-    m_inwaiting -= packet->GetSize ();
-    m_inwaitingp --;
-      Ptr<NetDeviceQueue> txq;
-      if (this->ND::GetQueueInterface ())
-        {
-          txq = this->ND::GetQueueInterface ()->GetTxQueue (0);
-          txq -> Start ();
-        }
-    this->ND::Send (packet, dest, protocolNumber);
-  }
+    Ptr<Packet> packet;
+    Address dest;
+    uint16_t protocolNumber;
+  };
 
-private:
   Ptr<DelayBox> m_delayBox;
   TracedCallback<Ptr<const Packet> > m_delayBoxEnqueueTrace;
   TracedCallback<Ptr<const Packet> > m_delayBoxDropTrace;
-  Ptr<NetDeviceQueueInterface> m_queueInterface;   //!< NetDevice queue interface
+  /// Packets currently held back by DelayBox.
+  uint32_t m_delayedPackets;
+  /// Bytes of the packets currently held back by DelayBox.
+  uint32_t m_delayedBytes;
+  /// Released packets waiting for room in the device queue, in order.
+  std::deque<Released> m_backlog;
+  /// Bytes of the packets in m_backlog.
+  uint32_t m_backlogBytes;
+  /// Packets sent while DelayBox held its share of the device queue
+  /// limit, waiting to be admitted to DelayBox, in order.
+  std::deque<Released> m_admission;
+  /// Whether NotifyTxEnd has been connected to PhyTxEnd.
+  bool m_txEndConnected;
+  EventId m_drainEvent;
 };
 
 
@@ -39,9 +39,12 @@
 #include "delaybox.h"
 
 #include "ns3/log.h"
+#include "ns3/rng-seed-manager.h"
 #include "ns3/tcp-header.h"
 #include "ns3/ppp-header.h"
 
+#include <algorithm>
+
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("DelayBox");
@@ -49,8 +52,8 @@ NS_OBJECT_ENSURE_REGISTERED (DelayBox);
 
 DelayBoxRuleKey::DelayBoxRuleKey (Ipv4Address src, uint16_t srcPort,
                                   Ipv4Address dst, uint16_t dstPort, bool symmetric)
-  : m_src (src, srcPort),
-    m_dst (dst, dstPort)
+  : m_src ((uint64_t (src.Get ()) << 16) | srcPort),
+    m_dst ((uint64_t (dst.Get ()) << 16) | dstPort)
 {
   if (symmetric)
     {
@@ -65,18 +68,7 @@ DelayBoxRuleKey::DelayBoxRuleKey (Ipv4Address src, uint16_t srcPort,
 bool
 DelayBoxRuleKey::operator< (const DelayBoxRuleKey& rhs) const
 {
-  if (m_src < rhs.m_src)
-    {
-      return true;
-    }
-  else if (m_src == rhs.m_src)
-    {
-      return m_dst < rhs.m_dst;
-    }
-  else
-    {
-      return false;
-    }
+  return m_src < rhs.m_src || (m_src == rhs.m_src && m_dst < rhs.m_dst);
 }
 
 bool
@@ -85,6 +77,31 @@ DelayBoxRuleKey::operator== (const DelayBoxRuleKey& rhs) const
   return m_src == rhs.m_src && m_dst == rhs.m_dst;
 }
 
+bool
+DelayBoxRuleKey::operator!= (const DelayBoxRuleKey& rhs) const
+{
+  return !(*this == rhs);
+}
+
+uint32_t
+DelayBoxRuleKey::Hash () const
+{
+  // 64-bit finalizer of MurmurHash3 over both ends.
+  uint64_t h = m_src * 0x9e3779b97f4a7c15ULL ^ m_dst;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return static_cast<uint32_t> (h);
+}
+
+uint32_t
+DelayBoxRuleKey::GetWildcards () const
+{
+  return ((m_src & 0xffff) == 0 ? 1 : 0) | ((m_dst & 0xffff) == 0 ? 2 : 0);
+}
+
 TypeId
 DelayBox::GetTypeId (void)
 {
@@ -96,30 +113,33 @@ DelayBox::GetTypeId (void)
 }
 
 DelayBox::DelayBox ()
-  : m_symmetric (true)
+  : m_symmetric (true),
+    m_stream (RngSeedManager::GetNextStreamIndex ()),
+    m_classifier (true)
+{
+  m_classifier.SetEvictCallback (MakeCallback (&DelayBox::FlowEvicted, this));
+}
+
+int64_t
+DelayBox::AssignStreams (int64_t stream)
 {
+  NS_LOG_FUNCTION (this << stream);
+  m_stream = stream;
+  return 1;
 }
 
 void
 DelayBox::SetSymmetric (bool symmetric)
 {
   m_symmetric = symmetric;
+  m_classifier.SetSymmetric (symmetric);
 }
 
-bool
-DelayBox::Classify (const Ipv4Header& ipHeader, Ptr<const Packet> ipPayload,
-                    uint32_t* flowId, uint32_t* packetId)
+void
+DelayBox::FlowEvicted (uint32_t index, FlowId flowId)
 {
-  if (m_symmetric)
-    {
-      return m_symmetricClassifier.Classify (ipHeader, ipPayload, flowId,
-                                             packetId);
-    }
-  else
-    {
-      return m_asymmetricClassifier.Classify (ipHeader, ipPayload, flowId,
-                                              packetId);
-    }
+  NS_LOG_LOGIC ("Flow " << flowId << " evicted");
+  m_flowTable.Evict (index);
 }
 
 /*
@@ -143,77 +163,68 @@ DelayBox::Classify (const Ipv4Header& ipHeader, Ptr<const Packet> ipPayload,
 bool
 DelayBox::Delay (Callback<void> send, Ptr<const Packet> packet)
 {
-  // TODO: instead of digging through headers here, we should take
-  // them as parameters to this function.
-  Ptr<Packet> ipPayload = packet->Copy ();
-  Ipv4Header ipHeader;
-  ipPayload->RemoveHeader (ipHeader);
-  TcpHeader tcpHeader;
-  if (packet->GetSize()<36)
+  // Pick the addresses, ports and flags straight out of the packet
+  // bytes; copying the packet to deserialize its headers costs more
+  // than everything else done here.  An IPv4 header is at most 60
+  // bytes long.
+  uint8_t buffer[60 + TcpPortView::SIZE];
+  uint32_t size = packet->CopyData (buffer, sizeof (buffer));
+  uint32_t ipHeaderSize = size < 20 ? 0 : (buffer[0] & 0x0f) * 4;
+  if (ipHeaderSize < 20 || size < ipHeaderSize + TcpPortView::SIZE)
     {
       send ();
       return true;
     }
-  ipPayload->PeekHeader (tcpHeader);
-
-  NS_LOG_LOGIC ("Considering packet: " << ipHeader.GetSource () << ":" << tcpHeader.GetSourcePort () << " -> " << ipHeader.GetDestination () << ":" << tcpHeader.GetDestinationPort ());
-
-  uint32_t flowId;
-  uint32_t packetId;
-  if (Classify (ipHeader, ipPayload, &flowId, &packetId))
+  if (buffer[9] != TcpL4Protocol::PROT_NUMBER)
     {
-      NS_LOG_LOGIC ("Packet classified: flow " << flowId << ", packet " << packetId);
+      NS_LOG_WARN ("Couldn't classify packet.");
+      send ();
+      return true;
     }
-  else
+  return Delay (send, Ipv4Address::Deserialize (buffer + 12), Ipv4Address::Deserialize (buffer + 16),
+                TcpPortView::Read (buffer + ipHeaderSize), packet->GetSize ());
+}
+
+bool
+DelayBox::Delay (Callback<void> send, Ptr<const QueueDiscItem> item)
+{
+  const Ipv4QueueDiscItem *ipItem = dynamic_cast<const Ipv4QueueDiscItem *> (PeekPointer (item));
+  if (!ipItem || ipItem->GetHeader ().GetProtocol () != TcpL4Protocol::PROT_NUMBER)
     {
       NS_LOG_WARN ("Couldn't classify packet.");
       send ();
       return true;
     }
-
-  DelayBoxRule rule;
-  if (m_ruleTable.Lookup (ipHeader.GetSource (), tcpHeader.GetSourcePort (),
-                          ipHeader.GetDestination (), tcpHeader.GetDestinationPort (), m_symmetric,
-                          rule))
+  const Ipv4Header& ipHeader = ipItem->GetHeader ();
+  Ptr<const Packet> packet = item->GetPacket ();
+  // Once the header has been added to the packet, the item no longer
+  // counts it on top of the packet size.
+  uint32_t offset = 0;
+  if (ipItem->GetPacketSize () == packet->GetSize ())
     {
-      return m_flowTable.Enqueue (flowId, rule, send, packet->GetSize (),
-                                  tcpHeader);
+      offset = ipHeader.GetSerializedSize ();
     }
-  else
+  uint8_t buffer[60 + TcpPortView::SIZE];
+  if (packet->CopyData (buffer, offset + TcpPortView::SIZE) < offset + TcpPortView::SIZE)
     {
-      NS_LOG_DEBUG ("Packet didn't match a rule; sending immediately");
       send ();
       return true;
     }
+  return Delay (send, ipHeader.GetSource (), ipHeader.GetDestination (),
+                TcpPortView::Read (buffer + offset), ipItem->GetPacketSize ());
 }
 
-/*bool
-DelayBox::Delay (Callback<void> send, Ptr<const QueueDiscItem> item)
+bool
+DelayBox::Delay (Callback<void> send, Ipv4Address source, Ipv4Address destination,
+                 const TcpPortView& tcp, uint32_t packetSize)
 {
-  // TODO: instead of digging through headers here, we should take
-  // them as parameters to this function.
-  Ptr<Packet> packet = item->GetPacket ();
-  Ptr<Packet> ipPayload = packet->Copy ();
-  Ipv4Header ipHeader;
-  Ptr<const Ipv4QueueDiscItem> iqd = Ptr<const Ipv4QueueDiscItem> (dynamic_cast<const Ipv4QueueDiscItem *> (PeekPointer (item)));
-  ipHeader = iqd->GetHeader ();
-  TcpHeader tcpHeader;
-  if (packet->GetSize()<36)
-    {
-      send ();
-      return true;
-    }
-  NS_LOG_LOGIC ("Before Peek Header");
-  ipPayload->PeekHeader (tcpHeader);
-  NS_LOG_LOGIC ("After Peek Header");
-
-  NS_LOG_LOGIC ("Considering packet: " << ipHeader.GetSource () << ":" << tcpHeader.GetSourcePort () << " -> " << ipHeader.GetDestination () << ":" << tcpHeader.GetDestinationPort ());
+  NS_LOG_LOGIC ("Considering packet: " << source << ":" << tcp.sourcePort << " -> " << destination << ":" << tcp.destinationPort);
 
   uint32_t flowId;
-  uint32_t packetId;
-  if (Classify (ipHeader, ipPayload, &flowId, &packetId))
+  uint32_t index;
+  if (m_classifier.Classify (source, destination, tcp, &flowId, &index))
     {
-      NS_LOG_LOGIC ("Packet classified: flow " << flowId << ", packet " << packetId);
+      NS_LOG_LOGIC ("Packet classified: flow " << flowId);
     }
   else
     {
@@ -222,131 +233,289 @@ DelayBox::Delay (Callback<void> send, Ptr<const QueueDiscItem> item)
       return true;
     }
 
-  DelayBoxRule rule;
-  if (m_ruleTable.Lookup (ipHeader.GetSource (), tcpHeader.GetSourcePort (),
-                          ipHeader.GetDestination (), tcpHeader.GetDestinationPort (), m_symmetric,
-                          rule))
+  DelayBoxFlow* flow = m_flowTable.Find (index);
+  if (!flow)
     {
-      return m_flowTable.Enqueue (flowId, rule, send, packet->GetSize (),
-                                  tcpHeader);
+      // Only the first packet of a flow is matched against the rules;
+      // the flow keeps the parameters it sampled from them.
+      const DelayBoxRuleTable::Entry* entry = m_ruleTable.Lookup (
+          source, tcp.sourcePort, destination, tcp.destinationPort, m_symmetric);
+      if (!entry)
+        {
+          NS_LOG_DEBUG ("Packet didn't match a rule; sending immediately");
+          send ();
+          return true;
+        }
+      Callback<void> cancelled;
+      if (entry->expireWithFlow)
+        {
+          cancelled = MakeCallback (&DelayBox::ExpireRule, this).TwoBind (entry->key, entry->id);
+        }
+      flow = &m_flowTable.Add (index, flowId, m_stream, entry->rule, cancelled);
     }
-  else
+  if (flow->Cancelled ())
     {
-      NS_LOG_DEBUG ("Packet didn't match a rule; sending immediately");
+      // If the flow has already been cancelled, we're not interested
+      // in delaying any more packets that arrive on it.
+      NS_LOG_DEBUG ("Packet arrived on cancelled flow; sending immediately.");
       send ();
       return true;
     }
-}*/
+  return flow->Enqueue (send, packetSize, tcp.flags);
+}
 
-bool
-DelayBoxFlowTable::Enqueue (uint32_t flowId, const DelayBoxRule& rule, Callback<
-                              void> send, uint32_t packetSize, const TcpHeader& tcpHeader)
+DelayBoxFlowTable::DelayBoxFlowTable ()
+  : m_nFlows (0)
 {
-  std::map<uint32_t, DelayBoxFlow>::iterator flow = m_flows.find (flowId);
-  if (flow == m_flows.end ())
+}
+
+DelayBoxFlow*
+DelayBoxFlowTable::Find (uint32_t index)
+{
+  return index < m_used.size () && m_used[index] ? &m_flows[index] : 0;
+}
+
+DelayBoxFlow&
+DelayBoxFlowTable::Add (uint32_t index, uint32_t flowId, uint64_t stream,
+                        const DelayBoxRule& rule, Callback<void> cancelled)
+{
+  if (index >= m_flows.size ())
     {
-      // If the flow isn't found, create one, sampling from the rule's
-      // random variables, and add it to the flow table.
-      flow = m_flows.insert (std::map<uint32_t, DelayBoxFlow>::value_type (
-                               flowId, DelayBoxFlow (rule))).first;
+      m_flows.resize (index + 1);
+      m_used.resize (index + 1, false);
     }
-  else if (flow->second.Cancelled ())
+  NS_ASSERT (!m_used[index]);
+  m_flows[index].Reset (rule, flowId, stream);
+  m_flows[index].SetCancelCallback (cancelled);
+  m_used[index] = true;
+  m_nFlows++;
+  return m_flows[index];
+}
+
+void
+DelayBoxFlowTable::Evict (uint32_t index)
+{
+  if (!Find (index))
     {
-      // If the flow has already been cancelled, we're not interested
-      // in delaying any more packets that arrive on it.
-      NS_LOG_DEBUG ("Packet arrived on cancelled flow; sending immediately.");
-      send ();
-      return true;
+      return;
     }
-  else
+  if (!m_flows[index].Cancelled ())
     {
-      // The flow already exists and is active.
+      m_flows[index].Cancel ();
     }
+  m_used[index] = false;
+  m_nFlows--;
+}
+
+const uint32_t DelayBoxRuleTable::NO_SLOT;
 
-  // Prune cancelled flows from the table every once in a while to
-  // save on memory during long runs.  I'm not completely sure of the
-  // reasoning here but checking the table of N flows about once every
-  // N packets seems... reasonable.
-  if (m_flows.size () > 100 && m_rng->GetInteger (1, m_flows.size ()) == 1)                //HJB
+DelayBoxRuleTable::DelayBoxRuleTable ()
+  : m_slots (16, NO_SLOT),
+    m_nextId (1)
+{
+  std::fill (m_nWildcards, m_nWildcards + 4, 0);
+}
+
+uint32_t
+DelayBoxRuleTable::Find (const DelayBoxRuleKey& key) const
+{
+  uint32_t mask = m_slots.size () - 1;
+  for (uint32_t i = key.Hash () & mask; m_slots[i] != NO_SLOT; i = (i + 1) & mask)
     {
-      unsigned n = 0;
-      for (std::map<uint32_t, DelayBoxFlow>::iterator it = m_flows.begin (); it
-           != m_flows.end (); )
+      if (m_entries[m_slots[i]].key == key)
         {
-          if (it->second.Cancelled ())
-            {
-              m_flows.erase (it++);
-              ++n;
-            }
-          else
-            {
-              ++it;
-            }
+          return i;
         }
-      NS_LOG_LOGIC ("Pruned " << n << " cancelled flows. " << m_flows.size () << " remain.");
     }
+  return NO_SLOT;
+}
 
-  return flow->second.Enqueue (send, packetSize, tcpHeader);
+uint32_t
+DelayBoxRuleTable::Add (DelayBoxRuleKey key, const DelayBoxRule& rule, bool expireWithFlow)
+{
+  uint32_t slot = Find (key);
+  if (slot != NO_SLOT)
+    {
+      // A newer rule for the same key replaces the old one.
+      Entry& entry = m_entries[m_slots[slot]];
+      entry.rule = rule;
+      entry.id = m_nextId++;
+      entry.expireWithFlow = expireWithFlow;
+      return entry.id;
+    }
+  // Keep the load factor at or below one half so probe runs stay short.
+  if (2 * (m_entries.size () + 1) > m_slots.size ())
+    {
+      Resize (2 * m_slots.size ());
+    }
+  uint32_t mask = m_slots.size () - 1;
+  uint32_t i = key.Hash () & mask;
+  while (m_slots[i] != NO_SLOT)
+    {
+      i = (i + 1) & mask;
+    }
+  m_slots[i] = m_entries.size ();
+  Entry entry = { key, rule, m_nextId++, expireWithFlow };
+  m_entries.push_back (entry);
+  m_nWildcards[key.GetWildcards ()]++;
+  return entry.id;
 }
 
 void
-DelayBoxRuleTable::Add (DelayBoxRuleKey key, const DelayBoxRule& rule)
+DelayBoxRuleTable::Remove (DelayBoxRuleKey key)
 {
-  m_rules.insert (std::pair<DelayBoxRuleKey, DelayBoxRule> (key, rule));
+  uint32_t slot = Find (key);
+  if (slot != NO_SLOT)
+    {
+      Erase (slot);
+    }
 }
 
-bool
+void
+DelayBoxRuleTable::Remove (DelayBoxRuleKey key, uint32_t id)
+{
+  uint32_t slot = Find (key);
+  if (slot != NO_SLOT && m_entries[m_slots[slot]].id == id)
+    {
+      Erase (slot);
+    }
+}
+
+void
+DelayBoxRuleTable::Erase (uint32_t slot)
+{
+  uint32_t index = m_slots[slot];
+  m_nWildcards[m_entries[index].key.GetWildcards ()]--;
+
+  // Shift later members of the probe run back over the hole, so that
+  // no tombstones are needed.
+  uint32_t mask = m_slots.size () - 1;
+  uint32_t hole = slot;
+  for (uint32_t i = (slot + 1) & mask; m_slots[i] != NO_SLOT; i = (i + 1) & mask)
+    {
+      uint32_t home = m_entries[m_slots[i]].key.Hash () & mask;
+      // Move the entry unless its home slot lies cyclically in (hole, i].
+      if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+          m_slots[hole] = m_slots[i];
+          hole = i;
+        }
+    }
+  m_slots[hole] = NO_SLOT;
+
+  // Keep m_entries dense by moving the last entry into the gap.
+  uint32_t last = m_entries.size () - 1;
+  if (index != last)
+    {
+      m_slots[Find (m_entries[last].key)] = index;
+      m_entries[index] = m_entries[last];
+    }
+  m_entries.pop_back ();
+
+  if (m_slots.size () > 16 && 8 * m_entries.size () < m_slots.size ())
+    {
+      Resize (m_slots.size () / 2);
+    }
+}
+
+void
+DelayBoxRuleTable::Resize (uint32_t nSlots)
+{
+  m_slots.assign (nSlots, NO_SLOT);
+  uint32_t mask = nSlots - 1;
+  for (uint32_t index = 0; index < m_entries.size (); index++)
+    {
+      uint32_t i = m_entries[index].key.Hash () & mask;
+      while (m_slots[i] != NO_SLOT)
+        {
+          i = (i + 1) & mask;
+        }
+      m_slots[i] = index;
+    }
+}
+
+const DelayBoxRuleTable::Entry*
 DelayBoxRuleTable::Lookup (Ipv4Address src, uint16_t srcPort, Ipv4Address dst,
-                           uint16_t dstPort, bool sym, DelayBoxRule& out) const
+                           uint16_t dstPort, bool sym) const
 {
-  std::map<DelayBoxRuleKey, DelayBoxRule>::const_iterator rule;
   /*
-   * The auto-formatter makes a mess of this, but what this does is
-   * simple: try looking up each of the four combinations
-   * (src,srcPort,dst,dstPort), (src,0,dst,srcPort),
-   * (src,srcPort,dst,0), (src,0,dst,0), in that order, and return the
-   * first one that's found (relying on short circuit evaluation).
-   * Since port 0 means to match any port, we cover all possibilities
-   * for how the user might have specified the rule.  The most
-   * specific rule is tried first.
+   * Try each of the four combinations (src,srcPort,dst,dstPort),
+   * (src,0,dst,dstPort), (src,srcPort,dst,0), (src,0,dst,0), in that
+   * order, and return the first one that's found.  Since port 0 means
+   * to match any port, we cover all possibilities for how the user
+   * might have specified the rule.  The most specific rule is tried
+   * first.  Combinations no rule uses are not probed at all.
    */
-  if ((rule = m_rules.find (DelayBoxRuleKey (src, srcPort, dst, dstPort, sym)))
-      != m_rules.end () // match both ports
-      || (rule = m_rules.find (DelayBoxRuleKey (src, 0, dst, dstPort, sym)))
-      != m_rules.end ()    // any source port, match destination port
-      || (rule = m_rules.find (DelayBoxRuleKey (src, srcPort, dst, 0, sym)))
-      != m_rules.end ()    // match source port, any destination port
-      || (rule = m_rules.find (DelayBoxRuleKey (src, 0, dst, 0, sym)))
-      != m_rules.end ()    // any source port, any destination port
-      )
-    {
-      out = rule->second;
-      return true;
-    }
-  else
+  const uint16_t srcPorts[4] = { srcPort, 0, srcPort, 0 };
+  const uint16_t dstPorts[4] = { dstPort, dstPort, 0, 0 };
+  for (uint32_t i = 0; i < 4; i++)
     {
-      return false;
+      DelayBoxRuleKey key (src, srcPorts[i], dst, dstPorts[i], sym);
+      if (m_nWildcards[key.GetWildcards ()] == 0)
+        {
+          continue;
+        }
+      uint32_t slot = Find (key);
+      if (slot != NO_SLOT)
+        {
+          return &m_entries[m_slots[slot]];
+        }
     }
+  return 0;
 }
 
-DelayBoxFlow::DelayBoxFlow (const DelayBoxRule& rule)
+DelayBoxFlow::DelayBoxFlow ()
+  : m_delay (Seconds (0)),
+    m_lossRate (0),
+    m_linkSpeed (0),
+    m_stream (0),
+    m_counter (0),
+    m_tailPacketEnd (Seconds (0)),
+    m_cancelled (true)
 {
-  rnd = CreateObject<UniformRandomVariable> ();                          //HJB
-  rnd->SetAttribute ("Min",DoubleValue (0));
-  rnd->SetAttribute ("Max",DoubleValue (1));
-  m_delay = Seconds (rule.GetDelay ()->GetValue ());
+}
+
+DelayBoxFlow::DelayBoxFlow (const DelayBoxRule& rule, uint32_t flowId, uint64_t stream)
+{
+  Reset (rule, flowId, stream);
+}
+
+void
+DelayBoxFlow::Reset (const DelayBoxRule& rule, uint32_t flowId, uint64_t stream)
+{
+  NS_ASSERT (m_delayLine.empty ());
+  m_delay = Seconds (rule.GetDelay ());
 
   if (!m_delay.IsPositive ())
     {
       NS_FATAL_ERROR ("");
     }
-  m_lossRate = rule.GetLossRate ()->GetValue ();                          //HJB
-  m_linkSpeed = rule.GetLinkSpeed ()->GetValue ();
+  m_lossRate = rule.GetLossRate ();
+  m_linkSpeed = rule.GetLinkSpeed ();
+  m_stream = Mix (Mix (Mix (Mix (RngSeedManager::GetSeed ()) ^ RngSeedManager::GetRun ()) ^ stream) ^ flowId);
+  m_counter = 0;
   m_tailPacketEnd = Seconds (0);
   m_cancelled = false;
+  m_cancelCallback.Nullify ();
   NS_LOG_DEBUG ("New flow, delay=" << m_delay << ", lossRate=" << m_lossRate << ", linkSpeed=" << m_linkSpeed);
 }
 
+uint64_t
+DelayBoxFlow::Mix (uint64_t x)
+{
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+double
+DelayBoxFlow::NextUniform ()
+{
+  // The n-th sample depends only on the stream key and n.
+  uint64_t x = Mix (m_stream + ++m_counter * 0x9e3779b97f4a7c15ULL);
+  return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
 /*
  * Packet timeline:
  *      A   B    C
@@ -358,8 +527,7 @@ DelayBoxFlow::DelayBoxFlow (const DelayBoxRule& rule)
  *
  * At time A a packet is sent, routed to this flow by the classifier,
  * and this function Enqueue is called.  The packet is delayed for the
- * interval A->B, determined by the sample m_delay from the associated
- * rule's random variable.  If m_linkSpeed is nonzero, we also model
+ * interval A->B, the delay m_delay of the associated rule.  If m_linkSpeed is nonzero, we also model
  * the time it would take to transfer this packet across a link with
  * the given speed, and delay it by the additional interval
  * B->C. Finally at time C the packet will have finished arriving and
@@ -368,9 +536,15 @@ DelayBoxFlow::DelayBoxFlow (const DelayBoxRule& rule)
 bool
 DelayBoxFlow::Enqueue (Callback<void> send, uint32_t packetSize,
                        const TcpHeader& tcpHeader)
+{
+  return Enqueue (send, packetSize, tcpHeader.GetFlags ());
+}
+
+bool
+DelayBoxFlow::Enqueue (Callback<void> send, uint32_t packetSize, uint8_t tcpFlags)
 {
   NS_ASSERT (!m_cancelled);
-  if (rnd->GetValue () < m_lossRate)                                     //HJB
+  if (m_lossRate > 0 && NextUniform () < m_lossRate)
     {
       NS_LOG_DEBUG ("Packet dropped due to flow loss rate " << m_lossRate);
       return false;
@@ -382,64 +556,77 @@ DelayBoxFlow::Enqueue (Callback<void> send, uint32_t packetSize,
       transferDuration = Seconds (8.0 * ((double) packetSize) / m_linkSpeed);
       NS_LOG_DEBUG ("Packet transfer duration: " << transferDuration.GetSeconds () << "s, size: " << packetSize);
     }
-  if (now > m_tailPacketEnd)
+  Time start = Max (now + m_delay, m_tailPacketEnd);
+  Time end = start + transferDuration;
+  Departure departure = { end, send, (tcpFlags & TcpHeader::FIN) != 0 };
+  m_delayLine.push_back (departure);
+  m_tailPacketEnd = end;
+  if (m_delayLine.size () == 1)
     {
-      Time start = now + m_delay;
-      Time end = now + m_delay + transferDuration;
-      m_eventQueue.push_back (Simulator::Schedule (m_delay + transferDuration,
-                                                   &DelayBoxFlow::Dequeue, this, send, tcpHeader));
-      m_tailPacketEnd = end;
+      m_departure = Simulator::Schedule (end - now, &DelayBoxFlow::Dequeue, this);
       NS_LOG_DEBUG ("No packets in queue. Start = " << start.GetSeconds () << "s, End = " << end.GetSeconds () << "s");
     }
   else
     {
-      Time start = Max (now + m_delay, m_tailPacketEnd);
-      Time end = start + transferDuration;
-      // Low-priority TODO: Catastrophic floating-point cancellation
-      // here (end-now) ? If only there was a way to schedule an event
-      // for an absolute time. Or work with relative time throughout
-      // the previous calculations instead.
-      m_eventQueue.push_back (Simulator::Schedule (end - now,
-                                                   &DelayBoxFlow::Dequeue, this, send, tcpHeader));
-      m_tailPacketEnd = end;
-      NS_LOG_DEBUG ("Packet queued behind " << m_eventQueue.size () - 1 << " others. Start = " << start.GetSeconds () << "s, End = " << end.GetSeconds () << "s");
+      NS_LOG_DEBUG ("Packet queued behind " << m_delayLine.size () - 1 << " others. Start = " << start.GetSeconds () << "s, End = " << end.GetSeconds () << "s");
     }
   return true;
 }
 
 void
-DelayBoxFlow::Dequeue (Callback<void> send, const TcpHeader& tcpHeader)
+DelayBoxFlow::Dequeue ()
 {
   NS_ASSERT (!m_cancelled);
-  m_eventQueue.pop_front ();
-  send ();
-  /**
-   * When a packet with the FIN flag set arrives, we can basically
-   * forget about that connection.  DelayBoxFlow::Cancel() will drop
-   * all remaining packets in that queue, and mark itself as cancelled
-   * so that any subsequent packets (including the FIN+ACK) will not
-   * be delayed. This mimics the behavior of DelayBox in ns-2.
-   */
-  if (tcpHeader.GetFlags () & TcpHeader::FIN)
+  Time now = Simulator::Now ();
+  while (!m_delayLine.empty () && m_delayLine.front ().time <= now)
     {
-      Cancel ();
-      NS_LOG_DEBUG ("Flow cancelled by FIN.");
+      Departure departure = m_delayLine.front ();
+      m_delayLine.pop_front ();
+      departure.send ();
+      /**
+       * When a packet with the FIN flag set arrives, we can basically
+       * forget about that connection.  DelayBoxFlow::Cancel() will flush
+       * all remaining packets in that queue, and mark itself as cancelled
+       * so that any subsequent packets (including the FIN+ACK) will not
+       * be delayed. This mimics the behavior of DelayBox in ns-2.
+       */
+      if (departure.fin)
+        {
+          Cancel ();
+          NS_LOG_DEBUG ("Flow cancelled by FIN.");
+          return;
+        }
+    }
+  if (!m_delayLine.empty ())
+    {
+      m_departure = Simulator::Schedule (m_delayLine.front ().time - now,
+                                         &DelayBoxFlow::Dequeue, this);
     }
 }
 
 void
 DelayBoxFlow::Cancel ()
 {
-  // Prevent the simulator from executing any events that this flow
-  // has scheduled which are still pending.
-  for (std::deque<EventId>::iterator it = m_eventQueue.begin (); it
-       != m_eventQueue.end (); ++it)
-    {
-      Simulator::Cancel (*it);
-    }
-  m_eventQueue.clear ();
+  // Stop the pending departure and hand the remaining packets on
+  // right away.  Silently dropping them would leave the device that
+  // is holding them waiting forever, and they are mostly the other
+  // side's FIN/ACK anyway.
+  m_departure.Cancel ();
   m_tailPacketEnd = Seconds (0);
   m_cancelled = true;
+  // Keep the delay line's storage for the next flow Reset() starts here.
+  while (!m_delayLine.empty ())
+    {
+      Callback<void> send = m_delayLine.front ().send;
+      m_delayLine.pop_front ();
+      send ();
+    }
+  if (!m_cancelCallback.IsNull ())
+    {
+      Callback<void> cancelled = m_cancelCallback;
+      m_cancelCallback.Nullify ();
+      cancelled ();
+    }
 }
 
 void
@@ -451,10 +638,44 @@ DelayBox::AddRule (Ipv4Address src, Ipv4Address dst, const DelayBoxRule& rule)
 void
 DelayBox::AddRule (Ipv4Address src, uint16_t srcPort, Ipv4Address dst,
                    uint16_t dstPort, const DelayBoxRule& rule)
+{
+  AddRule (src, srcPort, dst, dstPort, rule, false);
+}
+
+void
+DelayBox::AddRule (Ipv4Address src, uint16_t srcPort, Ipv4Address dst,
+                   uint16_t dstPort, const DelayBoxRule& rule, bool expireWithFlow)
 {
   m_ruleTable.Add (DelayBoxRuleKey (src, srcPort, dst, dstPort, m_symmetric),
-                   rule);
+                   rule, expireWithFlow);
   NS_LOG_LOGIC ("Rule added: " << src << ":" << srcPort << " -> " << dst << ":" << dstPort);
 }
 
+void
+DelayBox::RemoveRule (Ipv4Address src, uint16_t srcPort, Ipv4Address dst,
+                      uint16_t dstPort)
+{
+  m_ruleTable.Remove (DelayBoxRuleKey (src, srcPort, dst, dstPort, m_symmetric));
+  NS_LOG_LOGIC ("Rule removed: " << src << ":" << srcPort << " -> " << dst << ":" << dstPort);
+}
+
+uint32_t
+DelayBox::GetNRules () const
+{
+  return m_ruleTable.GetNRules ();
+}
+
+uint32_t
+DelayBox::GetNFlows () const
+{
+  return m_flowTable.GetNFlows ();
+}
+
+void
+DelayBox::ExpireRule (DelayBoxRuleKey key, uint32_t id)
+{
+  NS_LOG_LOGIC ("Rule expired with its flow");
+  m_ruleTable.Remove (key, id);
+}
+
 }
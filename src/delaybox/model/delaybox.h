@@ -50,6 +50,7 @@
 #include "ns3/double.h"                                 //HJB
 
 #include <deque>
+#include <vector>
 
 namespace ns3 {
 
@@ -60,7 +61,9 @@ namespace ns3 {
  * \internal
  * \brief For internal use.
  *
- * Provides equality and a canonical sort order for DelayBoxRule lookups.
+ * Provides equality, a hash and a canonical sort order for
+ * DelayBoxRule lookups.  Each end is packed into one integer holding
+ * the address and the port.
  */
 class DelayBoxRuleKey
 {
@@ -72,20 +75,34 @@ public:
   operator< (const DelayBoxRuleKey& rhs) const;
   bool
   operator== (const DelayBoxRuleKey& rhs) const;
+  bool
+  operator!= (const DelayBoxRuleKey& rhs) const;
+
+  uint32_t
+  Hash () const;
+
+  /**
+   * \return which ports of the canonical key are wildcards: bit 0 for
+   * the first end, bit 1 for the second.
+   */
+  uint32_t
+  GetWildcards () const;
 
 private:
-  InetSocketAddress m_src;
-  InetSocketAddress m_dst;
+  uint64_t m_src;
+  uint64_t m_dst;
 };
 
 /**
  * \brief Delay, loss rate, and link speed.
  *
- * Contains three random variables, all of which are optional and default to zero:
+ * Contains three values, all of which are optional and default to zero:
  *  - delay (in seconds),
  *  - loss rate (between 0.0 and 1.0, defaults to 0),
  *  - bottleneck link speed (in bits per second; the default of 0 means
  *    there is no limit).
+ *
+ * Rules are plain values, cheap to copy into every flow they match.
  */
 class DelayBoxRule
 {
@@ -96,40 +113,39 @@ public:
    * \param linkSpeed Bottleneck link speed, in bits per second. A
    * value of zero indicates unlimited speed. Default 0.
    */
-  DelayBoxRule (const double delay = 0.0,                                //HJB
+  DelayBoxRule (const double delay = 0.0,
                 const double lossRate = 0.0,
                 const double linkSpeed = 0.0)
+    : m_delay (delay),
+      m_lossRate (lossRate),
+      m_linkSpeed (linkSpeed)
   {
-    m_delayRV = CreateObject<ConstantRandomVariable> ();
-    m_lossRateRV = CreateObject<ConstantRandomVariable> ();
-    m_linkSpeedRV = CreateObject<ConstantRandomVariable> ();
-    m_delayRV->SetAttribute ("Constant",DoubleValue (delay));
-    m_lossRateRV->SetAttribute ("Constant",DoubleValue (lossRate));
-    m_linkSpeedRV->SetAttribute ("Constant",DoubleValue (linkSpeed));
   }
 
-  const Ptr<ConstantRandomVariable>&
+  /// \return the delay, in seconds.
+  double
   GetDelay () const
   {
-    return m_delayRV;
+    return m_delay;
   }
 
-  const Ptr<ConstantRandomVariable>&
+  double
   GetLossRate () const
   {
-    return m_lossRateRV;
+    return m_lossRate;
   }
 
-  const Ptr<ConstantRandomVariable>&
+  /// \return the link speed, in bits per second, or 0 for no limit.
+  double
   GetLinkSpeed () const
   {
-    return m_linkSpeedRV;
+    return m_linkSpeed;
   }
 
 private:
-  Ptr<ConstantRandomVariable> m_delayRV;
-  Ptr<ConstantRandomVariable> m_lossRateRV;
-  Ptr<ConstantRandomVariable> m_linkSpeedRV;
+  double m_delay;
+  double m_lossRate;
+  double m_linkSpeed;
 };
 
 /**
@@ -137,19 +153,74 @@ private:
  * \brief For internal use.
  *
  * Matches a packet to a DelayBoxRule based on the source and destination.
+ *
+ * Rules live in a dense array indexed by an open addressing hash
+ * table with linear probing, so a lookup costs one probe per wildcard
+ * combination actually in use, and removing a rule gives its memory
+ * back.
  */
 class DelayBoxRuleTable
 {
 public:
+  struct Entry
+  {
+    DelayBoxRuleKey key;
+    DelayBoxRule rule;
+    /// Distinguishes this rule from earlier ones with the same key.
+    uint32_t id;
+    /// Whether the rule is removed once the flow it matched is cancelled.
+    bool expireWithFlow;
+  };
+
+  DelayBoxRuleTable ();
+
+  /**
+   * Add a rule, replacing any rule with the same key.
+   * \return the id of the new rule.
+   */
+  uint32_t
+  Add (DelayBoxRuleKey key, const DelayBoxRule& rule, bool expireWithFlow = false);
+
   void
-  Add (DelayBoxRuleKey key, const DelayBoxRule& rule);
+  Remove (DelayBoxRuleKey key);
 
-  bool
+  /**
+   * Remove the rule with the given key, unless it has been replaced
+   * since the rule with the given id was added.
+   */
+  void
+  Remove (DelayBoxRuleKey key, uint32_t id);
+
+  /**
+   * \return the most specific rule matching the packet, or 0.
+   */
+  const Entry*
   Lookup (Ipv4Address src, uint16_t srcPort, Ipv4Address dst, uint16_t dstPort,
-          bool symmetric, DelayBoxRule& out) const;
+          bool symmetric) const;
+
+  uint32_t
+  GetNRules () const
+  {
+    return m_entries.size ();
+  }
 
 private:
-  std::map<DelayBoxRuleKey, DelayBoxRule> m_rules;
+  /// \return the slot holding the key, or NO_SLOT.
+  uint32_t
+  Find (const DelayBoxRuleKey& key) const;
+  void
+  Erase (uint32_t slot);
+  void
+  Resize (uint32_t nSlots);
+
+  static const uint32_t NO_SLOT = 0xffffffff;
+
+  std::vector<Entry> m_entries;
+  /// Indices into m_entries, or NO_SLOT; the size is a power of two.
+  std::vector<uint32_t> m_slots;
+  /// Number of rules for each DelayBoxRuleKey::GetWildcards() value.
+  uint32_t m_nWildcards[4];
+  uint32_t m_nextId;
 };
 
 /**
@@ -159,9 +230,31 @@ private:
 class DelayBoxFlow
 {
 public:
-  DelayBoxFlow (const DelayBoxRule&);
+  /**
+   * An empty flow, already cancelled.
+   */
+  DelayBoxFlow ();
+  /**
+   * \param rule The flow's delay, loss rate and link speed.
+   * \param flowId Selects the flow's stream of loss samples; see Reset().
+   * \param stream Selects the stream of loss samples too; see Reset().
+   */
+  DelayBoxFlow (const DelayBoxRule& rule, uint32_t flowId = 0, uint64_t stream = 0);
+
+  /**
+   * Start a new flow in this cancelled one's place, reusing its
+   * storage.
+   *
+   * Packets are dropped according to a counter-based generator keyed
+   * by the simulation's seed and run number, by \p stream and by
+   * \p flowId, so the losses of a flow are reproducible and
+   * independent of how flows interleave, and starting a flow
+   * allocates nothing.  DelayBox passes its own stream number, so
+   * flows with the same id in two instances see different losses.
+   */
+  void
+  Reset (const DelayBoxRule& rule, uint32_t flowId, uint64_t stream = 0);
 
-  Ptr<UniformRandomVariable> rnd;               //HJB
   /**
    * Schedules sending this packet for some future time (or
    * immediately), depending on the parameters of this flow.
@@ -175,8 +268,16 @@ public:
   Enqueue (Callback<void> send, uint32_t packetSize, const TcpHeader& tcpHeader);
 
   /**
-   * Remove and drop all remaining packets in this flow's queue.
-   * After a call to Cancel(), it is an error to call any functions except Cancelled().
+   * Like Enqueue() above, given the TcpHeader::Flags_t bits of the
+   * packet instead of its header.
+   */
+  bool
+  Enqueue (Callback<void> send, uint32_t packetSize, uint8_t tcpFlags);
+
+  /**
+   * Send all remaining packets in this flow's queue immediately, in
+   * order, and stop delaying the flow.  After a call to Cancel(), it
+   * is an error to call any functions except Cancelled().
    */
   void
   Cancel ();
@@ -190,21 +291,63 @@ public:
     return m_cancelled;
   }
 
+  /**
+   * Set a callback to be called once, when the flow is cancelled.
+   */
+  void
+  SetCancelCallback (Callback<void> cancelled)
+  {
+    m_cancelCallback = cancelled;
+  }
+
 protected:
+  /**
+   * Send every packet at the head of the delay line that is due, then
+   * schedule the next departure, if any.
+   */
   void
-  Dequeue (Callback<void> send, const TcpHeader& tcpHeader);
+  Dequeue ();
 
 private:
+  /// A packet waiting in the delay line.
+  struct Departure
+  {
+    /// When the last bit of the packet has arrived.
+    Time time;
+    Callback<void> send;
+    /// Whether the packet carries a FIN.
+    bool fin;
+  };
+
+  /// \return the next sample of the flow's uniform [0, 1) stream.
+  double
+  NextUniform ();
+  /// A bijective 64 bit mixing function (the SplitMix64 finalizer).
+  static uint64_t
+  Mix (uint64_t x);
+
   Time m_delay;
   double m_lossRate;
   double m_linkSpeed;
+  /// Key of the loss samples, from the seed, run, stream and flow id.
+  uint64_t m_stream;
+  /// Number of loss samples drawn so far.
+  uint64_t m_counter;
   /**
    * The time that the last bit of the last packet in the "queue"
    * should be done transmitting.
    */
   Time m_tailPacketEnd;
-  std::deque<EventId> m_eventQueue;
+  /**
+   * Packets in order of departure.  The delay is constant for the
+   * whole flow, so packets leave in the order they arrived and only
+   * the head needs a simulator event.
+   */
+  std::deque<Departure> m_delayLine;
+  /// Dequeue event for the head of m_delayLine.
+  EventId m_departure;
   bool m_cancelled;
+  Callback<void> m_cancelCallback;
 };
 
 /**
@@ -214,20 +357,48 @@ private:
 class DelayBoxFlowTable
 {
 public:
-  DelayBoxFlowTable ()                                   //HJB
+  DelayBoxFlowTable ();
+
+  /**
+   * \return the flow with the given classifier index, or 0 if there
+   * is none yet.
+   */
+  DelayBoxFlow*
+  Find (uint32_t index);
+
+  /**
+   * Create the flow with the given classifier index and FlowId from
+   * the rule.
+   *
+   * \param stream Passed to DelayBoxFlow::Reset.
+   * \param cancelled Passed to DelayBoxFlow::SetCancelCallback.
+   */
+  DelayBoxFlow&
+  Add (uint32_t index, uint32_t flowId, uint64_t stream, const DelayBoxRule& rule,
+       Callback<void> cancelled);
+
+  /**
+   * Forget the flow with the given classifier index, sending any
+   * packets it still holds right away.
+   */
+  void
+  Evict (uint32_t index);
+
+  uint32_t
+  GetNFlows () const
   {
-    m_rng = CreateObject<UniformRandomVariable> ();
+    return m_nFlows;
   }
+
+private:
   /**
-   * \return true if the packet was enqueued or sent, false if it was
-   * dropped due to loss rate.
+   * Flows by TcpFlowClassifier index.  A deque never moves its
+   * elements as it grows, which the flows' pending events rely on.
    */
-  bool
-  Enqueue (uint32_t flowId, const DelayBoxRule& rule, Callback<void> send,
-           uint32_t packetSize, const TcpHeader& tcpHeader);
-private:
-  std::map<uint32_t, DelayBoxFlow> m_flows;
-  Ptr<UniformRandomVariable> m_rng;                     //HJB
+  std::deque<DelayBoxFlow> m_flows;
+  /// Whether each entry of m_flows holds a flow.
+  std::vector<bool> m_used;
+  uint32_t m_nFlows;
 };
 
 /**
@@ -256,7 +427,8 @@ public:
    * Calls send() at a later time, according to the packet's
    * classification and the configured rules.  If the packet does not
    * match any rules, or if it cannot be classified, send() is called
-   * immediately.
+   * immediately.  The packet is classified from its bytes; it is
+   * neither copied nor are its headers deserialized.
    *
    * \param send A bound callback which should send the packet on. It
    * will be scheduled to execute at the proper time.
@@ -267,8 +439,14 @@ public:
   bool
   Delay (Callback<void> send, Ptr<const Packet> packet);
 
-  //bool
-  //Delay (Callback<void> send, Ptr<const QueueDiscItem> item);
+  /**
+   * Like Delay() above, for a packet held by a queue disc.  The IPv4
+   * header is the one the Ipv4QueueDiscItem keeps, whether or not it
+   * has been added to the packet yet; items of other kinds are sent
+   * immediately.
+   */
+  bool
+  Delay (Callback<void> send, Ptr<const QueueDiscItem> item);
 
   /**
    * Use this to set up the delay parameters for your flows.
@@ -285,6 +463,25 @@ public:
   AddRule (Ipv4Address src, uint16_t srcPort, Ipv4Address dst, uint16_t dstPort,
            const DelayBoxRule& rule);
 
+  /**
+   * Like AddRule() above.  If \p expireWithFlow is true the rule is a
+   * one-shot rule: it is removed as soon as the first flow it matched
+   * is cancelled, i.e. once that connection has sent its FIN.  Use
+   * this for rules covering a single connection, so that the rule
+   * table does not keep growing over a long run.
+   */
+  void
+  AddRule (Ipv4Address src, uint16_t srcPort, Ipv4Address dst, uint16_t dstPort,
+           const DelayBoxRule& rule, bool expireWithFlow);
+
+  /**
+   * Remove a rule previously added with the same arguments, e.g. once
+   * the port it was added for is going to be reused.  Flows already
+   * classified under the rule keep their parameters.
+   */
+  void
+  RemoveRule (Ipv4Address src, uint16_t srcPort, Ipv4Address dst, uint16_t dstPort);
+
   /**
    * \brief Enable or disable symmetric mode.
    *
@@ -300,22 +497,57 @@ public:
    * side of a TCP conversation is a separate flow. To apply a delay
    * to both directions of a conversation in this mode, you must
    * manually add a rule in the reverse direction; even then, the
-   * reverse direction will still have its own sampling of random
-   * variables and its own bottleneck-link-speed packet queue.
+   * reverse direction will still have its own loss samples and its
+   * own bottleneck-link-speed packet queue.
    *
    * \param symmetric True to enable symmetric mode. False to disable it.
    */
   void
   SetSymmetric (bool symmetric);
 
+  /**
+   * Assign a fixed random variable stream number to the loss samples
+   * of this DelayBox.  Without it each instance draws a stream number
+   * of its own when it is created.
+   *
+   * \param stream first stream index to use
+   * \return the number of stream indices assigned by this model
+   */
+  int64_t
+  AssignStreams (int64_t stream);
+
+  /**
+   * \return the number of rules currently configured.
+   */
+  uint32_t
+  GetNRules () const;
+
+  /**
+   * \return the number of flows DelayBox currently delays or remembers.
+   */
+  uint32_t
+  GetNFlows () const;
+
 private:
+  /// Classify a TCP packet by its addresses, ports and flags, and
+  /// delay it according to its flow.
   bool
-  Classify (const Ipv4Header& ipHeader, Ptr<const Packet> ipPayload,
-            uint32_t* flowId, uint32_t* packetId);
+  Delay (Callback<void> send, Ipv4Address source, Ipv4Address destination,
+         const TcpPortView& tcp, uint32_t packetSize);
+
+  /// Cancel callback of flows matched by a rule that expires with its flow.
+  void
+  ExpireRule (DelayBoxRuleKey key, uint32_t id);
+
+  /// Evict callback of the classifier.
+  void
+  FlowEvicted (uint32_t index, FlowId flowId);
 
   bool m_symmetric;
-  TcpFlowClassifier m_symmetricClassifier;
-  Ipv4FlowClassifier m_asymmetricClassifier;
+  /// Stream number keying the loss samples of this instance's flows.
+  uint64_t m_stream;
+  /// Classifies packets in either mode; its flow indices index m_flowTable.
+  TcpFlowClassifier m_classifier;
   DelayBoxRuleTable m_ruleTable;
   DelayBoxFlowTable m_flowTable;
 };
@@ -40,13 +40,55 @@
 
 #include "ns3/tcp-header.h"
 #include "ns3/packet.h"
+#include "ns3/simulator.h"
+#include "ns3/log.h"
 
 namespace ns3 {
 
+NS_LOG_COMPONENT_DEFINE ("TcpFlowClassifier");
+
 const uint8_t TCP_PROT_NUMBER = 6;
 
-TcpFlowClassifier::TcpFlowClassifier ()
+const uint32_t TcpFlowClassifier::NO_SLOT;
+
+TcpFlowClassifier::TcpFlowClassifier (bool symmetric)
+  : m_symmetric (symmetric),
+    m_finTimeout (Seconds (10)),
+    m_idleTimeout (Seconds (300)),
+    m_slots (16, NO_SLOT)
+{
+}
+
+void
+TcpFlowClassifier::SetSymmetric (bool symmetric)
+{
+  NS_ASSERT_MSG (symmetric == m_symmetric || m_flows.empty (),
+                 "Symmetric mode changed after classifying packets");
+  m_symmetric = symmetric;
+}
+
+void
+TcpFlowClassifier::SetFinTimeout (Time timeout)
+{
+  m_finTimeout = timeout;
+}
+
+void
+TcpFlowClassifier::SetIdleTimeout (Time timeout)
+{
+  m_idleTimeout = timeout;
+}
+
+void
+TcpFlowClassifier::SetEvictCallback (Callback<void, uint32_t, FlowId> evicted)
+{
+  m_evicted = evicted;
+}
+
+uint32_t
+TcpFlowClassifier::GetNFlows () const
 {
+  return m_flows.size () - m_freeIndices.size ();
 }
 
 bool
@@ -62,69 +104,277 @@ TcpFlowClassifier::Classify (const Ipv4Header& ipHeader,
   return Classify (ipHeader, tcpHeader, out_flowId, out_packetId);
 }
 
+const uint32_t TcpPortView::SIZE;
+
+TcpPortView
+TcpPortView::Read (const uint8_t *buffer)
+{
+  TcpPortView view;
+  view.sourcePort = (uint16_t (buffer[0]) << 8) | buffer[1];
+  view.destinationPort = (uint16_t (buffer[2]) << 8) | buffer[3];
+  // Data offset and reserved bits in byte 12, the flags in byte 13.
+  view.flags = buffer[13];
+  return view;
+}
+
+TcpPortView
+TcpPortView::FromHeader (const TcpHeader& tcpHeader)
+{
+  TcpPortView view;
+  view.sourcePort = tcpHeader.GetSourcePort ();
+  view.destinationPort = tcpHeader.GetDestinationPort ();
+  view.flags = tcpHeader.GetFlags ();
+  return view;
+}
+
 bool
 TcpFlowClassifier::Classify (const Ipv4Header& ipHeader,
-                             const TcpHeader& tcpHeader, uint32_t *out_flowId, uint32_t *out_packetId)
+                             const TcpHeader& tcpHeader, uint32_t *out_flowId, uint32_t *out_packetId,
+                             uint32_t *out_index)
 {
   if (ipHeader.GetProtocol () != TCP_PROT_NUMBER)
     {
       return false;
     }
-  if (ipHeader.GetDestination () == Ipv4Address::GetBroadcast ())
+  if (!Classify (ipHeader.GetSource (), ipHeader.GetDestination (),
+                 TcpPortView::FromHeader (tcpHeader), out_flowId, out_index))
+    {
+      return false;
+    }
+  if (out_packetId)
+    {
+      *out_packetId = ipHeader.GetIdentification ();
+    }
+  return true;
+}
+
+bool
+TcpFlowClassifier::Classify (Ipv4Address source, Ipv4Address destination,
+                             const TcpPortView& tcp, uint32_t *out_flowId, uint32_t *out_index)
+{
+  if (destination == Ipv4Address::GetBroadcast ())
     {
       // we are not prepared to handle broadcast
       return false;
     }
 
-  TwoTuple node1;
-  TwoTuple node2;
-  node1.first = ipHeader.GetSource ();
-  node1.second = tcpHeader.GetSourcePort ();
-  node2.first = ipHeader.GetDestination ();
-  node2.second = tcpHeader.GetDestinationPort ();
+  Time now = Simulator::Now ();
+  ExpireFlows (now);
+
+  uint64_t first = (uint64_t (source.Get ()) << 16) | tcp.sourcePort;
+  uint64_t second = (uint64_t (destination.Get ()) << 16) | tcp.destinationPort;
   // sort the tuple into some canonical order so that both directions
   // map to the same flow id
-  if (node2 < node1)
+  if (m_symmetric && second < first)
     {
-      std::swap (node1, node2);
+      std::swap (first, second);
     }
-  FourTuple tuple;
-  tuple.first = node1;
-  tuple.second = node2;
 
-  // try to insert the tuple, but check if it already exists
-  std::pair<std::map<FourTuple, FlowId>::iterator, bool> insert =
-    m_flowMap.insert (std::pair<FourTuple, FlowId> (tuple, 0));
+  uint8_t flags = tcp.flags;
+  uint32_t slot = Find (first, second);
+  uint32_t index;
+  if (slot == NO_SLOT)
+    {
+      index = Insert (first, second);
+    }
+  else if (m_flows[m_slots[slot]].finished && (flags & TcpHeader::SYN))
+    {
+      // A new connection on the 4-tuple of one that has been closed.
+      NS_LOG_LOGIC ("SYN after FIN; flow " << m_flows[m_slots[slot]].flowId << " replaced.");
+      Evict (m_slots[slot]);
+      index = Insert (first, second);
+    }
+  else
+    {
+      index = m_slots[slot];
+    }
 
-  // if the insertion succeeded, we need to assign this tuple a new flow identifier
-  if (insert.second)
+  Flow& flow = m_flows[index];
+  flow.lastSeen = now;
+  if ((flags & TcpHeader::FIN) && !flow.finished)
     {
-      insert.first->second = GetNewFlowId ();
+      flow.finished = true;
+      Expiry expiry = { now + m_finTimeout, index, flow.flowId };
+      m_finExpiries.push_back (expiry);
     }
 
   if (out_flowId)
     {
-      *out_flowId = insert.first->second;
+      *out_flowId = flow.flowId;
     }
-  if (out_packetId)
+  if (out_index)
     {
-      *out_packetId = ipHeader.GetIdentification ();
+      *out_index = index;
     }
 
   return true;
 }
 
+uint32_t
+TcpFlowClassifier::Hash (uint64_t first, uint64_t second)
+{
+  uint64_t h = first * 0x9e3779b97f4a7c15ULL ^ second;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return static_cast<uint32_t> (h);
+}
+
+uint32_t
+TcpFlowClassifier::Find (uint64_t first, uint64_t second) const
+{
+  uint32_t mask = m_slots.size () - 1;
+  for (uint32_t i = Hash (first, second) & mask; m_slots[i] != NO_SLOT; i = (i + 1) & mask)
+    {
+      const Flow& flow = m_flows[m_slots[i]];
+      if (flow.first == first && flow.second == second)
+        {
+          return i;
+        }
+    }
+  return NO_SLOT;
+}
+
+uint32_t
+TcpFlowClassifier::Insert (uint64_t first, uint64_t second)
+{
+  // Keep the load factor at or below one half so probe runs stay short.
+  if (2 * (GetNFlows () + 1) > m_slots.size ())
+    {
+      Resize (2 * m_slots.size ());
+    }
+  uint32_t index;
+  if (m_freeIndices.empty ())
+    {
+      index = m_flows.size ();
+      m_flows.push_back (Flow ());
+    }
+  else
+    {
+      index = m_freeIndices.back ();
+      m_freeIndices.pop_back ();
+    }
+  Flow& flow = m_flows[index];
+  flow.first = first;
+  flow.second = second;
+  flow.flowId = GetNewFlowId ();
+  flow.finished = false;
+  flow.used = true;
+
+  uint32_t mask = m_slots.size () - 1;
+  uint32_t i = Hash (first, second) & mask;
+  while (m_slots[i] != NO_SLOT)
+    {
+      i = (i + 1) & mask;
+    }
+  m_slots[i] = index;
+
+  Expiry expiry = { Simulator::Now () + m_idleTimeout, index, flow.flowId };
+  m_idleExpiries.push_back (expiry);
+  return index;
+}
+
+void
+TcpFlowClassifier::Evict (uint32_t index)
+{
+  Flow& flow = m_flows[index];
+  NS_ASSERT (flow.used);
+  uint32_t slot = Find (flow.first, flow.second);
+  NS_ASSERT (slot != NO_SLOT);
+
+  // Shift later members of the probe run back over the hole, so that
+  // no tombstones are needed.
+  uint32_t mask = m_slots.size () - 1;
+  uint32_t hole = slot;
+  for (uint32_t i = (slot + 1) & mask; m_slots[i] != NO_SLOT; i = (i + 1) & mask)
+    {
+      const Flow& other = m_flows[m_slots[i]];
+      uint32_t home = Hash (other.first, other.second) & mask;
+      // Move the entry unless its home slot lies cyclically in (hole, i].
+      if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+          m_slots[hole] = m_slots[i];
+          hole = i;
+        }
+    }
+  m_slots[hole] = NO_SLOT;
+
+  flow.used = false;
+  m_freeIndices.push_back (index);
+  NS_LOG_LOGIC ("Flow " << flow.flowId << " evicted; " << GetNFlows () << " remain.");
+  if (!m_evicted.IsNull ())
+    {
+      m_evicted (index, flow.flowId);
+    }
+}
+
+void
+TcpFlowClassifier::Resize (uint32_t nSlots)
+{
+  m_slots.assign (nSlots, NO_SLOT);
+  uint32_t mask = nSlots - 1;
+  for (uint32_t index = 0; index < m_flows.size (); index++)
+    {
+      if (!m_flows[index].used)
+        {
+          continue;
+        }
+      uint32_t i = Hash (m_flows[index].first, m_flows[index].second) & mask;
+      while (m_slots[i] != NO_SLOT)
+        {
+          i = (i + 1) & mask;
+        }
+      m_slots[i] = index;
+    }
+}
+
+void
+TcpFlowClassifier::ExpireFlows (Time now)
+{
+  // An entry is stale if its flow has been evicted (and maybe the
+  // index reused) in the meantime; the FlowId tells them apart.
+  while (!m_finExpiries.empty () && m_finExpiries.front ().time <= now)
+    {
+      Expiry expiry = m_finExpiries.front ();
+      m_finExpiries.pop_front ();
+      const Flow& flow = m_flows[expiry.index];
+      if (flow.used && flow.flowId == expiry.flowId)
+        {
+          Evict (expiry.index);
+        }
+    }
+  while (!m_idleExpiries.empty () && m_idleExpiries.front ().time <= now)
+    {
+      Expiry expiry = m_idleExpiries.front ();
+      m_idleExpiries.pop_front ();
+      const Flow& flow = m_flows[expiry.index];
+      if (!flow.used || flow.flowId != expiry.flowId)
+        {
+          continue;
+        }
+      if (flow.lastSeen + m_idleTimeout <= now)
+        {
+          Evict (expiry.index);
+        }
+      else
+        {
+          expiry.time = flow.lastSeen + m_idleTimeout;
+          m_idleExpiries.push_back (expiry);
+        }
+    }
+}
+
 bool
 TcpFlowClassifier::FindFlow (FlowId flowId, FourTuple* out) const
 {
-  for (std::map<FourTuple, FlowId>::const_iterator i = m_flowMap.begin (); i
-       != m_flowMap.end (); ++i)
+  for (std::vector<Flow>::const_iterator i = m_flows.begin (); i != m_flows.end (); ++i)
     {
-      if (i->second == flowId)
+      if (i->used && i->flowId == flowId)
         {
           if (out)
             {
-              *out = i->first;
+              out->first = TwoTuple (Ipv4Address (uint32_t (i->first >> 16)), uint16_t (i->first));
+              out->second = TwoTuple (Ipv4Address (uint32_t (i->second >> 16)), uint16_t (i->second));
             }
           return true;
         }
@@ -41,10 +41,44 @@
 
 #include "ns3/tcp-header.h"
 #include "ns3/ipv4-flow-classifier.h"
+#include "ns3/nstime.h"
+#include "ns3/callback.h"
+
+#include <deque>
+#include <vector>
 
 namespace ns3 {
 
-// TODO: have this watch for FINs to make sure that we don't erroneously reuse a flow id in the event that a new conversation is started on the same ports
+/**
+ * \brief The few TCP header fields flow classification looks at.
+ *
+ * Read straight from the bytes of a serialized TCP header, so that a
+ * packet can be classified without copying it or deserializing its
+ * headers.
+ */
+struct TcpPortView
+{
+  /// Size of the prefix of a TCP header that Read() looks at.
+  static const uint32_t SIZE = 14;
+
+  uint16_t sourcePort;
+  uint16_t destinationPort;
+  /// The TcpHeader::Flags_t bits.
+  uint8_t flags;
+
+  /**
+   * \param buffer At least SIZE bytes, starting with a TCP header.
+   * \return the view of that header.
+   */
+  static TcpPortView
+  Read (const uint8_t *buffer);
+
+  /**
+   * \return the view of an already deserialized header.
+   */
+  static TcpPortView
+  FromHeader (const TcpHeader& tcpHeader);
+};
 
 /**
  * \brief Like Ipv4FlowClassifier, but sorts both sides of a TCP conversation into a single flow ID.
@@ -53,7 +87,22 @@ namespace ns3 {
  * source-port, destination-port) is extracted from the packet
  * headers, and a unique flow identified is assigned to each
  * tuple. TcpFlowClassifier sorts this tuple so that packets traveling
- * in both directions are mapped to the same flow ID.
+ * in both directions are mapped to the same flow ID, unless symmetric
+ * mode is disabled.
+ *
+ * Flows are kept in an open addressing hash table on the packed
+ * 4-tuple, and forgotten again: a flow is evicted a while after its
+ * first FIN (see SetFinTimeout), when it has been idle for too long
+ * (see SetIdleTimeout), or right away when a SYN starts a new
+ * connection on the same 4-tuple after a FIN.  A new connection thus
+ * never inherits the flow ID of an old one, and memory follows the
+ * number of concurrent flows rather than the number of flows ever
+ * seen.
+ *
+ * Besides its FlowId, every flow has an index which stays the same
+ * while the flow lives and is reused after it has been evicted.  The
+ * indices are dense, so users can keep per-flow state in an array;
+ * see SetEvictCallback.
  *
  * \see Ipv4FlowClassifier
  */
@@ -63,7 +112,11 @@ public:
   typedef std::pair<Ipv4Address, uint16_t> TwoTuple;
   typedef std::pair<TwoTuple, TwoTuple> FourTuple;
 
-  TcpFlowClassifier ();
+  /**
+   * \param symmetric Whether both directions of a conversation map to
+   * the same flow.
+   */
+  TcpFlowClassifier (bool symmetric = true);
 
   /**
    * Try to classify the packet into a flow, creating a new flow if it
@@ -91,13 +144,31 @@ public:
    * \param out_flowId If not null, the packet's flow id will be written here on success.
    * \param out_packetId If not null, the packet's id (unique within
    * the flow) will be written here on success.
+   * \param out_index If not null, the flow's index will be written here on success.
    * \return true if the packet was successfully classified (either
    * into an existing flow or a new one), false if it could not be
    * classified for some reason.
    */
   bool
   Classify (const Ipv4Header& ipHeader, const TcpHeader& tcpHeader,
-            uint32_t *out_flowId, uint32_t *out_packetId);
+            uint32_t *out_flowId, uint32_t *out_packetId, uint32_t *out_index = 0);
+
+  /**
+   * Like Classify() above, for a TCP packet whose addresses and ports
+   * have already been picked out of its headers.  The caller must
+   * have checked that the packet is TCP.
+   *
+   * \param source The packet's IP source address.
+   * \param destination The packet's IP destination address.
+   * \param tcp The packet's ports and flags.
+   * \param out_flowId If not null, the packet's flow id will be written here on success.
+   * \param out_index If not null, the flow's index will be written here on success.
+   * \return true if the packet was successfully classified, false if
+   * it could not be classified for some reason.
+   */
+  bool
+  Classify (Ipv4Address source, Ipv4Address destination, const TcpPortView& tcp,
+            uint32_t *out_flowId, uint32_t *out_index);
 
   /**
    * Searches for the FourTuple corresponding to the given flowId.
@@ -109,6 +180,40 @@ public:
   bool
   FindFlow (FlowId flowId, FourTuple* out) const;
 
+  /**
+   * Change the symmetric mode.  Only call this before the first packet
+   * is classified.
+   */
+  void
+  SetSymmetric (bool symmetric);
+
+  /**
+   * How long a flow is kept after its first FIN, so that stray packets
+   * of the closing connection still find it.  Default: 10 seconds.
+   */
+  void
+  SetFinTimeout (Time timeout);
+
+  /**
+   * How long a flow is kept without seeing any packets.  Default: 300
+   * seconds.
+   */
+  void
+  SetIdleTimeout (Time timeout);
+
+  /**
+   * Set a callback to be called with the index and FlowId of each
+   * flow that is evicted, before its index can be reused.
+   */
+  void
+  SetEvictCallback (Callback<void, uint32_t, FlowId> evicted);
+
+  /**
+   * \return the number of flows currently known.
+   */
+  uint32_t
+  GetNFlows () const;
+
   /**
    * FIXME: Not implemented.
    */
@@ -116,8 +221,58 @@ public:
   SerializeToXmlStream (std::ostream &os, int indent) const;
 
 private:
-  std::map<FourTuple, FlowId> m_flowMap;
+  struct Flow
+  {
+    /// Packed (address, port) of the two ends, in canonical order if symmetric.
+    uint64_t first;
+    uint64_t second;
+    FlowId flowId;
+    Time lastSeen;
+    /// Whether a FIN has been seen.
+    bool finished;
+    /// Whether this entry holds a flow, rather than being on the free list.
+    bool used;
+  };
+
+  /// A flow to look at again once the given time has come.
+  struct Expiry
+  {
+    Time time;
+    uint32_t index;
+    FlowId flowId;
+  };
+
+  static uint32_t
+  Hash (uint64_t first, uint64_t second);
+  /// \return the slot holding the flow, or NO_SLOT.
+  uint32_t
+  Find (uint64_t first, uint64_t second) const;
+  uint32_t
+  Insert (uint64_t first, uint64_t second);
+  void
+  Evict (uint32_t index);
+  void
+  Resize (uint32_t nSlots);
+  /// Evict the flows whose FIN or idle timeout has passed.
+  void
+  ExpireFlows (Time now);
+
+  static const uint32_t NO_SLOT = 0xffffffff;
 
+  bool m_symmetric;
+  Time m_finTimeout;
+  Time m_idleTimeout;
+  /// Flows by index.
+  std::vector<Flow> m_flows;
+  /// Unused indices in m_flows.
+  std::vector<uint32_t> m_freeIndices;
+  /// Indices into m_flows, or NO_SLOT; the size is a power of two.
+  std::vector<uint32_t> m_slots;
+  /// Flows to check for the FIN timeout, in order of time.
+  std::deque<Expiry> m_finExpiries;
+  /// Flows to check for the idle timeout, roughly in order of time.
+  std::deque<Expiry> m_idleExpiries;
+  Callback<void, uint32_t, FlowId> m_evicted;
 };
 
 }
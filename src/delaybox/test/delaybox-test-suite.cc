@@ -1,55 +1,866 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
-// Include a header file from your module to test.
 #include "ns3/delaybox.h"
-
-// An essential include is test.h
+#include "ns3/delaybox-net-device.h"
+#include "ns3/tcp-flow-classifier.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/drop-tail-queue.h"
+#include "ns3/tcp-socket-factory.h"
+#include "ns3/traffic-control-helper.h"
 #include "ns3/test.h"
 
-// Do not put your test classes in namespace ns3.  You may find it useful
-// to use the using directive to access the ns3 namespace directly
+#include <vector>
+
 using namespace ns3;
 
-// This is an example TestCase.
-class DelayboxTestCase1 : public TestCase
+class DelayBoxFlowTestCase : public TestCase
+{
+public:
+  DelayBoxFlowTestCase ();
+  virtual ~DelayBoxFlowTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Record (void);
+
+  std::vector<Time> m_sendTimes;
+};
+
+DelayBoxFlowTestCase::DelayBoxFlowTestCase ()
+  : TestCase ("Per-flow delay, link speed, loss and FIN flushing")
+{
+}
+
+DelayBoxFlowTestCase::~DelayBoxFlowTestCase ()
+{
+}
+
+void
+DelayBoxFlowTestCase::Record (void)
+{
+  m_sendTimes.push_back (Simulator::Now ());
+}
+
+void
+DelayBoxFlowTestCase::DoRun (void)
+{
+  TcpHeader data;
+  data.SetFlags (TcpHeader::ACK);
+  TcpHeader fin;
+  fin.SetFlags (TcpHeader::FIN | TcpHeader::ACK);
+  Callback<void> record = MakeCallback (&DelayBoxFlowTestCase::Record, this);
+
+  // 50 ms delay, 8 Mb/s: a 1000 byte packet takes 1 ms to transfer.
+  DelayBoxFlow flow (DelayBoxRule (0.05, 0.0, 8e6));
+  NS_TEST_ASSERT_MSG_EQ (flow.Enqueue (record, 1000, data), true, "Lossless flow dropped a packet");
+  NS_TEST_ASSERT_MSG_EQ (flow.Enqueue (record, 1000, data), true, "Lossless flow dropped a packet");
+  NS_TEST_ASSERT_MSG_EQ (flow.Enqueue (record, 1000, fin), true, "Lossless flow dropped a packet");
+  NS_TEST_ASSERT_MSG_EQ (flow.Enqueue (record, 1000, data), true, "Lossless flow dropped a packet");
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_sendTimes.size (), 4, "Every packet should have been sent");
+  NS_TEST_ASSERT_MSG_EQ_TOL (m_sendTimes[0], MilliSeconds (51), NanoSeconds (1), "First packet: delay plus transfer");
+  NS_TEST_ASSERT_MSG_EQ_TOL (m_sendTimes[1], MilliSeconds (52), NanoSeconds (1), "Second packet queues behind the first");
+  NS_TEST_ASSERT_MSG_EQ_TOL (m_sendTimes[2], MilliSeconds (53), NanoSeconds (1), "FIN queues behind the second");
+  NS_TEST_ASSERT_MSG_EQ_TOL (m_sendTimes[3], MilliSeconds (53), NanoSeconds (1), "Packet behind the FIN is flushed with it");
+  NS_TEST_ASSERT_MSG_EQ (flow.Cancelled (), true, "FIN should cancel the flow");
+
+  DelayBoxFlow lossy (DelayBoxRule (0.05, 1.0));
+  NS_TEST_ASSERT_MSG_EQ (lossy.Enqueue (record, 1000, data), false, "Flow with loss rate 1 should drop");
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (m_sendTimes.size (), 4, "Dropped packet should not be sent");
+
+  // Losses depend only on the run, the stream and the flow id.
+  DelayBoxRule halfLoss (0.05, 0.5);
+  DelayBoxFlow first (halfLoss, 7);
+  DelayBoxFlow again (halfLoss, 7);
+  DelayBoxFlow other (halfLoss, 8);
+  uint32_t nDropped = 0;
+  uint32_t nDifferent = 0;
+  for (uint32_t i = 0; i < 1000; i++)
+    {
+      bool sent = first.Enqueue (record, 1000, data);
+      NS_TEST_ASSERT_MSG_EQ (again.Enqueue (record, 1000, data), sent, "Same flow id, different losses");
+      nDropped += !sent;
+      nDifferent += other.Enqueue (record, 1000, data) != sent;
+    }
+  NS_TEST_ASSERT_MSG_EQ_TOL (nDropped, 500, 60, "Loss rate not honoured");
+  NS_TEST_ASSERT_MSG_GT (nDifferent, 0, "Different flows should see different losses");
+  Simulator::Run ();
+
+  Simulator::Destroy ();
+}
+
+/**
+ * Exercises the hashed rule table directly: wildcard precedence,
+ * symmetric keys, replacement, and removal while the table grows and
+ * shrinks again.
+ */
+class DelayBoxRuleTableTestCase : public TestCase
+{
+public:
+  DelayBoxRuleTableTestCase ();
+  virtual ~DelayBoxRuleTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+  double LookupDelay (const DelayBoxRuleTable& table, Ipv4Address src, uint16_t srcPort,
+                      Ipv4Address dst, uint16_t dstPort, bool symmetric);
+};
+
+DelayBoxRuleTableTestCase::DelayBoxRuleTableTestCase ()
+  : TestCase ("Rule table lookup, replacement and removal")
+{
+}
+
+DelayBoxRuleTableTestCase::~DelayBoxRuleTableTestCase ()
+{
+}
+
+double
+DelayBoxRuleTableTestCase::LookupDelay (const DelayBoxRuleTable& table, Ipv4Address src,
+                                        uint16_t srcPort, Ipv4Address dst, uint16_t dstPort,
+                                        bool symmetric)
+{
+  const DelayBoxRuleTable::Entry* entry = table.Lookup (src, srcPort, dst, dstPort, symmetric);
+  return entry ? entry->rule.GetDelay () : -1;
+}
+
+void
+DelayBoxRuleTableTestCase::DoRun (void)
+{
+  Ipv4Address a ("10.0.0.1");
+  Ipv4Address b ("10.0.0.2");
+
+  DelayBoxRuleTable table;
+  NS_TEST_ASSERT_MSG_EQ (LookupDelay (table, a, 1000, b, 80, false), -1, "Empty table matched");
+  table.Add (DelayBoxRuleKey (a, 0, b, 0, false), DelayBoxRule (1));
+  table.Add (DelayBoxRuleKey (a, 0, b, 80, false), DelayBoxRule (2));
+  table.Add (DelayBoxRuleKey (a, 1000, b, 80, false), DelayBoxRule (3));
+  NS_TEST_ASSERT_MSG_EQ (LookupDelay (table, a, 1000, b, 80, false), 3, "Exact rule should win");
+  NS_TEST_ASSERT_MSG_EQ (LookupDelay (table, a, 1001, b, 80, false), 2, "Destination port rule should win");
+  NS_TEST_ASSERT_MSG_EQ (LookupDelay (table, a, 1001, b, 81, false), 1, "Address rule should match");
+  NS_TEST_ASSERT_MSG_EQ (LookupDelay (table, b, 80, a, 1000, false), -1, "Asymmetric rule matched the reverse direction");
+  table.Add (DelayBoxRuleKey (a, 0, b, 80, false), DelayBoxRule (4));
+  NS_TEST_ASSERT_MSG_EQ (LookupDelay (table, a, 1001, b, 80, false), 4, "Newer rule should replace the old one");
+  NS_TEST_ASSERT_MSG_EQ (table.GetNRules (), 3, "Replacing a rule should not add one");
+
+  DelayBoxRuleTable symmetric;
+  symmetric.Add (DelayBoxRuleKey (a, 0, b, 80, true), DelayBoxRule (5));
+  NS_TEST_ASSERT_MSG_EQ (LookupDelay (symmetric, a, 1000, b, 80, true), 5, "Symmetric rule, forward direction");
+  NS_TEST_ASSERT_MSG_EQ (LookupDelay (symmetric, b, 80, a, 1000, true), 5, "Symmetric rule, reverse direction");
+
+  // One rule per connection, as Tmix adds them, then remove every other one.
+  const uint16_t nRules = 2000;
+  DelayBoxRuleTable perPort;
+  uint32_t firstId = perPort.Add (DelayBoxRuleKey (a, 0, b, 1, false), DelayBoxRule (1));
+  for (uint16_t port = 2; port <= nRules; port++)
+    {
+      perPort.Add (DelayBoxRuleKey (a, 0, b, port, false), DelayBoxRule (port));
+    }
+  NS_TEST_ASSERT_MSG_EQ (perPort.GetNRules (), nRules, "Wrong number of rules");
+  perPort.Add (DelayBoxRuleKey (a, 0, b, 1, false), DelayBoxRule (1));
+  perPort.Remove (DelayBoxRuleKey (a, 0, b, 1, false), firstId);
+  NS_TEST_ASSERT_MSG_EQ (LookupDelay (perPort, a, 5000, b, 1, false), 1, "Stale id removed a newer rule");
+  for (uint16_t port = 2; port <= nRules; port += 2)
+    {
+      perPort.Remove (DelayBoxRuleKey (a, 0, b, port, false));
+    }
+  NS_TEST_ASSERT_MSG_EQ (perPort.GetNRules (), nRules / 2, "Wrong number of rules after removal");
+  for (uint16_t port = 1; port <= nRules; port++)
+    {
+      double expected = port % 2 ? port : -1;
+      NS_TEST_ASSERT_MSG_EQ (LookupDelay (perPort, a, 5000, b, port, false), expected,
+                             "Wrong rule for port " << port);
+    }
+  for (uint16_t port = 1; port <= nRules; port += 2)
+    {
+      perPort.Remove (DelayBoxRuleKey (a, 0, b, port, false));
+    }
+  NS_TEST_ASSERT_MSG_EQ (perPort.GetNRules (), 0, "Rules left after removing them all");
+  NS_TEST_ASSERT_MSG_EQ (LookupDelay (perPort, a, 5000, b, 1, false), -1, "Removed rule matched");
+}
+
+/**
+ * Flow ids for both directions, eviction after FIN and idle timeouts,
+ * and a fresh flow for a new connection on a closed 4-tuple.
+ */
+class TcpFlowClassifierTestCase : public TestCase
+{
+public:
+  TcpFlowClassifierTestCase ();
+  virtual ~TcpFlowClassifierTestCase ();
+
+private:
+  virtual void DoRun (void);
+  uint32_t Classify (TcpFlowClassifier& classifier, Ipv4Address src, uint16_t srcPort,
+                     Ipv4Address dst, uint16_t dstPort, uint8_t flags);
+  void Evicted (uint32_t index, FlowId flowId);
+
+  uint32_t m_nEvicted;
+};
+
+TcpFlowClassifierTestCase::TcpFlowClassifierTestCase ()
+  : TestCase ("TCP flow classification and eviction")
+{
+}
+
+TcpFlowClassifierTestCase::~TcpFlowClassifierTestCase ()
+{
+}
+
+uint32_t
+TcpFlowClassifierTestCase::Classify (TcpFlowClassifier& classifier, Ipv4Address src,
+                                     uint16_t srcPort, Ipv4Address dst, uint16_t dstPort,
+                                     uint8_t flags)
+{
+  Ipv4Header ipHeader;
+  ipHeader.SetSource (src);
+  ipHeader.SetDestination (dst);
+  ipHeader.SetProtocol (6);
+  TcpHeader tcpHeader;
+  tcpHeader.SetSourcePort (srcPort);
+  tcpHeader.SetDestinationPort (dstPort);
+  tcpHeader.SetFlags (flags);
+  uint32_t flowId = 0;
+  classifier.Classify (ipHeader, tcpHeader, &flowId, 0);
+  return flowId;
+}
+
+void
+TcpFlowClassifierTestCase::Evicted (uint32_t index, FlowId flowId)
+{
+  m_nEvicted++;
+}
+
+void
+TcpFlowClassifierTestCase::DoRun (void)
+{
+  m_nEvicted = 0;
+  Ipv4Address a ("10.0.0.1");
+  Ipv4Address b ("10.0.0.2");
+
+  TcpFlowClassifier symmetric;
+  symmetric.SetEvictCallback (MakeCallback (&TcpFlowClassifierTestCase::Evicted, this));
+  symmetric.SetFinTimeout (Seconds (1));
+  symmetric.SetIdleTimeout (Seconds (10));
+  uint32_t flow = Classify (symmetric, a, 1000, b, 80, TcpHeader::SYN);
+  NS_TEST_ASSERT_MSG_EQ (Classify (symmetric, b, 80, a, 1000, TcpHeader::SYN | TcpHeader::ACK), flow,
+                         "Both directions should share a flow");
+  uint32_t other = Classify (symmetric, a, 1001, b, 80, TcpHeader::SYN);
+  NS_TEST_ASSERT_MSG_NE (other, flow, "Different ports should be different flows");
+  NS_TEST_ASSERT_MSG_EQ (Classify (symmetric, a, 1000, b, 80, TcpHeader::FIN | TcpHeader::ACK), flow,
+                         "FIN belongs to the flow");
+  NS_TEST_ASSERT_MSG_EQ (Classify (symmetric, b, 80, a, 1000, TcpHeader::ACK), flow,
+                         "Packets right after a FIN still belong to the flow");
+  uint32_t reused = Classify (symmetric, a, 1000, b, 80, TcpHeader::SYN);
+  NS_TEST_ASSERT_MSG_NE (reused, flow, "A new connection after a FIN should get a new flow");
+  NS_TEST_ASSERT_MSG_EQ (m_nEvicted, 1, "The closed flow should have been evicted");
+  NS_TEST_ASSERT_MSG_EQ (symmetric.GetNFlows (), 2, "Wrong number of flows");
+
+  Classify (symmetric, a, 1000, b, 80, TcpHeader::FIN | TcpHeader::ACK);
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+  Classify (symmetric, a, 1001, b, 80, TcpHeader::ACK);
+  NS_TEST_ASSERT_MSG_EQ (symmetric.GetNFlows (), 1, "Flow should be evicted after the FIN timeout");
+  Simulator::Stop (Seconds (9));
+  Simulator::Run ();
+  Classify (symmetric, a, 2000, b, 80, TcpHeader::SYN);
+  NS_TEST_ASSERT_MSG_EQ (symmetric.GetNFlows (), 2, "Flow seen recently should not be idle");
+  Simulator::Stop (Seconds (5));
+  Simulator::Run ();
+  Classify (symmetric, a, 2000, b, 80, TcpHeader::ACK);
+  NS_TEST_ASSERT_MSG_EQ (symmetric.GetNFlows (), 1, "Idle flow should be evicted");
+  NS_TEST_ASSERT_MSG_EQ (m_nEvicted, 3, "Every eviction should be reported");
+
+  TcpFlowClassifier directional (false);
+  uint32_t forward = Classify (directional, a, 1000, b, 80, TcpHeader::SYN);
+  NS_TEST_ASSERT_MSG_NE (Classify (directional, b, 80, a, 1000, TcpHeader::SYN | TcpHeader::ACK), forward,
+                         "Directions should be separate flows");
+  TcpFlowClassifier::FourTuple tuple;
+  NS_TEST_ASSERT_MSG_EQ (directional.FindFlow (forward, &tuple), true, "Flow not found");
+  NS_TEST_ASSERT_MSG_EQ (tuple.first.first, a, "Wrong source address");
+  NS_TEST_ASSERT_MSG_EQ (tuple.first.second, 1000, "Wrong source port");
+  NS_TEST_ASSERT_MSG_EQ (tuple.second.first, b, "Wrong destination address");
+  NS_TEST_ASSERT_MSG_EQ (tuple.second.second, 80, "Wrong destination port");
+
+  Simulator::Destroy ();
+}
+
+/**
+ * DelayBox classifies packets from their bytes, and queue disc items
+ * from the header they keep, whether or not it has been added to the
+ * packet yet.
+ */
+class DelayBoxClassificationTestCase : public TestCase
+{
+public:
+  DelayBoxClassificationTestCase ();
+  virtual ~DelayBoxClassificationTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Record (void);
+
+  std::vector<Time> m_sendTimes;
+};
+
+DelayBoxClassificationTestCase::DelayBoxClassificationTestCase ()
+  : TestCase ("Classification from packet bytes and queue disc items")
+{
+}
+
+DelayBoxClassificationTestCase::~DelayBoxClassificationTestCase ()
+{
+}
+
+void
+DelayBoxClassificationTestCase::Record (void)
+{
+  m_sendTimes.push_back (Simulator::Now ());
+}
+
+void
+DelayBoxClassificationTestCase::DoRun (void)
+{
+  Ipv4Address a ("10.0.0.1");
+  Ipv4Address b ("10.0.0.2");
+  Ptr<DelayBox> delayBox = CreateObject<DelayBox> ();
+  delayBox->AddRule (a, 1000, b, 80, DelayBoxRule (0.01));
+  Callback<void> record = MakeCallback (&DelayBoxClassificationTestCase::Record, this);
+
+  Ipv4Header ipHeader;
+  ipHeader.SetSource (b);
+  ipHeader.SetDestination (a);
+  ipHeader.SetProtocol (6);
+  ipHeader.SetPayloadSize (100 + 20);
+  TcpHeader tcpHeader;
+  tcpHeader.SetSourcePort (80);
+  tcpHeader.SetDestinationPort (1000);
+  tcpHeader.SetFlags (TcpHeader::ACK);
+
+  Ptr<Packet> packet = Create<Packet> (100);
+  packet->AddHeader (tcpHeader);
+  Ptr<Packet> withIpHeader = packet->Copy ();
+  withIpHeader->AddHeader (ipHeader);
+  Ptr<Ipv4QueueDiscItem> item = Create<Ipv4QueueDiscItem> (packet->Copy (), Address (), 0, ipHeader);
+  Ptr<Ipv4QueueDiscItem> dequeued = Create<Ipv4QueueDiscItem> (packet->Copy (), Address (), 0, ipHeader);
+  dequeued->AddHeader ();
+
+  delayBox->Delay (record, Ptr<const Packet> (withIpHeader));
+  delayBox->Delay (record, Ptr<const QueueDiscItem> (item));
+  delayBox->Delay (record, Ptr<const QueueDiscItem> (dequeued));
+  NS_TEST_ASSERT_MSG_EQ (m_sendTimes.size (), 0, "Packets matching the rule should be delayed");
+  NS_TEST_ASSERT_MSG_EQ (delayBox->GetNFlows (), 1, "All three packets belong to one flow");
+
+  Ipv4Header udpHeader = ipHeader;
+  udpHeader.SetProtocol (17);
+  Ptr<Packet> udp = packet->Copy ();
+  udp->AddHeader (udpHeader);
+  delayBox->Delay (record, Ptr<const Packet> (udp));
+  NS_TEST_ASSERT_MSG_EQ (m_sendTimes.size (), 1, "Packets that are not TCP should be sent immediately");
+
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (m_sendTimes.size (), 4, "Every packet should have been sent");
+  for (uint32_t i = 1; i < 4; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ_TOL (m_sendTimes[i], MilliSeconds (10), NanoSeconds (1), "Packet not delayed by the rule");
+    }
+
+  Simulator::Destroy ();
+}
+
+/**
+ * Rules added with expireWithFlow, as Tmix adds them for each
+ * connection, are removed once the flow they matched sends its FIN,
+ * unless they have been replaced in the meantime.
+ */
+class DelayBoxExpiringRuleTestCase : public TestCase
+{
+public:
+  DelayBoxExpiringRuleTestCase ();
+  virtual ~DelayBoxExpiringRuleTestCase ();
+
+private:
+  virtual void DoRun (void);
+  Ptr<const Packet> MakePacket (uint16_t srcPort, uint8_t flags);
+  void Record (void);
+
+  uint32_t m_nSent;
+};
+
+DelayBoxExpiringRuleTestCase::DelayBoxExpiringRuleTestCase ()
+  : TestCase ("Rules added with expireWithFlow expire with their flow")
+{
+}
+
+DelayBoxExpiringRuleTestCase::~DelayBoxExpiringRuleTestCase ()
+{
+}
+
+Ptr<const Packet>
+DelayBoxExpiringRuleTestCase::MakePacket (uint16_t srcPort, uint8_t flags)
+{
+  Ipv4Header ipHeader;
+  ipHeader.SetSource (Ipv4Address ("10.0.0.1"));
+  ipHeader.SetDestination (Ipv4Address ("10.0.0.2"));
+  ipHeader.SetProtocol (6);
+  ipHeader.SetPayloadSize (100 + 20);
+  TcpHeader tcpHeader;
+  tcpHeader.SetSourcePort (srcPort);
+  tcpHeader.SetDestinationPort (80);
+  tcpHeader.SetFlags (flags);
+
+  Ptr<Packet> packet = Create<Packet> (100);
+  packet->AddHeader (tcpHeader);
+  packet->AddHeader (ipHeader);
+  return packet;
+}
+
+void
+DelayBoxExpiringRuleTestCase::Record (void)
+{
+  m_nSent++;
+}
+
+void
+DelayBoxExpiringRuleTestCase::DoRun (void)
+{
+  m_nSent = 0;
+  Ipv4Address a ("10.0.0.1");
+  Ipv4Address b ("10.0.0.2");
+  Ptr<DelayBox> delayBox = CreateObject<DelayBox> ();
+  delayBox->AddRule (a, 1000, b, 80, DelayBoxRule (0.01), true);
+  delayBox->AddRule (a, 1001, b, 80, DelayBoxRule (0.01), true);
+  delayBox->AddRule (a, 1002, b, 80, DelayBoxRule (0.01));
+  NS_TEST_ASSERT_MSG_EQ (delayBox->GetNRules (), 3, "Wrong number of rules");
+  Callback<void> record = MakeCallback (&DelayBoxExpiringRuleTestCase::Record, this);
+
+  for (uint16_t port = 1000; port <= 1002; port++)
+    {
+      delayBox->Delay (record, MakePacket (port, TcpHeader::ACK));
+      delayBox->Delay (record, MakePacket (port, TcpHeader::FIN | TcpHeader::ACK));
+    }
+  NS_TEST_ASSERT_MSG_EQ (m_nSent, 0, "Packets matching the rules should be delayed");
+  // Port 1001 is about to be reused: its flow's FIN must not remove
+  // the rule added for the next connection.
+  delayBox->AddRule (a, 1001, b, 80, DelayBoxRule (0.02), true);
+  NS_TEST_ASSERT_MSG_EQ (delayBox->GetNRules (), 3, "Replacing a rule should not add one");
+
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (m_nSent, 6, "Every packet should have been sent");
+  NS_TEST_ASSERT_MSG_EQ (delayBox->GetNRules (), 2, "Only the rule of the finished flow should have expired");
+  delayBox->RemoveRule (a, 1001, b, 80);
+  delayBox->RemoveRule (a, 1002, b, 80);
+  NS_TEST_ASSERT_MSG_EQ (delayBox->GetNRules (), 0, "The rules for ports 1001 and 1002 should have been kept");
+
+  Simulator::Destroy ();
+}
+
+/**
+ * Two DelayBox instances with the same rules see different losses on
+ * their first flow, unless they are given the same stream number.
+ */
+class DelayBoxStreamTestCase : public TestCase
+{
+public:
+  DelayBoxStreamTestCase ();
+  virtual ~DelayBoxStreamTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// \return which of the packets of one flow \p delayBox dropped.
+  std::vector<bool> Drops (Ptr<DelayBox> delayBox);
+  void Record (void);
+};
+
+DelayBoxStreamTestCase::DelayBoxStreamTestCase ()
+  : TestCase ("Loss streams of DelayBox instances")
+{
+}
+
+DelayBoxStreamTestCase::~DelayBoxStreamTestCase ()
+{
+}
+
+void
+DelayBoxStreamTestCase::Record (void)
+{
+}
+
+std::vector<bool>
+DelayBoxStreamTestCase::Drops (Ptr<DelayBox> delayBox)
+{
+  Ipv4Address a ("10.0.0.1");
+  Ipv4Address b ("10.0.0.2");
+  delayBox->AddRule (a, b, DelayBoxRule (0.01, 0.5));
+
+  Ipv4Header ipHeader;
+  ipHeader.SetSource (a);
+  ipHeader.SetDestination (b);
+  ipHeader.SetProtocol (6);
+  ipHeader.SetPayloadSize (100 + 20);
+  TcpHeader tcpHeader;
+  tcpHeader.SetSourcePort (1000);
+  tcpHeader.SetDestinationPort (80);
+  tcpHeader.SetFlags (TcpHeader::ACK);
+  Ptr<Packet> packet = Create<Packet> (100);
+  packet->AddHeader (tcpHeader);
+  packet->AddHeader (ipHeader);
+
+  Callback<void> record = MakeCallback (&DelayBoxStreamTestCase::Record, this);
+  std::vector<bool> drops;
+  for (uint32_t i = 0; i < 100; i++)
+    {
+      drops.push_back (!delayBox->Delay (record, Ptr<const Packet> (packet)));
+    }
+  return drops;
+}
+
+void
+DelayBoxStreamTestCase::DoRun (void)
+{
+  Ptr<DelayBox> first = CreateObject<DelayBox> ();
+  Ptr<DelayBox> second = CreateObject<DelayBox> ();
+  NS_TEST_ASSERT_MSG_EQ ((Drops (first) != Drops (second)), true,
+                         "Instances without assigned streams share their losses");
+
+  Ptr<DelayBox> fixed = CreateObject<DelayBox> ();
+  Ptr<DelayBox> same = CreateObject<DelayBox> ();
+  Ptr<DelayBox> other = CreateObject<DelayBox> ();
+  NS_TEST_ASSERT_MSG_EQ (fixed->AssignStreams (5), 1, "DelayBox uses one stream");
+  same->AssignStreams (5);
+  other->AssignStreams (6);
+  std::vector<bool> drops = Drops (fixed);
+  NS_TEST_ASSERT_MSG_EQ ((drops == Drops (same)), true, "Same stream, different losses");
+  NS_TEST_ASSERT_MSG_EQ ((drops != Drops (other)), true, "Different streams, same losses");
+
+  Simulator::Run ();
+  Simulator::Destroy ();
+}
+
+/**
+ * Bulk TCP transfer between two nodes joined by DelayBox point to
+ * point devices with tiny device queues.  Every RTT sample has to
+ * include the DelayBox delay in both directions, and the packets held
+ * by DelayBox must count against the device queue instead of
+ * overflowing it.
+ */
+class DelayBoxMinRttTestCase : public TestCase
+{
+public:
+  DelayBoxMinRttTestCase ();
+  virtual ~DelayBoxMinRttTestCase ();
+
+private:
+  virtual void DoRun (void);
+  Ptr<DelayBoxPointToPointNetDevice> AddDevice (Ptr<Node> node, Ptr<PointToPointChannel> channel,
+                                                Ptr<DelayBox> delayBox);
+  void RttChange (Time oldRtt, Time newRtt);
+  void MacTxDrop (Ptr<const Packet> packet);
+  void Connected (Ptr<Socket> socket);
+  void Accept (Ptr<Socket> socket, const Address& from);
+  void Receive (Ptr<Socket> socket);
+  void CheckHeld (void);
+
+  Time m_minRtt;
+  uint32_t m_nRttSamples;
+  uint32_t m_macTxDrops;
+  uint32_t m_rxBytes;
+  uint32_t m_maxHeld;
+  std::vector<Ptr<DelayBoxPointToPointNetDevice> > m_devices;
+};
+
+static const uint32_t g_transferBytes = 100000;
+
+DelayBoxMinRttTestCase::DelayBoxMinRttTestCase ()
+  : TestCase ("Per-flow min-RTT is enforced end to end without device queue overflow")
+{
+}
+
+DelayBoxMinRttTestCase::~DelayBoxMinRttTestCase ()
+{
+}
+
+Ptr<DelayBoxPointToPointNetDevice>
+DelayBoxMinRttTestCase::AddDevice (Ptr<Node> node, Ptr<PointToPointChannel> channel,
+                                   Ptr<DelayBox> delayBox)
+{
+  Ptr<DelayBoxPointToPointNetDevice> device = CreateObject<DelayBoxPointToPointNetDevice> ();
+  device->SetAddress (Mac48Address::Allocate ());
+  device->SetDelayBox (delayBox);
+  device->SetDataRate (DataRate ("10Mbps"));
+  Ptr<DropTailQueue> queue = CreateObject<DropTailQueue> ();
+  queue->SetMode (Queue::QUEUE_MODE_PACKETS);
+  queue->SetMaxPackets (4);
+  device->SetQueue (queue);
+  device->Attach (channel);
+  node->AddDevice (device);
+  device->TraceConnectWithoutContext ("MacTxDrop", MakeCallback (&DelayBoxMinRttTestCase::MacTxDrop, this));
+  m_devices.push_back (device);
+  return device;
+}
+
+void
+DelayBoxMinRttTestCase::RttChange (Time oldRtt, Time newRtt)
+{
+  if (newRtt.IsStrictlyPositive ())
+    {
+      m_minRtt = m_nRttSamples ? Min (m_minRtt, newRtt) : newRtt;
+      m_nRttSamples++;
+    }
+}
+
+void
+DelayBoxMinRttTestCase::MacTxDrop (Ptr<const Packet> packet)
+{
+  m_macTxDrops++;
+}
+
+void
+DelayBoxMinRttTestCase::Connected (Ptr<Socket> socket)
+{
+  socket->Send (Create<Packet> (g_transferBytes));
+  socket->Close ();
+}
+
+void
+DelayBoxMinRttTestCase::Accept (Ptr<Socket> socket, const Address& from)
+{
+  socket->SetRecvCallback (MakeCallback (&DelayBoxMinRttTestCase::Receive, this));
+}
+
+void
+DelayBoxMinRttTestCase::Receive (Ptr<Socket> socket)
+{
+  Ptr<Packet> packet;
+  while ((packet = socket->Recv ()))
+    {
+      m_rxBytes += packet->GetSize ();
+    }
+}
+
+void
+DelayBoxMinRttTestCase::CheckHeld (void)
+{
+  for (uint32_t i = 0; i < m_devices.size (); i++)
+    {
+      Ptr<DelayBoxPointToPointNetDevice> device = m_devices[i];
+      m_maxHeld = std::max (m_maxHeld, device->GetNDelayedPackets () + device->GetNBackloggedPackets ()
+                            + device->GetQueue ()->GetNPackets ());
+    }
+  Simulator::Schedule (MicroSeconds (100), &DelayBoxMinRttTestCase::CheckHeld, this);
+}
+
+void
+DelayBoxMinRttTestCase::DoRun (void)
+{
+  m_minRtt = Time (0);
+  m_nRttSamples = 0;
+  m_macTxDrops = 0;
+  m_rxBytes = 0;
+  m_maxHeld = 0;
+
+  NodeContainer nodes;
+  nodes.Create (2);
+  InternetStackHelper internet;
+  internet.Install (nodes);
+
+  Ptr<PointToPointChannel> channel = CreateObject<PointToPointChannel> ();
+  channel->SetAttribute ("Delay", TimeValue (MilliSeconds (1)));
+  Ptr<DelayBox> delayBox = CreateObject<DelayBox> ();
+  NetDeviceContainer devices;
+  devices.Add (AddDevice (nodes.Get (0), channel, delayBox));
+  devices.Add (AddDevice (nodes.Get (1), channel, delayBox));
+
+  Ipv4AddressHelper addresses ("10.1.1.0", "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = addresses.Assign (devices);
+  Time oneWay = MilliSeconds (40);
+  delayBox->AddRule (interfaces.GetAddress (0), interfaces.GetAddress (1),
+                     DelayBoxRule (oneWay.GetSeconds ()));
+
+  uint16_t port = 5000;
+  Ptr<Socket> server = Socket::CreateSocket (nodes.Get (1), TcpSocketFactory::GetTypeId ());
+  server->Bind (InetSocketAddress (Ipv4Address::GetAny (), port));
+  server->Listen ();
+  server->SetAcceptCallback (MakeNullCallback<bool, Ptr<Socket>, const Address &> (),
+                             MakeCallback (&DelayBoxMinRttTestCase::Accept, this));
+
+  Ptr<Socket> client = Socket::CreateSocket (nodes.Get (0), TcpSocketFactory::GetTypeId ());
+  client->TraceConnectWithoutContext ("RTT", MakeCallback (&DelayBoxMinRttTestCase::RttChange, this));
+  client->SetConnectCallback (MakeCallback (&DelayBoxMinRttTestCase::Connected, this),
+                              MakeNullCallback<void, Ptr<Socket> > ());
+  client->Bind ();
+  // Connect once the nodes have been initialized; the traffic control
+  // layer cannot send before then.
+  Address serverAddress = InetSocketAddress (interfaces.GetAddress (1), port);
+  Simulator::Schedule (Seconds (0), &Socket::Connect, client, serverAddress);
+
+  Simulator::Schedule (Seconds (0), &DelayBoxMinRttTestCase::CheckHeld, this);
+  Simulator::Stop (Seconds (20));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_rxBytes, g_transferBytes, "Transfer did not complete");
+  NS_TEST_ASSERT_MSG_GT (m_nRttSamples, 0, "No RTT samples were taken");
+  NS_TEST_ASSERT_MSG_GT_OR_EQ (m_minRtt, oneWay + oneWay + MilliSeconds (2),
+                               "RTT sample below the DelayBox minimum");
+  NS_TEST_ASSERT_MSG_GT (m_maxHeld, 1, "The window should have kept several packets inside DelayBox");
+  NS_TEST_ASSERT_MSG_LT_OR_EQ (m_maxHeld, 4, "DelayBox held more packets than the device queue limit");
+  NS_TEST_ASSERT_MSG_EQ (m_macTxDrops, 0, "Device queue overflowed");
+  for (uint32_t i = 0; i < m_devices.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (m_devices[i]->GetNDelayedPackets (), 0, "Packets left inside DelayBox");
+      NS_TEST_ASSERT_MSG_EQ (m_devices[i]->GetNBackloggedPackets (), 0, "Packets left in the backlog");
+    }
+
+  m_devices.clear ();
+  Simulator::Destroy ();
+}
+
+/**
+ * A bulk TCP transfer through a slow DelayBox bottleneck.  The packets
+ * held by DelayBox fill the device queue limit, so once the window
+ * outgrows the path the queue disc above the device has to queue and
+ * drop the excess.
+ */
+class DelayBoxSaturationTestCase : public TestCase
 {
 public:
-  DelayboxTestCase1 ();
-  virtual ~DelayboxTestCase1 ();
+  DelayBoxSaturationTestCase ();
+  virtual ~DelayBoxSaturationTestCase ();
 
 private:
   virtual void DoRun (void);
+  void Connected (Ptr<Socket> socket);
+  void Accept (Ptr<Socket> socket, const Address& from);
+  void Receive (Ptr<Socket> socket);
+  void MacTxDrop (Ptr<const Packet> packet);
+  void CheckHeld (void);
+
+  uint32_t m_rxBytes;
+  uint32_t m_macTxDrops;
+  uint32_t m_maxHeld;
+  Ptr<DelayBoxPointToPointNetDevice> m_device;
 };
 
-// Add some help text to this case to describe what it is intended to test
-DelayboxTestCase1::DelayboxTestCase1 ()
-  : TestCase ("Delaybox test case (does nothing)")
+static const uint32_t g_bulkBytes = 300000;
+
+DelayBoxSaturationTestCase::DelayBoxSaturationTestCase ()
+  : TestCase ("A saturated DelayBox bottleneck drops in its queue disc")
+{
+}
+
+DelayBoxSaturationTestCase::~DelayBoxSaturationTestCase ()
+{
+}
+
+void
+DelayBoxSaturationTestCase::Connected (Ptr<Socket> socket)
 {
+  socket->Send (Create<Packet> (g_bulkBytes));
+  socket->Close ();
 }
 
-// This destructor does nothing but we include it as a reminder that
-// the test case should clean up after itself
-DelayboxTestCase1::~DelayboxTestCase1 ()
+void
+DelayBoxSaturationTestCase::Accept (Ptr<Socket> socket, const Address& from)
+{
+  socket->SetRecvCallback (MakeCallback (&DelayBoxSaturationTestCase::Receive, this));
+}
+
+void
+DelayBoxSaturationTestCase::Receive (Ptr<Socket> socket)
 {
+  Ptr<Packet> packet;
+  while ((packet = socket->Recv ()))
+    {
+      m_rxBytes += packet->GetSize ();
+    }
 }
 
-//
-// This method is the pure virtual method from class TestCase that every
-// TestCase must implement
-//
 void
-DelayboxTestCase1::DoRun (void)
+DelayBoxSaturationTestCase::MacTxDrop (Ptr<const Packet> packet)
 {
-  // A wide variety of test macros are available in src/core/test.h
-  NS_TEST_ASSERT_MSG_EQ (true, true, "true doesn't equal true for some reason");
-  // Use this one for floating point comparisons
-  NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
+  m_macTxDrops++;
+}
+
+void
+DelayBoxSaturationTestCase::CheckHeld (void)
+{
+  m_maxHeld = std::max (m_maxHeld, m_device->GetNDelayedPackets () + m_device->GetNBackloggedPackets ()
+                        + m_device->GetQueue ()->GetNPackets ());
+  Simulator::Schedule (MicroSeconds (100), &DelayBoxSaturationTestCase::CheckHeld, this);
+}
+
+void
+DelayBoxSaturationTestCase::DoRun (void)
+{
+  m_rxBytes = 0;
+  m_macTxDrops = 0;
+  m_maxHeld = 0;
+
+  NodeContainer nodes;
+  nodes.Create (2);
+  InternetStackHelper internet;
+  internet.Install (nodes);
+
+  Ptr<PointToPointChannel> channel = CreateObject<PointToPointChannel> ();
+  Ptr<DelayBox> delayBox = CreateObject<DelayBox> ();
+  NetDeviceContainer devices;
+  for (uint32_t i = 0; i < nodes.GetN (); i++)
+    {
+      Ptr<DelayBoxPointToPointNetDevice> device = CreateObject<DelayBoxPointToPointNetDevice> ();
+      device->SetAddress (Mac48Address::Allocate ());
+      device->SetDelayBox (delayBox);
+      device->SetDataRate (DataRate ("1Mbps"));
+      Ptr<DropTailQueue> queue = CreateObject<DropTailQueue> ();
+      queue->SetMode (Queue::QUEUE_MODE_PACKETS);
+      queue->SetMaxPackets (4);
+      device->SetQueue (queue);
+      device->Attach (channel);
+      nodes.Get (i)->AddDevice (device);
+      devices.Add (device);
+    }
+  m_device = DynamicCast<DelayBoxPointToPointNetDevice> (devices.Get (0));
+  m_device->TraceConnectWithoutContext ("MacTxDrop", MakeCallback (&DelayBoxSaturationTestCase::MacTxDrop, this));
+
+  TrafficControlHelper tch;
+  tch.SetRootQueueDisc ("ns3::PfifoFastQueueDisc", "Limit", UintegerValue (5));
+  QueueDiscContainer queueDiscs = tch.Install (devices);
+
+  Ipv4AddressHelper addresses ("10.1.1.0", "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = addresses.Assign (devices);
+  delayBox->AddRule (interfaces.GetAddress (0), interfaces.GetAddress (1), DelayBoxRule (0.01));
+
+  uint16_t port = 5000;
+  Ptr<Socket> server = Socket::CreateSocket (nodes.Get (1), TcpSocketFactory::GetTypeId ());
+  server->Bind (InetSocketAddress (Ipv4Address::GetAny (), port));
+  server->Listen ();
+  server->SetAcceptCallback (MakeNullCallback<bool, Ptr<Socket>, const Address &> (),
+                             MakeCallback (&DelayBoxSaturationTestCase::Accept, this));
+
+  Ptr<Socket> client = Socket::CreateSocket (nodes.Get (0), TcpSocketFactory::GetTypeId ());
+  client->SetAttribute ("SndBufSize", UintegerValue (g_bulkBytes));
+  client->SetConnectCallback (MakeCallback (&DelayBoxSaturationTestCase::Connected, this),
+                              MakeNullCallback<void, Ptr<Socket> > ());
+  client->Bind ();
+  Address serverAddress = InetSocketAddress (interfaces.GetAddress (1), port);
+  Simulator::Schedule (Seconds (0), &Socket::Connect, client, serverAddress);
+
+  Simulator::Schedule (Seconds (0), &DelayBoxSaturationTestCase::CheckHeld, this);
+  Simulator::Stop (Seconds (30));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_rxBytes, g_bulkBytes, "Transfer did not complete");
+  NS_TEST_ASSERT_MSG_GT (queueDiscs.Get (0)->GetTotalDroppedPackets (), 0,
+                         "The queue disc above the bottleneck never dropped");
+  NS_TEST_ASSERT_MSG_EQ (m_macTxDrops, 0, "Device queue overflowed");
+  NS_TEST_ASSERT_MSG_LT_OR_EQ (m_maxHeld, 4, "DelayBox held more packets than the device queue limit");
+
+  m_device = 0;
+  Simulator::Destroy ();
 }
 
-// The TestSuite class names the TestSuite, identifies what type of TestSuite,
-// and enables the TestCases to be run.  Typically, only the constructor for
-// this class must be defined
-//
 class DelayboxTestSuite : public TestSuite
 {
 public:
@@ -59,10 +870,14 @@ public:
 DelayboxTestSuite::DelayboxTestSuite ()
   : TestSuite ("delaybox", UNIT)
 {
-  // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
-  AddTestCase (new DelayboxTestCase1, TestCase::QUICK);
+  AddTestCase (new DelayBoxFlowTestCase, TestCase::QUICK);
+  AddTestCase (new DelayBoxRuleTableTestCase, TestCase::QUICK);
+  AddTestCase (new TcpFlowClassifierTestCase, TestCase::QUICK);
+  AddTestCase (new DelayBoxClassificationTestCase, TestCase::QUICK);
+  AddTestCase (new DelayBoxExpiringRuleTestCase, TestCase::QUICK);
+  AddTestCase (new DelayBoxStreamTestCase, TestCase::QUICK);
+  AddTestCase (new DelayBoxMinRttTestCase, TestCase::QUICK);
+  AddTestCase (new DelayBoxSaturationTestCase, TestCase::QUICK);
 }
 
-// Do not forget to allocate an instance of this TestSuite
 static DelayboxTestSuite delayboxTestSuite;
-
@@ -36,6 +36,7 @@
 #include "tcp-tx-buffer.h"
 #include "tcp-rx-buffer.h"
 #include "rtt-estimator.h"
+#include "tcp-timer.h"
 
 namespace ns3 {
 
@@ -976,10 +977,11 @@ protected:
 
 protected:
   // Counters and events
-  EventId           m_retxEvent;       //!< Retransmission event
-  EventId           m_lastAckEvent;    //!< Last ACK timeout event
-  EventId           m_delAckEvent;     //!< Delayed ACK timeout event
-  EventId           m_persistEvent;    //!< Persist event: Send 1 byte to probe for a non-zero Rx window
+  TcpTimerQueue     m_timers;          //!< Shared simulator event of the timers below
+  TcpTimer          m_retxEvent;       //!< Retransmission event
+  TcpTimer          m_lastAckEvent;    //!< Last ACK timeout event
+  TcpTimer          m_delAckEvent;     //!< Delayed ACK timeout event
+  TcpTimer          m_persistEvent;    //!< Persist event: Send 1 byte to probe for a non-zero Rx window
   EventId           m_timewaitEvent;   //!< TIME_WAIT expiration event: Move this socket to CLOSED state
   uint32_t          m_dupAckCount;     //!< Dupack counter
   uint32_t          m_delAckCount;     //!< Delayed ACK counter
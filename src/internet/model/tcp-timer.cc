@@ -0,0 +1,145 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "tcp-timer.h"
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TcpTimer");
+
+TcpTimerQueue::TcpTimerQueue ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+TcpTimerQueue::~TcpTimerQueue ()
+{
+  NS_LOG_FUNCTION (this);
+  m_event.Cancel ();
+}
+
+void
+TcpTimerQueue::Attach (TcpTimer *timer)
+{
+  NS_LOG_FUNCTION (this << timer);
+  m_timers.push_back (timer);
+}
+
+void
+TcpTimerQueue::Arm (void)
+{
+  NS_LOG_FUNCTION (this);
+  TcpTimer *earliest = 0;
+  for (std::vector<TcpTimer *>::const_iterator it = m_timers.begin ();
+       it != m_timers.end (); ++it)
+    {
+      if ((*it)->m_event != 0
+          && (earliest == 0 || (*it)->m_deadline < earliest->m_deadline))
+        {
+          earliest = *it;
+        }
+    }
+  if (earliest == 0
+      || (m_event.IsRunning () && m_eventTime <= earliest->m_deadline))
+    {
+      // Nothing to wait for, or the event fires early enough: a stale
+      // event finds nothing to do when it fires.
+      return;
+    }
+  m_event.Cancel ();
+  m_eventTime = earliest->m_deadline;
+  m_event = Simulator::Schedule (m_eventTime - Simulator::Now (),
+                                 &TcpTimerQueue::Expire, this);
+}
+
+void
+TcpTimerQueue::Expire (void)
+{
+  NS_LOG_FUNCTION (this);
+  Time now = Simulator::Now ();
+  TcpTimer *due = 0;
+  for (std::vector<TcpTimer *>::const_iterator it = m_timers.begin ();
+       it != m_timers.end (); ++it)
+    {
+      if ((*it)->m_event != 0 && (*it)->m_deadline <= now
+          && (due == 0 || (*it)->m_deadline < due->m_deadline))
+        {
+          due = *it;
+        }
+    }
+  Ptr<EventImpl> event;
+  if (due != 0)
+    {
+      event = due->m_event;
+      due->m_event = 0;
+    }
+  Arm ();
+  if (event != 0)
+    {
+      // Last: the function may destroy the socket, and this queue.
+      event->Invoke ();
+    }
+}
+
+TcpTimer::TcpTimer (TcpTimerQueue *queue)
+  : m_queue (queue),
+    m_event (0)
+{
+  NS_LOG_FUNCTION (this << queue);
+  m_queue->Attach (this);
+}
+
+void
+TcpTimer::DoSchedule (const Time &delay, EventImpl *event)
+{
+  NS_LOG_FUNCTION (this << delay << event);
+  NS_ASSERT (delay.IsPositive ());
+  m_event = Ptr<EventImpl> (event, false);
+  m_deadline = Simulator::Now () + delay;
+  m_queue->Arm ();
+}
+
+void
+TcpTimer::Cancel (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_event = 0;
+}
+
+bool
+TcpTimer::IsRunning (void) const
+{
+  return m_event != 0;
+}
+
+bool
+TcpTimer::IsExpired (void) const
+{
+  return m_event == 0;
+}
+
+Time
+TcpTimer::GetDelayLeft (void) const
+{
+  if (m_event == 0)
+    {
+      return Time (0);
+    }
+  return m_deadline - Simulator::Now ();
+}
+
+} // namespace ns3
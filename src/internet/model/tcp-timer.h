@@ -0,0 +1,185 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef TCP_TIMER_H
+#define TCP_TIMER_H
+
+#include "ns3/event-id.h"
+#include "ns3/event-impl.h"
+#include "ns3/make-event.h"
+#include "ns3/nstime.h"
+#include "ns3/ptr.h"
+#include <vector>
+
+namespace ns3 {
+
+class TcpTimer;
+
+/**
+ * \ingroup tcp
+ *
+ * \brief The timers of a TCP socket, sharing one simulator event
+ *
+ * A TCP socket rearms its retransmission timer on almost every ACK,
+ * and its delayed ACK timer on almost every segment.  With one
+ * simulator event per timer, each rearm cancels an event, which stays
+ * in the scheduler until its time, and inserts a new one.
+ *
+ * The TcpTimer instances of a socket are attached to one TcpTimerQueue,
+ * which keeps a single event in the simulator, at the earliest deadline
+ * of the running timers.  Rearming a timer to a later deadline, or
+ * cancelling it, only updates the timer: the event fires at the
+ * earlier time, finds nothing to do, and is scheduled again for the
+ * deadline which is then the earliest.  Only a deadline earlier than
+ * the event reschedules it.
+ */
+class TcpTimerQueue
+{
+public:
+  TcpTimerQueue ();
+  /**
+   * \brief Destructor: the shared event is cancelled, so that the
+   * queue can be destroyed with its socket at any time.
+   */
+  ~TcpTimerQueue ();
+
+private:
+  friend class TcpTimer;
+
+  /**
+   * \brief Attach a timer
+   * \param timer the timer
+   */
+  void Attach (TcpTimer *timer);
+
+  /**
+   * \brief Make sure that the event fires no later than the earliest
+   * deadline of the running timers
+   */
+  void Arm (void);
+
+  /**
+   * \brief Expire the earliest timer, if its deadline is reached,
+   * then arm the event for the next one
+   */
+  void Expire (void);
+
+  std::vector<TcpTimer *> m_timers; //!< The attached timers
+  EventId m_event;                  //!< The shared event
+  Time m_eventTime;                 //!< The time of m_event, when running
+
+  /// Not copyable: the timers point to their queue.
+  TcpTimerQueue (const TcpTimerQueue &);
+  /// Not copyable: the timers point to their queue.
+  TcpTimerQueue &operator = (const TcpTimerQueue &);
+};
+
+/**
+ * \ingroup tcp
+ *
+ * \brief A timer of a TCP socket
+ *
+ * It is used like an EventId returned by Simulator::Schedule, but the
+ * simulator event is the one of its TcpTimerQueue.  Schedule replaces
+ * the function and the deadline of the timer, running or not.
+ */
+class TcpTimer
+{
+public:
+  /**
+   * \brief Constructor
+   * \param queue the queue of the socket, which must outlive the timer
+   */
+  TcpTimer (TcpTimerQueue *queue);
+
+  /**
+   * \brief Schedule a member function call
+   * \param delay the delay after which the function is called
+   * \param mem_ptr the member function
+   * \param obj the object the function is called on
+   */
+  template <typename MEM, typename OBJ>
+  void Schedule (const Time &delay, MEM mem_ptr, OBJ obj);
+
+  /**
+   * \brief Schedule a member function call with one argument
+   * \param delay the delay after which the function is called
+   * \param mem_ptr the member function
+   * \param obj the object the function is called on
+   * \param a1 the argument of the function
+   */
+  template <typename MEM, typename OBJ, typename T1>
+  void Schedule (const Time &delay, MEM mem_ptr, OBJ obj, T1 a1);
+
+  /**
+   * \brief Stop the timer; the function will not be called
+   */
+  void Cancel (void);
+
+  /**
+   * \brief Check if the timer is running
+   * \returns true if the function is yet to be called
+   */
+  bool IsRunning (void) const;
+
+  /**
+   * \brief Check if the timer is expired
+   * \returns true if the function was called, cancelled or never scheduled
+   */
+  bool IsExpired (void) const;
+
+  /**
+   * \brief Get the time left before the function is called
+   * \returns the delay left, or zero if the timer is not running
+   */
+  Time GetDelayLeft (void) const;
+
+private:
+  friend class TcpTimerQueue;
+
+  /**
+   * \brief Replace the function and the deadline of the timer
+   * \param delay the delay after which the function is called
+   * \param event the function
+   */
+  void DoSchedule (const Time &delay, EventImpl *event);
+
+  TcpTimerQueue *m_queue;  //!< The queue of the socket
+  Ptr<EventImpl> m_event;  //!< The function, or 0 if not running
+  Time m_deadline;         //!< The deadline, when running
+
+  /// Not copyable: the queue points to its timers.
+  TcpTimer (const TcpTimer &);
+  /// Not copyable: the queue points to its timers.
+  TcpTimer &operator = (const TcpTimer &);
+};
+
+template <typename MEM, typename OBJ>
+void
+TcpTimer::Schedule (const Time &delay, MEM mem_ptr, OBJ obj)
+{
+  DoSchedule (delay, MakeEvent (mem_ptr, obj));
+}
+
+template <typename MEM, typename OBJ, typename T1>
+void
+TcpTimer::Schedule (const Time &delay, MEM mem_ptr, OBJ obj, T1 a1)
+{
+  DoSchedule (delay, MakeEvent (mem_ptr, obj, a1));
+}
+
+} // namespace ns3
+
+#endif /* TCP_TIMER_H */
@@ -0,0 +1,165 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/tcp-timer.h"
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup internet-test
+ * \ingroup tests
+ *
+ * \brief Check that the timers of a TcpTimerQueue fire at their last
+ * deadline, in order, and not when cancelled
+ */
+class TcpTimerTestCase : public TestCase
+{
+public:
+  TcpTimerTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  /**
+   * \brief Record a timer expiration
+   * \param name the name of the timer
+   */
+  void Fired (std::string name);
+
+  /**
+   * \brief Rearm m_a to a later deadline
+   */
+  void RearmLater (void);
+
+  /**
+   * \brief Rearm m_b to an earlier deadline, cancel m_c
+   */
+  void RearmEarlier (void);
+
+  /**
+   * \brief Rearm m_c from its own expiration
+   * \param name the name of the timer
+   */
+  void FiredAndRearm (std::string name);
+
+  TcpTimerQueue m_queue;              //!< The queue of the timers
+  TcpTimer m_a;                       //!< A timer
+  TcpTimer m_b;                       //!< A timer
+  TcpTimer m_c;                       //!< A timer
+  std::vector<std::string> m_names;   //!< The names of the fired timers
+  std::vector<Time> m_times;          //!< The expiration times
+};
+
+TcpTimerTestCase::TcpTimerTestCase ()
+  : TestCase ("Check the timers sharing one simulator event"),
+    m_a (&m_queue),
+    m_b (&m_queue),
+    m_c (&m_queue)
+{
+}
+
+void
+TcpTimerTestCase::Fired (std::string name)
+{
+  m_names.push_back (name);
+  m_times.push_back (Simulator::Now ());
+}
+
+void
+TcpTimerTestCase::FiredAndRearm (std::string name)
+{
+  Fired (name);
+  if (m_names.size () < 5)
+    {
+      m_c.Schedule (Seconds (1), &TcpTimerTestCase::FiredAndRearm, this, std::string ("c"));
+    }
+}
+
+void
+TcpTimerTestCase::RearmLater (void)
+{
+  NS_TEST_EXPECT_MSG_EQ (m_a.IsRunning (), true, "a should be running");
+  NS_TEST_EXPECT_MSG_EQ (m_a.GetDelayLeft (), Seconds (0.5), "a should fire in 0.5 s");
+  m_a.Cancel ();
+  NS_TEST_EXPECT_MSG_EQ (m_a.IsExpired (), true, "a should be cancelled");
+  m_a.Schedule (Seconds (2), &TcpTimerTestCase::Fired, this, std::string ("a"));
+  NS_TEST_EXPECT_MSG_EQ (m_a.GetDelayLeft (), Seconds (2), "a should fire in 2 s");
+}
+
+void
+TcpTimerTestCase::RearmEarlier (void)
+{
+  m_b.Schedule (Seconds (0.25), &TcpTimerTestCase::Fired, this, std::string ("b"));
+  m_c.Cancel ();
+}
+
+void
+TcpTimerTestCase::DoRun (void)
+{
+  m_a.Schedule (Seconds (1), &TcpTimerTestCase::Fired, this, std::string ("a"));
+  m_b.Schedule (Seconds (5), &TcpTimerTestCase::Fired, this, std::string ("b"));
+  m_c.Schedule (Seconds (0.75), &TcpTimerTestCase::Fired, this, std::string ("c"));
+  Simulator::Schedule (Seconds (0.5), &TcpTimerTestCase::RearmLater, this);
+  Simulator::Schedule (Seconds (0.5), &TcpTimerTestCase::RearmEarlier, this);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_names.size (), 2, "cancelled timers should not fire");
+  NS_TEST_EXPECT_MSG_EQ (m_names[0], "b", "b should be first");
+  NS_TEST_EXPECT_MSG_EQ (m_times[0], Seconds (0.75), "b should be moved earlier");
+  NS_TEST_EXPECT_MSG_EQ (m_names[1], "a", "a should be second");
+  NS_TEST_EXPECT_MSG_EQ (m_times[1], Seconds (2.5), "a should be moved later");
+  NS_TEST_EXPECT_MSG_EQ (m_a.IsExpired (), true, "a should be expired");
+
+  m_names.clear ();
+  m_times.clear ();
+  m_a.Schedule (Seconds (1), &TcpTimerTestCase::Fired, this, std::string ("a"));
+  m_b.Schedule (Seconds (1), &TcpTimerTestCase::Fired, this, std::string ("b"));
+  m_c.Schedule (Seconds (0.5), &TcpTimerTestCase::FiredAndRearm, this, std::string ("c"));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_names.size (), 5, "every timer should fire");
+  NS_TEST_EXPECT_MSG_EQ (m_times[0], Seconds (3.0), "c should fire first");
+  NS_TEST_EXPECT_MSG_EQ (m_times[1], Seconds (3.5), "a and b should fire together");
+  NS_TEST_EXPECT_MSG_EQ (m_times[2], Seconds (3.5), "a and b should fire together");
+  NS_TEST_EXPECT_MSG_EQ (m_times[3], Seconds (4.0), "c should be rearmed");
+  NS_TEST_EXPECT_MSG_EQ (m_times[4], Seconds (5.0), "c should be rearmed");
+
+  Simulator::Destroy ();
+}
+
+/**
+ * \ingroup internet-test
+ * \ingroup tests
+ *
+ * \brief TcpTimer TestSuite
+ */
+class TcpTimerTestSuite : public TestSuite
+{
+public:
+  TcpTimerTestSuite ()
+    : TestSuite ("tcp-timer", UNIT)
+  {
+    AddTestCase (new TcpTimerTestCase, TestCase::QUICK);
+  }
+};
+
+static TcpTimerTestSuite g_tcpTimerTestSuite; //!< Static variable for test initialization
+
+} // namespace ns3
@@ -227,7 +227,7 @@ TcpZeroWindowTest::ProcessedAck (const Ptr<const TcpSocketState> tcb,
     {
       if (h.GetFlags () & TcpHeader::SYN)
         {
-          EventId persistentEvent = GetPersistentEvent (SENDER);
+          const TcpTimer &persistentEvent = GetPersistentEvent (SENDER);
           NS_TEST_ASSERT_MSG_EQ (persistentEvent.IsRunning (), true,
                                  "Persistent event not started");
         }
@@ -25,9 +25,6 @@
 #include <ostream>
 #include "ns3/assert.h"
 
-
-#define BUFFER_FREE_LIST 1
-
 namespace ns3 {
 
 /**
@@ -555,6 +552,14 @@ private:
    */
   Buffer CreateFragment (uint32_t start, uint32_t length) const;
 
+  /**
+   * \brief Create a copy of the buffer which owns its own data
+   * storage, rather than sharing it copy-on-write.
+   *
+   * \returns a copy of the buffer
+   */
+  Buffer CreateDetachedCopy (void) const;
+
   /**
    * \return an Iterator which points to the
    * start of this Buffer.
@@ -728,17 +733,28 @@ private:
 
   /**
    * \brief Recycle the buffer memory
+   *
+   * The memory goes back to the PacketMemory pools of the calling
+   * thread.
+   *
    * \param data the buffer data storage
    */
   static void Recycle (struct Buffer::Data *data);
   /**
    * \brief Create a buffer data storage
+   *
+   * The storage holds at least g_maxSize bytes.
+   *
    * \param size the storage size to create
    * \returns a pointer to the created buffer storage
    */
   static struct Buffer::Data *Create (uint32_t size);
   /**
    * \brief Allocate a buffer data storage
+   *
+   * Its m_size is the capacity of the PacketMemory block, which may
+   * be larger than \p reqSize.
+   *
    * \param reqSize the storage size to create
    * \returns a pointer to the allocated buffer storage
    */
@@ -765,9 +781,15 @@ private:
   /**
    * location in a newly-allocated buffer where you should start
    * writing data. i.e., m_start should be initialized to this 
-   * value.
+   * value.  Each thread keeps its own.
    */
-  static uint32_t g_recommendedStart;
+  static thread_local uint32_t g_recommendedStart;
+  /**
+   * largest data size recycled by the calling thread. New data
+   * storage is at least this large, so that a buffer rarely has to
+   * grow.
+   */
+  static thread_local uint32_t g_maxSize;
 
   /**
    * offset to the start of the virtual zero area from the start
@@ -789,19 +811,6 @@ private:
    * instance from the start of m_data->m_data
    */
   uint32_t m_end;
-
-#ifdef BUFFER_FREE_LIST
-  /// Container for buffer data
-  typedef std::vector<struct Buffer::Data*> FreeList;
-  /// Local static destructor structure
-  struct LocalStaticDestructor 
-  {
-    ~LocalStaticDestructor ();
-  };
-  static uint32_t g_maxSize; //!< Max observed data size
-  static FreeList *g_freeList; //!< Buffer data container
-  static struct LocalStaticDestructor g_localStaticDestructor; //!< Local static destructor
-#endif
 };
 
 } // namespace ns3
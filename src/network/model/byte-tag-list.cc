@@ -18,12 +18,11 @@
  * Author: Mathieu Lacage <mathieu.lacage@sophia.inria.fr>
  */
 #include "byte-tag-list.h"
+#include "packet-memory.h"
 #include "ns3/log.h"
 #include <vector>
 #include <cstring>
 
-#define USE_FREE_LIST 1
-#define FREE_LIST_SIZE 1000
 #define OFFSET_MAX (2147483647)
 
 namespace ns3 {
@@ -44,32 +43,11 @@ struct ByteTagListData {
   uint8_t data[4]; //!< data
 };
 
-#ifdef USE_FREE_LIST
 /**
- * \ingroup packet
- *
- * \brief Container class for struct ByteTagListData
- *
- * Internal use only.
+ * Largest data size released by the calling thread; new data is at
+ * least this large, so that a list rarely has to grow.
  */
-static class ByteTagListDataFreeList : public std::vector<struct ByteTagListData *>
-{
-public:
-  ~ByteTagListDataFreeList ();
-} g_freeList; //!< Container for struct ByteTagListData
-static uint32_t g_maxSize = 0; //!< maximum data size (used for allocation)
-
-ByteTagListDataFreeList::~ByteTagListDataFreeList ()
-{
-  NS_LOG_FUNCTION (this);
-  for (ByteTagListDataFreeList::iterator i = begin ();
-       i != end (); i++)
-    {
-      uint8_t *buffer = (uint8_t *)(*i);
-      delete [] buffer;
-    }
-}
-#endif /* USE_FREE_LIST */
+static thread_local uint32_t g_maxSize = 0;
 
 ByteTagList::Iterator::Item::Item (TagBuffer buf_)
   : buf (buf_)
@@ -187,6 +165,22 @@ ByteTagList::~ByteTagList ()
   m_used = 0;
 }
 
+ByteTagList
+ByteTagList::CreateDetachedCopy (void) const
+{
+  NS_LOG_FUNCTION (this);
+  ByteTagList copy = *this;
+  if (m_data != 0)
+    {
+      struct ByteTagListData *data = copy.Allocate (m_data->size);
+      std::memcpy (&data->data, &m_data->data, m_used);
+      data->dirty = m_used;
+      copy.Deallocate (copy.m_data);
+      copy.m_data = data;
+    }
+  return copy;
+}
+
 TagBuffer
 ByteTagList::Add (TypeId tid, uint32_t bufferSize, int32_t start, int32_t end)
 {
@@ -338,30 +332,16 @@ ByteTagList::AddAtStart (int32_t prependOffset)
   *this = list;
 }
 
-#ifdef USE_FREE_LIST
-
 struct ByteTagListData *
 ByteTagList::Allocate (uint32_t size)
 {
   NS_LOG_FUNCTION (this << size);
-  while (!g_freeList.empty ())
-    {
-      struct ByteTagListData *data = g_freeList.back ();
-      g_freeList.pop_back ();
-      NS_ASSERT (data != 0);
-      if (data->size >= size)
-        {
-          data->count = 1;
-          data->dirty = 0;
-          return data;
-        }
-      uint8_t *buffer = (uint8_t *)data;
-      delete [] buffer;
-    }
-  uint8_t *buffer = new uint8_t [std::max (size, g_maxSize) + sizeof (struct ByteTagListData) - 4];
-  struct ByteTagListData *data = (struct ByteTagListData *)buffer;
+  uint32_t bytes = std::max (size, g_maxSize) + sizeof (struct ByteTagListData) - 4;
+  bytes = PacketMemory::GetCapacity (bytes);
+  void *buffer = PacketMemory::Allocate (PacketMemory::BYTE_TAGS, bytes);
+  struct ByteTagListData *data = static_cast<struct ByteTagListData *> (buffer);
   data->count = 1;
-  data->size = size;
+  data->size = bytes - sizeof (struct ByteTagListData) + 4;
   data->dirty = 0;
   return data;
 }
@@ -378,50 +358,9 @@ ByteTagList::Deallocate (struct ByteTagListData *data)
   data->count--;
   if (data->count == 0)
     {
-      if (g_freeList.size () > FREE_LIST_SIZE ||
-          data->size < g_maxSize)
-        {
-          uint8_t *buffer = (uint8_t *)data;
-          delete [] buffer;
-        }
-      else
-        {
-          g_freeList.push_back (data);
-        }
+      PacketMemory::Deallocate (PacketMemory::BYTE_TAGS, data,
+                                data->size + sizeof (struct ByteTagListData) - 4);
     }
 }
 
-#else /* USE_FREE_LIST */
-
-struct ByteTagListData *
-ByteTagList::Allocate (uint32_t size)
-{
-  NS_LOG_FUNCTION (this << size);
-  uint8_t *buffer = new uint8_t [size + sizeof (struct ByteTagListData) - 4];
-  struct ByteTagListData *data = (struct ByteTagListData *)buffer;
-  data->count = 1;
-  data->size = size;
-  data->dirty = 0;
-  return data;
-}
-
-void 
-ByteTagList::Deallocate (struct ByteTagListData *data)
-{
-  NS_LOG_FUNCTION (this << data);
-  if (data == 0)
-    {
-      return;
-    }
-  data->count--;
-  if (data->count == 0)
-    {
-      uint8_t *buffer = (uint8_t *)data;
-      delete [] buffer;
-    }
-}
-
-#endif /* USE_FREE_LIST */
-
-
 } // namespace ns3
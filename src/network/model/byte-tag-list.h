@@ -188,6 +188,12 @@ private:
    */ 
   void RemoveAll (void);
 
+  /**
+   * \returns a copy of this list which owns its own tag buffer, rather
+   * than sharing it copy-on-write.
+   */
+  ByteTagList CreateDetachedCopy (void) const;
+
   /**
    * \param offsetStart the offset which uniquely identifies the first data byte 
    *        present in the byte buffer associated to this ByteTagList.
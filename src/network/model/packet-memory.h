@@ -0,0 +1,118 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef PACKET_MEMORY_H
+#define PACKET_MEMORY_H
+
+#include "ns3/memory-pool.h"
+#include <stdint.h>
+#include <ostream>
+
+namespace ns3 {
+
+/**
+ * \ingroup packet
+ *
+ * \brief The MemoryPool pools of the packet internals.
+ *
+ * Buffer, PacketMetadata, ByteTagList and PacketTagList get their
+ * variable-sized storage from here instead of from process-wide free
+ * lists.  Each of them has its own pool, with its own per-thread free
+ * lists and statistics.
+ */
+class PacketMemory
+{
+public:
+  /** The users of the pools. */
+  enum Pool
+  {
+    BUFFER = 0,  //!< Buffer::Data
+    METADATA,    //!< PacketMetadata::Data
+    BYTE_TAGS,   //!< ByteTagListData
+    PACKET_TAGS, //!< PacketTagList::TagData
+    N_POOLS      //!< Number of pools
+  };
+
+  /** Usage statistics of a pool, for the calling thread. */
+  typedef MemoryPool::Stats Stats;
+
+  /**
+   * \param size A number of bytes.
+   * \return the number of bytes a block allocated for \p size bytes
+   *         really holds.
+   */
+  static uint32_t GetCapacity (uint32_t size)
+  {
+    return MemoryPool::GetCapacity (size);
+  }
+  /**
+   * Allocate a block of at least \p size bytes.
+   *
+   * \param pool The pool to allocate from.
+   * \param size The number of bytes needed; the block holds
+   *        GetCapacity (size) bytes.
+   * \return the block, suitably aligned for any type.
+   */
+  static void *Allocate (enum Pool pool, uint32_t size)
+  {
+    return MemoryPool::Allocate (GetMemoryPool (pool), size);
+  }
+  /**
+   * Give a block back to its pool.
+   *
+   * \param pool The pool it was allocated from.
+   * \param block The block.
+   * \param size The size it was allocated with, or its capacity.
+   */
+  static void Deallocate (enum Pool pool, void *block, uint32_t size)
+  {
+    MemoryPool::Deallocate (GetMemoryPool (pool), block, size);
+  }
+  /**
+   * \param pool A pool.
+   * \return the statistics of \p pool for the calling thread.
+   */
+  static Stats GetStats (enum Pool pool)
+  {
+    return MemoryPool::GetStats (GetMemoryPool (pool));
+  }
+  /**
+   * \param pool A pool.
+   * \return the name of \p pool.
+   */
+  static const char *GetPoolName (enum Pool pool)
+  {
+    return MemoryPool::GetPoolName (GetMemoryPool (pool));
+  }
+  /**
+   * Print the statistics of every pool for the calling thread.
+   * \param os The output stream.
+   */
+  static void PrintStats (std::ostream &os);
+
+private:
+  /**
+   * \param pool A pool.
+   * \return the MemoryPool pool of \p pool.
+   */
+  static enum MemoryPool::Pool GetMemoryPool (enum Pool pool)
+  {
+    return static_cast<enum MemoryPool::Pool> (MemoryPool::BUFFER + pool);
+  }
+};
+
+} // namespace ns3
+
+#endif /* PACKET_MEMORY_H */
@@ -19,10 +19,12 @@
  */
 #include <utility>
 #include <list>
+#include <cstring>
 #include "ns3/assert.h"
 #include "ns3/fatal-error.h"
 #include "ns3/log.h"
 #include "packet-metadata.h"
+#include "packet-memory.h"
 #include "buffer.h"
 #include "header.h"
 #include "trailer.h"
@@ -33,20 +35,9 @@ NS_LOG_COMPONENT_DEFINE ("PacketMetadata");
 
 bool PacketMetadata::m_enable = false;
 bool PacketMetadata::m_enableChecking = false;
-bool PacketMetadata::m_metadataSkipped = false;
-uint32_t PacketMetadata::m_maxSize = 0;
-uint16_t PacketMetadata::m_chunkUid = 0;
-PacketMetadata::DataFreeList PacketMetadata::m_freeList;
-
-PacketMetadata::DataFreeList::~DataFreeList ()
-{
-  NS_LOG_FUNCTION (this);
-  for (iterator i = begin (); i != end (); i++)
-    {
-      PacketMetadata::Deallocate (*i);
-    }
-  PacketMetadata::m_enable = false;
-}
+std::atomic<bool> PacketMetadata::m_metadataSkipped (false);
+thread_local uint32_t PacketMetadata::m_maxSize = 0;
+thread_local uint16_t PacketMetadata::m_chunkUid = 0;
 
 void 
 PacketMetadata::Enable (void)
@@ -576,19 +567,6 @@ PacketMetadata::Create (uint32_t size)
     {
       m_maxSize = size;
     }
-  while (!m_freeList.empty ()) 
-    {
-      struct PacketMetadata::Data *data = m_freeList.back ();
-      m_freeList.pop_back ();
-      if (data->m_size >= size) 
-        {
-          NS_LOG_LOGIC ("create found size="<<data->m_size);
-          data->m_count = 1;
-          return data;
-        }
-      PacketMetadata::Deallocate (data);
-      NS_LOG_LOGIC ("create dealloc size="<<data->m_size);
-    }
   NS_LOG_LOGIC ("create alloc size="<<m_maxSize);
   return PacketMetadata::Allocate (m_maxSize);
 }
@@ -597,22 +575,8 @@ void
 PacketMetadata::Recycle (struct PacketMetadata::Data *data)
 {
   NS_LOG_FUNCTION (data);
-  if (!m_enable)
-    {
-      PacketMetadata::Deallocate (data);
-      return;
-    } 
-  NS_LOG_LOGIC ("recycle size="<<data->m_size<<", list="<<m_freeList.size ());
   NS_ASSERT (data->m_count == 0);
-  if (m_freeList.size () > 1000 ||
-      data->m_size < m_maxSize) 
-    {
-      PacketMetadata::Deallocate (data);
-    } 
-  else 
-    {
-      m_freeList.push_back (data);
-    }
+  PacketMetadata::Deallocate (data);
 }
 
 struct PacketMetadata::Data *
@@ -624,10 +588,12 @@ PacketMetadata::Allocate (uint32_t n)
     {
       n = PACKET_METADATA_DATA_M_DATA_SIZE;
     }
-  size += n - PACKET_METADATA_DATA_M_DATA_SIZE;
-  uint8_t *buf = new uint8_t [size];
-  struct PacketMetadata::Data *data = (struct PacketMetadata::Data *)buf;
-  data->m_size = n;
+  size = PacketMemory::GetCapacity (size + n - PACKET_METADATA_DATA_M_DATA_SIZE);
+  void *buf = PacketMemory::Allocate (PacketMemory::METADATA, size);
+  struct PacketMetadata::Data *data = static_cast<struct PacketMetadata::Data *> (buf);
+  // m_size is 16 bit wide
+  n = size - sizeof (struct Data) + PACKET_METADATA_DATA_M_DATA_SIZE;
+  data->m_size = std::min<uint32_t> (n, std::numeric_limits<uint16_t>::max ());
   data->m_count = 1;
   data->m_dirtyEnd = 0;
   return data;
@@ -636,8 +602,8 @@ void
 PacketMetadata::Deallocate (struct PacketMetadata::Data *data)
 {
   NS_LOG_FUNCTION (data);
-  uint8_t *buf = (uint8_t *)data;
-  delete [] buf;
+  PacketMemory::Deallocate (PacketMemory::METADATA, data,
+                            sizeof (struct Data) + data->m_size - PACKET_METADATA_DATA_M_DATA_SIZE);
 }
 
 
@@ -651,6 +617,20 @@ PacketMetadata::CreateFragment (uint32_t start, uint32_t end) const
   return fragment;
 }
 
+PacketMetadata
+PacketMetadata::CreateDetachedCopy (void) const
+{
+  NS_LOG_FUNCTION (this);
+  PacketMetadata copy = *this;
+  struct PacketMetadata::Data *data = PacketMetadata::Create (m_data->m_size);
+  memcpy (data->m_data, m_data->m_data, m_used);
+  data->m_dirtyEnd = m_used;
+  // *this still holds a reference to the shared data.
+  copy.m_data->m_count--;
+  copy.m_data = data;
+  return copy;
+}
+
 void 
 PacketMetadata::AddHeader (const Header &header, uint32_t size)
 {
@@ -666,7 +646,7 @@ PacketMetadata::DoAddHeader (uint32_t uid, uint32_t size)
   NS_LOG_FUNCTION (this << uid << size);
   if (!m_enable)
     {
-      m_metadataSkipped = true;
+      SetMetadataSkipped ();
       return;
     }
 
@@ -688,7 +668,7 @@ PacketMetadata::RemoveHeader (const Header &header, uint32_t size)
   NS_ASSERT (IsStateOk ());
   if (!m_enable) 
     {
-      m_metadataSkipped = true;
+      SetMetadataSkipped ();
       return;
     }
   struct PacketMetadata::SmallItem item;
@@ -736,7 +716,7 @@ PacketMetadata::AddTrailer (const Trailer &trailer, uint32_t size)
   NS_ASSERT (IsStateOk ());
   if (!m_enable)
     {
-      m_metadataSkipped = true;
+      SetMetadataSkipped ();
       return;
     }
   struct PacketMetadata::SmallItem item;
@@ -758,7 +738,7 @@ PacketMetadata::RemoveTrailer (const Trailer &trailer, uint32_t size)
   NS_ASSERT (IsStateOk ());
   if (!m_enable) 
     {
-      m_metadataSkipped = true;
+      SetMetadataSkipped ();
       return;
     }
   struct PacketMetadata::SmallItem item;
@@ -805,7 +785,7 @@ PacketMetadata::AddAtEnd (PacketMetadata const&o)
   NS_ASSERT (IsStateOk ());
   if (!m_enable) 
     {
-      m_metadataSkipped = true;
+      SetMetadataSkipped ();
       return;
     }
   if (m_tail == 0xffff)
@@ -882,7 +862,7 @@ PacketMetadata::AddPaddingAtEnd (uint32_t end)
   NS_LOG_FUNCTION (this << end);
   if (!m_enable)
     {
-      m_metadataSkipped = true;
+      SetMetadataSkipped ();
       return;
     }
 }
@@ -893,7 +873,7 @@ PacketMetadata::RemoveAtStart (uint32_t start)
   NS_ASSERT (IsStateOk ());
   if (!m_enable) 
     {
-      m_metadataSkipped = true;
+      SetMetadataSkipped ();
       return;
     }
   NS_ASSERT (m_data != 0);
@@ -956,7 +936,7 @@ PacketMetadata::RemoveAtEnd (uint32_t end)
   NS_ASSERT (IsStateOk ());
   if (!m_enable) 
     {
-      m_metadataSkipped = true;
+      SetMetadataSkipped ();
       return;
     }
   NS_ASSERT (m_data != 0);
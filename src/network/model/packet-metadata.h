@@ -23,6 +23,7 @@
 #include <stdint.h>
 #include <vector>
 #include <limits>
+#include <atomic>
 #include "ns3/callback.h"
 #include "ns3/assert.h"
 #include "ns3/type-id.h"
@@ -217,6 +218,14 @@ private:
    */
   PacketMetadata CreateFragment (uint32_t start, uint32_t end) const;
 
+  /**
+   * \brief Create a copy of the metadata which owns its own storage,
+   * rather than sharing it copy-on-write.
+   *
+   * \returns a copy of the metadata
+   */
+  PacketMetadata CreateDetachedCopy (void) const;
+
   /**
    * \brief Add a metadata at the metadata start
    * \param o the metadata to add
@@ -491,16 +500,6 @@ private:
     uint64_t packetUid;
   };
 
-  /**
-   * \brief Class to hold all the metadata
-   */
-  class DataFreeList : public std::vector<struct Data *>
-  {
-public:
-    ~DataFreeList ();
-  };
-
-  friend DataFreeList::~DataFreeList ();
   friend class ItemIterator;
 
   PacketMetadata ();
@@ -635,6 +634,10 @@ public:
 
   /**
    * \brief Recycle the buffer memory
+   *
+   * The memory goes back to the PacketMemory pools of the calling
+   * thread.
+   *
    * \param data the buffer data storage
    */
   static void Recycle (struct PacketMetadata::Data *data);
@@ -656,7 +659,6 @@ public:
    */
   static void Deallocate (struct PacketMetadata::Data *data);
 
-  static DataFreeList m_freeList; //!< the metadata data storage
   static bool m_enable; //!< Enable the packet metadata
   static bool m_enableChecking; //!< Enable the packet metadata checking
 
@@ -665,10 +667,15 @@ public:
    * m_enable is false; used to detect enabling of metadata in the
    * middle of a simulation, which isn't allowed.
    */
-  static bool m_metadataSkipped;
+  static std::atomic<bool> m_metadataSkipped;
+  /**
+   * Set m_metadataSkipped.  The flag is only written the first time,
+   * so that threads do not keep writing the same shared cache line.
+   */
+  static inline void SetMetadataSkipped (void);
 
-  static uint32_t m_maxSize; //!< maximum metadata size
-  static uint16_t m_chunkUid; //!< Chunk Uid
+  static thread_local uint32_t m_maxSize; //!< maximum metadata size created by the calling thread
+  static thread_local uint16_t m_chunkUid; //!< Chunk Uid
 
   struct Data *m_data; //!< Metadata storage
   /*
@@ -732,6 +739,14 @@ PacketMetadata::operator = (PacketMetadata const& o)
   m_packetUid = o.m_packetUid;
   return *this;
 }
+void
+PacketMetadata::SetMetadataSkipped (void)
+{
+  if (!m_metadataSkipped.load (std::memory_order_relaxed))
+    {
+      m_metadataSkipped.store (true, std::memory_order_relaxed);
+    }
+}
 PacketMetadata::~PacketMetadata ()
 {
   NS_ASSERT (m_data != 0);
@@ -24,16 +24,32 @@
 */
 
 #include "packet-tag-list.h"
+#include "packet-memory.h"
 #include "tag-buffer.h"
 #include "tag.h"
 #include "ns3/fatal-error.h"
 #include "ns3/log.h"
 #include <cstring>
+#include <new>
 
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("PacketTagList");
 
+struct PacketTagList::TagData *
+PacketTagList::CreateTagData (void)
+{
+  void *buffer = PacketMemory::Allocate (PacketMemory::PACKET_TAGS, sizeof (struct TagData));
+  return new (buffer) struct TagData ();
+}
+
+void
+PacketTagList::FreeTagData (struct TagData * data)
+{
+  data->~TagData ();
+  PacketMemory::Deallocate (PacketMemory::PACKET_TAGS, data, sizeof (struct TagData));
+}
+
 bool
 PacketTagList::COWTraverse (Tag & tag, PacketTagList::COWWriter Writer)
 {
@@ -133,7 +149,7 @@ PacketTagList::COWTraverse (Tag & tag, PacketTagList::COWWriter Writer)
       NS_ASSERT (cur != 0);
       NS_ASSERT (cur->count > 1);
       cur->count--;                       // unmerge cur
-      struct TagData * copy = new struct TagData ();
+      struct TagData * copy = CreateTagData ();
       copy->tid = cur->tid;
       copy->count = 1;
       memcpy (copy->data, cur->data, TagData::MAX_SIZE);
@@ -177,7 +193,7 @@ PacketTagList::RemoveWriter (Tag & tag, bool preMerge,
   if (preMerge)
     {
       // found tid before first merge, so delete cur
-      delete cur;
+      FreeTagData (cur);
     }
   else
     {
@@ -225,7 +241,7 @@ PacketTagList::ReplaceWriter (Tag & tag, bool preMerge,
       // cur is always a merge at this point
       // need to copy, replace, and link past cur
       cur->count--;                     // unmerge cur
-      struct TagData * copy = new struct TagData ();
+      struct TagData * copy = CreateTagData ();
       copy->tid = tag.GetInstanceTypeId ();
       copy->count = 1;
       tag.Serialize (TagBuffer (copy->data,
@@ -249,7 +265,7 @@ PacketTagList::Add (const Tag &tag) const
     {
       NS_ASSERT_MSG (cur->tid != tag.GetInstanceTypeId (), "Error: cannot add the same kind of tag twice.");
     }
-  struct TagData * head = new struct TagData ();
+  struct TagData * head = CreateTagData ();
   head->count = 1;
   head->next = 0;
   head->tid = tag.GetInstanceTypeId ();
@@ -284,5 +300,23 @@ PacketTagList::Head (void) const
   return m_next;
 }
 
+PacketTagList
+PacketTagList::CreateDetachedCopy (void) const
+{
+  NS_LOG_FUNCTION (this);
+  PacketTagList copy;
+  struct TagData ** prevNext = &copy.m_next;
+  for (struct TagData *cur = m_next; cur != 0; cur = cur->next)
+    {
+      struct TagData * data = CreateTagData ();
+      *data = *cur;
+      data->count = 1;
+      data->next = 0;
+      *prevNext = data;
+      prevNext = &data->next;
+    }
+  return copy;
+}
+
 } /* namespace ns3 */
 
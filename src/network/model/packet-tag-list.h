@@ -237,8 +237,23 @@ public:
    * \returns pointer to head of tag list
    */
   const struct PacketTagList::TagData *Head (void) const;
+  /**
+   * \returns a copy of this list which shares no TagData with it.
+   */
+  PacketTagList CreateDetachedCopy (void) const;
 
 private:
+  /**
+   * Allocate a TagData from the PacketMemory pools.
+   * \returns a zero-filled TagData.
+   */
+  static struct TagData * CreateTagData (void);
+  /**
+   * Give a TagData back to the PacketMemory pools.
+   * \param [in] data The TagData.
+   */
+  static void FreeTagData (struct TagData * data);
+
   /**
    * Typedef of method function pointer for copy-on-write operations
    *
@@ -350,13 +365,13 @@ PacketTagList::RemoveAll (void)
         }
       if (prev != 0) 
         {
-	  delete prev;
+          FreeTagData (prev);
         }
       prev = cur;
     }
   if (prev != 0) 
     {
-      delete prev;
+      FreeTagData (prev);
     }
   m_next = 0;
 }
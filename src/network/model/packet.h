@@ -21,6 +21,7 @@
 #define PACKET_H
 
 #include <stdint.h>
+#include <atomic>
 #include "buffer.h"
 #include "header.h"
 #include "trailer.h"
@@ -424,6 +425,17 @@ public:
    */
   Ptr<Packet> Copy (void) const;
 
+  /**
+   * \brief performs a deep copy of the packet.
+   *
+   * \returns a copy of the packet which shares no reference-counted
+   * data with the original.
+   *
+   * The copy can be handed over to another thread while the original
+   * is still in use in this one.
+   */
+  Ptr<Packet> CreateDetachedCopy (void) const;
+
   /**
    * \brief Returns the packet's Uid.
    *
@@ -727,7 +739,7 @@ private:
   /* Please see comments above about nix-vector */
   Ptr<NixVector> m_nixVector; //!< the packet's Nix vector
 
-  static uint32_t m_globalUid; //!< Global counter of packets Uid
+  static std::atomic<uint32_t> m_globalUid; //!< Global counter of packets Uid, shared by all threads
 };
 
 /**
@@ -0,0 +1,184 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/global-value.h"
+#include "ns3/string.h"
+#include "ns3/nstime.h"
+#include "ns3/node.h"
+#include "ns3/packet.h"
+#include "ns3/simple-channel.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/multithreaded-simulator-impl.h"
+
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * Events bounce between two partitions linked by a 1 ms channel while
+ * each partition also runs a stream of local events.
+ */
+class MultithreadedSimulatorTestCase : public TestCase
+{
+public:
+  MultithreadedSimulatorTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Bounce (uint32_t node, uint32_t hops);
+  void Tick (uint32_t node);
+
+  Time m_hopDelay;
+  std::vector<Time> m_bounces[2];
+  std::vector<uint32_t> m_bounceSystemIds[2];
+  uint32_t m_ticks[2];
+};
+
+MultithreadedSimulatorTestCase::MultithreadedSimulatorTestCase ()
+  : TestCase ("Events cross partitions at the right time, on the right thread")
+{
+}
+
+void
+MultithreadedSimulatorTestCase::Bounce (uint32_t node, uint32_t hops)
+{
+  m_bounces[node].push_back (Simulator::Now ());
+  m_bounceSystemIds[node].push_back (Simulator::GetSystemId ());
+  if (hops > 0)
+    {
+      Simulator::ScheduleWithContext (1 - node, m_hopDelay,
+                                      &MultithreadedSimulatorTestCase::Bounce, this, 1 - node, hops - 1);
+    }
+}
+
+void
+MultithreadedSimulatorTestCase::Tick (uint32_t node)
+{
+  m_ticks[node]++;
+  Simulator::Schedule (MicroSeconds (100), &MultithreadedSimulatorTestCase::Tick, this, node);
+}
+
+void
+MultithreadedSimulatorTestCase::DoRun (void)
+{
+  Simulator::Destroy ();
+  GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::MultithreadedSimulatorImpl"));
+
+  m_hopDelay = MilliSeconds (1);
+  m_ticks[0] = m_ticks[1] = 0;
+  Ptr<Node> nodes[2] = { CreateObject<Node> (0), CreateObject<Node> (1) };
+  Ptr<SimpleChannel> channel = CreateObject<SimpleChannel> ();
+  channel->SetAttribute ("Delay", TimeValue (m_hopDelay));
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      Ptr<SimpleNetDevice> device = CreateObject<SimpleNetDevice> ();
+      nodes[i]->AddDevice (device);
+      device->SetChannel (channel);
+    }
+
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      Simulator::ScheduleWithContext (nodes[i]->GetId (), Seconds (0),
+                                      &MultithreadedSimulatorTestCase::Tick, this, i);
+    }
+  Simulator::ScheduleWithContext (nodes[0]->GetId (), MilliSeconds (2),
+                                  &MultithreadedSimulatorTestCase::Bounce, this, 0, 20);
+  Simulator::Stop (MilliSeconds (50));
+  Simulator::Run ();
+
+  Ptr<MultithreadedSimulatorImpl> impl = DynamicCast<MultithreadedSimulatorImpl> (Simulator::GetImplementation ());
+  NS_TEST_ASSERT_MSG_NE (impl, 0, "Wrong simulator implementation");
+  NS_TEST_ASSERT_MSG_EQ (impl->GetNPartitions (), 2, "One partition per system id");
+  NS_TEST_ASSERT_MSG_EQ (impl->GetLookAhead (), m_hopDelay, "Lookahead is the channel delay");
+  NS_TEST_ASSERT_MSG_EQ (Simulator::Now (), MilliSeconds (50), "Run should end at the stop time");
+
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (m_ticks[i], 501, "Local events up to and including the stop time should run");
+      NS_TEST_ASSERT_MSG_EQ (m_bounces[i].size (), 11 - i, "Lost or duplicated cross-partition events");
+      for (uint32_t j = 0; j < m_bounces[i].size (); j++)
+        {
+          NS_TEST_ASSERT_MSG_EQ (m_bounces[i][j], MilliSeconds (2 + 2 * j + i), "Cross-partition event at the wrong time");
+          NS_TEST_ASSERT_MSG_EQ (m_bounceSystemIds[i][j], i, "Event ran in the wrong partition");
+        }
+    }
+
+  // A second run picks up where the first one stopped.
+  Simulator::Stop (MilliSeconds (10));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (Simulator::Now (), MilliSeconds (60), "Second run should end at the new stop time");
+  NS_TEST_ASSERT_MSG_EQ (m_ticks[0], 601, "Local events should resume in the second run");
+
+  Simulator::Destroy ();
+  GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::DefaultSimulatorImpl"));
+}
+
+/**
+ * A detached copy of a packet must not share data with the original.
+ */
+class PacketDetachedCopyTestCase : public TestCase
+{
+public:
+  PacketDetachedCopyTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PacketDetachedCopyTestCase::PacketDetachedCopyTestCase ()
+  : TestCase ("Detached packet copies are independent of the original")
+{
+}
+
+void
+PacketDetachedCopyTestCase::DoRun (void)
+{
+  uint8_t bytes[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  Ptr<Packet> original = Create<Packet> (bytes, sizeof (bytes));
+  original->AddPaddingAtEnd (100);
+  Ptr<Packet> copy = original->CreateDetachedCopy ();
+  NS_TEST_ASSERT_MSG_EQ (copy->GetUid (), original->GetUid (), "A copy keeps the uid");
+  NS_TEST_ASSERT_MSG_EQ (copy->GetSize (), original->GetSize (), "A copy keeps the size");
+
+  original->RemoveAtStart (4);
+  uint8_t marker[] = { 9, 9, 9, 9 };
+  original->AddAtEnd (Create<Packet> (marker, sizeof (marker)));
+
+  uint8_t out[sizeof (bytes)];
+  copy->CopyData (out, sizeof (out));
+  for (uint32_t i = 0; i < sizeof (bytes); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ ((uint32_t) out[i], (uint32_t) bytes[i], "The copy changed with the original");
+    }
+  NS_TEST_ASSERT_MSG_EQ (copy->GetSize (), sizeof (bytes) + 100, "The copy changed size with the original");
+}
+
+class MultithreadedSimulatorTestSuite : public TestSuite
+{
+public:
+  MultithreadedSimulatorTestSuite ();
+};
+
+MultithreadedSimulatorTestSuite::MultithreadedSimulatorTestSuite ()
+  : TestSuite ("multithreaded-simulator", UNIT)
+{
+  AddTestCase (new PacketDetachedCopyTestCase, TestCase::QUICK);
+  AddTestCase (new MultithreadedSimulatorTestCase, TestCase::QUICK);
+}
+
+static MultithreadedSimulatorTestSuite multithreadedSimulatorTestSuite;
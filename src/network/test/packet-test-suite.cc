@@ -19,6 +19,7 @@
  */
 #include "ns3/packet.h"
 #include "ns3/packet-tag-list.h"
+#include "ns3/packet-memory.h"
 #include "ns3/test.h"
 #include "ns3/unused.h"
 #include <limits>     // std:numeric_limits
@@ -847,6 +848,65 @@ PacketTagListTest::DoRun (void)
     
 }
 
+//-----------------------------------------------------------------------------
+class PacketMemoryTest : public TestCase
+{
+public:
+  PacketMemoryTest ();
+  virtual void DoRun (void);
+};
+
+PacketMemoryTest::PacketMemoryTest ()
+  : TestCase ("PacketMemory")
+{
+}
+
+void
+PacketMemoryTest::DoRun (void)
+{
+  NS_TEST_EXPECT_MSG_EQ (PacketMemory::GetCapacity (1), 16, "16 byte classes");
+  NS_TEST_EXPECT_MSG_EQ (PacketMemory::GetCapacity (256), 256, "16 byte classes");
+  NS_TEST_EXPECT_MSG_EQ (PacketMemory::GetCapacity (257), 512, "power of two classes");
+  NS_TEST_EXPECT_MSG_EQ (PacketMemory::GetCapacity (1500), 2048, "power of two classes");
+  NS_TEST_EXPECT_MSG_EQ (PacketMemory::GetCapacity (65536), 65536, "largest class");
+  NS_TEST_EXPECT_MSG_EQ (PacketMemory::GetCapacity (70000), 70000, "no class above 64 KiB");
+
+  // a released block is reused by the next request of its size class
+  void *block = PacketMemory::Allocate (PacketMemory::BYTE_TAGS, 100);
+  PacketMemory::Deallocate (PacketMemory::BYTE_TAGS, block, 100);
+  PacketMemory::Stats before = PacketMemory::GetStats (PacketMemory::BYTE_TAGS);
+  void *again = PacketMemory::Allocate (PacketMemory::BYTE_TAGS, 110);
+  PacketMemory::Stats after = PacketMemory::GetStats (PacketMemory::BYTE_TAGS);
+  NS_TEST_EXPECT_MSG_EQ (again, block, "block not reused");
+  NS_TEST_EXPECT_MSG_EQ (after.hits, before.hits + 1, "reuse not counted as a hit");
+  NS_TEST_EXPECT_MSG_EQ (after.inUse, before.inUse + 1, "wrong in-use count");
+  NS_TEST_EXPECT_MSG_GT (after.peak, before.inUse, "wrong peak");
+  PacketMemory::Deallocate (PacketMemory::BYTE_TAGS, again, 110);
+
+  // packets give all their memory back
+  PacketMemory::Stats stats[PacketMemory::N_POOLS];
+  for (uint32_t i = 0; i < PacketMemory::N_POOLS; i++)
+    {
+      stats[i] = PacketMemory::GetStats (static_cast<PacketMemory::Pool> (i));
+    }
+  {
+    Ptr<Packet> p = Create<Packet> (1000);
+    p->AddByteTag (ATestTag<1> ());
+    p->AddPacketTag (ATestTag<2> ());
+    Ptr<Packet> copy = p->Copy ();
+    copy->AddAtEnd (Create<Packet> (500));
+    copy->AddPacketTag (ATestTag<3> ());
+    Ptr<Packet> detached = copy->CreateDetachedCopy ();
+    detached->RemoveAtStart (10);
+  }
+  for (uint32_t i = 0; i < PacketMemory::N_POOLS; i++)
+    {
+      PacketMemory::Pool pool = static_cast<PacketMemory::Pool> (i);
+      NS_TEST_EXPECT_MSG_EQ (PacketMemory::GetStats (pool).inUse, stats[i].inUse,
+                             PacketMemory::GetPoolName (pool) << " memory leaked");
+    }
+}
+
 //-----------------------------------------------------------------------------
 class PacketTestSuite : public TestSuite
 {
@@ -859,6 +919,7 @@ PacketTestSuite::PacketTestSuite ()
 {
   AddTestCase (new PacketTest, TestCase::QUICK);
   AddTestCase (new PacketTagListTest, TestCase::QUICK);
+  AddTestCase (new PacketMemoryTest, TestCase::QUICK);
 }
 
 static PacketTestSuite g_packetTestSuite;
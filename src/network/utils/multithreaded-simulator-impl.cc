@@ -0,0 +1,680 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "multithreaded-simulator-impl.h"
+
+#include "ns3/simulator.h"
+#include "ns3/system-thread.h"
+#include "ns3/node.h"
+#include "ns3/node-list.h"
+#include "ns3/channel.h"
+#include "ns3/channel-list.h"
+#include "ns3/net-device.h"
+#include "ns3/assert.h"
+#include "ns3/abort.h"
+#include "ns3/log.h"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+namespace ns3 {
+
+// Note:  Logging in this file is largely avoided due to the
+// number of calls that are made to these functions.
+NS_LOG_COMPONENT_DEFINE ("MultithreadedSimulatorImpl");
+
+NS_OBJECT_ENSURE_REGISTERED (MultithreadedSimulatorImpl);
+
+/// Timestamp of a partition without pending events; also "no limit".
+static const uint64_t NO_TS = std::numeric_limits<uint64_t>::max ();
+
+thread_local MultithreadedSimulatorImpl::Partition *MultithreadedSimulatorImpl::m_currentPartition = 0;
+
+TypeId
+MultithreadedSimulatorImpl::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::MultithreadedSimulatorImpl")
+    .SetParent<SimulatorImpl> ()
+    .SetGroupName ("Network")
+    .AddConstructor<MultithreadedSimulatorImpl> ()
+  ;
+  return tid;
+}
+
+MultithreadedSimulatorImpl::MultithreadedSimulatorImpl ()
+  : m_uid (4),
+    m_currentTs (0),
+    m_unscheduledEvents (0),
+    m_stopTs (NO_TS),
+    m_lookAhead (NO_TS),
+    m_stop (false),
+    m_barrierCount (0),
+    m_barrierGeneration (0)
+{
+  NS_LOG_FUNCTION (this);
+  // uids are allocated from 4, as in DefaultSimulatorImpl; uid 2 is
+  // "destroy" events.
+}
+
+MultithreadedSimulatorImpl::~MultithreadedSimulatorImpl ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+MultithreadedSimulatorImpl::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  for (uint32_t p = 0; p < m_partitions.size (); p++)
+    {
+      Partition *partition = m_partitions[p];
+      ReceiveInbound (partition);
+      while (!partition->events->IsEmpty ())
+        {
+          Scheduler::Event next = partition->events->RemoveNext ();
+          next.impl->Unref ();
+        }
+      delete partition;
+    }
+  m_partitions.clear ();
+  if (m_staging != 0)
+    {
+      while (!m_staging->IsEmpty ())
+        {
+          Scheduler::Event next = m_staging->RemoveNext ();
+          next.impl->Unref ();
+        }
+      m_staging = 0;
+    }
+  SimulatorImpl::DoDispose ();
+}
+
+void
+MultithreadedSimulatorImpl::Destroy ()
+{
+  NS_LOG_FUNCTION (this);
+  while (!m_destroyEvents.empty ())
+    {
+      Ptr<EventImpl> ev = m_destroyEvents.front ().PeekEventImpl ();
+      m_destroyEvents.pop_front ();
+      NS_LOG_LOGIC ("handle destroy " << ev);
+      if (!ev->IsCancelled ())
+        {
+          ev->Invoke ();
+        }
+    }
+}
+
+void
+MultithreadedSimulatorImpl::SetScheduler (ObjectFactory schedulerFactory)
+{
+  NS_LOG_FUNCTION (this << schedulerFactory);
+  NS_ASSERT_MSG (m_currentPartition == 0, "Cannot change the scheduler while running");
+  m_schedulerFactory = schedulerFactory;
+
+  if (m_partitions.empty ())
+    {
+      Ptr<Scheduler> scheduler = schedulerFactory.Create<Scheduler> ();
+      if (m_staging != 0)
+        {
+          while (!m_staging->IsEmpty ())
+            {
+              scheduler->Insert (m_staging->RemoveNext ());
+            }
+        }
+      m_staging = scheduler;
+      return;
+    }
+  for (uint32_t p = 0; p < m_partitions.size (); p++)
+    {
+      Ptr<Scheduler> scheduler = schedulerFactory.Create<Scheduler> ();
+      while (!m_partitions[p]->events->IsEmpty ())
+        {
+          scheduler->Insert (m_partitions[p]->events->RemoveNext ());
+        }
+      m_partitions[p]->events = scheduler;
+    }
+}
+
+uint32_t
+MultithreadedSimulatorImpl::GetSystemId (void) const
+{
+  return m_currentPartition != 0 ? m_currentPartition->id : 0;
+}
+
+uint32_t
+MultithreadedSimulatorImpl::GetNPartitions (void) const
+{
+  return m_partitions.size ();
+}
+
+Time
+MultithreadedSimulatorImpl::GetLookAhead (void) const
+{
+  return m_lookAhead == NO_TS ? GetMaximumSimulationTime () : TimeStep (m_lookAhead);
+}
+
+MultithreadedSimulatorImpl::Partition *
+MultithreadedSimulatorImpl::GetPartition (uint32_t context) const
+{
+  if (m_partitions.empty ())
+    {
+      return 0;
+    }
+  if (context >= m_partitionOfNode.size ())
+    {
+      return m_partitions[0];
+    }
+  return m_partitions[m_partitionOfNode[context]];
+}
+
+void
+MultithreadedSimulatorImpl::CreatePartitions (void)
+{
+  NS_LOG_FUNCTION (this);
+  uint32_t nPartitions = 1;
+  m_partitionOfNode.resize (NodeList::GetNNodes ());
+  for (NodeList::Iterator i = NodeList::Begin (); i != NodeList::End (); ++i)
+    {
+      m_partitionOfNode[(*i)->GetId ()] = (*i)->GetSystemId ();
+      nPartitions = std::max (nPartitions, (*i)->GetSystemId () + 1);
+    }
+
+  for (uint32_t p = 0; p < nPartitions; p++)
+    {
+      Partition *partition = new Partition;
+      partition->id = p;
+      partition->events = m_schedulerFactory.Create<Scheduler> ();
+      partition->nextUid = m_uid + p;
+      partition->currentUid = 0;
+      partition->currentTs = m_currentTs;
+      partition->currentContext = Simulator::NO_CONTEXT;
+      partition->unscheduledEvents = 0;
+      partition->stop = false;
+      partition->stopSeen = false;
+      partition->nextTs = NO_TS;
+      partition->inbound = 0;
+      m_partitions.push_back (partition);
+    }
+
+  // Events scheduled so far keep their uids, which are all below the
+  // ones the partitions hand out from now on.
+  while (!m_staging->IsEmpty ())
+    {
+      Scheduler::Event ev = m_staging->RemoveNext ();
+      Partition *partition = GetPartition (ev.key.m_context);
+      partition->unscheduledEvents++;
+      partition->events->Insert (ev);
+    }
+  m_unscheduledEvents = 0;
+  m_staging = 0;
+  NS_LOG_INFO (nPartitions << " partitions");
+}
+
+void
+MultithreadedSimulatorImpl::ComputeLookAhead (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_lookAhead = NO_TS;
+  for (ChannelList::Iterator i = ChannelList::Begin (); i != ChannelList::End (); ++i)
+    {
+      Ptr<Channel> channel = *i;
+      bool crosses = false;
+      uint32_t first = 0;
+      bool seen = false;
+      for (uint32_t j = 0; j < channel->GetNDevices (); j++)
+        {
+          Ptr<Node> node = channel->GetDevice (j)->GetNode ();
+          if (node == 0)
+            {
+              continue;
+            }
+          uint32_t partition = m_partitionOfNode[node->GetId ()];
+          if (seen && partition != first)
+            {
+              crosses = true;
+            }
+          first = seen ? first : partition;
+          seen = true;
+        }
+      if (!crosses)
+        {
+          continue;
+        }
+      TimeValue delay;
+      if (!channel->GetAttributeFailSafe ("Delay", delay))
+        {
+          NS_FATAL_ERROR ("Channel " << channel->GetId () << " links two partitions but has no Delay attribute");
+        }
+      NS_ABORT_MSG_UNLESS (delay.Get ().IsStrictlyPositive (),
+                           "Channel " << channel->GetId () << " links two partitions without delay");
+      m_lookAhead = std::min<uint64_t> (m_lookAhead, delay.Get ().GetTimeStep ());
+    }
+  NS_LOG_INFO ("lookahead " << GetLookAhead ());
+}
+
+Scheduler::Event
+MultithreadedSimulatorImpl::Insert (Partition *partition, uint64_t ts, uint32_t context, EventImpl *event)
+{
+  Scheduler::Event ev;
+  ev.impl = event;
+  ev.key.m_ts = ts;
+  ev.key.m_context = context;
+  if (partition == 0)
+    {
+      ev.key.m_uid = m_uid;
+      m_uid++;
+      m_unscheduledEvents++;
+      m_staging->Insert (ev);
+    }
+  else
+    {
+      // Partitions interleave their uids so that they never collide.
+      ev.key.m_uid = partition->nextUid;
+      partition->nextUid += m_partitions.size ();
+      partition->unscheduledEvents++;
+      partition->events->Insert (ev);
+    }
+  return ev;
+}
+
+void
+MultithreadedSimulatorImpl::ProcessOneEvent (Partition *partition)
+{
+  Scheduler::Event next = partition->events->RemoveNext ();
+
+  NS_ASSERT (next.key.m_ts >= partition->currentTs);
+  partition->unscheduledEvents--;
+
+  partition->currentTs = next.key.m_ts;
+  partition->currentContext = next.key.m_context;
+  partition->currentUid = next.key.m_uid;
+  next.impl->Invoke ();
+  next.impl->Unref ();
+}
+
+void
+MultithreadedSimulatorImpl::ReceiveInbound (Partition *partition)
+{
+  Inbound *inbound = partition->inbound.exchange (0, std::memory_order_acquire);
+  while (inbound != 0)
+    {
+      Inbound *next = inbound->next;
+      partition->unscheduledEvents++;
+      partition->events->Insert (inbound->ev);
+      delete inbound;
+      inbound = next;
+    }
+}
+
+void
+MultithreadedSimulatorImpl::Barrier (void)
+{
+  uint32_t generation = m_barrierGeneration.load ();
+  if (m_barrierCount.fetch_add (1) + 1 == m_partitions.size ())
+    {
+      m_barrierCount.store (0);
+      m_barrierGeneration.fetch_add (1);
+      return;
+    }
+  while (m_barrierGeneration.load () == generation)
+    {
+      std::this_thread::yield ();
+    }
+}
+
+bool
+MultithreadedSimulatorImpl::IsFinished (void) const
+{
+  if (m_stop)
+    {
+      return true;
+    }
+  if (m_partitions.empty ())
+    {
+      return m_staging->IsEmpty ();
+    }
+  for (uint32_t p = 0; p < m_partitions.size (); p++)
+    {
+      if (!m_partitions[p]->events->IsEmpty () || m_partitions[p]->inbound.load () != 0)
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+void
+MultithreadedSimulatorImpl::RunPartition (uint32_t p)
+{
+  Partition *partition = m_partitions[p];
+  m_currentPartition = partition;
+  bool independent = m_lookAhead == NO_TS;
+
+  while (true)
+    {
+      // Everything other partitions sent during the last window has
+      // been pushed before the barrier that ended it.
+      ReceiveInbound (partition);
+      partition->nextTs = partition->events->IsEmpty () ? NO_TS : partition->events->PeekNext ().key.m_ts;
+      partition->stopSeen = partition->stop;
+      Barrier ();
+
+      // Every partition reaches the same decision from the values
+      // published before the barrier.
+      uint64_t start = NO_TS;
+      bool stop = false;
+      for (uint32_t q = 0; q < m_partitions.size (); q++)
+        {
+          start = std::min (start, m_partitions[q]->nextTs);
+          stop = stop || m_partitions[q]->stopSeen;
+        }
+      if (stop || start == NO_TS || start > m_stopTs)
+        {
+          break;
+        }
+      // No partition can receive an event earlier than start + lookahead.
+      uint64_t end = NO_TS - start > m_lookAhead ? start + m_lookAhead : NO_TS;
+      if (m_stopTs < end - 1)
+        {
+          end = m_stopTs + 1;
+        }
+
+      while (!partition->stop
+             && !partition->events->IsEmpty ()
+             && partition->events->PeekNext ().key.m_ts < end)
+        {
+          if (independent && m_stop.load (std::memory_order_relaxed))
+            {
+              break;
+            }
+          ProcessOneEvent (partition);
+        }
+      Barrier ();
+    }
+  m_currentPartition = 0;
+}
+
+void
+MultithreadedSimulatorImpl::Run (void)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT_MSG (m_currentPartition == 0, "Simulator::Run is not reentrant");
+  if (m_partitions.empty ())
+    {
+      CreatePartitions ();
+    }
+  NS_ASSERT_MSG (NodeList::GetNNodes () == m_partitionOfNode.size (),
+                 "Nodes must not be created after the first Simulator::Run");
+  ComputeLookAhead ();
+  m_stop = false;
+
+  for (uint32_t p = 0; p < m_partitions.size (); p++)
+    {
+      m_partitions[p]->stop = false;
+    }
+  std::vector<Ptr<SystemThread> > threads;
+  for (uint32_t p = 1; p < m_partitions.size (); p++)
+    {
+      Ptr<SystemThread> thread =
+        Create<SystemThread> (MakeCallback (&MultithreadedSimulatorImpl::RunPartition, this).Bind (p));
+      thread->Start ();
+      threads.push_back (thread);
+    }
+  RunPartition (0);
+  for (uint32_t i = 0; i < threads.size (); i++)
+    {
+      threads[i]->Join ();
+    }
+
+  // Between runs the simulation is at the time the furthest partition
+  // reached, or at the stop time if it was reached.
+  bool stopped = false;
+  bool finished = true;
+  for (uint32_t p = 0; p < m_partitions.size (); p++)
+    {
+      m_currentTs = std::max (m_currentTs, m_partitions[p]->currentTs);
+      stopped = stopped || m_partitions[p]->stop;
+      finished = finished && m_partitions[p]->events->IsEmpty ();
+    }
+  if (!stopped && m_stopTs != NO_TS)
+    {
+      m_currentTs = std::max (m_currentTs, m_stopTs);
+      m_stopTs = NO_TS;
+    }
+
+  // If the simulator stopped naturally by lack of events, make a
+  // consistency test to check that we didn't lose any events along the way.
+  for (uint32_t p = 0; p < m_partitions.size (); p++)
+    {
+      NS_ASSERT (!finished || m_partitions[p]->unscheduledEvents == 0);
+    }
+}
+
+void
+MultithreadedSimulatorImpl::Stop (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (m_currentPartition != 0)
+    {
+      m_currentPartition->stop = true;
+    }
+  m_stop = true;
+}
+
+void
+MultithreadedSimulatorImpl::Stop (Time const &delay)
+{
+  NS_LOG_FUNCTION (this << delay.GetTimeStep ());
+  if (m_currentPartition != 0)
+    {
+      Simulator::Schedule (delay, &Simulator::Stop);
+      return;
+    }
+  m_stopTs = std::min<uint64_t> (m_stopTs, m_currentTs + delay.GetTimeStep ());
+}
+
+EventId
+MultithreadedSimulatorImpl::Schedule (Time const &delay, EventImpl *event)
+{
+  NS_LOG_FUNCTION (this << delay.GetTimeStep () << event);
+  Partition *partition = m_currentPartition;
+  uint64_t now = partition != 0 ? partition->currentTs : m_currentTs;
+
+  Time tAbsolute = delay + TimeStep (now);
+
+  NS_ASSERT (tAbsolute.IsPositive ());
+  NS_ASSERT (tAbsolute >= TimeStep (now));
+  uint32_t context = GetContext ();
+  Scheduler::Event ev = Insert (partition != 0 ? partition : GetPartition (context),
+                                tAbsolute.GetTimeStep (), context, event);
+  return EventId (event, ev.key.m_ts, ev.key.m_context, ev.key.m_uid);
+}
+
+void
+MultithreadedSimulatorImpl::ScheduleWithContext (uint32_t context, Time const &delay, EventImpl *event)
+{
+  NS_LOG_FUNCTION (this << context << delay.GetTimeStep () << event);
+  Partition *partition = m_currentPartition;
+  Partition *target = GetPartition (context);
+  uint64_t now = partition != 0 ? partition->currentTs : m_currentTs;
+  uint64_t ts = (delay + TimeStep (now)).GetTimeStep ();
+
+  if (partition == 0 || partition == target)
+    {
+      Insert (target, ts, context, event);
+      return;
+    }
+
+  NS_ASSERT_MSG ((uint64_t) delay.GetTimeStep () >= m_lookAhead,
+                 "Event for partition " << target->id << " scheduled " << delay
+                 << " ahead, less than the lookahead " << GetLookAhead ());
+  Inbound *inbound = new Inbound;
+  inbound->ev.impl = event;
+  inbound->ev.key.m_ts = ts;
+  inbound->ev.key.m_context = context;
+  inbound->ev.key.m_uid = partition->nextUid;
+  partition->nextUid += m_partitions.size ();
+  inbound->next = target->inbound.load (std::memory_order_relaxed);
+  while (!target->inbound.compare_exchange_weak (inbound->next, inbound,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed))
+    {
+    }
+}
+
+EventId
+MultithreadedSimulatorImpl::ScheduleNow (EventImpl *event)
+{
+  return Schedule (Time (0), event);
+}
+
+EventId
+MultithreadedSimulatorImpl::ScheduleDestroy (EventImpl *event)
+{
+  CriticalSection cs (m_destroyEventsMutex);
+  EventId id (Ptr<EventImpl> (event, false), Now ().GetTimeStep (), 0xffffffff, 2);
+  m_destroyEvents.push_back (id);
+  return id;
+}
+
+Time
+MultithreadedSimulatorImpl::Now (void) const
+{
+  // Do not add function logging here, to avoid stack overflow
+  Partition *partition = m_currentPartition;
+  return TimeStep (partition != 0 ? partition->currentTs : m_currentTs);
+}
+
+Time
+MultithreadedSimulatorImpl::GetDelayLeft (const EventId &id) const
+{
+  if (IsExpired (id))
+    {
+      return TimeStep (0);
+    }
+  else
+    {
+      return TimeStep (id.GetTs () - Now ().GetTimeStep ());
+    }
+}
+
+void
+MultithreadedSimulatorImpl::Remove (const EventId &id)
+{
+  if (id.GetUid () == 2)
+    {
+      // destroy events.
+      CriticalSection cs (m_destroyEventsMutex);
+      for (DestroyEvents::iterator i = m_destroyEvents.begin (); i != m_destroyEvents.end (); i++)
+        {
+          if (*i == id)
+            {
+              m_destroyEvents.erase (i);
+              break;
+            }
+        }
+      return;
+    }
+  if (IsExpired (id))
+    {
+      return;
+    }
+  Partition *owner = GetPartition (id.GetContext ());
+  Scheduler::Event event;
+  event.impl = id.PeekEventImpl ();
+  event.key.m_ts = id.GetTs ();
+  event.key.m_context = id.GetContext ();
+  event.key.m_uid = id.GetUid ();
+  if (owner == 0)
+    {
+      m_staging->Remove (event);
+      m_unscheduledEvents--;
+    }
+  else
+    {
+      owner->events->Remove (event);
+      owner->unscheduledEvents--;
+    }
+  event.impl->Cancel ();
+  // whenever we remove an event from the event list, we have to unref it.
+  event.impl->Unref ();
+}
+
+void
+MultithreadedSimulatorImpl::Cancel (const EventId &id)
+{
+  if (!IsExpired (id))
+    {
+      id.PeekEventImpl ()->Cancel ();
+    }
+}
+
+bool
+MultithreadedSimulatorImpl::IsExpired (const EventId &id) const
+{
+  if (id.GetUid () == 2)
+    {
+      if (id.PeekEventImpl () == 0 ||
+          id.PeekEventImpl ()->IsCancelled ())
+        {
+          return true;
+        }
+      // destroy events.
+      CriticalSection cs (m_destroyEventsMutex);
+      for (DestroyEvents::const_iterator i = m_destroyEvents.begin (); i != m_destroyEvents.end (); i++)
+        {
+          if (*i == id)
+            {
+              return false;
+            }
+        }
+      return true;
+    }
+  Partition *owner = GetPartition (id.GetContext ());
+  NS_ASSERT_MSG (m_currentPartition == 0 || m_currentPartition == owner,
+                 "Event of partition " << owner->id << " used from partition " << m_currentPartition->id);
+  uint64_t currentTs = owner != 0 ? owner->currentTs : m_currentTs;
+  uint32_t currentUid = owner != 0 ? owner->currentUid : 0;
+  if (id.PeekEventImpl () == 0 ||
+      id.GetTs () < currentTs ||
+      (id.GetTs () == currentTs &&
+       id.GetUid () <= currentUid) ||
+      id.PeekEventImpl ()->IsCancelled ())
+    {
+      return true;
+    }
+  else
+    {
+      return false;
+    }
+}
+
+Time
+MultithreadedSimulatorImpl::GetMaximumSimulationTime (void) const
+{
+  return TimeStep (0x7fffffffffffffffLL);
+}
+
+uint32_t
+MultithreadedSimulatorImpl::GetContext (void) const
+{
+  Partition *partition = m_currentPartition;
+  return partition != 0 ? partition->currentContext : Simulator::NO_CONTEXT;
+}
+
+} // namespace ns3
@@ -0,0 +1,217 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MULTITHREADED_SIMULATOR_IMPL_H
+#define MULTITHREADED_SIMULATOR_IMPL_H
+
+#include "ns3/simulator-impl.h"
+#include "ns3/scheduler.h"
+#include "ns3/event-impl.h"
+#include "ns3/object-factory.h"
+#include "ns3/system-mutex.h"
+#include "ns3/nstime.h"
+#include "ns3/ptr.h"
+
+#include <atomic>
+#include <list>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup simulator
+ *
+ * \brief Parallel simulator implementation running one partition of
+ * the nodes per thread of a single process.
+ *
+ * Nodes are partitioned by their system id (Node::GetSystemId), as
+ * for the MPI based DistributedSimulatorImpl, and every partition
+ * gets its own event list and thread.  An event belongs to the
+ * partition of the node its context names; events without a node
+ * context belong to partition 0, which runs on the thread that
+ * called Simulator::Run.
+ *
+ * Synchronization is conservative.  The lookahead is the smallest
+ * "Delay" attribute of the channels that link nodes of different
+ * partitions.  Partitions advance in windows [T, T + lookahead), T
+ * being the earliest pending event of all of them, and meet at a
+ * barrier at the end of each window.  Events for another partition
+ * are pushed on that partition's lock-free inbound queue and moved
+ * into its event list at the next barrier; they must be scheduled at
+ * least one lookahead in the future.  Channels hand the receiving
+ * partition the packet itself (see PointToPointChannel), not a
+ * serialized copy.
+ *
+ * All nodes and channels must exist before the first Simulator::Run.
+ * An event may only be cancelled or removed from the partition it
+ * belongs to, or from the main thread between runs.  Simulator::Stop
+ * without a delay stops the calling partition at once and the others
+ * at the end of the window.  Simulator::Stop with a delay, when
+ * called outside of Run, stops every partition once the given time
+ * is done; called from an event it behaves like Simulator::Stop at
+ * that time in the calling partition.
+ *
+ * Select it with the "SimulatorImplementationType" global value set
+ * to "ns3::MultithreadedSimulatorImpl".
+ */
+class MultithreadedSimulatorImpl : public SimulatorImpl
+{
+public:
+  /**
+   *  Register this type.
+   *  \return The object TypeId.
+   */
+  static TypeId GetTypeId (void);
+
+  /** Constructor. */
+  MultithreadedSimulatorImpl ();
+  /** Destructor. */
+  ~MultithreadedSimulatorImpl ();
+
+  // Inherited
+  virtual void Destroy ();
+  virtual bool IsFinished (void) const;
+  virtual void Stop (void);
+  virtual void Stop (const Time &delay);
+  virtual EventId Schedule (const Time &delay, EventImpl *event);
+  virtual void ScheduleWithContext (uint32_t context, const Time &delay, EventImpl *event);
+  virtual EventId ScheduleNow (EventImpl *event);
+  virtual EventId ScheduleDestroy (EventImpl *event);
+  virtual void Remove (const EventId &id);
+  virtual void Cancel (const EventId &id);
+  virtual bool IsExpired (const EventId &id) const;
+  virtual void Run (void);
+  virtual Time Now (void) const;
+  virtual Time GetDelayLeft (const EventId &id) const;
+  virtual Time GetMaximumSimulationTime (void) const;
+  virtual void SetScheduler (ObjectFactory schedulerFactory);
+  virtual uint32_t GetSystemId (void) const;
+  virtual uint32_t GetContext (void) const;
+
+  /**
+   * \return the number of partitions, or zero before the first Run.
+   */
+  uint32_t GetNPartitions (void) const;
+  /**
+   * \return the lookahead of the last Run.
+   */
+  Time GetLookAhead (void) const;
+
+private:
+  virtual void DoDispose (void);
+
+  /** An event sent by another partition. */
+  struct Inbound
+  {
+    Scheduler::Event ev; //!< The event, with its absolute timestamp.
+    Inbound *next;       //!< Next inbound event.
+  };
+
+  /** A partition of the simulation and the state of its thread. */
+  struct Partition
+  {
+    uint32_t id;                      //!< Partition index.
+    Ptr<Scheduler> events;            //!< The event priority queue.
+    uint32_t nextUid;                 //!< Next event unique id.
+    uint32_t currentUid;              //!< Unique id of the current event.
+    uint64_t currentTs;               //!< Timestamp of the current event.
+    uint32_t currentContext;          //!< Execution context of the current event.
+    int unscheduledEvents;            //!< Events inserted but not yet run.
+    bool stop;                        //!< Simulator::Stop was called from this partition.
+    bool stopSeen;                    //!< stop, published at the barrier.
+    uint64_t nextTs;                  //!< Earliest pending event, published at the barrier.
+    std::atomic<Inbound *> inbound;   //!< Lock-free stack of events from other partitions.
+  };
+
+  /**
+   * Split the events scheduled before the first Run among the
+   * partitions.
+   */
+  void CreatePartitions (void);
+  /** Compute m_lookAhead from the channels linking partitions. */
+  void ComputeLookAhead (void);
+  /**
+   * Thread body: run partition \p p until the simulation stops.
+   * \param p The partition index.
+   */
+  void RunPartition (uint32_t p);
+  /**
+   * Process the next event of a partition.
+   * \param partition The partition.
+   */
+  void ProcessOneEvent (Partition *partition);
+  /**
+   * Move the events other partitions sent into the event list.
+   * \param partition The receiving partition.
+   */
+  void ReceiveInbound (Partition *partition);
+  /** Wait for every partition to reach this point. */
+  void Barrier (void);
+  /**
+   * \param context An event context.
+   * \return the partition events with this context run in.
+   */
+  Partition *GetPartition (uint32_t context) const;
+  /**
+   * Insert an event in the event list of a partition.
+   * \param partition The partition.
+   * \param ts The absolute timestamp.
+   * \param context The event context.
+   * \param event The event.
+   * \return the inserted event.
+   */
+  Scheduler::Event Insert (Partition *partition, uint64_t ts, uint32_t context, EventImpl *event);
+
+  /** Factory of the event lists. */
+  ObjectFactory m_schedulerFactory;
+  /** Events scheduled before the first Run. */
+  Ptr<Scheduler> m_staging;
+  /** The partitions, created by the first Run. */
+  std::vector<Partition *> m_partitions;
+  /** Partition of each node, by node id. */
+  std::vector<uint32_t> m_partitionOfNode;
+  /** Partition run by the calling thread, if any. */
+  static thread_local Partition *m_currentPartition;
+
+  /** Container type for the events to run at Simulator::Destroy() */
+  typedef std::list<EventId> DestroyEvents;
+  /** The container of events to run at Destroy. */
+  DestroyEvents m_destroyEvents;
+  /** Mutex to control access to the list of destroy events. */
+  mutable SystemMutex m_destroyEventsMutex;
+
+  /** Next event unique id, before the first Run. */
+  uint32_t m_uid;
+  /** Timestamp of the simulation outside of Run. */
+  uint64_t m_currentTs;
+  /** Number of events inserted but not yet run, before the first Run. */
+  int m_unscheduledEvents;
+  /** Last timestamp to run, set by Stop (delay) outside of Run. */
+  uint64_t m_stopTs;
+  /** Lookahead, in time steps. */
+  uint64_t m_lookAhead;
+  /** Flag calling for the end of the simulation. */
+  std::atomic<bool> m_stop;
+
+  /** Number of partitions waiting at the barrier. */
+  std::atomic<uint32_t> m_barrierCount;
+  /** Number of times the barrier has opened. */
+  std::atomic<uint32_t> m_barrierGeneration;
+};
+
+} // namespace ns3
+
+#endif /* MULTITHREADED_SIMULATOR_IMPL_H */
@@ -21,6 +21,7 @@
 #include "ns3/trace-source-accessor.h"
 #include "ns3/packet.h"
 #include "ns3/simulator.h"
+#include "ns3/node.h"
 #include "ns3/log.h"
 
 namespace ns3 {
@@ -80,9 +81,27 @@ PointToPointChannel::Attach (Ptr<PointToPointNetDevice> device)
       m_link[1].m_dst = m_link[0].m_src;
       m_link[0].m_state = IDLE;
       m_link[1].m_state = IDLE;
+      for (uint32_t i = 0; i < N_DEVICES; i++)
+        {
+          CacheNodes (i);
+        }
     }
 }
 
+void
+PointToPointChannel::CacheNodes (uint32_t wire)
+{
+  NS_LOG_FUNCTION (this << wire);
+  Ptr<Node> src = m_link[wire].m_src->GetNode ();
+  Ptr<Node> dst = m_link[wire].m_dst->GetNode ();
+  if (src == 0 || dst == 0)
+    {
+      return;
+    }
+  m_link[wire].m_dstNodeId = dst->GetId ();
+  m_link[wire].m_crossesSystems = src->GetSystemId () != dst->GetSystemId ();
+}
+
 bool
 PointToPointChannel::TransmitStart (
   Ptr<Packet> p,
@@ -96,8 +115,25 @@ PointToPointChannel::TransmitStart (
   NS_ASSERT (m_link[1].m_state != INITIALIZING);
 
   uint32_t wire = src == m_link[0].m_src ? 0 : 1;
+  if (m_link[wire].m_dstNodeId == 0xffffffff)
+    {
+      // The devices were attached before being added to their nodes.
+      // Each wire is only used by the partition of its sender, so only
+      // this wire is cached here.
+      CacheNodes (wire);
+    }
+
+  if (m_link[wire].m_crossesSystems)
+    {
+      // The receiver may run on another thread: hand it a packet and a
+      // device pointer whose reference counts this side never touches.
+      Simulator::ScheduleWithContext (m_link[wire].m_dstNodeId,
+                                      txTime + m_delay, &PointToPointNetDevice::Receive,
+                                      PeekPointer (m_link[wire].m_dst), p->CreateDetachedCopy ());
+      return true;
+    }
 
-  Simulator::ScheduleWithContext (m_link[wire].m_dst->GetNode ()->GetId (),
+  Simulator::ScheduleWithContext (m_link[wire].m_dstNodeId,
                                   txTime + m_delay, &PointToPointNetDevice::Receive,
                                   m_link[wire].m_dst, p);
 
@@ -73,6 +73,12 @@ public:
 
   /**
    * \brief Transmit a packet over this channel
+   *
+   * When the two devices are on nodes with different system ids (see
+   * MultithreadedSimulatorImpl), the receiver gets a detached copy of
+   * the packet and the TxRxPointToPoint trace is not fired, so that the
+   * two sides never share reference counts.
+   *
    * \param p Packet to transmit
    * \param src Source PointToPointNetDevice
    * \param txTime Transmit time to apply
@@ -149,6 +155,14 @@ private:
   /** Each point to point link has exactly two net devices. */
   static const int N_DEVICES = 2;
 
+  /**
+   * \brief Record the node id and system id of both ends of a wire,
+   * if both devices have been added to their nodes.
+   *
+   * \param wire index of the wire
+   */
+  void CacheNodes (uint32_t wire);
+
   Time          m_delay;    //!< Propagation delay
   int32_t       m_nDevices; //!< Devices of this channel
 
@@ -194,11 +208,14 @@ public:
     /** \brief Create the link, it will be in INITIALIZING state
      *
      */
-    Link() : m_state (INITIALIZING), m_src (0), m_dst (0) {}
+    Link() : m_state (INITIALIZING), m_src (0), m_dst (0),
+             m_dstNodeId (0xffffffff), m_crossesSystems (false) {}
 
     WireState                  m_state; //!< State of the link
     Ptr<PointToPointNetDevice> m_src;   //!< First NetDevice
     Ptr<PointToPointNetDevice> m_dst;   //!< Second NetDevice
+    uint32_t                   m_dstNodeId;      //!< Node id of m_dst, once known
+    bool                       m_crossesSystems; //!< Whether m_src and m_dst have different system ids
   };
 
   Link    m_link[N_DEVICES]; //!< Link model
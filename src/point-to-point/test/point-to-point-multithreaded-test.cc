@@ -0,0 +1,226 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/test.h"
+#include "ns3/drop-tail-queue.h"
+#include "ns3/simulator.h"
+#include "ns3/global-value.h"
+#include "ns3/string.h"
+#include "ns3/uinteger.h"
+#include "ns3/data-rate.h"
+#include "ns3/node.h"
+#include "ns3/point-to-point-net-device.h"
+#include "ns3/point-to-point-channel.h"
+#include "ns3/multithreaded-simulator-impl.h"
+
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * \brief Packets sent both ways over a PointToPointChannel that links
+ * two partitions of the multithreaded simulator.
+ *
+ * Each side sends packets of varying sizes, so that both threads
+ * allocate and release packet memory while the other one does, and
+ * every packet must arrive once, in order, intact and on the thread of
+ * its receiver.
+ */
+class PointToPointMultithreadedTest : public TestCase
+{
+public:
+  /**
+   * \brief Create the test
+   */
+  PointToPointMultithreadedTest ();
+
+  /**
+   * \brief Run the test
+   */
+  virtual void DoRun (void);
+
+private:
+  /**
+   * \brief Send the packets of one side, one at a time
+   *
+   * \param side index of the sending device
+   * \param seq sequence number of the packet to send
+   */
+  void Send (uint32_t side, uint32_t seq);
+
+  /**
+   * \brief Receive callback of the devices
+   *
+   * \param device receiving device
+   * \param packet received packet
+   * \param protocol protocol number
+   * \param from sender address
+   * \returns true
+   */
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from);
+
+  /**
+   * \brief Size of a packet
+   *
+   * \param seq sequence number of the packet
+   * \returns the size of the packet, at least 4 bytes
+   */
+  static uint32_t PacketSize (uint32_t seq);
+
+  static const uint32_t N_PACKETS = 500; //!< Packets sent by each side
+
+  Ptr<PointToPointNetDevice> m_devices[2];   //!< The devices
+  std::vector<uint64_t> m_sentUids[2];       //!< Uids sent by each side
+  std::vector<uint64_t> m_receivedUids[2];   //!< Uids received by each side
+  std::vector<uint32_t> m_receivedSeqs[2];   //!< Sequence numbers received by each side
+  uint32_t m_wrongSize[2];                   //!< Packets received with a wrong size or payload
+  uint32_t m_wrongThread[2];                 //!< Packets received on another thread
+};
+
+PointToPointMultithreadedTest::PointToPointMultithreadedTest ()
+  : TestCase ("PointToPoint packets cross multithreaded partitions")
+{
+}
+
+uint32_t
+PointToPointMultithreadedTest::PacketSize (uint32_t seq)
+{
+  return 4 + (seq * 37) % 1400;
+}
+
+void
+PointToPointMultithreadedTest::Send (uint32_t side, uint32_t seq)
+{
+  uint32_t size = PacketSize (seq);
+  std::vector<uint8_t> payload (size, static_cast<uint8_t> (seq));
+  payload[0] = seq >> 24;
+  payload[1] = seq >> 16;
+  payload[2] = seq >> 8;
+  payload[3] = seq;
+  Ptr<Packet> p = Create<Packet> (&payload[0], size);
+  m_sentUids[side].push_back (p->GetUid ());
+  m_devices[side]->Send (p, m_devices[side]->GetBroadcast (), 0x800);
+  if (seq + 1 < N_PACKETS)
+    {
+      Simulator::Schedule (MicroSeconds (200), &PointToPointMultithreadedTest::Send, this, side, seq + 1);
+    }
+}
+
+bool
+PointToPointMultithreadedTest::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from)
+{
+  uint32_t side = device == m_devices[0] ? 0 : 1;
+  if (Simulator::GetSystemId () != device->GetNode ()->GetSystemId ())
+    {
+      m_wrongThread[side]++;
+    }
+  std::vector<uint8_t> payload (packet->GetSize ());
+  packet->CopyData (&payload[0], payload.size ());
+  uint32_t seq = payload.size () < 4 ? 0
+    : (payload[0] << 24) | (payload[1] << 16) | (payload[2] << 8) | payload[3];
+  bool intact = payload.size () == PacketSize (seq);
+  for (uint32_t i = 4; intact && i < payload.size (); i++)
+    {
+      intact = payload[i] == static_cast<uint8_t> (seq);
+    }
+  if (!intact)
+    {
+      m_wrongSize[side]++;
+    }
+  m_receivedSeqs[side].push_back (seq);
+  m_receivedUids[side].push_back (packet->GetUid ());
+  return true;
+}
+
+void
+PointToPointMultithreadedTest::DoRun (void)
+{
+  Simulator::Destroy ();
+  GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::MultithreadedSimulatorImpl"));
+
+  Ptr<PointToPointChannel> channel = CreateObject<PointToPointChannel> ();
+  channel->SetAttribute ("Delay", TimeValue (MilliSeconds (1)));
+  Ptr<Node> nodes[2];
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      nodes[i] = CreateObject<Node> (i);
+      m_devices[i] = CreateObject<PointToPointNetDevice> ();
+      m_devices[i]->SetAttribute ("DataRate", DataRateValue (DataRate ("100Mbps")));
+      m_devices[i]->SetAddress (Mac48Address::Allocate ());
+      m_devices[i]->SetQueue (CreateObject<DropTailQueue> ());
+      m_devices[i]->Attach (channel);
+      nodes[i]->AddDevice (m_devices[i]);
+      Ptr<NetDeviceQueueInterface> iface = CreateObject<NetDeviceQueueInterface> ();
+      m_devices[i]->AggregateObject (iface);
+      iface->CreateTxQueues ();
+      m_devices[i]->SetReceiveCallback (MakeCallback (&PointToPointMultithreadedTest::Receive, this));
+      m_wrongSize[i] = 0;
+      m_wrongThread[i] = 0;
+    }
+
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      Simulator::ScheduleWithContext (nodes[i]->GetId (), MicroSeconds (10 + 50 * i),
+                                      &PointToPointMultithreadedTest::Send, this, i, 0);
+    }
+  Simulator::Run ();
+
+  Ptr<MultithreadedSimulatorImpl> impl = DynamicCast<MultithreadedSimulatorImpl> (Simulator::GetImplementation ());
+  NS_TEST_ASSERT_MSG_NE (impl, 0, "Wrong simulator implementation");
+  NS_TEST_ASSERT_MSG_EQ (impl->GetNPartitions (), 2, "One partition per system id");
+  NS_TEST_ASSERT_MSG_EQ (impl->GetLookAhead (), MilliSeconds (1), "Lookahead is the channel delay");
+
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      uint32_t j = 1 - i;
+      NS_TEST_ASSERT_MSG_EQ (m_sentUids[j].size (), N_PACKETS, "Not all packets were sent");
+      NS_TEST_ASSERT_MSG_EQ (m_receivedSeqs[i].size (), N_PACKETS, "Lost or duplicated packets");
+      NS_TEST_ASSERT_MSG_EQ (m_wrongSize[i], 0, "Packets changed on their way");
+      NS_TEST_ASSERT_MSG_EQ (m_wrongThread[i], 0, "Packets received in the wrong partition");
+      for (uint32_t k = 0; k < m_receivedSeqs[i].size (); k++)
+        {
+          NS_TEST_ASSERT_MSG_EQ (m_receivedSeqs[i][k], k, "Packets received out of order");
+          NS_TEST_ASSERT_MSG_EQ (m_receivedUids[i][k], m_sentUids[j][k], "Packets lost their uid");
+        }
+    }
+
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      m_devices[i] = 0;
+    }
+  Simulator::Destroy ();
+  GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::DefaultSimulatorImpl"));
+}
+
+/**
+ * \brief TestSuite for PointToPoint links between multithreaded partitions
+ */
+class PointToPointMultithreadedTestSuite : public TestSuite
+{
+public:
+  /**
+   * \brief Constructor
+   */
+  PointToPointMultithreadedTestSuite ();
+};
+
+PointToPointMultithreadedTestSuite::PointToPointMultithreadedTestSuite ()
+  : TestSuite ("devices-point-to-point-multithreaded", UNIT)
+{
+  AddTestCase (new PointToPointMultithreadedTest, TestCase::QUICK);
+}
+
+static PointToPointMultithreadedTestSuite g_pointToPointMultithreadedTestSuite; //!< The testsuite
@@ -38,34 +38,125 @@ EvalStats::EvalStats (uint32_t bandwidth, Time rttp, std::string fileName, Ptr<Q
   this->m_bandwidth = bandwidth;
   this->m_rttp = rttp;
   m_queueDisc = queue;
+  m_queueLimit = 0;
+  m_sampleInterval = Seconds (1);
+  m_nDropped = 0;
+  m_delay = Create<BottleneckDelayCollector> ();
+  m_historySize = 3600;
+  m_firstSample = 0;
 }
 
 EvalStats::~EvalStats ()
 {
+  m_delay->Uninstall ();
   InsertIntoFile ();
   m_evalStatsFile.close ();
+  if (m_timeSeriesFile.is_open ())
+    {
+      // Sojourn time count, mean, p50, p95, p99, p99.9 and max over the whole run
+      m_timeSeriesFile << "# run ";
+      BottleneckDelayCollector::WritePercentiles (m_timeSeriesFile, m_delay->GetRunHistogram ());
+      m_timeSeriesFile << std::endl;
+    }
+  m_timeSeriesFile.close ();
 }
 
-// Computes link utilization and mean queue size
+void
+EvalStats::SetSampleInterval (Time interval)
+{
+  NS_ASSERT (interval.IsStrictlyPositive ());
+  m_sampleInterval = interval;
+}
+
+void
+EvalStats::SetHistorySize (uint32_t size)
+{
+  NS_ASSERT (size > 0);
+  m_historySize = size;
+}
+
+void
+EvalStats::SetTimeSeriesFileName (std::string fileName)
+{
+  m_timeSeriesFileName = fileName;
+}
+
+uint32_t
+EvalStats::GetNSamples () const
+{
+  return m_samples.size ();
+}
+
+Ptr<const BottleneckDelayCollector>
+EvalStats::GetDelayCollector () const
+{
+  return m_delay;
+}
+
+const EvalStats::IntervalSample&
+EvalStats::GetSample (uint32_t i) const
+{
+  NS_ASSERT (i < m_samples.size ());
+  return m_samples[(m_firstSample + i) % m_samples.size ()];
+}
+
+// Computes link utilization, mean queue size, sojourn time and drops over
+// the interval that just ended, then schedules the next sample
 void
 EvalStats::ComputeMetrics ()
 {
-  m_totalUtilization += (double) m_bytesOut * 8.0 / ( m_bandwidth * 1000 * 1000 );
+  Time now = Simulator::Now ();
+  double interval = (now - m_lastSample).GetSeconds ();
+
+  IntervalSample sample;
+  sample.end = now;
+  sample.utilization = (interval > 0) ? (double) m_bytesOut * 8.0 / (m_bandwidth * 1000 * 1000 * interval) : 0;
+  sample.queueOccupancy = (m_nthSampleInInterval == 0 || m_queueLimit == 0) ? 0 : ((double) m_sumQueueLength / m_nthSampleInInterval / m_queueLimit * 100);
+  const SojournHistogram& sojourn = m_delay->GetIntervalHistogram ();
+  sample.meanSojourn = sojourn.GetMean ();
+  sample.sojournP50 = sojourn.GetPercentile (50);
+  sample.sojournP95 = sojourn.GetPercentile (95);
+  sample.sojournP99 = sojourn.GetPercentile (99);
+  sample.sojournP999 = sojourn.GetPercentile (99.9);
+  sample.dequeued = sojourn.GetCount ();
+  sample.drops = m_nDropped;
+
+  // The overall metrics are averages over time, so each interval is
+  // weighted by its length.
+  m_totalUtilization += sample.utilization * interval;
+  m_totalQueueSize += sample.queueOccupancy * interval;
+
   m_bytesOut = 0;
+  m_sumQueueLength = 0;
+  m_nthSampleInInterval = 0;
+  m_delay->ResetInterval ();
+  m_nDropped = 0;
+  m_lastSample = now;
 
-  UintegerValue queueSize;
-  if (m_bottleneckQueue.compare ("RED") == 0)
+  if (m_samples.size () < m_historySize)
     {
-      m_queueDisc->GetAttribute ("QueueLimit", queueSize);
+      m_samples.push_back (sample);
     }
   else
     {
-      m_queueDisc->GetAttribute ("Limit", queueSize);
+      m_samples[m_firstSample] = sample;
+      m_firstSample = (m_firstSample + 1) % m_historySize;
     }
 
-  m_totalQueueSize += ((m_nthSampleInInterval == 0) ? 0 : ((double) (m_sumQueueLength / m_nthSampleInInterval) / queueSize.Get () * 100));
-  m_sumQueueLength = 0;
-  m_nthSampleInInterval = 0;
+  if (m_timeSeriesFile.is_open ())
+    {
+      m_timeSeriesFile << sample.end.GetSeconds () << std::setw (15) << sample.utilization * 100;
+      m_timeSeriesFile << std::setw (15) << sample.queueOccupancy;
+      m_timeSeriesFile << std::setw (15) << sample.meanSojourn.GetSeconds ();
+      m_timeSeriesFile << std::setw (15) << sample.sojournP50.GetSeconds () << std::setw (15) << sample.sojournP95.GetSeconds ();
+      m_timeSeriesFile << std::setw (15) << sample.sojournP99.GetSeconds () << std::setw (15) << sample.sojournP999.GetSeconds ();
+      m_timeSeriesFile << std::setw (15) << sample.dequeued << std::setw (15) << sample.drops << "\n";
+    }
+
+  if (now + m_sampleInterval <= m_simulationTime)
+    {
+      Simulator::Schedule (m_sampleInterval, &EvalStats::ComputeMetrics, this);
+    }
 }
 
 // Inserts the values computed in the ComputeMetrics into the file
@@ -79,17 +170,6 @@ EvalStats::InsertIntoFile ()
   m_evalStatsFile.open (m_evalStatsFileName.c_str (), std::ios::app);
   m_evalStatsFile << m_bandwidth << std::setw (15) << m_rttp.GetSeconds () << std::setw (15) << m_numFtpFlows;
   m_evalStatsFile << std::setw (15) << (m_totalUtilization / (m_simulationTime.ToDouble (Time::S)) * 100);
-
-  UintegerValue queueSize;
-  if (m_bottleneckQueue.compare ("RED") == 0)
-    {
-      m_queueDisc->GetAttribute ("QueueLimit", queueSize);
-    }
-  else
-    {
-      m_queueDisc->GetAttribute ("Limit", queueSize);
-    }
-
   m_evalStatsFile << std::setw (15) << m_totalQueueSize / (m_simulationTime.ToDouble (Time::S));
   m_evalStatsFile << std::setw (15) << m_totalDroppedPacketRate;
 
@@ -113,6 +193,14 @@ EvalStats::AggregateQueue (Ptr<const QueueItem> packet)
   m_nthSampleInInterval++;
 }
 
+// Called during the Drop event at the queue.
+// Counts the drops of the current interval.
+void
+EvalStats::AggregateDrop (Ptr<const QueueItem> packet)
+{
+  m_nDropped++;
+}
+
 
 // It takes node as input and gets references to netdevice and queue in that node.
 // It then connects the trace sources PhyTxBegin and Enqueue to the netdevice and queue respectively
@@ -135,10 +223,33 @@ EvalStats::Install (Ptr<NetDevice> node, Ptr<TrafficParameters> traffic)
 
   m_netDevice->TraceConnectWithoutContext ("PhyTxBegin", MakeCallback (&EvalStats::AggregateOverInterval, this));
   m_queueDisc->TraceConnectWithoutContext ("Enqueue", MakeCallback (&EvalStats::AggregateQueue, this));
+  m_delay->Install (m_queueDisc);
+  m_queueDisc->TraceConnectWithoutContext ("Drop", MakeCallback (&EvalStats::AggregateDrop, this));
+
+  // The queue limit does not change during the run
+  UintegerValue queueSize;
+  if (m_bottleneckQueue.compare ("RED") == 0)
+    {
+      m_queueDisc->GetAttribute ("QueueLimit", queueSize);
+    }
+  else
+    {
+      m_queueDisc->GetAttribute ("Limit", queueSize);
+    }
+  m_queueLimit = queueSize.Get ();
+
+  m_samples.reserve (m_historySize);
+  if (!m_timeSeriesFileName.empty ())
+    {
+      m_timeSeriesFile.open (m_timeSeriesFileName.c_str (), std::ios::trunc);
+    }
 
-  for (uint32_t i = 1; i <= m_simulationTime.ToInteger (Time::S); ++i)
+  // A single event samples the metrics and reschedules itself, instead of
+  // one event per interval queued up front
+  m_lastSample = Simulator::Now ();
+  if (m_lastSample + m_sampleInterval <= m_simulationTime)
     {
-      Simulator::Schedule (Seconds (i), &EvalStats::ComputeMetrics, this);
+      Simulator::Schedule (m_sampleInterval, &EvalStats::ComputeMetrics, this);
     }
 }
 }
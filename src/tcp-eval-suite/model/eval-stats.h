@@ -35,6 +35,7 @@
 #include "ns3/network-module.h"
 #include "ns3/internet-module.h"
 #include "ns3/traffic-parameters.h"
+#include "ns3/bottleneck-delay-collector.h"
 
 #include "ns3/point-to-point-module.h"
 #include "ns3/point-to-point-layout-module.h"
@@ -47,10 +48,31 @@ namespace ns3 {
  *
  *  When installed on a node, it computes metrics such as link utilization,
  *  mean queue length and packet drop rate.
+ *
+ *  The metrics are sampled by a single self-rescheduling event every
+ *  sample interval (one second by default).  The samples of the most
+ *  recent intervals are kept in a ring buffer and, if a time series file
+ *  is set, every sample is also appended to that file as it is taken.
  */
 class EvalStats : public Object
 {
 public:
+  /**
+   * \brief Metrics of one sample interval.
+   */
+  struct IntervalSample
+  {
+    Time     end;                 //!< End of the interval
+    double   utilization;         //!< Fraction of the bottleneck capacity used
+    double   queueOccupancy;      //!< Mean queue length at enqueue, in percent of the queue limit
+    Time     meanSojourn;         //!< Mean sojourn time of the packets dequeued
+    Time     sojournP50;          //!< Median sojourn time
+    Time     sojournP95;          //!< 95th percentile of the sojourn time
+    Time     sojournP99;          //!< 99th percentile of the sojourn time
+    Time     sojournP999;         //!< 99.9th percentile of the sojourn time
+    uint32_t dequeued;            //!< Number of packets dequeued
+    uint32_t drops;               //!< Number of packets dropped
+  };
 
   /**
    * \brief Constructor
@@ -67,10 +89,55 @@ public:
   ~EvalStats ();
 
   /**
-   * \brief Calculates metrics every second.
+   * \brief Sets the sample interval.
+   *
+   * Must be called before Install. Defaults to one second.
+   *
+   * \param interval Length of each sample interval.
+   */
+  void SetSampleInterval (Time interval);
+
+  /**
+   * \brief Sets how many interval samples are kept in memory.
+   *
+   * Must be called before Install. Defaults to 3600.
+   *
+   * \param size Capacity of the sample ring buffer.
+   */
+  void SetHistorySize (uint32_t size);
+
+  /**
+   * \brief Returns the sojourn times recorded at the bottleneck queue.
+   */
+  Ptr<const BottleneckDelayCollector> GetDelayCollector () const;
+
+  /**
+   * \brief Sets a file to which every interval sample is appended.
+   *
+   * Must be called before Install. By default no time series is written.
    *
-   * Computes metrics such as link utilization, queue size every second and
+   * \param fileName Name of the time series file.
+   */
+  void SetTimeSeriesFileName (std::string fileName);
+
+  /**
+   * \brief Returns the number of interval samples held in memory.
+   */
+  uint32_t GetNSamples () const;
+
+  /**
+   * \brief Returns an interval sample held in memory.
+   *
+   * \param i Index of the sample, 0 being the oldest one still held.
+   */
+  const IntervalSample& GetSample (uint32_t i) const;
+
+  /**
+   * \brief Calculates metrics every sample interval.
+   *
+   * Computes metrics such as link utilization, queue size every sample interval,
    * stores the value so the overall utilization and queue size can be computed later
+   * and schedules itself for the end of the next interval.
    */
   void ComputeMetrics ();
 
@@ -95,6 +162,15 @@ public:
    */
   void AggregateQueue (Ptr<const QueueItem> packet);
 
+  /**
+   * \brief Counts a dropped packet
+   *
+   * It is called everytime a Drop event occurs.
+   *
+   * \param packet The item being dropped.
+   */
+  void AggregateDrop (Ptr<const QueueItem> packet);
+
   /**
    * \brief Writes the metrics into a file.
    *
@@ -116,7 +192,7 @@ public:
   void Install (Ptr<NetDevice> node, Ptr<TrafficParameters> traffic);
 
 private:
-  uint32_t                    m_bytesOut;		//!< Number of bytes sent per second
+  uint32_t                    m_bytesOut;		//!< Number of bytes sent in the current interval
   uint32_t                    m_bandwidth;		//!< Bandwidth of bottleneck link in Mbps
   uint32_t                    m_sumQueueLength;		//!< Sum of sampled queue lengths
   uint32_t                    m_nthSampleInInterval;	//!< Number of samples for queue lengths
@@ -132,6 +208,16 @@ private:
   std::string                 m_evalStatsFileName;	//!< Name of file where the output is stored
   std::ofstream               m_evalStatsFile;		//!< The file for storing the output
   Ptr<QueueDisc> m_queueDisc;
+  uint32_t                    m_queueLimit;		//!< Limit of the bottleneck queue, read once in Install
+  Time                        m_sampleInterval;		//!< Length of a sample interval
+  Time                        m_lastSample;		//!< End of the previous sample interval
+  uint32_t                    m_nDropped;		//!< Packets dropped in the current interval
+  Ptr<BottleneckDelayCollector> m_delay;		//!< Sojourn times at the bottleneck queue
+  std::vector<IntervalSample> m_samples;		//!< Ring buffer of interval samples
+  uint32_t                    m_historySize;		//!< Capacity of m_samples
+  uint32_t                    m_firstSample;		//!< Index of the oldest sample in m_samples
+  std::string                 m_timeSeriesFileName;	//!< Name of the time series file, if any
+  std::ofstream               m_timeSeriesFile;		//!< The file for the per-interval samples
 };
 
 }
@@ -0,0 +1,55 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * Convert a text connection vector file to the binary cvec format read
+ * by Tmix::BinaryCvecReader, e.g.
+ *
+ *   ./waf --run "tmix-cvec-convert --input=inbound.orig --format=original --output=inbound.bcvec"
+ *
+ * The binary file only needs to be produced once per trace; it can then
+ * be mapped by every run instead of parsing the text again.
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/tmix-binary-cvec.h"
+
+#include <fstream>
+
+using namespace ns3;
+
+int
+main (int argc, char *argv[])
+{
+  std::string input;
+  std::string output;
+  std::string format = "alt";
+
+  CommandLine cmd;
+  cmd.AddValue ("input", "Text connection vector file to convert", input);
+  cmd.AddValue ("output", "Binary connection vector file to create", output);
+  cmd.AddValue ("format", "Format of the input: alt (ns-2) or original", format);
+  cmd.Parse (argc, argv);
+
+  if (input.empty () || output.empty () || (format != "alt" && format != "original"))
+    {
+      std::cerr << "Usage: tmix-cvec-convert --input=<file> --output=<file> [--format=alt|original]" << std::endl;
+      return 1;
+    }
+
+  std::ifstream in (input.c_str ());
+  if (!in)
+    {
+      std::cerr << "Could not open " << input << std::endl;
+      return 1;
+    }
+  uint64_t n = Tmix::ConvertToBinaryCvec (in, format == "alt" ? Tmix::ALT_FORMAT : Tmix::ORIGINAL_FORMAT, output);
+
+  Tmix::BinaryCvecReader reader;
+  if (!reader.Open (output) || reader.GetNCvecs () != n)
+    {
+      std::cerr << "Could not write " << output << std::endl;
+      return 1;
+    }
+  std::cout << "Wrote " << n << " connection vectors (" << reader.GetNAdus () << " ADUs) to " << output << std::endl;
+  return 0;
+}
@@ -0,0 +1,63 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * Convert a binary trace written by a Tmix::Ns2StyleTraceHelper in
+ * BINARY mode to the ns-2 style text format, e.g.
+ *
+ *   ./waf --run "tmix-ns2-trace-convert --input=tmix.bt --output=tmix.tr"
+ *
+ * Writing the binary format during the simulation and converting it
+ * afterwards keeps full packet traces from slowing the simulation down.
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/tmix-ns2-style-trace-helper.h"
+
+#include <fstream>
+
+using namespace ns3;
+
+int
+main (int argc, char *argv[])
+{
+  std::string input;
+  std::string output;
+  bool header = false;
+
+  CommandLine cmd;
+  cmd.AddValue ("input", "Binary trace file to convert", input);
+  cmd.AddValue ("output", "Text trace file to create", output);
+  cmd.AddValue ("header", "Start the text trace with a comment naming the columns", header);
+  cmd.Parse (argc, argv);
+
+  if (input.empty () || output.empty ())
+    {
+      std::cerr << "Usage: tmix-ns2-trace-convert --input=<file> --output=<file> [--header]" << std::endl;
+      return 1;
+    }
+
+  std::ifstream in (input.c_str (), std::ios::in | std::ios::binary);
+  if (!in)
+    {
+      std::cerr << "Could not open " << input << std::endl;
+      return 1;
+    }
+  std::ofstream out (output.c_str ());
+  if (!out)
+    {
+      std::cerr << "Could not open " << output << std::endl;
+      return 1;
+    }
+  if (header)
+    {
+      out << Tmix::NS2_TRACE_COLUMNS;
+    }
+  int64_t n = Tmix::ConvertBinaryNs2Trace (in, out);
+  if (n < 0)
+    {
+      std::cerr << input << " is not a binary Tmix trace" << std::endl;
+      return 1;
+    }
+  std::cout << "Converted " << n << " events to " << output << std::endl;
+  return 0;
+}
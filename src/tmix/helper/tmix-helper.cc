@@ -51,14 +51,20 @@ TmixHelper::TmixHelper (Ptr<DelayBox> delayBox, Ptr<Node> initiatorNode,
                         Ipv4Address acceptorAddress)
   : m_ignoreLossRate (false),
     m_notifyCvecComplete (MakeNullCallback<void,
-                                           Tmix::ConnectionVector> ())
+                                           Ptr<const Tmix::ConnectionVector> > ()),
+    m_lazyIn (0),
+    m_lazyCursor (0),
+    m_lazyWindow (64),
+    m_lazyPending (0)
 {
   NS_LOG_FUNCTION (this << delayBox << initiatorAddress << acceptorAddress);
   m_portAllocator = Create<PortAllocator> ();
+  AddAddressPair (initiatorAddress, acceptorAddress);
   m_initiator = CreateObject<Tmix::Application> (delayBox,
                                                  Tmix::ADU::INITIATOR, initiatorAddress, acceptorAddress);
   m_acceptor = CreateObject<Tmix::Application> (delayBox, Tmix::ADU::ACCEPTOR,
                                                 acceptorAddress, initiatorAddress);
+  m_initiator->SetConnectionFailedCallback (MakeCallback (&TmixHelper::ConnectionFailed, this));
   initiatorNode->AddApplication (m_initiator);
   acceptorNode->AddApplication (m_acceptor);
 
@@ -70,38 +76,115 @@ TmixHelper::SetLossless (bool lossless)
   m_ignoreLossRate = lossless;
 }
 
+void
+TmixHelper::AddAddressPair (Ipv4Address initiatorAddress, Ipv4Address acceptorAddress)
+{
+  NS_LOG_FUNCTION (this << initiatorAddress << acceptorAddress);
+  m_addressPairs.push_back (std::make_pair (initiatorAddress, acceptorAddress));
+  m_portAllocator->AddPair ();
+}
+
+uint32_t
+TmixHelper::GetNPortsInUse () const
+{
+  return m_portAllocator->GetNPortsInUse ();
+}
+
 void
 TmixHelper::AddConnectionVector (const Tmix::ConnectionVector& cvec)
 { 
-  NS_LOG_FUNCTION (cvec.startTime);
-  Simulator::Schedule (cvec.startTime, &TmixHelper::StartConnectionVector, this,
+  ScheduleConnectionVector (Create<Tmix::ConnectionVector> (cvec));
+}
+
+void
+TmixHelper::ScheduleConnectionVector (Ptr<Tmix::ConnectionVector> cvec)
+{
+  NS_LOG_FUNCTION (cvec->startTime);
+  Simulator::Schedule (cvec->startTime, &TmixHelper::StartConnectionVector, this,
                        cvec);
 }
 
 void
-TmixHelper::StartConnectionVector (const Tmix::ConnectionVector& cvecLossy)
+TmixHelper::AddConnectionVector (Ptr<const Tmix::BinaryCvecReader> reader, uint64_t cursor)
+{
+  Tmix::BinaryCvecReader::View view;
+  uint64_t next = cursor;
+  if (!reader->Next (next, view))
+    {
+      NS_FATAL_ERROR ("No connection vector at offset " << cursor);
+    }
+  NS_LOG_FUNCTION (view.GetStartTime ());
+  Simulator::Schedule (view.GetStartTime (), &TmixHelper::StartStoredConnectionVector, this,
+                       reader, cursor);
+}
+
+void
+TmixHelper::StartStoredConnectionVector (Ptr<const Tmix::BinaryCvecReader> reader, uint64_t cursor)
 {
-  NS_LOG_FUNCTION (cvecLossy.startTime);
+  Tmix::BinaryCvecReader::View view;
+  reader->Next (cursor, view);
+  Ptr<Tmix::ConnectionVector> cvec = Create<Tmix::ConnectionVector> ();
+  view.ToConnectionVector (*cvec);
+  StartConnectionVector (cvec);
+}
 
-  uint16_t port = m_portAllocator->AllocatePort ();
-  Callback<void> deallocate = MakeCallback (&PortAllocator::DeallocatePort,
-                                            m_portAllocator).Bind (port);
+void
+TmixHelper::StartConnectionVector (Ptr<Tmix::ConnectionVector> cvec)
+{
+  NS_LOG_FUNCTION (cvec->startTime);
 
-  Tmix::ConnectionVector cvec (cvecLossy);
+  uint32_t pair;
+  uint16_t port;
+  m_portAllocator->AllocatePort (pair, port);
+  Callback<void> deallocate = MakeCallback (&TmixHelper::DeallocatePort,
+                                            this).Bind (pair).Bind (port);
+  const Ipv4Address& initiatorAddress = m_addressPairs[pair].first;
+  const Ipv4Address& acceptorAddress = m_addressPairs[pair].second;
+
+  // The helper holds the only other reference, so the loss rates can
+  // be cleared in place before the applications share the cvec.
   if (m_ignoreLossRate)
     {
-      cvec.lossRateAtoI = 0;
-      cvec.lossRateItoA = 0;
+      cvec->lossRateAtoI = 0;
+      cvec->lossRateItoA = 0;
+    }
+  m_acceptor->StartConnectionVector (cvec, port, acceptorAddress, initiatorAddress,
+                                     m_notifyCvecComplete, deallocate);
+  m_initiator->StartConnectionVector (cvec, port, initiatorAddress, acceptorAddress,
+                                      m_notifyCvecComplete, deallocate);
+}
+
+void
+TmixHelper::DeallocatePort (uint32_t pair, uint16_t port)
+{
+  if (m_portAllocator->DeallocatePort (pair, port))
+    {
+      const Ipv4Address& initiatorAddress = m_addressPairs[pair].first;
+      const Ipv4Address& acceptorAddress = m_addressPairs[pair].second;
+      m_acceptor->ForgetConnection (port, acceptorAddress, initiatorAddress);
+      m_initiator->ForgetConnection (port, initiatorAddress, acceptorAddress);
     }
-  m_acceptor->StartConnectionVector (cvec, port, m_notifyCvecComplete,
-                                     deallocate);
-  m_initiator->StartConnectionVector (cvec, port, m_notifyCvecComplete,
-                                      deallocate);
+}
+
+void
+TmixHelper::ConnectionFailed (uint16_t port, Ipv4Address initiatorAddress, Ipv4Address acceptorAddress)
+{
+  NS_LOG_FUNCTION (this << port << initiatorAddress << acceptorAddress);
+  m_acceptor->AbandonConnection (port, acceptorAddress);
 }
 
 unsigned
 TmixHelper::AddConnectionVectors (const std::string& filename)
 {
+  if (Tmix::BinaryCvecReader::IsBinaryCvecFile (filename))
+    {
+      Ptr<Tmix::BinaryCvecReader> reader = Create<Tmix::BinaryCvecReader> ();
+      if (!reader->Open (filename))
+        {
+          return 0;
+        }
+      return AddConnectionVectors (reader);
+    }
   std::ifstream in (filename.c_str ());
   return AddConnectionVectors (in);
 }
@@ -110,10 +193,26 @@ unsigned
 TmixHelper::AddConnectionVectors (std::istream& in)
 {
   unsigned n = 0;
-  Tmix::ConnectionVector cvec;
-  while (Tmix::ParseConnectionVector (in, cvec))
+  Ptr<Tmix::ConnectionVector> cvec = Create<Tmix::ConnectionVector> ();
+  while (Tmix::ParseConnectionVector (in, *cvec))
+    {
+      ScheduleConnectionVector (cvec);
+      cvec = Create<Tmix::ConnectionVector> ();
+      ++n;
+    }
+  return n;
+}
+
+unsigned
+TmixHelper::AddConnectionVectors (Ptr<const Tmix::BinaryCvecReader> reader)
+{
+  unsigned n = 0;
+  Tmix::BinaryCvecReader::View view;
+  for (uint64_t cursor = reader->Begin (); reader->Next (cursor, view); )
     {
-      AddConnectionVector (cvec);
+      Ptr<Tmix::ConnectionVector> cvec = Create<Tmix::ConnectionVector> ();
+      view.ToConnectionVector (*cvec);
+      ScheduleConnectionVector (cvec);
       ++n;
     }
   return n;
@@ -123,55 +222,196 @@ unsigned
 TmixHelper::AddConnectionVectors (std::istream& in, double ratio)
 {
   unsigned n = 0;
-  Tmix::ConnectionVector cvec;
-  while (Tmix::ParseConnectionVector (in, cvec))
+  Ptr<Tmix::ConnectionVector> cvec = Create<Tmix::ConnectionVector> ();
+  while (Tmix::ParseConnectionVector (in, *cvec))
     {
       if (m_rng->GetValue (0., 1.) < ratio)              //HJB
         {
-          AddConnectionVector (cvec);
+          ScheduleConnectionVector (cvec);
+          cvec = Create<Tmix::ConnectionVector> ();
           ++n;
         }
     }
   return n;
 }
 
+void
+TmixHelper::SetLazyWindow (uint32_t window)
+{
+  NS_ASSERT (window > 0);
+  m_lazyWindow = window;
+}
+
+uint32_t
+TmixHelper::GetNLazyPending () const
+{
+  return m_lazyPending;
+}
+
+void
+TmixHelper::AddConnectionVectorsLazy (std::istream& in)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT_MSG (!m_lazyIn && !m_lazyReader, "Only one lazy source per TmixHelper");
+  m_lazyIn = &in;
+  Simulator::ScheduleNow (&TmixHelper::FillLazyWindow, this);
+}
+
+bool
+TmixHelper::AddConnectionVectorsLazy (const std::string& filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+  if (Tmix::BinaryCvecReader::IsBinaryCvecFile (filename))
+    {
+      Ptr<Tmix::BinaryCvecReader> reader = Create<Tmix::BinaryCvecReader> ();
+      if (!reader->Open (filename))
+        {
+          return false;
+        }
+      AddConnectionVectorsLazy (reader);
+      return true;
+    }
+  m_lazyFile.open (filename.c_str ());
+  if (!m_lazyFile)
+    {
+      return false;
+    }
+  AddConnectionVectorsLazy (m_lazyFile);
+  return true;
+}
+
+void
+TmixHelper::AddConnectionVectorsLazy (Ptr<const Tmix::BinaryCvecReader> reader)
+{
+  NS_LOG_FUNCTION (this << reader);
+  NS_ASSERT_MSG (!m_lazyIn && !m_lazyReader, "Only one lazy source per TmixHelper");
+  m_lazyReader = reader;
+  m_lazyCursor = reader->Begin ();
+  Simulator::ScheduleNow (&TmixHelper::FillLazyWindow, this);
+}
+
+bool
+TmixHelper::ReadLazy (Tmix::ConnectionVector& cvec)
+{
+  if (m_lazyReader)
+    {
+      Tmix::BinaryCvecReader::View view;
+      if (!m_lazyReader->Next (m_lazyCursor, view))
+        {
+          return false;
+        }
+      view.ToConnectionVector (cvec);
+      return true;
+    }
+  return m_lazyIn && Tmix::ParseConnectionVector (*m_lazyIn, cvec);
+}
+
+void
+TmixHelper::FillLazyWindow ()
+{
+  Ptr<Tmix::ConnectionVector> cvec = Create<Tmix::ConnectionVector> ();
+  while (m_lazyPending < m_lazyWindow && ReadLazy (*cvec))
+    {
+      if (cvec->startTime < m_lazyLastStart)
+        {
+          NS_FATAL_ERROR ("Connection vectors are not sorted by start time: " << cvec->startTime
+                          << " follows " << m_lazyLastStart);
+        }
+      m_lazyLastStart = cvec->startTime;
+      Time delay = cvec->startTime - Simulator::Now ();
+      if (delay.IsStrictlyNegative ())
+        {
+          delay = Time (0);
+        }
+      Simulator::Schedule (delay, &TmixHelper::StartLazyConnectionVector, this, cvec);
+      cvec = Create<Tmix::ConnectionVector> ();
+      ++m_lazyPending;
+    }
+  NS_LOG_LOGIC (m_lazyPending << " connection vectors scheduled ahead");
+}
+
+void
+TmixHelper::StartLazyConnectionVector (Ptr<Tmix::ConnectionVector> cvec)
+{
+  --m_lazyPending;
+  StartConnectionVector (cvec);
+  FillLazyWindow ();
+}
+
 TmixHelper::PortAllocator::PortAllocator ()
-  : m_topPort (1024)
+  : m_nextPair (0),
+    m_nPortsInUse (0)
 {
 }
 
-uint16_t
-TmixHelper::PortAllocator::AllocatePort ()
+void
+TmixHelper::PortAllocator::AddPair ()
 {
-  if (!m_availablePorts.empty ())
+  PortRange range;
+  range.topPort = 1024;
+  range.holders.resize (65536, 0);
+  m_ranges.push_back (range);
+}
+
+bool
+TmixHelper::PortAllocator::AllocateFrom (PortRange& range, uint16_t& port)
+{
+  if (!range.availablePorts.empty ())
     {
-      uint16_t port = m_availablePorts.front ();
-      std::pop_heap (m_availablePorts.begin (), m_availablePorts.end (),
+      port = range.availablePorts.front ();
+      std::pop_heap (range.availablePorts.begin (), range.availablePorts.end (),
                      std::greater<uint16_t> ());
-      m_availablePorts.pop_back ();
+      range.availablePorts.pop_back ();
       NS_LOG_LOGIC ("Port " << port << " is being reused.");
-      return port;
+      return true;
     }
-  else
+  if (range.topPort > 65535)
     {
-      // Did we use too many ports simultaneously?
-      if (m_topPort == 65535)
-        {
-          NS_FATAL_ERROR ("Ran out of port numbers to assign. Too many concurrent connections?");
-        } //
-      NS_LOG_LOGIC ("Port " << m_topPort << " is newly assigned.");
-      return m_topPort++;
+      return false;
     }
+  port = range.topPort++;
+  NS_LOG_LOGIC ("Port " << port << " is newly assigned.");
+  return true;
 }
 
 void
-TmixHelper::PortAllocator::DeallocatePort (uint16_t port)
+TmixHelper::PortAllocator::AllocatePort (uint32_t& pair, uint16_t& port)
+{
+  NS_ASSERT (!m_ranges.empty ());
+  for (uint32_t tries = 0; tries < m_ranges.size (); tries++)
+    {
+      pair = m_nextPair;
+      m_nextPair = (m_nextPair + 1) % m_ranges.size ();
+      PortRange& range = m_ranges[pair];
+      if (AllocateFrom (range, port))
+        {
+          // Both the initiator and the acceptor hold the port until
+          // their socket is closed.
+          range.holders[port] = 2;
+          m_nPortsInUse++;
+          return;
+        }
+    }
+  NS_FATAL_ERROR ("Ran out of port numbers to assign. Too many concurrent connections? "
+                  "Consider TmixHelper::AddAddressPair.");
+}
+
+bool
+TmixHelper::PortAllocator::DeallocatePort (uint32_t pair, uint16_t port)
 {
-  NS_ASSERT_MSG (std::find (m_availablePorts.begin (), m_availablePorts.end (), port) == m_availablePorts.end (), "Port " << port << " deallocated twice.");
-  m_availablePorts.push_back (port);
-  std::push_heap (m_availablePorts.begin (), m_availablePorts.end (),
+  NS_ASSERT (pair < m_ranges.size ());
+  PortRange& range = m_ranges[pair];
+  NS_ASSERT_MSG (range.holders[port] > 0, "Port " << port << " deallocated twice.");
+  if (--range.holders[port] > 0)
+    {
+      return false;
+    }
+  range.availablePorts.push_back (port);
+  std::push_heap (range.availablePorts.begin (), range.availablePorts.end (),
                   std::greater<uint16_t> ());
+  m_nPortsInUse--;
   NS_LOG_LOGIC ("Port " << port << " deallocated.");
+  return true;
 }
 
 }
@@ -40,6 +40,9 @@
 #define TMIX_HELPER_H_
 
 #include "tmix.h"
+#include "tmix-binary-cvec.h"
+
+#include <fstream>
 
 namespace ns3 {
 
@@ -90,14 +93,47 @@ public:
   void
   SetLossless (bool lossless);
 
+  /**
+   * Also use the given pair of addresses for connections.  The
+   * addresses must already be configured on the initiator and
+   * acceptor node respectively, and be reachable through DelayBox
+   * devices sharing this helper's DelayBox.
+   *
+   * Each address pair has its own range of acceptor ports, and new
+   * connections are spread over all pairs round-robin, so the number
+   * of concurrently open connections the helper can run grows with
+   * the number of pairs.  The pair given to the constructor is always
+   * the first one.
+   */
+  void
+  AddAddressPair (Ipv4Address initiatorAddress, Ipv4Address acceptorAddress);
+
+  /**
+   * \return the number of acceptor ports that are still held by a
+   * connection, including connections in TIME_WAIT.
+   */
+  uint32_t
+  GetNPortsInUse () const;
+
   /**
    * Add and schedule one connection vector for execution at its startTime.
    */
   void
   AddConnectionVector (const Tmix::ConnectionVector& cvec);
 
+  /**
+   * Schedule the connection vector stored at the given cursor of a
+   * binary cvec file for execution at its startTime.  Only the reader
+   * and the cursor are kept until then; the record is converted when
+   * the connection starts, so many helpers can share one reader.
+   */
+  void
+  AddConnectionVector (Ptr<const Tmix::BinaryCvecReader> reader, uint64_t cursor);
+
   /**
    * Parse all connection vectors from the given file and schedule them.
+   * Files starting with the binary cvec magic number are read through
+   * a Tmix::BinaryCvecReader, anything else is parsed as text.
    * \return the number of connection vectors added.
    */
   unsigned
@@ -110,6 +146,13 @@ public:
   unsigned
   AddConnectionVectors (std::istream& in);
 
+  /**
+   * Schedule all connection vectors of an open binary cvec file.
+   * \return the number of connection vectors added.
+   */
+  unsigned
+  AddConnectionVectors (Ptr<const Tmix::BinaryCvecReader> reader);
+
   /**
    * Parse all connection vectors from the given input stream and schedule
    * a certain fraction of them, chosen at random. The ratio argument should
@@ -120,60 +163,182 @@ public:
   AddConnectionVectors (std::istream& in, double ratio);
 
   /**
-   * \attention Not yet implemented.
-   *
    * Parse connection vectors one at a time, waiting for the simulation to catch up
    * after each one is scheduled. This function will schedule parsing of the first
-   * connection vector for simulation time 0. It expects that connection vectors
+   * connection vectors for simulation time 0. It expects that connection vectors
    * will arrive at the input stream sorted in ascending order by start time and will
    * abort the simulation if they are not.
    *
-   * Adding connection vectors in this way may help reduce memory usage and startup time
-   * for exceptionally large sets of connection vectors.
+   * At most SetLazyWindow() connection vectors are parsed ahead of the
+   * simulation clock; each time one of them starts, the next one is read
+   * from the stream and scheduled.  The number of pending events and the
+   * memory held for ADUs are thus bounded by the window and the number of
+   * concurrently running connections, not by the length of the trace.
    *
-   * TODO: NOT YET IMPLEMENTED.
+   * The stream must outlive the simulation.  Only one lazy source can be
+   * active per helper.
    */
   void
-  AddConnectionVectorsLazy (std::istream& in)
-  {
-    NS_FATAL_ERROR ("Not implemented.");
-  }
+  AddConnectionVectorsLazy (std::istream& in);
+
+  /**
+   * Like AddConnectionVectorsLazy(std::istream&), but the file is opened
+   * and owned by the helper.  Binary cvec files are read through a
+   * Tmix::BinaryCvecReader.
+   * \return false if the file could not be opened.
+   */
+  bool
+  AddConnectionVectorsLazy (const std::string& filename);
+
+  /**
+   * Like AddConnectionVectorsLazy(std::istream&), reading from an open
+   * binary cvec file.
+   */
+  void
+  AddConnectionVectorsLazy (Ptr<const Tmix::BinaryCvecReader> reader);
+
+  /**
+   * Maximum number of connection vectors the lazy mode schedules ahead of
+   * the simulation clock.
+   *
+   * Default: 64.
+   */
+  void
+  SetLazyWindow (uint32_t window);
+
+  /**
+   * \return the number of connection vectors the lazy mode has
+   * scheduled that have not started yet.
+   */
+  uint32_t
+  GetNLazyPending () const;
 
   void
-  SetCvecCompleteCallback (const Callback<void, Tmix::ConnectionVector>& callback)
+  SetCvecCompleteCallback (const Callback<void, Ptr<const Tmix::ConnectionVector> >& callback)
   {
     m_notifyCvecComplete = callback;
   }
 
 private:
+  /// Schedule a connection vector the helper owns for its startTime.
+  void
+  ScheduleConnectionVector (Ptr<Tmix::ConnectionVector> cvec);
+
+  /// Start a connection vector; both applications share \p cvec.
+  void
+  StartConnectionVector (Ptr<Tmix::ConnectionVector> cvec);
+
+  /**
+   * Called by each of the two applications once its side of the
+   * connection has released the port.  The second call frees the
+   * port and removes the DelayBox rules.
+   */
+  void
+  DeallocatePort (uint32_t pair, uint16_t port);
+
+  /**
+   * Called by the initiator application when it gave up on a
+   * connection that was never established; the acceptor stops
+   * waiting for it.
+   */
+  void
+  ConnectionFailed (uint16_t port, Ipv4Address initiatorAddress, Ipv4Address acceptorAddress);
+
+  /// Start the connection vector stored at the given cursor of a binary cvec file.
+  void
+  StartStoredConnectionVector (Ptr<const Tmix::BinaryCvecReader> reader, uint64_t cursor);
+
+  /// Read the next connection vector from the active lazy source.
+  bool
+  ReadLazy (Tmix::ConnectionVector& cvec);
+  /// Schedule connection vectors from the lazy source until the window is full.
+  void
+  FillLazyWindow ();
+  /// Start a connection vector scheduled by FillLazyWindow and refill the window.
   void
-  StartConnectionVector (const Tmix::ConnectionVector& cvec);
+  StartLazyConnectionVector (Ptr<Tmix::ConnectionVector> cvec);
 
 private:
   Ptr<UniformRandomVariable> m_rng;                     //HJB
   bool m_ignoreLossRate;
 
-  Callback<void, Tmix::ConnectionVector> m_notifyCvecComplete;
+  Callback<void, Ptr<const Tmix::ConnectionVector> > m_notifyCvecComplete;
 
   Ptr<Tmix::Application> m_initiator;
   Ptr<Tmix::Application> m_acceptor;
 
+  /// Text source of the lazy mode, if any.
+  std::istream *m_lazyIn;
+  /// File opened by AddConnectionVectorsLazy(const std::string&).
+  std::ifstream m_lazyFile;
+  /// Binary source of the lazy mode, if any.
+  Ptr<const Tmix::BinaryCvecReader> m_lazyReader;
+  /// Position of the next record in m_lazyReader.
+  uint64_t m_lazyCursor;
+  /// Maximum number of lazily scheduled, not yet started connection vectors.
+  uint32_t m_lazyWindow;
+  /// Number of lazily scheduled, not yet started connection vectors.
+  uint32_t m_lazyPending;
+  /// Start time of the last connection vector read from the lazy source.
+  Time m_lazyLastStart;
+
+  /// Initiator and acceptor addresses of each address pair.
+  std::vector<std::pair<Ipv4Address, Ipv4Address> > m_addressPairs;
+
+  /**
+   * Hands out acceptor ports for each address pair.  A port is held
+   * by both sides of its connection and becomes available again once
+   * both have released it; the lowest available port is reused first.
+   */
   class PortAllocator : public SimpleRefCount<PortAllocator>
   {
 public:
     PortAllocator ();
 
-    uint16_t
-    AllocatePort ();
+    /// Add the port range of another address pair.
+    void
+    AddPair ();
 
+    /**
+     * Allocate a port, trying the address pairs round-robin.
+     * \param pair Out: index of the address pair.
+     * \param port Out: the port.
+     */
     void
-    DeallocatePort (uint16_t port);
+    AllocatePort (uint32_t& pair, uint16_t& port);
+
+    /**
+     * Release one side's hold on a port.
+     * \return true if the port is now available again.
+     */
+    bool
+    DeallocatePort (uint32_t pair, uint16_t port);
+
+    uint32_t
+    GetNPortsInUse () const
+    {
+      return m_nPortsInUse;
+    }
 
 private:
-    /// Min-heap of available ports. Starts out empty and grows as needed.
-    std::vector<uint16_t> m_availablePorts;
-    /// Next port number to add if m_availablePorts is empty.
-    int m_topPort;
+    struct PortRange
+    {
+      /// Min-heap of available ports. Starts out empty and grows as needed.
+      std::vector<uint16_t> availablePorts;
+      /// Next port number to add if availablePorts is empty.
+      uint32_t topPort;
+      /// Number of sides still holding each port, indexed by port.
+      std::vector<uint8_t> holders;
+    };
+
+    /// Take a port from the given range. \return false if it is exhausted.
+    bool
+    AllocateFrom (PortRange& range, uint16_t& port);
+
+    std::vector<PortRange> m_ranges;
+    /// Range to try first on the next allocation.
+    uint32_t m_nextPair;
+    uint32_t m_nPortsInUse;
   };
 
   Ptr<PortAllocator> m_portAllocator;
@@ -38,9 +38,9 @@
 
 #include "tmix-ns2-style-trace-helper.h"
 
-#include <iomanip>
+#include <cstdio>
+#include <cstring>
 #include "ns3/ipv4-interface.h"
-#include "ns3/ppp-header.h"
 #include "ns3/log.h"
 
 NS_LOG_COMPONENT_DEFINE ("TmixNs2StyleTraceHelper");
@@ -48,10 +48,60 @@ NS_LOG_COMPONENT_DEFINE ("TmixNs2StyleTraceHelper");
 namespace ns3 {
 namespace Tmix {
 
+/// Size of the buffer events are collected in before being written.
+static const uint32_t NS2_TRACE_WRITE_BUFFER = 1 << 20;
+
+/// Size of the PPP header in front of every traced packet.
+static const uint32_t PPP_HEADER_SIZE = 2;
+
+uint32_t
+FormatNs2TraceLine (const BinaryNs2TraceRecord& record, char *buffer)
+{
+  int n = std::snprintf (buffer, NS2_TRACE_LINE_MAX,
+                         "%c %.6f %u %u ack %u ------- 0 %u.%u %u.%u %u %llu %u 0x%02x 40 0 \n",
+                         record.event, record.time / 1e9, record.llsrc, record.lldst,
+                         record.size, record.srcNode, record.srcPort, record.dstNode,
+                         record.dstPort, record.seqno, (unsigned long long) record.uid,
+                         record.ackno, record.tcpFlags);
+  NS_ASSERT (n > 0 && uint32_t (n) < NS2_TRACE_LINE_MAX);
+  return n;
+}
+
+int64_t
+ConvertBinaryNs2Trace (std::istream& in, std::ostream& out)
+{
+  BinaryNs2TraceHeader header;
+  if (!in.read (reinterpret_cast<char *> (&header), sizeof (header))
+      || header.magic != BINARY_NS2_TRACE_MAGIC || header.version != BINARY_NS2_TRACE_VERSION)
+    {
+      return -1;
+    }
+  const uint32_t batch = 4096;
+  std::vector<BinaryNs2TraceRecord> records (batch);
+  std::vector<char> text (batch * NS2_TRACE_LINE_MAX);
+  int64_t n = 0;
+  while (in)
+    {
+      in.read (reinterpret_cast<char *> (&records[0]), batch * sizeof (BinaryNs2TraceRecord));
+      uint32_t nRecords = in.gcount () / sizeof (BinaryNs2TraceRecord);
+      uint32_t size = 0;
+      for (uint32_t i = 0; i < nRecords; i++)
+        {
+          size += FormatNs2TraceLine (records[i], &text[size]);
+        }
+      out.write (&text[0], size);
+      n += nRecords;
+    }
+  return n;
+}
+
 Ns2StyleTraceHelper::Ns2StyleTraceHelper (Ptr<TmixTopology> tmix,
-                                          std::ostream& out)
+                                          std::ostream& out, Format format)
   : m_tmix (tmix),
-    m_out (out)
+    m_out (out),
+    m_format (format),
+    m_buffer (NS2_TRACE_WRITE_BUFFER),
+    m_bufferUsed (0)
 {
   m_idOfNodeType[TmixTopology::LEFT_INITIATOR] = 0;
   m_idOfNodeType[TmixTopology::LEFT_ACCEPTOR] = 2;
@@ -59,6 +109,40 @@ Ns2StyleTraceHelper::Ns2StyleTraceHelper (Ptr<TmixTopology> tmix,
   m_idOfNodeType[TmixTopology::RIGHT_INITIATOR] = 3;
   m_idOfNodeType[TmixTopology::LEFT_ROUTER] = 4;
   m_idOfNodeType[TmixTopology::RIGHT_ROUTER] = 5;
+  if (m_format == BINARY)
+    {
+      BinaryNs2TraceHeader header;
+      header.magic = BINARY_NS2_TRACE_MAGIC;
+      header.version = BINARY_NS2_TRACE_VERSION;
+      Append (reinterpret_cast<const char *> (&header), sizeof (header));
+    }
+  m_flushEvent = Simulator::ScheduleDestroy (&Ns2StyleTraceHelper::Flush, this);
+}
+
+Ns2StyleTraceHelper::~Ns2StyleTraceHelper ()
+{
+  Simulator::Cancel (m_flushEvent);
+  Flush ();
+}
+
+void
+Ns2StyleTraceHelper::Append (const char *data, uint32_t size)
+{
+  if (m_bufferUsed + size > m_buffer.size ())
+    {
+      m_out.write (&m_buffer[0], m_bufferUsed);
+      m_bufferUsed = 0;
+    }
+  std::memcpy (&m_buffer[m_bufferUsed], data, size);
+  m_bufferUsed += size;
+}
+
+void
+Ns2StyleTraceHelper::Flush ()
+{
+  m_out.write (&m_buffer[0], m_bufferUsed);
+  m_bufferUsed = 0;
+  m_out.flush ();
 }
 
 /**
@@ -242,144 +326,99 @@ Ns2StyleTraceHelper::Install (Ptr<PointToPointNetDevice> device,
                               std::string trace, TraceEvent event, TmixTopology::NodeType llsrc,
                               TmixTopology::NodeType lldst, Ipv4Address src, Ipv4Address dst)
 {
+  TraceSpec ts (event, llsrc, lldst, src, dst, m_uniqid,
+                m_tmix->NodeTypeByAddress (src), m_tmix->NodeTypeByAddress (dst));
+  NS_ASSERT_MSG (ts.srcNode != TmixTopology::INVALID, "Couldn't match source with a Tmix node");
+  NS_ASSERT_MSG (ts.dstNode != TmixTopology::INVALID, "Couldn't match destination with a Tmix node");
   device->TraceConnectWithoutContext (trace, MakeCallback (
-                                        &Ns2StyleTraceHelper::OutputTrace, this).Bind (TraceSpec (event, llsrc,
-                                                                                                  lldst, src, dst, m_uniqid)));
+                                        &Ns2StyleTraceHelper::OutputTrace, this).Bind (ts));
 }
 
 void
 Ns2StyleTraceHelper::WriteInformativeHeader ()
 {
-  m_out
-  << "# event time llsrc lldst name size flags flowid src dst seqno uniqid ackno tcpflags hdrlen sockaddrlen"
-  << std::endl;
+  if (m_format == BINARY)
+    {
+      return;
+    }
+  Append (NS2_TRACE_COLUMNS, std::strlen (NS2_TRACE_COLUMNS));
 }
 
 void
 Ns2StyleTraceHelper::OutputTrace (TraceSpec ts, Ptr<const Packet> packet)
 {
-  PppHeader pppHeader;
-  Ipv4Header ipHeader;
-  TcpHeader tcpHeader;
-  {
-    Ptr<Packet> p = packet->Copy ();
-    p->RemoveHeader (pppHeader);
-    p->RemoveHeader (ipHeader);
-    if (ipHeader.GetFragmentOffset () > 0)
-      {
-        // XXX need to be more robust to fragmentation and also IPv6
-        // for now, skip peeking the TCP header that is not really there
-        NS_LOG_WARN ("Tmix does not handle fragmentation; adjust MTU so fragmentation doesn't occur");
-      }
-    else
-      {
-        p->PeekHeader (tcpHeader);
-      }
-  }
-
-  NS_LOG_FUNCTION (ts.event << ts.llsrc << ts.lldst << ipHeader.GetSource () << ipHeader.GetDestination () << packet->GetSize ());
+  // Read the few header fields we need straight from the packet bytes
+  // (PPP, then IPv4, then TCP) instead of copying the packet and
+  // deserializing its headers.  An IPv4 header is at most 60 bytes.
+  uint8_t bytes[PPP_HEADER_SIZE + 60 + 14];
+  uint32_t size = packet->CopyData (bytes, sizeof (bytes));
+  const uint8_t *ip = bytes + PPP_HEADER_SIZE;
+  uint32_t ipHeaderSize = size < PPP_HEADER_SIZE + 20 ? 0 : (ip[0] & 0x0f) * 4;
+  if (ipHeaderSize < 20)
+    {
+      NS_LOG_WARN ("Packet too short for an IPv4 header; not traced");
+      return;
+    }
+  Ipv4Address source = Ipv4Address::Deserialize (ip + 12);
+  Ipv4Address destination = Ipv4Address::Deserialize (ip + 16);
+
+  NS_LOG_FUNCTION (ts.event << ts.llsrc << ts.lldst << source << destination << packet->GetSize ());
 
   // Check that this packet belongs to the topology
-  NS_ASSERT_MSG (m_tmix->NodeTypeByAddress (ipHeader.GetSource ()) != TmixTopology::INVALID, "Couldn't match packet's source with a Tmix node"); //
-  NS_ASSERT_MSG (m_tmix->NodeTypeByAddress (ipHeader.GetDestination ()) != TmixTopology::INVALID, "Couldn't match packet's destination with a Tmix node");
+  NS_ASSERT_MSG (m_tmix->NodeTypeByAddress (source) != TmixTopology::INVALID, "Couldn't match packet's source with a Tmix node"); //
+  NS_ASSERT_MSG (m_tmix->NodeTypeByAddress (destination) != TmixTopology::INVALID, "Couldn't match packet's destination with a Tmix node");
 
   // Make sure this packet matches our src/dst filter
-  if (ipHeader.GetSource () != ts.src || ipHeader.GetDestination () != ts.dst)
+  if (source != ts.src || destination != ts.dst)
     {
-      NS_LOG_LOGIC (ipHeader.GetSource () << " != " << ts.src << " || " << ipHeader.GetDestination () << " != " << ts.dst);
+      NS_LOG_LOGIC (source << " != " << ts.src << " || " << destination << " != " << ts.dst);
       return;
     }
 
-  // Column 1: Event. '+' means enqueued, '-' means dequeued, 'r'
-  // means received, 'd' means dropped.
-  if (ts.event == ENQUEUE)
+  BinaryNs2TraceRecord record;
+  std::memset (&record, 0, sizeof (record));
+  const char events[] = { '+', 'd', '-', 'r' };
+  record.event = events[ts.event];
+  record.time = Simulator::Now ().GetNanoSeconds ();
+  record.llsrc = m_idOfNodeType[ts.llsrc];
+  record.lldst = m_idOfNodeType[ts.lldst];
+  // (we subtract the size of the PPP header)
+  record.size = packet->GetSize () - PPP_HEADER_SIZE;
+  record.srcNode = m_idOfNodeType[ts.srcNode];
+  record.dstNode = m_idOfNodeType[ts.dstNode];
+  // FIXME: using Packet::GetUid may not be correct as it might change
+  // with fragmentation perhaps
+  record.uid = packet->GetUid ();
+
+  uint16_t srcPort = 0;
+  uint16_t dstPort = 0;
+  const uint8_t *tcp = ip + ipHeaderSize;
+  if ((((ip[6] & 0x1f) << 8) | ip[7]) > 0)
     {
-      m_out << '+';
+      // XXX need to be more robust to fragmentation and also IPv6
+      // for now, skip peeking the TCP header that is not really there
+      NS_LOG_WARN ("Tmix does not handle fragmentation; adjust MTU so fragmentation doesn't occur");
     }
-  else if (ts.event == DEQUEUE)
+  else if (size >= PPP_HEADER_SIZE + ipHeaderSize + 14)
     {
-      m_out << '-';
+      srcPort = (uint16_t (tcp[0]) << 8) | tcp[1];
+      dstPort = (uint16_t (tcp[2]) << 8) | tcp[3];
+      record.seqno = (uint32_t (tcp[4]) << 24) | (uint32_t (tcp[5]) << 16) | (uint32_t (tcp[6]) << 8) | tcp[7];
+      record.ackno = (uint32_t (tcp[8]) << 24) | (uint32_t (tcp[9]) << 16) | (uint32_t (tcp[10]) << 8) | tcp[11];
+      record.tcpFlags = tcp[13];
     }
-  else if (ts.event == RECEIVE)
+  record.srcPort = (uint32_t (ts.uniqid) << 16) + srcPort;
+  record.dstPort = (uint32_t (ts.uniqid) << 16) + dstPort;
+
+  if (m_format == BINARY)
     {
-      m_out << 'r';
+      Append (reinterpret_cast<const char *> (&record), sizeof (record));
     }
-  else if (ts.event == DROP)
+  else
     {
-      m_out << 'd';
+      char line[NS2_TRACE_LINE_MAX];
+      Append (line, FormatNs2TraceLine (record, line));
     }
-  m_out << ' ';
-
-  // Column 2: The time in seconds when the event occurred.
-  m_out << std::setiosflags (std::ios::fixed) << std::setprecision (6) << Simulator::Now ().GetSeconds ();
-  m_out << ' ';
-
-  // Column 3: Link-layer source node ID.
-  m_out << m_idOfNodeType[ts.llsrc];
-  m_out << ' ';
-
-  // Column 4: Link-layer destination node ID.
-  m_out << m_idOfNodeType[ts.lldst];
-  m_out << ' ';
-
-  // Column 5: Packet name. Unused, always "ack" (in ns-2 one-way TCP
-  // mode it would be different).
-  m_out << "ack";
-  m_out << ' ';
-
-  // Column 6: Total packet size in bytes.
-  // (we subtract the size of the PPP header)
-  m_out << packet->GetSize () - 2;
-  m_out << ' ';
-
-  // Column 7: Flags. Unused, always "-------".
-  m_out << "-------";
-  m_out << ' ';
-
-  // Column 8: Integer flow ID. Currently unused and always set to zero. TODO: implement.
-  m_out << 0;
-  m_out << ' ';
-
-  // Column 9: Source. Format is the node ID and the port number
-  // separated by a period, e.g. "0.1"
-  m_out << m_idOfNodeType[m_tmix->NodeTypeByAddress (ipHeader.GetSource ())]
-        << '.' << ((uint32_t (ts.uniqid) << 16) + tcpHeader.GetSourcePort ());
-  m_out << ' ';
-
-  // Column 10: Destination. Same format as source.
-  m_out << m_idOfNodeType[m_tmix->NodeTypeByAddress (ipHeader.GetDestination ())]
-        << '.' << ((uint32_t (ts.uniqid) << 16) + tcpHeader.GetDestinationPort ());
-  m_out << ' ';
-
-  // Column 11: Packet sequence number.
-  m_out << tcpHeader.GetSequenceNumber ().GetValue ();
-  m_out << ' ';
-
-  // Column 12: Unique packet ID.
-  // FIXME: using Packet::GetUid may not be correct as it might change
-  // with fragmentation perhaps
-  m_out << packet->GetUid ();
-  m_out << ' ';
-
-  // Column 13: Ack number.
-  m_out << tcpHeader.GetAckNumber ();
-  m_out << ' ';
-
-  // Column 14: TCP flags as a hexadecimal value, e.g. "0xa" for PUSH|SYN.
-  m_out << "0x" << std::hex << std::setfill ('0') << std::setw (2) << int(
-    tcpHeader.GetFlags ());
-  m_out << std::dec << std::setw (0) << ' ';
-
-  // Column 15: Header length. Unused, always equal 40.
-  m_out << 40;
-  m_out << ' ';
-
-  // Column 16: Socket address length. Unused, always zero.
-  m_out << 0;
-  m_out << ' ';
-
-  // Done.
-  m_out << std::endl;
 }
 
 }
@@ -40,6 +40,8 @@
 #define TMIXNS2STYLETRACEHELPER_H_
 
 #include <iostream>
+#include <stdint.h>
+#include <vector>
 #include "ns3/delaybox.h"
 #include "ns3/delaybox-net-device.h"
 #include "ns3/tmix-topology.h"
@@ -47,6 +49,77 @@
 namespace ns3 {
 namespace Tmix {
 
+/**
+ * \brief One event of a binary ns-2 style trace.
+ *
+ * A binary trace starts with a BinaryNs2TraceHeader followed by one
+ * record per event, in host byte order.  The columns that are always
+ * the same in the text format are not stored.
+ */
+struct BinaryNs2TraceRecord
+{
+  /// Time of the event in nanoseconds.
+  int64_t time;
+  /// Packet::GetUid ().
+  uint64_t uid;
+  uint32_t seqno;
+  uint32_t ackno;
+  /// Total packet size in bytes, without the PPP header.
+  uint32_t size;
+  /// Port of the source, with the node pair number in the upper 16 bits.
+  uint32_t srcPort;
+  /// Port of the destination, likewise.
+  uint32_t dstPort;
+  /// '+', '-', 'r' or 'd'.
+  uint8_t event;
+  uint8_t llsrc;
+  uint8_t lldst;
+  uint8_t srcNode;
+  uint8_t dstNode;
+  uint8_t tcpFlags;
+  uint8_t padding[2];
+};
+
+struct BinaryNs2TraceHeader
+{
+  /// Always BINARY_NS2_TRACE_MAGIC.
+  uint32_t magic;
+  /// Layout version, BINARY_NS2_TRACE_VERSION when written by this code.
+  uint32_t version;
+};
+
+/// "TMXT" read as a little-endian 32-bit integer.
+const uint32_t BINARY_NS2_TRACE_MAGIC = 0x54584d54;
+const uint32_t BINARY_NS2_TRACE_VERSION = 1;
+
+/**
+ * Format one event as a line of the ns-2 style text trace described
+ * at Ns2StyleTraceHelper, including the newline.
+ *
+ * \param record The event.
+ * \param buffer Room for at least NS2_TRACE_LINE_MAX characters.
+ * \return the number of characters written.
+ */
+uint32_t
+FormatNs2TraceLine (const BinaryNs2TraceRecord& record, char *buffer);
+
+/// Upper bound on the length of a line written by FormatNs2TraceLine().
+const uint32_t NS2_TRACE_LINE_MAX = 256;
+
+/// Comment line naming the columns of the text format.
+const char * const NS2_TRACE_COLUMNS =
+  "# event time llsrc lldst name size flags flowid src dst seqno uniqid ackno tcpflags hdrlen sockaddrlen\n";
+
+/**
+ * Convert a binary ns-2 style trace to the text format, as written by
+ * an Ns2StyleTraceHelper in TEXT mode.
+ *
+ * \return the number of events converted, or -1 if \p in is not a
+ * binary trace of a supported version.
+ */
+int64_t
+ConvertBinaryNs2Trace (std::istream& in, std::ostream& out);
+
 /**
  * \brief Produces ns-2 style trace files for a TmixTopology.
  *
@@ -94,22 +167,44 @@ namespace Tmix {
  * - Column 14: TCP flags as a hexadecimal value, e.g. "0xa" for PUSH|SYN.
  * - Column 15: Header length. Unused, always equal to 40.
  * - Column 16: Socket address length. Unused, always zero.
+ *
+ * Lines are collected in a buffer and written in large blocks; the
+ * buffer is flushed when the simulator is destroyed, or by Flush().
+ * In BINARY mode each event is written as a BinaryNs2TraceRecord
+ * instead, to be turned into the text format offline by
+ * ConvertBinaryNs2Trace() or the tmix-ns2-trace-convert program.
  */
 class Ns2StyleTraceHelper
 {
 public:
+  enum Format
+  {
+    TEXT, BINARY
+  };
+
   /**
    * \param tmix Instance of TmixTopology.
-   * \param out Output stream to print the
+   * \param out Output stream to write the trace to; opened in binary
+   * mode if \p format is BINARY.
+   * \param format TEXT for the ns-2 text format, BINARY for fixed size
+   * records.
    */
-  Ns2StyleTraceHelper (Ptr<TmixTopology> tmix, std::ostream& out);
+  Ns2StyleTraceHelper (Ptr<TmixTopology> tmix, std::ostream& out, Format format = TEXT);
+  ~Ns2StyleTraceHelper ();
 
   /**
-   * Writes a slightly informative block of comments to the output file.
+   * Writes a slightly informative block of comments to the output
+   * file.  Does nothing in BINARY mode.
    */
   void
   WriteInformativeHeader ();
 
+  /**
+   * Write out any buffered events and flush the output stream.
+   */
+  void
+  Flush ();
+
   /**
    * Installs the traces on all node pairs in the topology.
    */
@@ -140,13 +235,16 @@ private:
   struct TraceSpec
   {
     TraceSpec (TraceEvent ev, TmixTopology::NodeType lls,
-               TmixTopology::NodeType lld, Ipv4Address s, Ipv4Address d, uint16_t id)
+               TmixTopology::NodeType lld, Ipv4Address s, Ipv4Address d, uint16_t id,
+               TmixTopology::NodeType sn, TmixTopology::NodeType dn)
       : event (ev),
         llsrc (lls),
         lldst (lld),
         src (s),
         dst (d),
-        uniqid (id)
+        uniqid (id),
+        srcNode (sn),
+        dstNode (dn)
     {
     }
 
@@ -156,26 +254,41 @@ private:
     Ipv4Address src;
     Ipv4Address dst;
     uint16_t uniqid;
+    /// Node types of src and dst, looked up once at installation.
+    TmixTopology::NodeType srcNode;
+    TmixTopology::NodeType dstNode;
 
     bool
     operator!= (const TraceSpec& rhs) const
     {
       return event != rhs.event || llsrc != rhs.llsrc || lldst != rhs.lldst
-             || src != rhs.src || dst != rhs.dst || uniqid != rhs.uniqid;
+             || src != rhs.src || dst != rhs.dst || uniqid != rhs.uniqid
+             || srcNode != rhs.srcNode || dstNode != rhs.dstNode;
     }
   };
 
   void
   OutputTrace (TraceSpec ts, Ptr<const Packet> packet);
 
+  /// Append to m_buffer, writing it out first if it is full.
+  void
+  Append (const char *data, uint32_t size);
+
 private:
   Ptr<TmixTopology> m_tmix;
   std::ostream& m_out;
+  Format m_format;
   uint16_t m_uniqid;
   TmixTopology::TmixNodePair m_left;
   TmixTopology::TmixNodePair m_right;
 
-  std::map<TmixTopology::NodeType, int> m_idOfNodeType;
+  /// ns-2 node ID of each TmixTopology::NodeType.
+  uint8_t m_idOfNodeType[6];
+  /// Events not yet written to m_out.
+  std::vector<char> m_buffer;
+  uint32_t m_bufferUsed;
+  /// Flushes the buffer when the simulator is destroyed.
+  EventId m_flushEvent;
 };
 
 }
@@ -0,0 +1,289 @@
+/* -*- Mode:C++; c-file-style:''gnu''; indent-tabs-mode:nil; -*- */
+
+/*
+ * Copyright 2012, Old Dominion University
+ * Copyright 2012, University of North Carolina at Chapel Hill
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *    3. The name of the author may not be used to endorse or promote
+ * products derived from this software without specific prior written
+ * permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * M.C. Weigle, P. Adurthi, F. Hernandez-Campos, K. Jeffay, and F.D. Smith,
+ * Tmix: A Tool for Generating Realistic Application Workloads in ns-2,
+ * ACM Computer Communication Review, July 2006, Vol 36, No 3, pp. 67-76.
+ *
+ * Contact: Michele Weigle (mweigle@cs.odu.edu)
+ * http://www.cs.odu.edu/inets/Tmix
+ */
+
+#include "ns3/log.h"
+
+#include "tmix-binary-cvec.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+NS_LOG_COMPONENT_DEFINE ("TmixBinaryCvec");
+
+namespace ns3 {
+namespace Tmix {
+
+/// Size of the user-space buffer behind each writer.
+static const size_t BINARY_CVEC_WRITE_BUFFER = 1 << 20;
+
+BinaryCvecWriter::BinaryCvecWriter ()
+  : m_buffer (BINARY_CVEC_WRITE_BUFFER)
+{
+  m_header.magic = BINARY_CVEC_MAGIC;
+  m_header.version = BINARY_CVEC_VERSION;
+  m_header.numCvecs = 0;
+  m_header.numAdus = 0;
+}
+
+BinaryCvecWriter::~BinaryCvecWriter ()
+{
+  Close ();
+}
+
+bool
+BinaryCvecWriter::Open (const std::string& filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+  Close ();
+  m_header.numCvecs = 0;
+  m_header.numAdus = 0;
+  m_out.rdbuf ()->pubsetbuf (&m_buffer[0], m_buffer.size ());
+  m_out.open (filename.c_str (), std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!m_out)
+    {
+      NS_LOG_WARN ("Could not open " << filename << " for writing");
+      return false;
+    }
+  m_out.write (reinterpret_cast<const char *> (&m_header), sizeof (m_header));
+  return true;
+}
+
+void
+BinaryCvecWriter::Write (const ConnectionVector& cvec)
+{
+  NS_ASSERT_MSG (m_out.is_open (), "BinaryCvecWriter::Write() called before Open()");
+  BinaryCvecHeader header;
+  header.startTime = cvec.startTime.GetNanoSeconds ();
+  header.minRTT = cvec.minRTT.GetNanoSeconds ();
+  header.lossRateItoA = cvec.lossRateItoA;
+  header.lossRateAtoI = cvec.lossRateAtoI;
+  header.type = cvec.type;
+  header.id1 = cvec.id1;
+  header.id2 = cvec.id2;
+  header.windowSizeInitiator = cvec.windowSizeInitiator;
+  header.windowSizeAcceptor = cvec.windowSizeAcceptor;
+  header.mssInitiator = cvec.mssInitiator;
+  header.mssAcceptor = cvec.mssAcceptor;
+  header.numAdus = cvec.adus.size ();
+  m_out.write (reinterpret_cast<const char *> (&header), sizeof (header));
+  for (std::vector<ADU>::const_iterator i = cvec.adus.begin (); i != cvec.adus.end (); ++i)
+    {
+      BinaryAdu adu;
+      adu.sendWaitTime = i->sendWaitTime.GetNanoSeconds ();
+      adu.recvWaitTime = i->recvWaitTime.GetNanoSeconds ();
+      adu.side = i->side;
+      adu.size = i->size;
+      m_out.write (reinterpret_cast<const char *> (&adu), sizeof (adu));
+    }
+  m_header.numCvecs++;
+  m_header.numAdus += cvec.adus.size ();
+}
+
+void
+BinaryCvecWriter::Close ()
+{
+  if (!m_out.is_open ())
+    {
+      return;
+    }
+  NS_LOG_FUNCTION (this << m_header.numCvecs << m_header.numAdus);
+  m_out.seekp (0);
+  m_out.write (reinterpret_cast<const char *> (&m_header), sizeof (m_header));
+  m_out.close ();
+}
+
+BinaryCvecReader::BinaryCvecReader ()
+  : m_data (0),
+    m_size (0)
+{
+}
+
+BinaryCvecReader::~BinaryCvecReader ()
+{
+  Close ();
+}
+
+bool
+BinaryCvecReader::Open (const std::string& filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+  Close ();
+  int fd = open (filename.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      NS_LOG_WARN ("Could not open " << filename);
+      return false;
+    }
+  struct stat st;
+  if (fstat (fd, &st) != 0 || (uint64_t) st.st_size < sizeof (BinaryCvecFileHeader))
+    {
+      NS_LOG_WARN (filename << " is too short to be a binary cvec file");
+      close (fd);
+      return false;
+    }
+  void *data = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      NS_LOG_WARN ("Could not map " << filename);
+      return false;
+    }
+  m_data = static_cast<const char *> (data);
+  m_size = st.st_size;
+
+  const BinaryCvecFileHeader *header = reinterpret_cast<const BinaryCvecFileHeader *> (m_data);
+  if (header->magic != BINARY_CVEC_MAGIC)
+    {
+      NS_LOG_WARN (filename << " is not a binary cvec file, or was written on a machine of different endianness");
+      Close ();
+      return false;
+    }
+  if (header->version != BINARY_CVEC_VERSION)
+    {
+      NS_LOG_WARN (filename << " has unsupported binary cvec version " << header->version);
+      Close ();
+      return false;
+    }
+  // The records are only read sequentially.
+  madvise (data, m_size, MADV_SEQUENTIAL);
+  NS_LOG_LOGIC ("Mapped " << header->numCvecs << " cvecs and " << header->numAdus << " ADUs from " << filename);
+  return true;
+}
+
+void
+BinaryCvecReader::Close ()
+{
+  if (m_data)
+    {
+      munmap (const_cast<char *> (m_data), m_size);
+      m_data = 0;
+      m_size = 0;
+    }
+}
+
+uint64_t
+BinaryCvecReader::GetNCvecs () const
+{
+  NS_ASSERT (IsOpen ());
+  return reinterpret_cast<const BinaryCvecFileHeader *> (m_data)->numCvecs;
+}
+
+uint64_t
+BinaryCvecReader::GetNAdus () const
+{
+  NS_ASSERT (IsOpen ());
+  return reinterpret_cast<const BinaryCvecFileHeader *> (m_data)->numAdus;
+}
+
+bool
+BinaryCvecReader::Next (uint64_t& cursor, View& view) const
+{
+  if (!m_data || cursor + sizeof (BinaryCvecHeader) > m_size)
+    {
+      return false;
+    }
+  const BinaryCvecHeader *header = reinterpret_cast<const BinaryCvecHeader *> (m_data + cursor);
+  uint64_t end = cursor + sizeof (BinaryCvecHeader) + (uint64_t) header->numAdus * sizeof (BinaryAdu);
+  if (end > m_size)
+    {
+      NS_LOG_WARN ("Truncated binary cvec record at offset " << cursor);
+      return false;
+    }
+  view.header = header;
+  view.adus = reinterpret_cast<const BinaryAdu *> (header + 1);
+  cursor = end;
+  return true;
+}
+
+bool
+BinaryCvecReader::IsBinaryCvecFile (const std::string& filename)
+{
+  std::ifstream in (filename.c_str (), std::ios::in | std::ios::binary);
+  uint32_t magic = 0;
+  in.read (reinterpret_cast<char *> (&magic), sizeof (magic));
+  return in && magic == BINARY_CVEC_MAGIC;
+}
+
+void
+BinaryCvecReader::View::ToConnectionVector (ConnectionVector& out) const
+{
+  out.type = static_cast<ConnectionVector::Type> (header->type);
+  out.startTime = NanoSeconds (header->startTime);
+  out.id1 = header->id1;
+  out.id2 = header->id2;
+  out.windowSizeInitiator = header->windowSizeInitiator;
+  out.windowSizeAcceptor = header->windowSizeAcceptor;
+  out.minRTT = NanoSeconds (header->minRTT);
+  out.lossRateItoA = header->lossRateItoA;
+  out.lossRateAtoI = header->lossRateAtoI;
+  out.mssInitiator = header->mssInitiator;
+  out.mssAcceptor = header->mssAcceptor;
+  out.adus.resize (header->numAdus);
+  for (uint32_t i = 0; i < header->numAdus; i++)
+    {
+      out.adus[i].side = static_cast<ADU::Side> (adus[i].side);
+      out.adus[i].sendWaitTime = NanoSeconds (adus[i].sendWaitTime);
+      out.adus[i].recvWaitTime = NanoSeconds (adus[i].recvWaitTime);
+      out.adus[i].size = adus[i].size;
+    }
+}
+
+uint64_t
+ConvertToBinaryCvec (std::istream& in, TextCvecFormat format, const std::string& outFilename)
+{
+  NS_LOG_FUNCTION (format << outFilename);
+  BinaryCvecWriter writer;
+  if (!writer.Open (outFilename))
+    {
+      return 0;
+    }
+  ConnectionVector cvec;
+  while (format == ALT_FORMAT ? ParseConnectionVector (in, cvec)
+         : ParseOriginalConnectionVector (in, cvec, true))
+    {
+      writer.Write (cvec);
+    }
+  uint64_t n = writer.GetNCvecs ();
+  writer.Close ();
+  return n;
+}
+
+}
+}
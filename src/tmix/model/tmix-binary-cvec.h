@@ -0,0 +1,272 @@
+/* -*- Mode:C++; c-file-style:''gnu''; indent-tabs-mode:nil; -*- */
+
+/*
+ * Copyright 2012, Old Dominion University
+ * Copyright 2012, University of North Carolina at Chapel Hill
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *    3. The name of the author may not be used to endorse or promote
+ * products derived from this software without specific prior written
+ * permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * M.C. Weigle, P. Adurthi, F. Hernandez-Campos, K. Jeffay, and F.D. Smith,
+ * Tmix: A Tool for Generating Realistic Application Workloads in ns-2,
+ * ACM Computer Communication Review, July 2006, Vol 36, No 3, pp. 67-76.
+ *
+ * Contact: Michele Weigle (mweigle@cs.odu.edu)
+ * http://www.cs.odu.edu/inets/Tmix
+ */
+
+#ifndef TMIX_BINARY_CVEC_H_
+#define TMIX_BINARY_CVEC_H_
+
+#include "tmix.h"
+#include "ns3/simple-ref-count.h"
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+namespace Tmix {
+
+/**
+ * \brief Binary connection vector file layout.
+ *
+ * A binary cvec file starts with a BinaryCvecFileHeader, followed by
+ * one record per connection vector: a BinaryCvecHeader immediately
+ * followed by its numAdus BinaryAdu entries.  All fields are in host
+ * byte order and naturally aligned, so the file can be used in place
+ * once mapped into memory.  A reader seeing the magic number with its
+ * bytes swapped knows the file was written on a machine of the other
+ * endianness.
+ */
+struct BinaryCvecFileHeader
+{
+  /// Always BINARY_CVEC_MAGIC.
+  uint32_t magic;
+  /// Layout version, BINARY_CVEC_VERSION when written by this code.
+  uint32_t version;
+  /// Number of connection vectors in the file.
+  uint64_t numCvecs;
+  /// Total number of ADUs in the file.
+  uint64_t numAdus;
+};
+
+/// Fixed part of a connection vector record. Times are in nanoseconds.
+struct BinaryCvecHeader
+{
+  int64_t startTime;
+  int64_t minRTT;
+  double lossRateItoA;
+  double lossRateAtoI;
+  uint32_t type;
+  uint32_t id1;
+  uint32_t id2;
+  uint32_t windowSizeInitiator;
+  uint32_t windowSizeAcceptor;
+  uint32_t mssInitiator;
+  uint32_t mssAcceptor;
+  /// Number of BinaryAdu entries following this header.
+  uint32_t numAdus;
+};
+
+/// One ADU of a connection vector record. Times are in nanoseconds.
+struct BinaryAdu
+{
+  int64_t sendWaitTime;
+  int64_t recvWaitTime;
+  uint32_t side;
+  uint32_t size;
+};
+
+/// "TMXB" read as a little-endian 32-bit integer.
+const uint32_t BINARY_CVEC_MAGIC = 0x42584d54;
+const uint32_t BINARY_CVEC_VERSION = 1;
+
+/**
+ * \brief Writes connection vectors to a binary cvec file.
+ *
+ * The file is opened once and written through a large user-space
+ * buffer.  The connection vector and ADU counts in the file header are
+ * filled in by Close(), which is also called by the destructor.
+ */
+class BinaryCvecWriter
+{
+public:
+  BinaryCvecWriter ();
+  ~BinaryCvecWriter ();
+
+  /**
+   * Create (or truncate) the given file and write a provisional header.
+   * \return false if the file could not be opened.
+   */
+  bool
+  Open (const std::string& filename);
+
+  /// Append one connection vector to the file.
+  void
+  Write (const ConnectionVector& cvec);
+
+  /// Write the final header and close the file.
+  void
+  Close ();
+
+  /// \return the number of connection vectors written so far.
+  uint64_t
+  GetNCvecs () const
+  {
+    return m_header.numCvecs;
+  }
+
+private:
+  BinaryCvecWriter (const BinaryCvecWriter&);
+  BinaryCvecWriter& operator= (const BinaryCvecWriter&);
+
+  std::ofstream m_out;
+  std::vector<char> m_buffer;
+  BinaryCvecFileHeader m_header;
+};
+
+/**
+ * \brief Memory-mapped reader for binary cvec files.
+ *
+ * The whole file is mapped read-only and records are handed out as
+ * views pointing straight into the mapping, so no ADU vectors are
+ * built unless ToConnectionVector() is called.  Views remain valid for
+ * as long as the reader stays open; a single reader can be shared by
+ * any number of consumers, each keeping its own cursor.
+ *
+ * \code
+ * Ptr<Tmix::BinaryCvecReader> reader = Create<Tmix::BinaryCvecReader> ();
+ * reader->Open ("inbound.bcvec");
+ * Tmix::BinaryCvecReader::View view;
+ * for (uint64_t cursor = reader->Begin (); reader->Next (cursor, view); )
+ *   {
+ *     ... view.header->startTime, view.adus[0 .. view.header->numAdus) ...
+ *   }
+ * \endcode
+ */
+class BinaryCvecReader : public SimpleRefCount<BinaryCvecReader>
+{
+public:
+  /// Zero-copy view of one connection vector record.
+  struct View
+  {
+    /// Fixed part of the record.
+    const BinaryCvecHeader *header;
+    /// The header->numAdus ADUs of the record.
+    const BinaryAdu *adus;
+
+    /// \return the start time of the connection vector.
+    Time
+    GetStartTime () const
+    {
+      return NanoSeconds (header->startTime);
+    }
+
+    /// Materialize the record as a ConnectionVector.
+    void
+    ToConnectionVector (ConnectionVector& out) const;
+  };
+
+  BinaryCvecReader ();
+  ~BinaryCvecReader ();
+
+  /**
+   * Map the given file and check its header.
+   * \return false if the file can't be mapped, or is not a binary cvec
+   * file of a supported version.
+   */
+  bool
+  Open (const std::string& filename);
+
+  /// Unmap the file. Outstanding views become invalid.
+  void
+  Close ();
+
+  bool
+  IsOpen () const
+  {
+    return m_data != 0;
+  }
+
+  /// \return the number of connection vectors in the file.
+  uint64_t
+  GetNCvecs () const;
+
+  /// \return the total number of ADUs in the file.
+  uint64_t
+  GetNAdus () const;
+
+  /// \return the cursor of the first record.
+  uint64_t
+  Begin () const
+  {
+    return sizeof (BinaryCvecFileHeader);
+  }
+
+  /**
+   * Fetch the record at the given cursor and advance the cursor to the
+   * next record.
+   * \return false at the end of the file or if the record is truncated.
+   */
+  bool
+  Next (uint64_t& cursor, View& view) const;
+
+  /// \return true if the file at the given path starts with the binary cvec magic number.
+  static bool
+  IsBinaryCvecFile (const std::string& filename);
+
+private:
+  BinaryCvecReader (const BinaryCvecReader&);
+  BinaryCvecReader& operator= (const BinaryCvecReader&);
+
+  const char *m_data;
+  uint64_t m_size;
+};
+
+/// Text formats that can be converted to the binary format.
+enum TextCvecFormat
+{
+  /// The ``new'' (ns-2) format read by ParseConnectionVector.
+  ALT_FORMAT,
+  /// The original (Felix) format read by ParseOriginalConnectionVector.
+  ORIGINAL_FORMAT
+};
+
+/**
+ * Convert a text connection vector file to the binary format.
+ *
+ * \param in Stream holding the text connection vectors.
+ * \param format Format of the text.
+ * \param outFilename Binary cvec file to create.
+ * \return the number of connection vectors written.
+ */
+uint64_t
+ConvertToBinaryCvec (std::istream& in, TextCvecFormat format, const std::string& outFilename);
+
+}
+}
+
+#endif
@@ -49,7 +49,8 @@
 #include "tmix.h"
 
 #include <limits>
-#include <deque>
+#include <sstream>
+#include <algorithm>
 
 NS_LOG_COMPONENT_DEFINE ("Tmix");
 
@@ -62,7 +63,8 @@ Application::Application (Ptr<DelayBox> delayBox, ADU::Side side,
     m_packetSize (1448),
     m_localAddress (localAddress),
     m_peerAddress (peerAddress),
-    m_delayBox (delayBox)
+    m_delayBox (delayBox),
+    m_maxConnectRetries (3)
 {
   //std::cout << m_localAddress << "\t" << m_peerAddress << "\n";
 }
@@ -97,6 +99,11 @@ ADU::operator!= (const ADU& rhs) const
 /**
  * Abstract base class for Initiator and Acceptor which factors out the common logic for
  * keeping track of what bytes must be sent, what bytes must be received, and when.
+ *
+ * A worker does not copy its ADUs: it keeps a cursor to the next ADU
+ * of each side in the shared connection vector.  Workers are pooled by
+ * their Application, so the same object runs many connection vectors
+ * one after the other; see Init() and Reset().
  */
 class Worker : public Object
 {
@@ -104,54 +111,98 @@ public:
   virtual void
   Start () = 0;
 
-  Worker (Ptr<Socket> socket, unsigned packetSize, const ConnectionVector& cvec,
-          ADU::Side side, Callback<void, ConnectionVector> notifyCvecComplete)
-    : m_cvec (cvec),
-      m_socket (socket),
-      m_packetSize (packetSize),
-      m_lastSendTime (
-        Seconds (-1)),
+  Worker (ADU::Side side)
+    : m_side (side),
+      m_nextSend (0),
+      m_nextRecv (0),
+      m_recvRemaining (0),
+      m_terminalPending (false),
+      m_bytesToSend (0),
+      m_lastSendTime (Seconds (-1)),
       m_lastRecvTime (Seconds (-1)),
       m_closed (false),
-      m_notifyCvecComplete (notifyCvecComplete)
+      m_connected (false),
+      m_port (0),
+      m_generation (0)
   {
-    NS_LOG_FUNCTION_NOARGS();
-    NS_LOG_FUNCTION (this << socket << cvec);
-    for (std::vector<ADU>::const_iterator i = cvec.adus.begin (); i
-         != cvec.adus.end (); ++i)
+    NS_LOG_FUNCTION (this << side);
+    m_terminal.recvWaitTime = Seconds (0);
+    m_terminal.sendWaitTime = Seconds (0);
+    m_terminal.side = side;
+    m_terminal.size = 0;
+  }
+
+  /**
+   * Get ready to run \p cvec over \p socket, connecting to or
+   * listening on \p port.  Called on a new worker, or on a pooled one
+   * after Reset().
+   */
+  void
+  Init (Ptr<Socket> socket, Ptr<const Packet> payload, Ptr<const ConnectionVector> cvec,
+        const Ipv4Address& localAddress, const Ipv4Address& peerAddress, uint16_t port,
+        Callback<void, Ptr<const ConnectionVector> > notifyCvecComplete,
+        Callback<void, Ptr<Worker> > released)
+  {
+    NS_LOG_FUNCTION (this << socket << *cvec);
+    m_socket = socket;
+    m_payload = payload;
+    m_cvec = cvec;
+    m_localAddress = localAddress;
+    m_peerAddress = peerAddress;
+    m_port = port;
+    m_notifyCvecComplete = notifyCvecComplete;
+    m_released = released;
+    m_nextSend = NextAdu (0, true);
+    m_nextRecv = NextAdu (0, false);
+    m_recvRemaining = HaveAduToRecv () ? m_cvec->adus[m_nextRecv].size : 0;
+    m_terminalPending = false;
+    m_bytesToSend = 0;
+    m_lastSendTime = Seconds (-1);
+    m_lastRecvTime = Seconds (-1);
+    m_closed = false;
+    m_connected = false;
+    // Check that the cvec was OK
+    for (uint32_t i = 0; i < m_cvec->adus.size (); ++i)
       {
-        if (i->side == side)
-          {
-            m_adusToSend.push_back (*i);
-          }
-        else
+        const ADU& adu = m_cvec->adus[i];
+        if (adu.size == 0 && NextAdu (i + 1, adu.side == m_side) != m_cvec->adus.size ())
           {
-            m_adusToRecv.push_back (*i);
+            NS_LOG_WARN ("Bad cvec: there can be only one ADU with zero size per side and it must be the last one\n" << *m_cvec);
           }
       }
-    // Check that the cvec was OK
-    for (std::deque<ADU>::const_iterator i = m_adusToSend.begin (); i
-         != m_adusToSend.end (); ++i)
+  }
+
+  /**
+   * Detach from the finished connection so that this worker can be
+   * handed the next one.  Events still scheduled for the old
+   * connection are ignored from now on.
+   */
+  void
+  Reset ()
+  {
+    NS_LOG_FUNCTION (this);
+    ++m_generation;
+    if (m_connection)
       {
-        if (i->size == 0)
-          {
-            if ((i + 1) != m_adusToSend.end ())
-              {
-                NS_LOG_WARN ("Bad cvec: there can be only one ADU with zero size per side and it must be the last one\n" << cvec);
-              }
-          }
+        m_connection->SetRecvCallback (MakeNullCallback<void, Ptr<Socket> > ());
+        m_connection->SetSendCallback (MakeNullCallback<void, Ptr<Socket>, uint32_t> ());
+        m_connection->SetCloseCallbacks (MakeNullCallback<void, Ptr<Socket> > (),
+                                         MakeNullCallback<void, Ptr<Socket> > ());
+        m_connection->TraceDisconnectWithoutContext ("State", MakeCallback (&Worker::StateChanged, this));
       }
-    for (std::deque<ADU>::const_iterator i = m_adusToRecv.begin (); i
-         != m_adusToRecv.end (); ++i)
+    if (m_socket)
       {
-        if (i->size == 0)
-          {
-            if ((i + 1) != m_adusToRecv.end ())
-              {
-                NS_LOG_WARN ("Bad cvec: there can be only one ADU with zero size per side and it must be the last one\n" << cvec);
-              }
-          }
+        m_socket->SetConnectCallback (MakeNullCallback<void, Ptr<Socket> > (),
+                                      MakeNullCallback<void, Ptr<Socket> > ());
+        m_socket->SetAcceptCallback (MakeNullCallback<bool, Ptr<Socket>, const Address &> (),
+                                     MakeNullCallback<void, Ptr<Socket>, const Address &> ());
       }
+    m_socket = 0;
+    m_connection = 0;
+    m_payload = 0;
+    m_cvec = 0;
+    m_notifyCvecComplete.Nullify ();
+    m_released.Nullify ();
   }
 
   void
@@ -165,11 +216,10 @@ public:
         // This means we have already half-closed our socket, and we
         // just received a FIN; therefore the connection is now fully
         // closed.  We shouldn't have any more ADUs to send.
-        NS_ASSERT (m_adusToSend.empty ()); //
+        NS_ASSERT (!HaveAduToSend ()); //
         // We should either be out of ADUs to receive, or we should
         // have just the explicit FIN ADU remaining.
-        if (m_adusToRecv.empty () || (m_adusToRecv.size () == 1
-                                      && m_adusToRecv.front ().size == 0))
+        if (RecvFinished ())
           {
             NS_LOG_LOGIC ("Received FIN; Connection vector completed.");
             if (!m_notifyCvecComplete.IsNull ())
@@ -183,7 +233,7 @@ public:
             // the old ns-3 TCP implementation. Happily that problem
             // has been solved, and we can now be sure that this
             // condition indicates an actual problem.
-            NS_LOG_WARN ("Received FIN, but there are still ADUs to receive (connected to wrong application?). Next ADU to receive: " << m_adusToRecv.front ());
+            NS_LOG_WARN ("Received FIN, but there are still ADUs to receive (connected to wrong application?). Next ADU to receive: " << m_cvec->adus[m_nextRecv]);
           }
         CloseIfDone (socket);
         NS_ASSERT (m_closed);
@@ -191,32 +241,34 @@ public:
       }
 
     unsigned bytesToRecv = packet->GetSize ();
-    // Slurp ADUs off of m_adusToRecv until all received bytes have been used up.
+    // Move the receive cursor along until all received bytes have been used up.
     while (bytesToRecv)
       {
-        if (m_adusToRecv.empty () || m_adusToRecv.front ().size == 0)
+        if (!HaveAduToRecv () || m_recvRemaining == 0)
           {
-            NS_LOG_WARN ("Expected to receive FIN, but received " << bytesToRecv << " extra bytes instead. Cvec: " << m_cvec);
+            NS_LOG_WARN ("Expected to receive FIN, but received " << bytesToRecv << " extra bytes instead. Cvec: " << *m_cvec);
             break;
           }
-        else if (m_adusToRecv.front ().size > bytesToRecv)
+        else if (m_recvRemaining > bytesToRecv)
           {
-            // Received less than a whole ADU. Reduce its size by the
-            // number of bytes received.
-            m_adusToRecv.front ().size -= bytesToRecv;
-            NS_LOG_LOGIC ("Received " << bytesToRecv << " bytes of an ADU. " << m_adusToRecv.front ().size << " bytes to go.");
+            // Received less than a whole ADU. Reduce what is left of
+            // it by the number of bytes received.
+            m_recvRemaining -= bytesToRecv;
+            NS_LOG_LOGIC ("Received " << bytesToRecv << " bytes of an ADU. " << m_recvRemaining << " bytes to go.");
             break;
           }
        // else
          // {
-            // front ADU size <= bytesToRecv: remove the whole thing and continue receiving
-            bytesToRecv -= m_adusToRecv.front ().size;
-            m_adusToRecv.pop_front ();
-            NS_LOG_LOGIC ("Finished receiving an ADU. " << m_adusToRecv.size () << " to go.");
+            // rest of the ADU <= bytesToRecv: finish it and continue receiving
+            bytesToRecv -= m_recvRemaining;
+            PopAduToRecv ();
+            NS_LOG_LOGIC ("Finished receiving an ADU. Next one is ADU " << m_nextRecv << " of " << m_cvec->adus.size () << ".");
             m_lastRecvTime = Simulator::Now ();
-            // Successful receipt of an ADU might trigger a send.
-            if (!m_adusToSend.empty ()
-                && m_adusToSend.front ().recvWaitTime.IsStrictlyPositive ())
+            // Successful receipt of an ADU might trigger a send.  If
+            // we are still feeding an ADU to the socket, the next send
+            // is scheduled once that one is done.
+            if (HaveAduToSend () && !m_bytesToSend
+                && AduToSend ().recvWaitTime.IsStrictlyPositive ())
               {
                 ScheduleNextSend (socket);
               }
@@ -233,12 +285,14 @@ public:
   CloseIfDone (Ptr<Socket> socket)
   {
     NS_LOG_FUNCTION_NOARGS();
-    if (m_adusToSend.empty () || (m_adusToSend.size () == 1
-                                  && m_adusToSend.front ().size == 0))
+    if (m_bytesToSend)
+      {
+        NS_LOG_LOGIC (m_bytesToSend << " bytes of the current ADU still to send.");
+      }
+    else if (SendFinished ())
       {
         // No more ADUs to send.
-        if (m_adusToRecv.empty () || (m_adusToRecv.size () == 1
-                                      && m_adusToRecv.front ().size == 0))
+        if (RecvFinished ())
           {
             // No more ADUs to receive.
             NS_LOG_LOGIC ("Closing socket " << socket);
@@ -247,12 +301,12 @@ public:
           }
         else
           {
-            NS_LOG_LOGIC (m_adusToRecv.size () << " ADUs to receive.");
+            NS_LOG_LOGIC ("Still receiving ADU " << m_nextRecv << " of " << m_cvec->adus.size () << ".");
           }
       }
     else
       {
-        NS_LOG_LOGIC (m_adusToSend.size () << " ADUs to send.");
+        NS_LOG_LOGIC ("Still sending; next is ADU " << m_nextSend << " of " << m_cvec->adus.size () << ".");
       }
     NS_LOG_LOGIC ("CloseIfDone() is about to return");
     return m_closed;
@@ -270,17 +324,196 @@ public:
       }
   }
 
+  /**
+   * Socket send callback: more room in the send buffer, so carry on
+   * with the ADU currently being sent, if any.
+   */
+  void
+  SendSpaceAvailable (Ptr<Socket> socket, uint32_t available)
+  {
+    NS_LOG_FUNCTION (this << socket << available);
+    if (m_bytesToSend)
+      {
+        SendPending (socket);
+      }
+  }
+
+  /**
+   * Trace sink for the connected socket's State.  Once the socket is
+   * CLOSED its endpoint is deallocated, so the port may be reused;
+   * tell the Application after the socket has finished doing so.
+   * This includes a connection that was reset or timed out before it
+   * was established, unless it is retried.
+   */
+  void
+  StateChanged (TcpSocket::TcpStates_t oldState, TcpSocket::TcpStates_t newState)
+  {
+    if (newState == TcpSocket::CLOSED && !m_released.IsNull ())
+      {
+        if (!m_connected && RetryConnection ())
+          {
+            return;
+          }
+        Simulator::ScheduleNow (&Worker::Release, Ptr<Worker> (this), m_generation);
+      }
+  }
+
+  /**
+   * Called when the socket is CLOSED before the connection was
+   * established.
+   * \return true if the connection is being retried.
+   */
+  virtual bool
+  RetryConnection ()
+  {
+    NS_LOG_WARN ("Connection to " << m_peerAddress << " port " << m_port << " closed before it was established");
+    return false;
+  }
+
+  /**
+   * Give up on a connection that was never established: close the
+   * socket and release this worker, and its hold on the port, without
+   * running the connection vector.
+   */
+  void
+  Abandon ()
+  {
+    NS_LOG_FUNCTION (this);
+    m_closed = true;
+    m_socket->Close ();
+    // The listening socket of an Acceptor is not traced.
+    Simulator::ScheduleNow (&Worker::Release, Ptr<Worker> (this), m_generation);
+  }
+
+  /// \return true once the connection has been established.
+  bool
+  IsConnected () const
+  {
+    return m_connected;
+  }
+
+  /// \return the port of the acceptor.
+  uint16_t
+  GetPort () const
+  {
+    return m_port;
+  }
+
+  Ipv4Address
+  GetLocalAddress () const
+  {
+    return m_localAddress;
+  }
+
+  Ipv4Address
+  GetPeerAddress () const
+  {
+    return m_peerAddress;
+  }
+
 protected:
+  void
+  Release (uint32_t generation)
+  {
+    NS_LOG_FUNCTION (this << generation);
+    if (generation != m_generation || m_released.IsNull ())
+      {
+        return;
+      }
+    // The Application resets us from within the callback; keep the
+    // callback alive until it returns.
+    Callback<void, Ptr<Worker> > released = m_released;
+    m_released.Nullify ();
+    released (this);
+  }
+
+  /**
+   * \return the index of the first ADU at or after \p index that is
+   * sent by this side (\p mine) or by the peer, or the number of ADUs
+   * if there is none.
+   */
+  uint32_t
+  NextAdu (uint32_t index, bool mine) const
+  {
+    const std::vector<ADU>& adus = m_cvec->adus;
+    while (index < adus.size () && (adus[index].side == m_side) != mine)
+      {
+        ++index;
+      }
+    return index;
+  }
+
+  bool
+  HaveAduToSend () const
+  {
+    return m_nextSend < m_cvec->adus.size () || m_terminalPending;
+  }
+
+  const ADU&
+  AduToSend () const
+  {
+    return m_nextSend < m_cvec->adus.size () ? m_cvec->adus[m_nextSend] : m_terminal;
+  }
+
+  void
+  PopAduToSend ()
+  {
+    if (m_nextSend < m_cvec->adus.size ())
+      {
+        m_nextSend = NextAdu (m_nextSend + 1, true);
+      }
+    else
+      {
+        m_terminalPending = false;
+      }
+  }
+
+  /// \return true if nothing but the closing (size=0) ADU is left to send.
+  bool
+  SendFinished () const
+  {
+    if (!HaveAduToSend ())
+      {
+        return true;
+      }
+    return AduToSend ().size == 0
+           && (m_nextSend == m_cvec->adus.size ()
+               || NextAdu (m_nextSend + 1, true) == m_cvec->adus.size ());
+  }
+
+  bool
+  HaveAduToRecv () const
+  {
+    return m_nextRecv < m_cvec->adus.size ();
+  }
+
+  void
+  PopAduToRecv ()
+  {
+    m_nextRecv = NextAdu (m_nextRecv + 1, false);
+    m_recvRemaining = HaveAduToRecv () ? m_cvec->adus[m_nextRecv].size : 0;
+  }
+
+  /// \return true if nothing but the closing (size=0) ADU is left to receive.
+  bool
+  RecvFinished () const
+  {
+    return !HaveAduToRecv ()
+           || (m_cvec->adus[m_nextRecv].size == 0
+               && NextAdu (m_nextRecv + 1, false) == m_cvec->adus.size ());
+  }
+
   void
   ScheduleNextSend (Ptr<Socket> socket)
   {
     NS_LOG_FUNCTION_NOARGS();
     NS_LOG_FUNCTION (this << socket);
-    // It's expected that this won't be called if m_adusToSend is
-    // empty, since the last ADU should have size==0, indicating FIN
-    NS_ASSERT (!m_adusToSend.empty ());
+    // It's expected that this won't be called if there are no ADUs
+    // to send, since the last ADU should have size==0, indicating FIN
+    NS_ASSERT (HaveAduToSend ());
+    const ADU& adu = AduToSend ();
     // Either sendWaitTime, or recvWaitTime, or both are always zero.
-    if (m_adusToSend.front ().sendWaitTime.IsStrictlyPositive ())
+    if (adu.sendWaitTime.IsStrictlyPositive ())
       {
         if (m_lastSendTime < Seconds (0))
           {
@@ -290,21 +523,21 @@ protected:
           {
             // (m_lastSendTime + adu.sendWaitTime) is the earliest
             // time at which the data may be sent.
-            Time sendTime = m_lastSendTime + m_adusToSend.front ().sendWaitTime;
+            Time sendTime = m_lastSendTime + adu.sendWaitTime;
             if (sendTime >= Simulator::Now ())
               {
                 NS_LOG_LOGIC ("send_wait: Scheduling DoSend at " << sendTime.GetSeconds () << "s");
                 Simulator::Schedule (sendTime - Simulator::Now (),
-                                     &Worker::DoSend, this, socket);
+                                     &Worker::ScheduledSend, Ptr<Worker> (this), socket, m_generation);
               }
             else
               {
                 NS_LOG_LOGIC ("send_wait: Scheduling DoSend immediately (was overdue by " << (Simulator::Now () - sendTime).GetSeconds () << "s");
-                Simulator::ScheduleNow (&Worker::DoSend, this, socket);
+                Simulator::ScheduleNow (&Worker::ScheduledSend, Ptr<Worker> (this), socket, m_generation);
               }
           }
       }
-    else if (m_adusToSend.front ().recvWaitTime.IsStrictlyPositive ())
+    else if (adu.recvWaitTime.IsStrictlyPositive ())
       {
         if (m_lastRecvTime < Seconds (0))
           {
@@ -314,17 +547,17 @@ protected:
           {
             // (m_lastRecvTime + adu.recvWaitTime) is the earliest
             // time at which the data may be sent.
-            Time sendTime = m_lastRecvTime + m_adusToSend.front ().recvWaitTime;
+            Time sendTime = m_lastRecvTime + adu.recvWaitTime;
             if (sendTime >= Simulator::Now ())
               {
                 NS_LOG_LOGIC ("recv_wait: Scheduling DoSend at " << sendTime.GetSeconds () << "s");
                 Simulator::Schedule (sendTime - Simulator::Now (),
-                                     &Worker::DoSend, this, socket);
+                                     &Worker::ScheduledSend, Ptr<Worker> (this), socket, m_generation);
               }
             else
               {
                 NS_LOG_LOGIC ("recv_wait: Scheduling DoSend immediately (was overdue by " << (Simulator::Now () - sendTime) << ")");
-                Simulator::ScheduleNow (&Worker::DoSend, this, socket);
+                Simulator::ScheduleNow (&Worker::ScheduledSend, Ptr<Worker> (this), socket, m_generation);
               }
             // Very important: clear m_lastRecvTime now that the
             // response to this packet has been scheduled.  This
@@ -343,27 +576,42 @@ protected:
   }
 
   /**
-   * Performs the actual send of data through the socket.
+   * DoSend, unless this worker has been reset since the send was
+   * scheduled.
+   */
+  void
+  ScheduledSend (Ptr<Socket> socket, uint32_t generation)
+  {
+    if (generation == m_generation)
+      {
+        DoSend (socket);
+      }
+  }
+
+  /**
+   * Starts sending the next ADU through the socket.
    * May be scheduled or called directly from ScheduleNextSend.
    */
   void
   DoSend (Ptr<Socket> socket)
   {
     NS_LOG_FUNCTION_NOARGS();
-    if (m_adusToSend.empty ())
+    if (!HaveAduToSend () || m_bytesToSend)
       {
         // This happens sometimes when 2 ADUs are received in a row
-        // and both trigger a DoSend scheduling via recv_wait.  It can
+        // and both trigger a DoSend scheduling via recv_wait, or
+        // while the previous ADU is still being sent, in which case
+        // the next send is scheduled when that one is done.  It can
         // be safely ignored.
         return;
       }
-    ADU adu = m_adusToSend.front ();
-    m_adusToSend.pop_front ();
+    ADU adu = AduToSend ();
+    PopAduToSend ();
     NS_LOG_FUNCTION (this << socket << adu);
 
     if (adu.size == 0)
       {
-        NS_ASSERT_MSG (m_adusToSend.empty (), "Tmix::Worker::DoSend(): Non-zero-length ADU follows zero-length ADU: " << '\n' << adu << '\n' << m_adusToSend.front () << '\n');
+        NS_ASSERT_MSG (!HaveAduToSend (), "Tmix::Worker::DoSend(): Non-zero-length ADU follows zero-length ADU: " << '\n' << adu << '\n' << AduToSend () << '\n');
         // Zero size indicates it's time to send a FIN, closing the
         // connection from this side.  Can't do that if we still have
         // ADUs to receive, though, so don't close unless we're done.
@@ -375,84 +623,103 @@ protected:
       }
     else
       {
-        // Stuff the whole ADU into the send buffer, one packet at a time.
-        unsigned bytesToSend = adu.size;
-        unsigned bytesQueued = 0;
-        while (bytesToSend)
+        m_bytesToSend = adu.size;
+        SendPending (socket);
+      }
+    NS_LOG_LOGIC ("Ending DoSend");
+  }
+
+  /**
+   * Hand as much of the current ADU to the socket as its send buffer
+   * takes, in fragments of the shared zero-filled payload.  The rest
+   * is sent from SendSpaceAvailable as the buffer drains; once the
+   * last byte is in, the next ADU is scheduled.
+   */
+  void
+  SendPending (Ptr<Socket> socket)
+  {
+    while (m_bytesToSend)
+      {
+        uint32_t chunk = std::min (m_bytesToSend, std::min (socket->GetTxAvailable (),
+                                                            m_payload->GetSize ()));
+        if (chunk == 0)
           {
-            int bytesAccepted;
-            if (bytesToSend > m_packetSize)
-              {
-                bytesAccepted = socket->Send (Create<Packet> (m_packetSize));
-              }
-            else
-              {
-                bytesAccepted = socket->Send (Create<Packet> (bytesToSend));
-              }
-            if (bytesAccepted > 0)
-              {
-                bytesToSend -= bytesAccepted;
-                bytesQueued += bytesAccepted;
-              }
-            else if (socket->GetErrno () == TcpSocket::ERROR_MSGSIZE)
-              {
-                // TODO: instead of trying to load the whole thing
-                // into the send buffer all at once, register a send
-                // callback and finish the job asynchronously
-                NS_LOG_WARN ("Send buffer filled while sending ADU " << adu << " (" << bytesQueued << " bytes already queued). Increase TcpSocket's SndBufSize.");
-                break;
-              }
-            else if (socket->GetErrno () == TcpSocket::ERROR_NOTCONN)
-              {
-                // This means that the socket was already closed by us for sending, somehow.
-                NS_LOG_WARN ("ERROR_NOTCONN while sending - this is a bug");
-                break;
-              }
-            else
-              {
-                NS_LOG_WARN ("Error sending " << bytesToSend << " bytes of data (" << bytesQueued << " bytes already queued). TcpSocket errno == " << socket->GetErrno ());
-                break;
-              }
+            NS_LOG_LOGIC ("Send buffer full, " << m_bytesToSend << " bytes of the ADU to go.");
+            return;
           }
-
-        m_lastSendTime = Simulator::Now ();
-
-        if (m_adusToSend.empty ())
+        int bytesAccepted = socket->Send (m_payload->CreateFragment (0, chunk));
+        if (bytesAccepted > 0)
+          {
+            m_bytesToSend -= bytesAccepted;
+          }
+        else if (socket->GetErrno () == TcpSocket::ERROR_NOTCONN)
+          {
+            // This means that the socket was already closed by us for sending, somehow.
+            NS_LOG_WARN ("ERROR_NOTCONN while sending - this is a bug");
+            m_bytesToSend = 0;
+          }
+        else
           {
-            // Technically, all connection vectors should be
-            // terminated with a zero-length ADU indicating the time
-            // at which the connection is closed.  However, in this
-            // case it is missing and we must insert it, making that
-            // assumption that the connection should be closed
-            // immediately.
-            NS_LOG_LOGIC ("No more ADUs to send and no explicit closing ADU (size=0). Queueing a close immediately.");
-
-            ADU terminal;
-            terminal.recvWaitTime = Seconds (0);
-            terminal.sendWaitTime = Seconds (0);
-            terminal.side = m_side;
-            terminal.size = 0;
-
-            m_adusToSend.push_back (terminal);
+            NS_LOG_WARN ("Error sending " << m_bytesToSend << " bytes of data. TcpSocket errno == " << socket->GetErrno ());
+            m_bytesToSend = 0;
           }
+      }
 
-        ScheduleNextSend (socket);
+    m_lastSendTime = Simulator::Now ();
 
-      } // end else if adu.size != 0
-    NS_LOG_LOGIC ("Ending DoSend");
+    if (!HaveAduToSend ())
+      {
+        // Technically, all connection vectors should be
+        // terminated with a zero-length ADU indicating the time
+        // at which the connection is closed.  However, in this
+        // case it is missing and we must insert it, making that
+        // assumption that the connection should be closed
+        // immediately.
+        NS_LOG_LOGIC ("No more ADUs to send and no explicit closing ADU (size=0). Queueing a close immediately.");
+        m_terminalPending = true;
+      }
+
+    ScheduleNextSend (socket);
   }
 
 protected:
   ADU::Side m_side;
-  ConnectionVector m_cvec;
+  /// Shared, read-only connection vector being run.
+  Ptr<const ConnectionVector> m_cvec;
+  /// Index in m_cvec->adus of the next ADU to send.
+  uint32_t m_nextSend;
+  /// Index in m_cvec->adus of the ADU being received.
+  uint32_t m_nextRecv;
+  /// Bytes of ADU m_nextRecv not received yet.
+  uint32_t m_recvRemaining;
+  /// Closing ADU sent when the connection vector lacks one.
+  ADU m_terminal;
+  /// Whether m_terminal is still to be sent.
+  bool m_terminalPending;
+  /// Socket given to Init(): the listening socket of an Acceptor or
+  /// the connecting socket of an Initiator.
   Ptr<Socket> m_socket;
-  unsigned m_packetSize;
-  std::deque<ADU> m_adusToSend;
-  std::deque<ADU> m_adusToRecv;
+  /// Socket of the established connection.
+  Ptr<Socket> m_connection;
+  /// Zero-filled payload; every packet sent is a fragment of it.
+  Ptr<const Packet> m_payload;
+  /// Bytes of the ADU being sent that are not in the socket yet.
+  uint32_t m_bytesToSend;
   Time m_lastSendTime;
   Time m_lastRecvTime;
   bool m_closed;
-  Callback<void, ConnectionVector> m_notifyCvecComplete;
+  /// Whether the connection has been established.
+  bool m_connected;
+  Ipv4Address m_localAddress;
+  Ipv4Address m_peerAddress;
+  /// Port the acceptor listens on.
+  uint16_t m_port;
+  /// Bumped by Reset(), so that sends scheduled for an earlier
+  /// connection vector can be told apart.
+  uint32_t m_generation;
+  Callback<void, Ptr<const ConnectionVector> > m_notifyCvecComplete;
+  /// Called once the connected socket is CLOSED.
+  Callback<void, Ptr<Worker> > m_released;
 };
 
 /**
@@ -463,32 +730,24 @@ protected:
 class Acceptor : public Worker
 {
 public:
-  Acceptor (Ptr<Socket> socket, unsigned packetSize,
-            const ConnectionVector& cvec, const InetSocketAddress& localAddress,
-            Callback<void, ConnectionVector> notifyCvecComplete,
-            Callback<void> deallocate)
-    : Worker (socket, packetSize, cvec, ADU::ACCEPTOR, notifyCvecComplete),
-      m_localAddress (
-        localAddress),
-      m_deallocate (deallocate)
+  Acceptor ()
+    : Worker (ADU::ACCEPTOR)
   {
-    NS_LOG_FUNCTION_NOARGS();
-    NS_LOG_FUNCTION (this << socket);
-    m_socket->SetAcceptCallback (
-      MakeCallback (&Acceptor::ConnectionRequest, this), MakeCallback (
-        &Acceptor::NewConnectionCreated, this));
-    // Don't bother using SetConnectCallbacks -- we don't initiate connections.
   }
 
   virtual void
   Start ()
   {
     NS_LOG_FUNCTION_NOARGS();
-    NS_LOG_FUNCTION (this << m_localAddress);
+    NS_LOG_FUNCTION (this << m_localAddress << m_port);
     NS_LOG_DEBUG ("In this start");
-    if (m_socket->Bind (m_localAddress))
+    m_socket->SetAcceptCallback (
+      MakeCallback (&Acceptor::ConnectionRequest, this), MakeCallback (
+        &Acceptor::NewConnectionCreated, this));
+    // Don't bother using SetConnectCallbacks -- we don't initiate connections.
+    if (m_socket->Bind (InetSocketAddress (m_localAddress, m_port)))
       {
-        NS_LOG_WARN ("Acceptor::Start(): m_socket->Bind(" << m_localAddress << ") failed with errno " << m_socket->GetErrno ());
+        NS_LOG_WARN ("Acceptor::Start(): m_socket->Bind(" << m_localAddress << ":" << m_port << ") failed with errno " << m_socket->GetErrno ());
       }
     if (m_socket->Listen ())
       {
@@ -496,30 +755,6 @@ public:
       }
   }
 
-  virtual void
-  Closed (Ptr<Socket> socket)
-  {
-    NS_LOG_FUNCTION_NOARGS();
-    NS_LOG_FUNCTION (this << socket);
-
-    Worker::Closed (socket);
-
-    if (!m_closed)
-      {
-        CloseIfDone (socket);
-        if (m_closed)
-          {
-            m_deallocate ();
-          }
-      }
-
-    // Deallocate the port IF it has been fully closed by both sides,
-    // and the socket's endpoint deallocated.  FIXME: Unfortunately
-    // with the new TCP implementation, I haven't found an easy way to
-    // tell when this has happened.  So for the time being, ports stay
-    // allocated forever.  m_deallocate();
-  }
-
   bool
   ConnectionRequest (Ptr<Socket> socket, const Address& address)
   {
@@ -534,11 +769,17 @@ public:
   {
     NS_LOG_FUNCTION_NOARGS();
     NS_LOG_FUNCTION (this << socket << address);
+    m_connected = true;
+    m_connection = socket;
     socket->SetRecvCallback (MakeCallback (&Worker::Receive, this));
-    socket->SetCloseCallbacks (MakeCallback (&Acceptor::Closed, this),
+    socket->SetSendCallback (MakeCallback (&Worker::SendSpaceAvailable, this));
+    socket->SetCloseCallbacks (MakeCallback (&Worker::Closed, this),
                                MakeNullCallback<void, Ptr<Socket> > ());
+    // The port is free again once this socket has been closed and its
+    // endpoint deallocated.
+    socket->TraceConnectWithoutContext ("State", MakeCallback (&Worker::StateChanged, this));
     // Begin sending, maybe.
-    if (!m_adusToSend.empty ())
+    if (HaveAduToSend ())
       {
         // The first ADU to send might be on recv_wait, so this won't
         // necessarily schedule anything.
@@ -553,10 +794,6 @@ public:
     // Close the socket listening for new connections
     m_socket->Close ();
   }
-
-private:
-  InetSocketAddress m_localAddress;
-  Callback<void> m_deallocate;
 };
 
 /**
@@ -565,17 +802,17 @@ private:
 class Initiator : public Worker
 {
 public:
-  Initiator (Ptr<Socket> socket, unsigned packetSize,
-             const ConnectionVector& cvec, const InetSocketAddress& peerAddress,
-             Callback<void, ConnectionVector> notifyCvecComplete)
-    : Worker (socket, packetSize, cvec, ADU::INITIATOR, notifyCvecComplete),
-      m_peerAddress (peerAddress)
+  Initiator ()
+    : Worker (ADU::INITIATOR),
+      m_connectRetries (0)
   {
-    NS_LOG_FUNCTION_NOARGS();
-    NS_LOG_FUNCTION (this << socket);
-    m_socket->SetConnectCallback (MakeCallback (&Initiator::ConnectionComplete,
-                                                this), MakeCallback (&Initiator::ConnectionFailed, this));
-    // Don't bother using SetAcceptCallback -- we don't listen for connections on this side.
+  }
+
+  /// Number of times to retry a connection that failed to open.
+  void
+  SetConnectRetries (uint32_t retries)
+  {
+    m_connectRetries = retries;
   }
 
   virtual void
@@ -584,8 +821,15 @@ public:
     NS_LOG_FUNCTION_NOARGS();
    NS_LOG_DEBUG ("In that start");
     NS_LOG_FUNCTION (this);
-    m_socket->Bind ();
-    m_socket->Connect (m_peerAddress);
+    m_socket->SetConnectCallback (MakeCallback (&Initiator::ConnectionComplete,
+                                                this), MakeCallback (&Initiator::ConnectionFailed, this));
+    // Don't bother using SetAcceptCallback -- we don't listen for connections on this side.
+    // Bind to the chosen local address so that the packets match the
+    // DelayBox rule, even if the node has several addresses.
+    m_socket->Bind (InetSocketAddress (m_localAddress, 0));
+    m_connection = m_socket;
+    m_socket->TraceConnectWithoutContext ("State", MakeCallback (&Worker::StateChanged, this));
+    m_socket->Connect (InetSocketAddress (m_peerAddress, m_port));
   }
 
   void
@@ -593,12 +837,14 @@ public:
   {
     NS_LOG_FUNCTION_NOARGS();
     NS_LOG_FUNCTION (this << socket);
+    m_connected = true;
     // Get ready to receive.
     socket->SetRecvCallback (MakeCallback (&Worker::Receive, this));
+    socket->SetSendCallback (MakeCallback (&Worker::SendSpaceAvailable, this));
     socket->SetCloseCallbacks (MakeCallback (&Worker::Closed, this),
                                MakeNullCallback<void, Ptr<Socket> > ());
     // Begin sending, maybe.
-    if (!m_adusToSend.empty ())
+    if (HaveAduToSend ())
       {
         // The first ADU to send might be on recv_wait, so this won't
         // necessarily schedule anything.
@@ -617,62 +863,192 @@ public:
   {
     NS_LOG_FUNCTION_NOARGS();
     NS_LOG_FUNCTION (this << socket);
-    // Retry the connection I guess? This isn't really supposed to happen.
-    NS_LOG_WARN ("Initiator failed to open connection. Retrying.");
-    m_socket->Connect (m_peerAddress);
+    // This isn't really supposed to happen: retry a few times, then
+    // give the port back.
+    if (m_connectRetries > 0)
+      {
+        --m_connectRetries;
+        NS_LOG_WARN ("Initiator failed to open connection to " << m_peerAddress << " port " << m_port << ". Retrying.");
+        m_socket->Connect (InetSocketAddress (m_peerAddress, m_port));
+      }
+    else
+      {
+        NS_LOG_WARN ("Initiator failed to open connection to " << m_peerAddress << " port " << m_port << ". Giving up.");
+        Abandon ();
+      }
+  }
+
+  /**
+   * The socket closes itself once its SYNs went unanswered, or on a
+   * reset; retry like ConnectionFailed().
+   */
+  virtual bool
+  RetryConnection ()
+  {
+    if (m_closed || m_connectRetries == 0)
+      {
+        NS_LOG_WARN ("Initiator failed to open connection to " << m_peerAddress << " port " << m_port << ". Giving up.");
+        return false;
+      }
+    --m_connectRetries;
+    NS_LOG_WARN ("Initiator failed to open connection to " << m_peerAddress << " port " << m_port << ". Retrying.");
+    // The socket frees its endpoint after changing state.
+    Simulator::ScheduleNow (&Initiator::Reconnect, Ptr<Initiator> (this), m_generation);
+    return true;
   }
 
 private:
-  InetSocketAddress m_peerAddress;
+  void
+  Reconnect (uint32_t generation)
+  {
+    NS_LOG_FUNCTION (this << generation);
+    if (generation != m_generation)
+      {
+        return;
+      }
+    m_socket->Bind (InetSocketAddress (m_localAddress, 0));
+    m_socket->Connect (InetSocketAddress (m_peerAddress, m_port));
+  }
+
+  /// Connection retries left.
+  uint32_t m_connectRetries;
 };
 
+void
+Application::DoDispose (void)
+{
+  m_workers.clear ();
+  m_idleWorkers.clear ();
+  m_delayBox = 0;
+  ns3::Application::DoDispose ();
+}
+
+void
+Application::WorkerReleased (Callback<void> deallocatePort, Ptr<Worker> worker)
+{
+  NS_LOG_FUNCTION (this << worker);
+  if (!deallocatePort.IsNull ())
+    {
+      deallocatePort ();
+    }
+  if (!worker->IsConnected () && !m_connectionFailed.IsNull ())
+    {
+      m_connectionFailed (worker->GetPort (), worker->GetLocalAddress (), worker->GetPeerAddress ());
+    }
+  m_workers.erase (worker);
+  worker->Reset ();
+  m_idleWorkers.push_back (worker);
+}
+
+void
+Application::AbandonConnection (uint16_t port, const Ipv4Address& localAddress)
+{
+  NS_LOG_FUNCTION (this << port << localAddress);
+  for (std::set<Ptr<Worker> >::const_iterator it = m_workers.begin (); it != m_workers.end (); ++it)
+    {
+      if (!(*it)->IsConnected () && (*it)->GetPort () == port
+          && (*it)->GetLocalAddress () == localAddress)
+        {
+          (*it)->Abandon ();
+          return;
+        }
+    }
+}
+
+uint32_t
+Application::GetNWorkers () const
+{
+  return m_workers.size ();
+}
+
+uint32_t
+Application::GetNIdleWorkers () const
+{
+  return m_idleWorkers.size ();
+}
+
+void
+Application::ForgetConnection (uint16_t port, const Ipv4Address& localAddress,
+                               const Ipv4Address& peerAddress)
+{
+  if (m_side == ADU::INITIATOR)
+    {
+      m_delayBox->RemoveRule (localAddress, 0, peerAddress, port);
+    }
+  else
+    {
+      m_delayBox->RemoveRule (localAddress, port, peerAddress, 0);
+    }
+}
+
 void
 Application::StartConnectionVector (const ConnectionVector& cvec, uint16_t port,
-                                    Callback<void, ConnectionVector> notifyCvecComplete,
+                                    Callback<void, Ptr<const ConnectionVector> > notifyCvecComplete,
+                                    Callback<void> deallocatePort)
+{
+  StartConnectionVector (Create<ConnectionVector> (cvec), port, m_localAddress, m_peerAddress,
+                         notifyCvecComplete, deallocatePort);
+}
+
+void
+Application::StartConnectionVector (Ptr<const ConnectionVector> cvec, uint16_t port,
+                                    const Ipv4Address& localAddress, const Ipv4Address& peerAddress,
+                                    Callback<void, Ptr<const ConnectionVector> > notifyCvecComplete,
                                     Callback<void> deallocatePort)
 {
   NS_LOG_FUNCTION_NOARGS();
   Ptr<Socket> socket = Socket::CreateSocket (GetNode (),
                                              TcpSocketFactory::GetTypeId ());
-  // FIXME: Increasing the buffer sizes like this is ugly. Fix the
-  // Worker implementation so it is no longer necessary.  Note that
-  // increasing this value beyond half of 2^32 will cause serious
-  // problems (sequence numbers) in the current TCP implementation, so
-  // don't do it.
-  socket->SetAttribute ("SndBufSize", UintegerValue (2000000000));
-  socket->SetAttribute ("RcvBufSize", UintegerValue (2000000000));
+  // Buffer sizes are TcpSocket's SndBufSize and RcvBufSize defaults;
+  // workers feed ADUs to the socket as its send buffer drains.
+  if (!m_payload || m_payload->GetSize () != m_packetSize)
+    {
+      m_payload = Create<Packet> (m_packetSize);
+    }
   socket->SetAttribute ("SegmentSize", UintegerValue (m_packetSize));
   // Disable symmetric mode on DelayBox because we need to specify a
   // different loss rate in each direction.  Since we only use
   // ConstantVariable random variables, and never set a bottleneck
   // link speed, this won't affect anything else.
   m_delayBox->SetSymmetric (false);
+  Callback<void, Ptr<Worker> > released = MakeCallback (
+      &Application::WorkerReleased, this).Bind (deallocatePort);
   Ptr<Worker> worker;
+  if (!m_idleWorkers.empty ())
+    {
+      worker = m_idleWorkers.back ();
+      m_idleWorkers.pop_back ();
+    }
   if (m_side == ADU::INITIATOR)
     {
       socket->SetAttribute ("InitialCwnd", UintegerValue (
-                              cvec.windowSizeInitiator));
+                              cvec->windowSizeInitiator));
       socket->SetAttribute ("SegmentSize", UintegerValue (
-                              cvec.mssInitiator));
-      m_delayBox->AddRule (m_localAddress, 0, m_peerAddress, port, DelayBoxRule (                 //HJB
-                             (cvec.minRTT.GetSeconds () / 2.0), (
-                               cvec.lossRateItoA), (0)));
-      worker = CreateObject<Initiator> (socket, m_packetSize, cvec,
-                                        InetSocketAddress (m_peerAddress, port), notifyCvecComplete);
+                              cvec->mssInitiator));
+      m_delayBox->AddRule (localAddress, 0, peerAddress, port, DelayBoxRule (                 //HJB
+                             (cvec->minRTT.GetSeconds () / 2.0), (
+                               cvec->lossRateItoA), (0)), true);
+      Ptr<Initiator> initiator = worker ? DynamicCast<Initiator> (worker) : CreateObject<Initiator> ();
+      initiator->SetConnectRetries (m_maxConnectRetries);
+      worker = initiator;
     }
   else // m_side == ADU::ACCEPTOR
     {
       socket->SetAttribute ("InitialCwnd",
-                            UintegerValue (cvec.windowSizeAcceptor));
+                            UintegerValue (cvec->windowSizeAcceptor));
       socket->SetAttribute ("SegmentSize", UintegerValue (
-                              cvec.mssAcceptor));
-      m_delayBox->AddRule (m_localAddress, port, m_peerAddress, 0, DelayBoxRule (                 //HJB
-                             (cvec.minRTT.GetSeconds () / 2.0), (
-                               cvec.lossRateAtoI), (0)));
-      worker = CreateObject<Acceptor> (socket, m_packetSize, cvec,
-                                       InetSocketAddress (m_localAddress, port), notifyCvecComplete,
-                                       deallocatePort);
+                              cvec->mssAcceptor));
+      m_delayBox->AddRule (localAddress, port, peerAddress, 0, DelayBoxRule (                 //HJB
+                             (cvec->minRTT.GetSeconds () / 2.0), (
+                               cvec->lossRateAtoI), (0)), true);
+      if (!worker)
+        {
+          worker = CreateObject<Acceptor> ();
+        }
     }
+  worker->Init (socket, m_payload, cvec, localAddress, peerAddress, port,
+                notifyCvecComplete, released);
+  m_workers.insert (worker);
   Simulator::ScheduleNow (MakeEvent (&Worker::Start, worker));
 }
 
@@ -719,20 +1095,23 @@ ParseConnectionVector (std::istream &in, ConnectionVector& cvec)
     }
    cvec.startTime = MicroSeconds (startTimeMicroseconds);
   in >> x; 
+  // The MSS and window lines are optional; traces from UNC, such as
+  // inbound.ns, have no MSS line.
   if (x == 'm')
     {
       in >> cvec.mssInitiator >> cvec.mssAcceptor;
+      in >> x;
     }
   else
     {
-      return false;
+      cvec.mssInitiator = 1460;
+      cvec.mssAcceptor = 1460;
     }
-  in >> x;
   if (x == 'w')
     {
       in >> cvec.windowSizeInitiator >> cvec.windowSizeAcceptor;
+      in >> x;
     }
-  in >> x;
   if (x == 'r')
     {
       uint64_t rttMicroseconds;
@@ -801,6 +1180,200 @@ ParseConnectionVector (std::istream &in, ConnectionVector& cvec)
   return true;
 }
 
+static void
+AppendAdu (ConnectionVector& cvec, ADU::Side side, uint64_t sendWaitTimeMicroseconds,
+           uint64_t recvWaitTimeMicroseconds, unsigned size)
+{
+  ADU adu;
+  adu.side = side;
+  adu.sendWaitTime = MicroSeconds (sendWaitTimeMicroseconds);
+  adu.recvWaitTime = MicroSeconds (recvWaitTimeMicroseconds);
+  adu.size = size;
+  cvec.adus.push_back (adu);
+}
+
+bool
+ParseOriginalConnectionVector (std::istream &in, ConnectionVector& cvec, bool endOfTrace)
+{
+  NS_LOG_FUNCTION_NOARGS();
+  if (!in)
+    {
+      return false;
+    }
+  cvec.type = ConnectionVector::SEQUENTIAL;
+  cvec.startTime = Seconds (0);
+  cvec.id1 = 0;
+  cvec.id2 = 0;
+  cvec.windowSizeInitiator = 0;
+  cvec.windowSizeAcceptor = 0;
+  cvec.minRTT = Seconds (0);
+  cvec.lossRateItoA = 0;
+  cvec.lossRateAtoI = 0;
+  // ns-2 Tmix default, used when the trace has no 'm' line.
+  cvec.mssInitiator = 1460;
+  cvec.mssAcceptor = 1460;
+  cvec.adus.clear ();
+
+  bool haveHeader = false;
+  bool nextHeaderFound = false;
+  // Pending wait times (us) and directions, as kept by cvec-orig2alt.
+  uint64_t time = 0;
+  uint64_t initTime = 0;
+  uint64_t accTime = 0;
+  bool haveLastSide = false;
+  ADU::Side lastSide = ADU::INITIATOR;
+  bool haveSide = false;
+  ADU::Side side = ADU::INITIATOR;
+  std::string line;
+  while (true)
+    {
+      std::streampos lineStart = in.tellg ();
+      if (!std::getline (in, line))
+        {
+          break;
+        }
+      std::istringstream fields (line);
+      std::string tag;
+      if (!(fields >> tag) || tag[0] == '#')
+        {
+          // Skip blank and comment lines.
+          continue;
+        }
+      if (tag == "SEQ" || tag == "S" || tag == "CONC" || tag == "C")
+        {
+          if (haveHeader)
+            {
+              // Start of the next connection vector; leave it for the next call.
+              in.clear ();
+              in.seekg (lineStart);
+              nextHeaderFound = true;
+              break;
+            }
+          haveHeader = true;
+          double startTimeMicroseconds;
+          unsigned numExchanges;
+          if (tag[0] == 'S')
+            {
+              cvec.type = ConnectionVector::SEQUENTIAL;
+              fields >> startTimeMicroseconds >> numExchanges >> cvec.id1 >> cvec.id2;
+            }
+          else
+            {
+              cvec.type = ConnectionVector::CONCURRENT;
+              unsigned numAcceptAdus;
+              fields >> startTimeMicroseconds >> numExchanges >> numAcceptAdus >> cvec.id1 >> cvec.id2;
+            }
+          if (!fields)
+            {
+              return false;
+            }
+          cvec.startTime = MicroSeconds (startTimeMicroseconds);
+          continue;
+        }
+      if (!haveHeader)
+        {
+          return false;
+        }
+      uint64_t value = 0;
+      if (tag == "m")
+        {
+          fields >> cvec.mssInitiator >> cvec.mssAcceptor;
+        }
+      else if (tag == "w")
+        {
+          fields >> cvec.windowSizeInitiator >> cvec.windowSizeAcceptor;
+        }
+      else if (tag == "r")
+        {
+          fields >> value;
+          cvec.minRTT = MicroSeconds (value);
+        }
+      else if (tag == "l")
+        {
+          fields >> cvec.lossRateItoA >> cvec.lossRateAtoI;
+        }
+      else if (tag == ">" || tag == "<")
+        {
+          // Sequential ADU: wait after our own send if the previous ADU
+          // went the same way, otherwise wait after receiving.
+          fields >> value;
+          side = (tag == ">") ? ADU::INITIATOR : ADU::ACCEPTOR;
+          haveSide = true;
+          if (haveLastSide && lastSide == side)
+            {
+              AppendAdu (cvec, side, time, 0, value);
+            }
+          else
+            {
+              AppendAdu (cvec, side, 0, time, value);
+            }
+          time = 0;
+          lastSide = side;
+          haveLastSide = true;
+        }
+      else if (tag == "t")
+        {
+          // A zero wait would be indistinguishable from no wait at all.
+          fields >> time;
+          time = std::max<uint64_t> (time, 1);
+        }
+      else if (tag == "c>")
+        {
+          fields >> value;
+          side = ADU::INITIATOR;
+          haveSide = true;
+          AppendAdu (cvec, side, initTime, 0, value);
+          initTime = 0;
+        }
+      else if (tag == "c<")
+        {
+          fields >> value;
+          side = ADU::ACCEPTOR;
+          haveSide = true;
+          AppendAdu (cvec, side, accTime, 0, value);
+          accTime = 0;
+        }
+      else if (tag == "t>")
+        {
+          fields >> initTime;
+          initTime = std::max<uint64_t> (initTime, 1);
+        }
+      else if (tag == "t<")
+        {
+          fields >> accTime;
+          accTime = std::max<uint64_t> (accTime, 1);
+        }
+      else
+        {
+          NS_LOG_WARN ("Ignoring unknown line in original cvec: " << line);
+        }
+    }
+  if (!haveHeader)
+    {
+      return false;
+    }
+  // Trailing waits become the FINs closing the connection.
+  if (time > 0)
+    {
+      AppendAdu (cvec, lastSide, time, 0, 0);
+    }
+  if (initTime > 0)
+    {
+      AppendAdu (cvec, ADU::INITIATOR, initTime, 0, 0);
+    }
+  if (accTime > 0)
+    {
+      AppendAdu (cvec, ADU::ACCEPTOR, accTime, 0, 0);
+    }
+  if (endOfTrace && !nextHeaderFound && time == 0 && initTime == 0 && accTime == 0 && haveSide)
+    {
+      // The converter closes the very last connection of a file even
+      // when no wait time follows its last ADU.
+      AppendAdu (cvec, side, 1, 0, 0);
+    }
+  return true;
+}
+
 void
 ConnectionVector::DebugPrint (std::ostream& out) const
 {
@@ -42,8 +42,10 @@
 #include "ns3/nstime.h"
 #include "ns3/application.h"
 #include "ns3/delaybox.h"
+#include "ns3/simple-ref-count.h"
 
 #include <iostream>
+#include <set>
 #include <vector>
 
 namespace ns3 {
@@ -98,9 +100,13 @@ operator<< (std::ostream& lhs, const ADU& rhs);
  * rate, window size, etc.  Each connection vector also contains an
  * arbitrary number of application data units (ADUs).
  *
+ * Once a connection vector is started it is shared, read only, by
+ * both of its workers through a Ptr<const ConnectionVector>; copies
+ * get a reference count of their own.
+ *
  * \see ADU
  */
-struct ConnectionVector
+struct ConnectionVector : public SimpleRefCount<ConnectionVector>
 {
   typedef enum
   {
@@ -130,7 +136,8 @@ struct ConnectionVector
 
   uint32_t mssAcceptor;
 
-  /// Sequential list of ADUs.
+  /// Sequential list of ADUs of both sides.  Workers walk it with
+  /// cursors rather than copying their side out.
   std::vector<ADU> adus;
 
   /// Print a human readable representation of this connection vector
@@ -156,6 +163,31 @@ operator<< (std::ostream& lhs, const ConnectionVector& rhs);
 bool
 ParseConnectionVector (std::istream &in, ConnectionVector& out);
 
+/**
+ * Read a single connection vector in the original (Felix) format, as
+ * found in the .orig traces and written by the trace shuffler, from an
+ * input stream.  The t/>/</c>/c< lines are turned into ADUs the same
+ * way utils/cvec-orig2alt.cpp converts them. Call repeatedly to parse
+ * the whole file; the stream must support seekg.
+ *
+ * Like the converter, a FIN is only sent after the last ADU of a
+ * connection when the trace gives a wait time for it, except for the
+ * last connection of the file, which always gets one.  Callers feeding
+ * the connections of a trace one at a time pass endOfTrace = false for
+ * all but the last of them, so they get the same ADUs as a whole-file
+ * conversion.
+ *
+ * \param in Stream to read from.
+ * \param out ConnectionVector to write to.
+ * \param endOfTrace true if the end of the stream is the end of the
+ * trace, so a connection ending it is closed as the last one of a file.
+ * \return true if successful, false if parsing failed or end of file was reached.
+ */
+bool
+ParseOriginalConnectionVector (std::istream &in, ConnectionVector& out, bool endOfTrace);
+
+class Worker;
+
 /**
  * \brief Implements the Tmix initiator and acceptor applications.
  *
@@ -192,17 +224,45 @@ public:
    * \param cvec Connection vector to execute immediately.
    * \param port TCP port to listen on or connect to, depending on
    * which side this application is on.
-   * \param notifyCvecComplete Will be called when the connection
-   * vector is nominally complete, but the port may still be in the
-   * process of shutting down for some time.
-   * \param deallocatePort Will be called when the connection vector
-   * is complete and the port is no longer needed.
+   * \param notifyCvecComplete Will be called with the connection
+   * vector, which is not copied, when it is nominally complete, but
+   * the port may still be in the process of shutting down for some
+   * time.
+   * \param deallocatePort Will be called once this side's socket has
+   * reached CLOSED (after TIME_WAIT, if this side closed first) and its
+   * endpoint has been freed, i.e. when this side no longer needs the
+   * port.
    */
   void
   StartConnectionVector (const ConnectionVector& cvec, uint16_t port,
-                         Callback<void, ConnectionVector> notifyCvecComplete,
+                         Callback<void, Ptr<const ConnectionVector> > notifyCvecComplete,
                          Callback<void> deallocatePort);
 
+  /**
+   * Like StartConnectionVector() above, but use the given pair of
+   * addresses instead of the ones this application was created with.
+   * The local address must be configured on this application's node.
+   * The connection vector is not copied; the same instance should be
+   * passed to the peer application, and must not be modified until
+   * both sides have deallocated the port.
+   */
+  void
+  StartConnectionVector (Ptr<const ConnectionVector> cvec, uint16_t port,
+                         const Ipv4Address& localAddress, const Ipv4Address& peerAddress,
+                         Callback<void, Ptr<const ConnectionVector> > notifyCvecComplete,
+                         Callback<void> deallocatePort);
+
+  /**
+   * Remove the DelayBox rule StartConnectionVector() added for the
+   * given port and pair of addresses.  Call this once both sides have
+   * deallocated the port and before it is reused.  The rule normally
+   * expired when its flow sent a FIN; this covers connections that
+   * ended some other way.
+   */
+  void
+  ForgetConnection (uint16_t port, const Ipv4Address& localAddress,
+                    const Ipv4Address& peerAddress);
+
   /**
    * Maximum size of packets to send. Larger ADUs will be broken up
    * into chunks of no more than this many bytes.
@@ -215,7 +275,56 @@ public:
     m_packetSize = packetSize;
   }
 
+  /**
+   * Number of times an initiator retries a connection that failed to
+   * open, i.e. whose SYNs all went unanswered, before giving up on
+   * its connection vector and releasing the port.
+   *
+   * Default: 3.
+   */
+  void
+  SetMaxConnectRetries (uint32_t retries)
+  {
+    m_maxConnectRetries = retries;
+  }
+
+  /**
+   * \param callback Called with the port, local and peer address of a
+   * connection this application gave up on before it was established,
+   * once it has released the port.  The peer application should be
+   * told to AbandonConnection().
+   */
+  void
+  SetConnectionFailedCallback (Callback<void, uint16_t, Ipv4Address, Ipv4Address> callback)
+  {
+    m_connectionFailed = callback;
+  }
+
+  /**
+   * Give up on the connection vector running on the given port and
+   * local address, if its connection has not been established yet:
+   * an acceptor stops listening and releases the port.
+   */
+  void
+  AbandonConnection (uint16_t port, const Ipv4Address& localAddress);
+
+  /// \return the number of workers running a connection vector.
+  uint32_t
+  GetNWorkers () const;
+
+  /// \return the number of workers kept for the next connection vectors.
+  uint32_t
+  GetNIdleWorkers () const;
+
+protected:
+  virtual void
+  DoDispose (void);
+
 private:
+  /// Called by a Worker once its socket is closed and its endpoint freed.
+  void
+  WorkerReleased (Callback<void> deallocatePort, Ptr<Worker> worker);
+
   /**
    * SetStartTime doesn't do anything; the application runs whenever
    * StartConnectionVector is called.
@@ -244,6 +353,16 @@ private:
   Ipv4Address m_peerAddress;
   /// DelayBox instance to be used for RTT and loss rate enforcement
   Ptr<DelayBox> m_delayBox;
+  /// Zero-filled packet of m_packetSize bytes shared by all workers.
+  Ptr<Packet> m_payload;
+  /// Workers whose sockets have not reached CLOSED yet.
+  std::set<Ptr<Worker> > m_workers;
+  /// Released workers, ready to run the next connection vector.
+  std::vector<Ptr<Worker> > m_idleWorkers;
+  /// Connection retries of an initiator before it gives up.
+  uint32_t m_maxConnectRetries;
+  /// Called when a connection is given up before it was established.
+  Callback<void, uint16_t, Ipv4Address, Ipv4Address> m_connectionFailed;
 };
 
 }
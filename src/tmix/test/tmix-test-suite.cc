@@ -1,70 +1,40 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
 #include "ns3/tmix.h"
-#include "ns3/tmix-topology.h"
+#include "ns3/tmix-binary-cvec.h"
 #include "ns3/tmix-helper.h"
-#include "ns3/tmix-ns2-style-trace-helper.h"
-#include "ns3/tmix-topology-parameter.h"
 
-#include "ns3/global-route-manager.h"
+#include "ns3/delaybox-net-device.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/ipv4-address-generator.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/drop-tail-queue.h"
+#include "ns3/tcp-header.h"
+#include "ns3/tcp-socket-factory.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/double.h"
+#include "ns3/uinteger.h"
+#include "ns3/nstime.h"
+#include "ns3/config.h"
+#include "ns3/simulator.h"
 
 #include "ns3/test.h"
 
-using namespace ns3;
-
-// These two things are global because when TmixTopology c'tor is called, it assigns IP addresses in a given range without checking whether they have been used up or not.
-// It causes problems since two TestCase c'tors call the TmixTopology c'tor (when creating object).
-// So the creation of the TmixTopology object is done only in the first testcase.
-// FIXME : Fix the above problem. Find a way to unassign the IP adresses or create the object outside the test cases.
-
-Ptr<TmixTopology> tmix;
-InternetStackHelper internet;
-
-class TmixTopologyTest : public TestCase
-{
-public:
-  TmixTopologyTest ();
-  virtual ~TmixTopologyTest ();
-private:
-  virtual void DoRun (void);
-  void AddNodes (Ptr<TmixTopology>& tmix, int nLeftPairs, int nRightPairs);
-};
-
-TmixTopologyTest::TmixTopologyTest ()
-  : TestCase ("Creates nodes and checks if they have been created")
-{
-  Ptr<TmixToplogyParameters> ttp = Create<TmixToplogyParameters>();
-  tmix = Create<TmixTopology> (internet,ttp);
-}
-
-TmixTopologyTest::~TmixTopologyTest ()
-{
-}
-
-void TmixTopologyTest::AddNodes (Ptr<TmixTopology>& tmix,int nLeftPairs, int nRightPairs)
-{
-  int i;
-  for (i = 0; i < nLeftPairs; i++)
-    {
-      tmix->NewPair (TmixTopology::LEFT);
-    }
-  for (i = 0; i < nRightPairs; i++)
-    {
-      tmix->NewPair (TmixTopology::RIGHT);
-    }
-}
-
-void
-TmixTopologyTest::DoRun (void)
-{
-  uint32_t num_left = 3, num_right = 4;
-  AddNodes (tmix, num_left, num_right);
-  NS_TEST_ASSERT_MSG_EQ ((tmix->LeftPairs ()).size (), num_left, "No of nodes being created not equal to the specified number at LEFT");
-  NS_TEST_ASSERT_MSG_EQ ((tmix->RightPairs ()).size (), num_right, "No of nodes being created not equal to the specified number at RIGHT");
-}
-
-//***************************************//
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
 
+using namespace ns3;
 
 class TmixCvecParseTest : public TestCase
 {
@@ -94,8 +64,9 @@ TmixCvecParseTest::DoRun (void)
   // please use the inbound.ns file given by UNC, Chapel Hill
   // values are hard coded, based on the inbound.ns file
 
+  SetDataDir (NS_TEST_SOURCEDIR);
   std::ifstream cvecfile;
-  cvecfile.open ("src/tmix/test//tmix-inbound.ns");
+  cvecfile.open (CreateDataDirFilename ("tmix-inbound.ns").c_str ());
   parse_success = Tmix::ParseConnectionVector (cvecfile, cvec);
   cvecfile.close ();
 
@@ -130,74 +101,972 @@ TmixCvecParseTest::DoRun (void)
 //***************************************//
 
 
-class TmixTrafficTest : public TestCase
+class TmixBinaryCvecTest : public TestCase
 {
 public:
-  TmixTrafficTest ();
-  virtual ~TmixTrafficTest ();
+  TmixBinaryCvecTest ();
+  virtual ~TmixBinaryCvecTest ();
 private:
   virtual void DoRun (void);
+};
+
+TmixBinaryCvecTest::TmixBinaryCvecTest ()
+  : TestCase ("Round-trips Cvecs through the binary format")
+{
+}
+
+TmixBinaryCvecTest::~TmixBinaryCvecTest ()
+{
+}
 
-  bool FileCompare (const char filename1[], const char filename2[]);
+void
+TmixBinaryCvecTest::DoRun (void)
+{
+  std::istringstream text ("S 3412 1 21217 555381\n"
+                           "m 1460 536\n"
+                           "w 64800 6432\n"
+                           "r 1118156\n"
+                           "l 0.000000 0.157900\n"
+                           "I 0 0 253\n"
+                           "A 0 123693 510\n"
+                           "A 6308497 0 0\n"
+                           "C 3724 1 1 15715 439847\n"
+                           "m 1460 1460\n"
+                           "w 8760 6656\n"
+                           "r 3146992\n"
+                           "l 0.000000 0.000000\n"
+                           "I 0 0 250\n"
+                           "A 0 0 1024\n");
+  std::vector<Tmix::ConnectionVector> expected;
   Tmix::ConnectionVector cvec;
-  TmixTopology::TmixNodePair pair;
-  std::ifstream cvecfile;
-  std::ofstream outputfile;
+  while (Tmix::ParseConnectionVector (text, cvec))
+    {
+      expected.push_back (cvec);
+    }
+  NS_TEST_ASSERT_MSG_EQ (expected.size (), 2, "Text Cvecs parsed");
+
+  std::string filename = CreateTempDirFilename ("cvecs.bcvec");
+  text.clear ();
+  text.seekg (0);
+  NS_TEST_ASSERT_MSG_EQ (Tmix::ConvertToBinaryCvec (text, Tmix::ALT_FORMAT, filename), 2, "Cvecs converted");
+  NS_TEST_ASSERT_MSG_EQ (Tmix::BinaryCvecReader::IsBinaryCvecFile (filename), true, "Magic number written");
+
+  Tmix::BinaryCvecReader reader;
+  NS_TEST_ASSERT_MSG_EQ (reader.Open (filename), true, "Binary file mapped");
+  NS_TEST_ASSERT_MSG_EQ (reader.GetNCvecs (), 2, "Cvec count in file header");
+  NS_TEST_ASSERT_MSG_EQ (reader.GetNAdus (), 5, "ADU count in file header");
+
+  Tmix::BinaryCvecReader::View view;
+  uint64_t cursor = reader.Begin ();
+  for (std::vector<Tmix::ConnectionVector>::const_iterator e = expected.begin (); e != expected.end (); ++e)
+    {
+      NS_TEST_ASSERT_MSG_EQ (reader.Next (cursor, view), true, "Record read back");
+      NS_TEST_ASSERT_MSG_EQ (view.GetStartTime (), e->startTime, "Start time read back wrong");
+      NS_TEST_ASSERT_MSG_EQ (view.header->numAdus, e->adus.size (), "ADU count read back wrong");
+      view.ToConnectionVector (cvec);
+      NS_TEST_ASSERT_MSG_EQ (cvec.type, e->type, "Type read back wrong");
+      NS_TEST_ASSERT_MSG_EQ (cvec.id1, e->id1, "ID 1 read back wrong");
+      NS_TEST_ASSERT_MSG_EQ (cvec.id2, e->id2, "ID 2 read back wrong");
+      NS_TEST_ASSERT_MSG_EQ (cvec.windowSizeInitiator, e->windowSizeInitiator, "Initiator window size read back wrong");
+      NS_TEST_ASSERT_MSG_EQ (cvec.windowSizeAcceptor, e->windowSizeAcceptor, "Acceptor window size read back wrong");
+      NS_TEST_ASSERT_MSG_EQ (cvec.mssInitiator, e->mssInitiator, "Initiator MSS read back wrong");
+      NS_TEST_ASSERT_MSG_EQ (cvec.mssAcceptor, e->mssAcceptor, "Acceptor MSS read back wrong");
+      NS_TEST_ASSERT_MSG_EQ (cvec.minRTT, e->minRTT, "RTT read back wrong");
+      NS_TEST_ASSERT_MSG_EQ (cvec.lossRateItoA, e->lossRateItoA, "lossRateItoA read back wrong");
+      NS_TEST_ASSERT_MSG_EQ (cvec.lossRateAtoI, e->lossRateAtoI, "lossRateAtoI read back wrong");
+      NS_TEST_ASSERT_MSG_EQ ((cvec.adus == e->adus), true, "ADUs read back wrong");
+    }
+  NS_TEST_ASSERT_MSG_EQ (reader.Next (cursor, view), false, "No records past the end of the file");
+  reader.Close ();
+
+  // Files with the wrong magic number, an unknown version or a
+  // truncated header are rejected.
+  std::string contents;
+  {
+    std::ifstream in (filename.c_str (), std::ios::binary);
+    std::ostringstream buffer;
+    buffer << in.rdbuf ();
+    contents = buffer.str ();
+  }
+  std::string badFilename = CreateTempDirFilename ("bad.bcvec");
+  Tmix::BinaryCvecFileHeader header;
+  memcpy (&header, contents.data (), sizeof (header));
+
+  Tmix::BinaryCvecFileHeader swapped = header;
+  swapped.magic = ((header.magic & 0xff) << 24) | ((header.magic & 0xff00) << 8)
+    | ((header.magic >> 8) & 0xff00) | (header.magic >> 24);
+  std::string bad = contents;
+  bad.replace (0, sizeof (swapped), reinterpret_cast<const char *> (&swapped), sizeof (swapped));
+  std::ofstream (badFilename.c_str (), std::ios::binary) << bad;
+  NS_TEST_ASSERT_MSG_EQ (Tmix::BinaryCvecReader::IsBinaryCvecFile (badFilename), false, "Byte-swapped magic number accepted");
+  NS_TEST_ASSERT_MSG_EQ (reader.Open (badFilename), false, "File with a byte-swapped magic number opened");
+
+  Tmix::BinaryCvecFileHeader newer = header;
+  newer.version = Tmix::BINARY_CVEC_VERSION + 1;
+  bad = contents;
+  bad.replace (0, sizeof (newer), reinterpret_cast<const char *> (&newer), sizeof (newer));
+  std::ofstream (badFilename.c_str (), std::ios::binary) << bad;
+  NS_TEST_ASSERT_MSG_EQ (Tmix::BinaryCvecReader::IsBinaryCvecFile (badFilename), true, "Magic number of a newer file not recognized");
+  NS_TEST_ASSERT_MSG_EQ (reader.Open (badFilename), false, "File with an unknown version opened");
+
+  std::ofstream (badFilename.c_str (), std::ios::binary) << contents.substr (0, sizeof (header) - 1);
+  NS_TEST_ASSERT_MSG_EQ (reader.Open (badFilename), false, "File with a truncated header opened");
+
+  // The whole inbound.ns trace reads back as ParseConnectionVector
+  // reads the text.
+  SetDataDir (NS_TEST_SOURCEDIR);
+  std::ifstream traceText (CreateDataDirFilename ("tmix-inbound.ns").c_str ());
+  uint64_t nConverted = Tmix::ConvertToBinaryCvec (traceText, Tmix::ALT_FORMAT, filename);
+  NS_TEST_ASSERT_MSG_GT (nConverted, 1000, "Trace converted");
+  traceText.clear ();
+  traceText.seekg (0);
+  NS_TEST_ASSERT_MSG_EQ (reader.Open (filename), true, "Binary trace mapped");
+  NS_TEST_ASSERT_MSG_EQ (reader.GetNCvecs (), nConverted, "Cvec count in trace header");
+  cursor = reader.Begin ();
+  Tmix::ConnectionVector fromText;
+  for (uint64_t i = 0; i < nConverted; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (Tmix::ParseConnectionVector (traceText, fromText), true, "Text Cvec " << i << " parsed");
+      NS_TEST_ASSERT_MSG_EQ (reader.Next (cursor, view), true, "Record " << i << " read back");
+      view.ToConnectionVector (cvec);
+      NS_TEST_ASSERT_MSG_EQ (cvec.startTime, fromText.startTime, "Start time of Cvec " << i << " read back wrong");
+      NS_TEST_ASSERT_MSG_EQ (cvec.id1, fromText.id1, "ID 1 of Cvec " << i << " read back wrong");
+      NS_TEST_ASSERT_MSG_EQ (cvec.minRTT, fromText.minRTT, "RTT of Cvec " << i << " read back wrong");
+      NS_TEST_ASSERT_MSG_EQ ((cvec.adus == fromText.adus), true, "ADUs of Cvec " << i << " read back wrong");
+    }
+  NS_TEST_ASSERT_MSG_EQ (Tmix::ParseConnectionVector (traceText, fromText), false, "Text Cvecs left over");
+  reader.Close ();
+
+  remove (badFilename.c_str ());
+  remove (filename.c_str ());
+}
+
+//***************************************//
+
+
+/**
+ * Connect two nodes with an Internet stack through DelayBox
+ * point-to-point devices sharing \p delayBox.
+ * \return the addresses assigned to the devices, in \p network/24.
+ */
+static Ipv4InterfaceContainer
+CreateDelayBoxLink (NodeContainer nodes, Ptr<DelayBox> delayBox, const char *network,
+                    NetDeviceContainer& devices)
+{
+  InternetStackHelper stack;
+  stack.Install (nodes);
+  Ptr<PointToPointChannel> channel = CreateObject<PointToPointChannel> ();
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      Ptr<DelayBoxPointToPointNetDevice> device = CreateObject<DelayBoxPointToPointNetDevice> ();
+      device->SetAddress (Mac48Address::Allocate ());
+      device->SetDelayBox (delayBox);
+      device->SetDataRate (DataRate ("10Mbps"));
+      device->SetQueue (CreateObject<DropTailQueue> ());
+      device->Attach (channel);
+      nodes.Get (i)->AddDevice (device);
+      devices.Add (device);
+    }
+  Ipv4AddressHelper addresses (network, "255.255.255.0");
+  return addresses.Assign (devices);
+}
+
+/**
+ * \return a connection vector where the initiator sends a request of
+ * \p requestSize bytes, the acceptor answers with \p responseSize
+ * bytes, and the initiator closes the connection.
+ */
+static Tmix::ConnectionVector
+RequestResponseCvec (Time startTime, uint32_t id, uint32_t requestSize, uint32_t responseSize)
+{
+  Tmix::ConnectionVector cvec;
+  cvec.type = Tmix::ConnectionVector::SEQUENTIAL;
+  cvec.startTime = startTime;
+  cvec.id1 = id;
+  cvec.id2 = 0;
+  cvec.windowSizeInitiator = 10;
+  cvec.windowSizeAcceptor = 10;
+  cvec.minRTT = MilliSeconds (20);
+  cvec.lossRateItoA = 0;
+  cvec.lossRateAtoI = 0;
+  cvec.mssInitiator = 1460;
+  cvec.mssAcceptor = 1460;
+  Tmix::ADU request;
+  request.side = Tmix::ADU::INITIATOR;
+  request.sendWaitTime = Seconds (0);
+  request.recvWaitTime = Seconds (0);
+  request.size = requestSize;
+  Tmix::ADU response;
+  response.side = Tmix::ADU::ACCEPTOR;
+  response.sendWaitTime = Seconds (0);
+  response.recvWaitTime = MilliSeconds (1);
+  response.size = responseSize;
+  Tmix::ADU close;
+  close.side = Tmix::ADU::INITIATOR;
+  close.sendWaitTime = Seconds (0);
+  close.recvWaitTime = MilliSeconds (1);
+  close.size = 0;
+  cvec.adus.push_back (request);
+  cvec.adus.push_back (response);
+  cvec.adus.push_back (close);
+  return cvec;
+}
+
+class TmixPortRecyclingTest : public TestCase
+{
+public:
+  TmixPortRecyclingTest ();
+  virtual ~TmixPortRecyclingTest ();
+private:
+  virtual void DoRun (void);
+  void CvecComplete (Ptr<const Tmix::ConnectionVector> cvec);
+  void CheckPorts (void);
+  void AcceptorRx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+
+  Ptr<TmixHelper> m_helper;
+  Ptr<DelayBox> m_delayBox;
+  uint32_t m_nComplete;
+  uint32_t m_maxPortsInUse;
+  uint32_t m_maxRules;
+  std::map<Ipv4Address, uint32_t> m_acceptorRx;
+};
+
+TmixPortRecyclingTest::TmixPortRecyclingTest ()
+  : TestCase ("Acceptor ports are recycled once both sockets are closed")
+{
+}
+
+TmixPortRecyclingTest::~TmixPortRecyclingTest ()
+{
+}
+
+void
+TmixPortRecyclingTest::CvecComplete (Ptr<const Tmix::ConnectionVector> cvec)
+{
+  m_nComplete++;
+}
+
+void
+TmixPortRecyclingTest::CheckPorts (void)
+{
+  m_maxPortsInUse = std::max (m_maxPortsInUse, m_helper->GetNPortsInUse ());
+  m_maxRules = std::max (m_maxRules, m_delayBox->GetNRules ());
+  Simulator::Schedule (MilliSeconds (100), &TmixPortRecyclingTest::CheckPorts, this);
+}
+
+void
+TmixPortRecyclingTest::AcceptorRx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  Ipv4Header header;
+  packet->PeekHeader (header);
+  m_acceptorRx[header.GetDestination ()]++;
+}
+
+void
+TmixPortRecyclingTest::DoRun (void)
+{
+  m_nComplete = 0;
+  m_maxPortsInUse = 0;
+  m_maxRules = 0;
+  m_acceptorRx.clear ();
+  // Keep TIME_WAIT short so that ports come back within the test.
+  Config::SetDefault ("ns3::TcpSocketBase::MaxSegLifetime", DoubleValue (0.5));
+
+  NodeContainer nodes;
+  nodes.Create (2);
+  Ptr<DelayBox> delayBox = CreateObject<DelayBox> ();
+  m_delayBox = delayBox;
+  NetDeviceContainer devices;
+  Ipv4InterfaceContainer interfaces = CreateDelayBoxLink (nodes, delayBox, "10.9.1.0", devices);
+
+  // A second address on each node, used as a second address pair.
+  Ipv4Address second[2] = { Ipv4Address ("10.9.2.1"), Ipv4Address ("10.9.2.2") };
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      Ptr<Ipv4> ipv4 = nodes.Get (i)->GetObject<Ipv4> ();
+      int32_t interface = ipv4->GetInterfaceForDevice (devices.Get (i));
+      ipv4->AddAddress (interface, Ipv4InterfaceAddress (second[i], Ipv4Mask ("255.255.255.0")));
+    }
+
+  m_helper = Create<TmixHelper> (delayBox, nodes.Get (0), interfaces.GetAddress (0),
+                                 nodes.Get (1), interfaces.GetAddress (1));
+  m_helper->AddAddressPair (second[0], second[1]);
+  m_helper->SetCvecCompleteCallback (MakeCallback (&TmixPortRecyclingTest::CvecComplete, this));
+  nodes.Get (1)->GetObject<Ipv4L3Protocol> ()->TraceConnectWithoutContext (
+    "Rx", MakeCallback (&TmixPortRecyclingTest::AcceptorRx, this));
+
+  // One request/response exchange every 3 s; each connection is long
+  // gone, TIME_WAIT included, before the next one starts.
+  const uint32_t nCvecs = 6;
+  for (uint32_t i = 0; i < nCvecs; i++)
+    {
+      m_helper->AddConnectionVector (RequestResponseCvec (Seconds (3 * i), i, 1000, 5000));
+    }
+
+  // A stale rule for the first connection, as left by an earlier run:
+  // the rule the initiator adds for it should replace it.
+  delayBox->AddRule (interfaces.GetAddress (0), 0, interfaces.GetAddress (1), 1024,
+                     DelayBoxRule (1.0, 0.5, 0));
+
+  Simulator::Schedule (Seconds (0), &TmixPortRecyclingTest::CheckPorts, this);
+  Simulator::Stop (Seconds (3 * nCvecs + 5));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_nComplete, nCvecs, "Every connection vector should have completed");
+  NS_TEST_ASSERT_MSG_EQ (m_maxPortsInUse, 1, "Ports should have been reused instead of piling up");
+  NS_TEST_ASSERT_MSG_EQ (m_helper->GetNPortsInUse (), 0, "Ports still held after every socket closed");
+  // Connections alternate between the two address pairs.
+  NS_TEST_ASSERT_MSG_GT (m_acceptorRx[interfaces.GetAddress (1)], 0, "First address pair unused");
+  NS_TEST_ASSERT_MSG_GT (m_acceptorRx[second[1]], 0, "Second address pair unused");
+  // Each application adds one rule per connection, replacing the stale
+  // one, and removes it with the port.
+  NS_TEST_ASSERT_MSG_EQ (m_maxRules, 2, "Rules should be replaced, not duplicated, and removed with their port");
+  NS_TEST_ASSERT_MSG_EQ (delayBox->GetNRules (), 0, "Rules left after every port was released");
+
+  m_helper = 0;
+  m_delayBox = 0;
+  Simulator::Destroy ();
+  Ipv4AddressGenerator::Reset ();
+}
+
+//***********************************************************************//
+
+class TmixConnectionFailureTest : public TestCase
+{
+public:
+  TmixConnectionFailureTest ();
+  virtual ~TmixConnectionFailureTest ();
+private:
+  virtual void DoRun (void);
+  void CvecComplete (Ptr<const Tmix::ConnectionVector> cvec);
+  void InitiatorTx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+  void CheckReleased (void);
+
+  Ptr<TmixHelper> m_helper;
+  Ptr<DelayBox> m_delayBox;
+  Ptr<Tmix::Application> m_initiator;
+  Ptr<Tmix::Application> m_acceptor;
+  uint32_t m_nComplete;
+  uint32_t m_nSyn;
+  // State once the first connection vector was given up
+  uint32_t m_portsInUse;
+  uint32_t m_nRules;
+  uint32_t m_nInitiatorWorkers;
+  uint32_t m_nAcceptorWorkers;
+};
+
+TmixConnectionFailureTest::TmixConnectionFailureTest ()
+  : TestCase ("Connections that never open are given up on both sides")
+{
+}
+
+TmixConnectionFailureTest::~TmixConnectionFailureTest ()
+{
+}
+
+void
+TmixConnectionFailureTest::CvecComplete (Ptr<const Tmix::ConnectionVector> cvec)
+{
+  m_nComplete++;
+}
+
+void
+TmixConnectionFailureTest::InitiatorTx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  Ptr<Packet> copy = packet->Copy ();
+  Ipv4Header ipHeader;
+  copy->RemoveHeader (ipHeader);
+  TcpHeader tcpHeader;
+  copy->PeekHeader (tcpHeader);
+  if (tcpHeader.GetFlags () & TcpHeader::SYN)
+    {
+      m_nSyn++;
+    }
+}
+
+void
+TmixConnectionFailureTest::CheckReleased (void)
+{
+  m_portsInUse = m_helper->GetNPortsInUse ();
+  m_nRules = m_delayBox->GetNRules ();
+  m_nInitiatorWorkers = m_initiator->GetNWorkers ();
+  m_nAcceptorWorkers = m_acceptor->GetNWorkers ();
+}
+
+void
+TmixConnectionFailureTest::DoRun (void)
+{
+  m_nComplete = 0;
+  m_nSyn = 0;
+  // Two SYNs per attempt, and the socket gives up 200 ms after the
+  // second one: an attempt takes 0.3 s.
+  Config::SetDefault ("ns3::TcpSocket::ConnCount", UintegerValue (2));
+  Config::SetDefault ("ns3::TcpSocket::ConnTimeout", TimeValue (MilliSeconds (100)));
+
+  NodeContainer nodes;
+  nodes.Create (2);
+  m_delayBox = CreateObject<DelayBox> ();
+  NetDeviceContainer devices;
+  Ipv4InterfaceContainer interfaces = CreateDelayBoxLink (nodes, m_delayBox, "10.9.3.0", devices);
+
+  m_helper = Create<TmixHelper> (m_delayBox, nodes.Get (0), interfaces.GetAddress (0),
+                                 nodes.Get (1), interfaces.GetAddress (1));
+  m_helper->SetCvecCompleteCallback (MakeCallback (&TmixConnectionFailureTest::CvecComplete, this));
+  m_initiator = DynamicCast<Tmix::Application> (nodes.Get (0)->GetApplication (0));
+  m_acceptor = DynamicCast<Tmix::Application> (nodes.Get (1)->GetApplication (0));
+  NS_TEST_ASSERT_MSG_NE (m_initiator, 0, "Initiator application not found");
+  NS_TEST_ASSERT_MSG_NE (m_acceptor, 0, "Acceptor application not found");
+  const uint32_t retries = 2;
+  m_initiator->SetMaxConnectRetries (retries);
+  nodes.Get (0)->GetObject<Ipv4L3Protocol> ()->TraceConnectWithoutContext (
+    "Tx", MakeCallback (&TmixConnectionFailureTest::InitiatorTx, this));
+
+  // DelayBox drops every packet of the first connection from the
+  // initiator, SYNs included.  The second one starts once the first
+  // was given up, and should run normally on the same port.
+  Tmix::ConnectionVector lost = RequestResponseCvec (Seconds (0), 0, 1000, 5000);
+  lost.lossRateItoA = 1;
+  m_helper->AddConnectionVector (lost);
+  m_helper->AddConnectionVector (RequestResponseCvec (Seconds (5), 1, 1000, 5000));
+  Simulator::Schedule (Seconds (4), &TmixConnectionFailureTest::CheckReleased, this);
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_nSyn, (retries + 1) * 2 + 1, "Connection should be tried 1 + retries times, then the next one once");
+  NS_TEST_ASSERT_MSG_EQ (m_portsInUse, 0, "Both sides should have released the port of the failed connection");
+  NS_TEST_ASSERT_MSG_EQ (m_nRules, 0, "Rules left after the failed connection");
+  NS_TEST_ASSERT_MSG_EQ (m_nInitiatorWorkers, 0, "Initiator still running the failed connection");
+  NS_TEST_ASSERT_MSG_EQ (m_nAcceptorWorkers, 0, "Acceptor still listening for the failed connection");
+  NS_TEST_ASSERT_MSG_EQ (m_nComplete, 1, "Only the second connection vector should complete");
+  NS_TEST_ASSERT_MSG_EQ (m_initiator->GetNIdleWorkers (), 1, "Initiator worker should be reused");
+  NS_TEST_ASSERT_MSG_EQ (m_acceptor->GetNIdleWorkers (), 1, "Acceptor worker should be reused");
+  NS_TEST_ASSERT_MSG_EQ (m_helper->GetNPortsInUse (), 0, "Ports still held at the end");
+
+  m_helper = 0;
+  m_delayBox = 0;
+  m_initiator = 0;
+  m_acceptor = 0;
+  Simulator::Destroy ();
+  Ipv4AddressGenerator::Reset ();
+  Config::SetDefault ("ns3::TcpSocket::ConnCount", UintegerValue (6));
+  Config::SetDefault ("ns3::TcpSocket::ConnTimeout", TimeValue (Seconds (3)));
+}
+
+//***********************************************************************//
+
+class TmixLargeAduTest : public TestCase
+{
+public:
+  TmixLargeAduTest ();
+  virtual ~TmixLargeAduTest ();
+private:
+  virtual void DoRun (void);
+  void CvecComplete (Ptr<const Tmix::ConnectionVector> cvec);
+  void InitiatorRx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+  void AcceptorRx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+  void AcceptorTx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+  /// \return the TCP header and payload size of an IPv4 packet
+  static uint32_t GetTcpPayload (Ptr<const Packet> packet, TcpHeader& header);
+
+  uint32_t m_nComplete;
+  uint32_t m_initiatorBytes;
+  uint32_t m_acceptorBytes;
+  uint32_t m_requestSize;
+  uint32_t m_responseSize;
+  uint32_t m_sndBufSize;
+  Time m_requestReceived;   // Last byte of the request received
+  Time m_responseStart;     // First byte of the response sent
+  Time m_responseLastIn;    // Response byte m_responseSize - m_sndBufSize sent
+  Time m_responseEnd;       // Last byte of the response sent
+  Time m_acceptorFin;       // FIN of the acceptor sent
+};
+
+TmixLargeAduTest::TmixLargeAduTest ()
+  : TestCase ("ADUs larger than the socket buffers are sent in full")
+{
+}
+
+TmixLargeAduTest::~TmixLargeAduTest ()
+{
+}
+
+void
+TmixLargeAduTest::CvecComplete (Ptr<const Tmix::ConnectionVector> cvec)
+{
+  m_nComplete++;
+}
+
+uint32_t
+TmixLargeAduTest::GetTcpPayload (Ptr<const Packet> packet, TcpHeader& header)
+{
+  Ptr<Packet> copy = packet->Copy ();
+  Ipv4Header ipHeader;
+  copy->RemoveHeader (ipHeader);
+  copy->RemoveHeader (header);
+  return copy->GetSize ();
+}
+
+void
+TmixLargeAduTest::InitiatorRx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  TcpHeader header;
+  m_initiatorBytes += GetTcpPayload (packet, header);
+}
+
+void
+TmixLargeAduTest::AcceptorRx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  TcpHeader header;
+  uint32_t size = GetTcpPayload (packet, header);
+  m_acceptorBytes += size;
+  // Data starts at sequence number 1, after the SYN.
+  if (size && header.GetSequenceNumber ().GetValue () - 1 + size == m_requestSize)
+    {
+      m_requestReceived = Simulator::Now ();
+    }
+}
+
+void
+TmixLargeAduTest::AcceptorTx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  TcpHeader header;
+  uint32_t size = GetTcpPayload (packet, header);
+  uint32_t offset = header.GetSequenceNumber ().GetValue () - 1;
+  if (size && m_responseStart.IsZero ())
+    {
+      m_responseStart = Simulator::Now ();
+    }
+  uint32_t lastIn = m_responseSize - m_sndBufSize;
+  if (size && offset <= lastIn && lastIn < offset + size && m_responseLastIn.IsZero ())
+    {
+      m_responseLastIn = Simulator::Now ();
+    }
+  if (size && offset + size == m_responseSize && m_responseEnd.IsZero ())
+    {
+      m_responseEnd = Simulator::Now ();
+    }
+  if ((header.GetFlags () & TcpHeader::FIN) && m_acceptorFin.IsZero ())
+    {
+      m_acceptorFin = Simulator::Now ();
+    }
+}
+
+void
+TmixLargeAduTest::DoRun (void)
+{
+  m_nComplete = 0;
+  m_initiatorBytes = 0;
+  m_acceptorBytes = 0;
+  m_requestSize = 200000;
+  m_responseSize = 100000;
+  m_sndBufSize = 8192;
+  m_requestReceived = Time (0);
+  m_responseStart = Time (0);
+  m_responseLastIn = Time (0);
+  m_responseEnd = Time (0);
+  m_acceptorFin = Time (0);
+  Config::SetDefault ("ns3::TcpSocket::SndBufSize", UintegerValue (m_sndBufSize));
+  Config::SetDefault ("ns3::TcpSocket::RcvBufSize", UintegerValue (m_sndBufSize));
+
+  NodeContainer nodes;
+  nodes.Create (2);
+  Ptr<DelayBox> delayBox = CreateObject<DelayBox> ();
+  NetDeviceContainer devices;
+  Ipv4InterfaceContainer interfaces = CreateDelayBoxLink (nodes, delayBox, "10.9.4.0", devices);
+  Ptr<TmixHelper> helper = Create<TmixHelper> (delayBox, nodes.Get (0), interfaces.GetAddress (0),
+                                               nodes.Get (1), interfaces.GetAddress (1));
+  helper->SetCvecCompleteCallback (MakeCallback (&TmixLargeAduTest::CvecComplete, this));
+  Ptr<Tmix::Application> initiator = DynamicCast<Tmix::Application> (nodes.Get (0)->GetApplication (0));
+  Ptr<Tmix::Application> acceptor = DynamicCast<Tmix::Application> (nodes.Get (1)->GetApplication (0));
+  nodes.Get (0)->GetObject<Ipv4L3Protocol> ()->TraceConnectWithoutContext (
+    "Rx", MakeCallback (&TmixLargeAduTest::InitiatorRx, this));
+  nodes.Get (1)->GetObject<Ipv4L3Protocol> ()->TraceConnectWithoutContext (
+    "Rx", MakeCallback (&TmixLargeAduTest::AcceptorRx, this));
+  nodes.Get (1)->GetObject<Ipv4L3Protocol> ()->TraceConnectWithoutContext (
+    "Tx", MakeCallback (&TmixLargeAduTest::AcceptorTx, this));
+
+  // The acceptor answers 100 ms after the whole request is received,
+  // and closes 50 ms after the whole response is in its socket.  Both
+  // ADUs take longer than these waits to go through.
+  Tmix::ConnectionVector cvec;
+  std::ostringstream text;
+  // Segments fit the MTU with their options, so that they are not
+  // fragmented.
+  text << "S 0 1 1 0\n"
+       << "m 1400 1400\n"
+       << "w 64800 64800\n"
+       << "r 10000\n"
+       << "l 0.000000 0.000000\n"
+       << "I 0 0 " << m_requestSize << "\n"
+       << "A 0 100000 " << m_responseSize << "\n"
+       << "A 50000 0 0\n";
+  std::istringstream in (text.str ());
+  NS_TEST_ASSERT_MSG_EQ (Tmix::ParseConnectionVector (in, cvec), true, "Cvec parsed");
+  helper->AddConnectionVector (cvec);
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_nComplete, 1, "Connection vector should have completed");
+  NS_TEST_ASSERT_MSG_EQ (initiator->GetNWorkers (), 0, "Initiator should have finished");
+  NS_TEST_ASSERT_MSG_EQ (acceptor->GetNWorkers (), 0, "Acceptor should have finished");
+  NS_TEST_ASSERT_MSG_EQ (helper->GetNPortsInUse (), 0, "Port should have been released");
+  NS_TEST_ASSERT_MSG_EQ (m_acceptorBytes, m_requestSize, "Acceptor should receive the whole request");
+  NS_TEST_ASSERT_MSG_EQ (m_initiatorBytes, m_responseSize, "Initiator should receive the whole response");
+  // recv_wait counts from the last byte of the request.
+  NS_TEST_ASSERT_MSG_EQ_TOL ((m_responseStart - m_requestReceived).GetSeconds (), 0.1, 1e-6,
+                            "recv_wait should count from the end of the received ADU");
+  // send_wait counts from the last byte of the response going into the
+  // socket: after byte m_responseSize - m_sndBufSize was sent, since the
+  // socket held the rest, and before the last byte was sent.
+  NS_TEST_ASSERT_MSG_GT (m_responseEnd - m_responseStart, MilliSeconds (50), "Response sent too fast for the test");
+  NS_TEST_ASSERT_MSG_GT_OR_EQ (m_acceptorFin, m_responseLastIn + MilliSeconds (50),
+                               "send_wait should count from the end of the sent ADU");
+  NS_TEST_ASSERT_MSG_LT_OR_EQ (m_acceptorFin, m_responseEnd + MilliSeconds (50),
+                               "send_wait should count from the end of the sent ADU");
+
+  helper = 0;
+  Simulator::Destroy ();
+  Ipv4AddressGenerator::Reset ();
+  Config::SetDefault ("ns3::TcpSocket::SndBufSize", UintegerValue (131072));
+  Config::SetDefault ("ns3::TcpSocket::RcvBufSize", UintegerValue (131072));
+}
+
+//***********************************************************************//
+
+class TmixWorkerPoolTest : public TestCase
+{
+public:
+  TmixWorkerPoolTest ();
+  virtual ~TmixWorkerPoolTest ();
+private:
+  virtual void DoRun (void);
+  void CvecComplete (Ptr<const Tmix::ConnectionVector> cvec);
+  void CheckWorkers (void);
+  void StartAborted (void);
+  void StartNext (void);
+  void SendRequest (Ptr<Socket> socket);
+  void Receive (Ptr<Socket> socket);
+
+  Ptr<TmixHelper> m_helper;
+  Ptr<Tmix::Application> m_initiator;
+  Ptr<Tmix::Application> m_acceptor;
+  Ipv4Address m_initiatorAddress;
+  Ipv4Address m_acceptorAddress;
+  uint32_t m_nComplete;
+  uint32_t m_maxWorkers;
+  uint32_t m_maxIdleWorkers;
+  bool m_reused;
+  Ptr<Socket> m_abortedSocket;
+  Ptr<Socket> m_socket;
+  uint32_t m_rxBytes;
+  Time m_firstRx;
 };
 
-TmixTrafficTest::TmixTrafficTest ()
-  : TestCase ("Creates traffic and checks if they have been created")
+TmixWorkerPoolTest::TmixWorkerPoolTest ()
+  : TestCase ("Workers are reused for the next connection vectors")
+{
+}
+
+TmixWorkerPoolTest::~TmixWorkerPoolTest ()
+{
+}
+
+void
+TmixWorkerPoolTest::CvecComplete (Ptr<const Tmix::ConnectionVector> cvec)
 {
+  m_nComplete++;
 }
 
-TmixTrafficTest::~TmixTrafficTest ()
+void
+TmixWorkerPoolTest::CheckWorkers (void)
 {
+  m_maxWorkers = std::max (m_maxWorkers, std::max (m_initiator->GetNWorkers (), m_acceptor->GetNWorkers ()));
+  m_maxIdleWorkers = std::max (m_maxIdleWorkers, std::max (m_initiator->GetNIdleWorkers (), m_acceptor->GetNIdleWorkers ()));
+  Simulator::Schedule (MilliSeconds (100), &TmixWorkerPoolTest::CheckWorkers, this);
 }
 
-bool TmixTrafficTest::FileCompare (const char filename1[], const char filename2[])
+void
+TmixWorkerPoolTest::SendRequest (Ptr<Socket> socket)
 {
-  std::ifstream file1 (filename1);
-  std::ifstream file2 (filename2);
-  std::string s1,s2;
-  std::getline (file1,s1);
-  getline (file2,s2);
+  socket->Send (Create<Packet> (1000));
+}
 
-  if (!(s1.compare (s2)))
+void
+TmixWorkerPoolTest::Receive (Ptr<Socket> socket)
+{
+  Ptr<Packet> packet;
+  while ((packet = socket->Recv ()))
     {
-      return true;
+      if (m_firstRx.IsZero ())
+        {
+          m_firstRx = Simulator::Now ();
+        }
+      m_rxBytes += packet->GetSize ();
     }
-  else
+  if (m_rxBytes == 2000)
     {
-      return false;
+      socket->Close ();
     }
 }
 
 void
-TmixTrafficTest::DoRun (void)
+TmixWorkerPoolTest::StartAborted (void)
+{
+  // The acceptor sends first, answers the request after 500 ms, and
+  // is reset by the peer before it does.
+  Tmix::ConnectionVector cvec = RequestResponseCvec (Seconds (0), 100, 1000, 1000);
+  cvec.adus[1].recvWaitTime = MilliSeconds (500);
+  Tmix::ADU greeting = cvec.adus[1];
+  greeting.recvWaitTime = Seconds (0);
+  cvec.adus.insert (cvec.adus.begin (), greeting);
+  m_acceptor->StartConnectionVector (cvec, 5000, MakeCallback (&TmixWorkerPoolTest::CvecComplete, this),
+                                     MakeNullCallback<void> ());
+  m_abortedSocket = Socket::CreateSocket (m_initiator->GetNode (), TcpSocketFactory::GetTypeId ());
+  m_abortedSocket->SetAttribute ("SegmentSize", UintegerValue (1400));
+  m_abortedSocket->Bind ();
+  m_abortedSocket->SetConnectCallback (MakeCallback (&TmixWorkerPoolTest::SendRequest, this),
+                                       MakeNullCallback<void, Ptr<Socket> > ());
+  m_abortedSocket->Connect (InetSocketAddress (m_acceptorAddress, 5000));
+  // Closing with the greeting unread resets the connection.
+  Simulator::Schedule (MilliSeconds (200), &Socket::Close, m_abortedSocket);
+}
+
+void
+TmixWorkerPoolTest::StartNext (void)
+{
+  // The reset connection left a send of the acceptor scheduled 200 ms
+  // from now; the worker runs this connection by then.
+  uint32_t idle = m_acceptor->GetNIdleWorkers ();
+  Tmix::ConnectionVector cvec = RequestResponseCvec (Seconds (0), 101, 1000, 2000);
+  cvec.adus[1].recvWaitTime = Seconds (1);
+  m_acceptor->StartConnectionVector (cvec, 5001, MakeCallback (&TmixWorkerPoolTest::CvecComplete, this),
+                                     MakeNullCallback<void> ());
+  m_reused = idle == 1 && m_acceptor->GetNIdleWorkers () == 0;
+  m_socket = Socket::CreateSocket (m_initiator->GetNode (), TcpSocketFactory::GetTypeId ());
+  m_socket->SetAttribute ("SegmentSize", UintegerValue (1400));
+  m_socket->Bind ();
+  m_socket->SetConnectCallback (MakeCallback (&TmixWorkerPoolTest::SendRequest, this),
+                                MakeNullCallback<void, Ptr<Socket> > ());
+  m_socket->SetRecvCallback (MakeCallback (&TmixWorkerPoolTest::Receive, this));
+  m_socket->Connect (InetSocketAddress (m_acceptorAddress, 5001));
+}
+
+void
+TmixWorkerPoolTest::DoRun (void)
+{
+  m_nComplete = 0;
+  m_maxWorkers = 0;
+  m_maxIdleWorkers = 0;
+  m_reused = false;
+  m_rxBytes = 0;
+  m_firstRx = Time (0);
+  Config::SetDefault ("ns3::TcpSocketBase::MaxSegLifetime", DoubleValue (0.5));
+
+  NodeContainer nodes;
+  nodes.Create (2);
+  Ptr<DelayBox> delayBox = CreateObject<DelayBox> ();
+  NetDeviceContainer devices;
+  Ipv4InterfaceContainer interfaces = CreateDelayBoxLink (nodes, delayBox, "10.9.5.0", devices);
+  m_initiatorAddress = interfaces.GetAddress (0);
+  m_acceptorAddress = interfaces.GetAddress (1);
+  m_helper = Create<TmixHelper> (delayBox, nodes.Get (0), m_initiatorAddress,
+                                 nodes.Get (1), m_acceptorAddress);
+  m_helper->SetCvecCompleteCallback (MakeCallback (&TmixWorkerPoolTest::CvecComplete, this));
+  m_initiator = DynamicCast<Tmix::Application> (nodes.Get (0)->GetApplication (0));
+  m_acceptor = DynamicCast<Tmix::Application> (nodes.Get (1)->GetApplication (0));
+
+  // Connection vectors one after the other, each one done, TIME_WAIT
+  // included, before the next starts.
+  const uint32_t nCvecs = 6;
+  for (uint32_t i = 0; i < nCvecs; i++)
+    {
+      m_helper->AddConnectionVector (RequestResponseCvec (Seconds (3 * i), i, 1000, 5000));
+    }
+  Time start = Seconds (3 * nCvecs);
+  Simulator::Schedule (Seconds (0), &TmixWorkerPoolTest::CheckWorkers, this);
+  Simulator::Schedule (start, &TmixWorkerPoolTest::StartAborted, this);
+  Simulator::Schedule (start + MilliSeconds (300), &TmixWorkerPoolTest::StartNext, this);
+  Simulator::Stop (start + Seconds (5));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_maxWorkers, 1, "Workers should not pile up");
+  NS_TEST_ASSERT_MSG_EQ (m_maxIdleWorkers, 1, "Idle workers should be reused");
+  NS_TEST_ASSERT_MSG_EQ (m_reused, true, "The worker of the reset connection should be reused");
+  // The send left by the reset connection is ignored: the response
+  // comes 1 s after the request, in full.
+  NS_TEST_ASSERT_MSG_EQ (m_rxBytes, 2000, "Response should be received in full");
+  NS_TEST_ASSERT_MSG_GT (m_firstRx, start + Seconds (1.3), "Response sent by a send of the reset connection");
+  NS_TEST_ASSERT_MSG_EQ (m_nComplete, nCvecs + 1, "Every connection vector but the reset one should complete");
+  NS_TEST_ASSERT_MSG_EQ (m_initiator->GetNWorkers (), 0, "Initiator workers still running");
+  NS_TEST_ASSERT_MSG_EQ (m_acceptor->GetNWorkers (), 0, "Acceptor workers still running");
+  NS_TEST_ASSERT_MSG_EQ (m_acceptor->GetNIdleWorkers (), 1, "Acceptor worker should be back in the pool");
+
+  m_helper = 0;
+  m_initiator = 0;
+  m_acceptor = 0;
+  m_abortedSocket = 0;
+  m_socket = 0;
+  Simulator::Destroy ();
+  Ipv4AddressGenerator::Reset ();
+}
+
+//***********************************************************************//
+
+class TmixLazyTest : public TestCase
 {
-  pair = tmix->NewPair (TmixTopology::LEFT);
+public:
+  TmixLazyTest ();
+  virtual ~TmixLazyTest ();
+private:
+  virtual void DoRun (void);
+  void CvecComplete (Ptr<const Tmix::ConnectionVector> cvec);
+  void InitiatorTx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+  /// Run the connection vectors of \p filename through the lazy mode.
+  void RunLazy (const std::string& filename);
 
-  cvecfile.open ("src/tmix/test/tmix-inbound.ns");
-  outputfile.open ("scratch/out.txt");
+  Ptr<TmixHelper> m_helper;
+  uint32_t m_window;
+  uint32_t m_nComplete;
+  uint32_t m_maxPending;
+  std::vector<Time> m_syns;
+};
 
-  Tmix::ParseConnectionVector (cvecfile, cvec);
-  pair.helper->AddConnectionVector (cvec);
+TmixLazyTest::TmixLazyTest ()
+  : TestCase ("Lazily read connection vectors start on time")
+{
+}
 
-  std::ofstream& ns2StyleTraceFile = outputfile;
-  Tmix::Ns2StyleTraceHelper ost (tmix, ns2StyleTraceFile);
-  ost.Install ();
+TmixLazyTest::~TmixLazyTest ()
+{
+}
 
-  GlobalRouteManager::BuildGlobalRoutingDatabase ();
-  GlobalRouteManager::InitializeRoutes ();
+void
+TmixLazyTest::CvecComplete (Ptr<const Tmix::ConnectionVector> cvec)
+{
+  m_nComplete++;
+}
+
+void
+TmixLazyTest::InitiatorTx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  Ptr<Packet> copy = packet->Copy ();
+  Ipv4Header ipHeader;
+  TcpHeader header;
+  copy->RemoveHeader (ipHeader);
+  copy->RemoveHeader (header);
+  if (header.GetFlags () == TcpHeader::SYN)
+    {
+      m_syns.push_back (Simulator::Now ());
+    }
+  m_maxPending = std::max (m_maxPending, m_helper->GetNLazyPending ());
+}
+
+void
+TmixLazyTest::RunLazy (const std::string& filename)
+{
+  m_nComplete = 0;
+  m_maxPending = 0;
+  m_syns.clear ();
+
+  NodeContainer nodes;
+  nodes.Create (2);
+  Ptr<DelayBox> delayBox = CreateObject<DelayBox> ();
+  NetDeviceContainer devices;
+  Ipv4InterfaceContainer interfaces = CreateDelayBoxLink (nodes, delayBox, "10.9.6.0", devices);
+  m_helper = Create<TmixHelper> (delayBox, nodes.Get (0), interfaces.GetAddress (0),
+                                 nodes.Get (1), interfaces.GetAddress (1));
+  m_helper->SetCvecCompleteCallback (MakeCallback (&TmixLazyTest::CvecComplete, this));
+  m_helper->SetLazyWindow (m_window);
+  nodes.Get (0)->GetObject<Ipv4L3Protocol> ()->TraceConnectWithoutContext (
+    "Tx", MakeCallback (&TmixLazyTest::InitiatorTx, this));
+  NS_TEST_ASSERT_MSG_EQ (m_helper->AddConnectionVectorsLazy (filename), true, "Lazy source could not be opened");
 
   Simulator::Stop (Seconds (10));
   Simulator::Run ();
+
+  m_helper = 0;
   Simulator::Destroy ();
+  Ipv4AddressGenerator::Reset ();
+}
 
-  outputfile.close ();
+void
+TmixLazyTest::DoRun (void)
+{
+  // More connection vectors than the window, some of them overlapping.
+  m_window = 3;
+  const uint32_t nCvecs = 10;
+  std::vector<Time> startTimes;
+  std::ostringstream text;
+  for (uint32_t i = 0; i < nCvecs; i++)
+    {
+      startTimes.push_back (MicroSeconds (100000 + 150000 * i + 7000 * (i % 3)));
+      text << "S " << startTimes.back ().GetMicroSeconds () << " 1 " << i << " 0\n"
+           << "w 64800 64800\n"
+           << "r 20000\n"
+           << "l 0.000000 0.000000\n"
+           << "I 0 0 1000\n"
+           << "A 0 1000 5000\n"
+           << "I 0 1000 0\n";
+    }
+  std::string textFilename = CreateTempDirFilename ("lazy.ns");
+  std::string binaryFilename = CreateTempDirFilename ("lazy.bcvec");
+  std::ofstream out (textFilename.c_str ());
+  out << text.str ();
+  out.close ();
+  std::istringstream in (text.str ());
+  NS_TEST_ASSERT_MSG_EQ (Tmix::ConvertToBinaryCvec (in, Tmix::ALT_FORMAT, binaryFilename), nCvecs,
+                         "Trace should convert to the binary format");
+
+  const char *names[] = { "text", "binary" };
+  std::string filenames[] = { textFilename, binaryFilename };
+  for (uint32_t source = 0; source < 2; source++)
+    {
+      RunLazy (filenames[source]);
+      NS_TEST_EXPECT_MSG_EQ (m_nComplete, nCvecs, "Every " << names[source] << " connection vector should complete");
+      NS_TEST_EXPECT_MSG_EQ (m_maxPending, m_window, "The " << names[source] << " window should be full, not larger");
+      NS_TEST_ASSERT_MSG_EQ (m_syns.size (), nCvecs, "One SYN per " << names[source] << " connection vector");
+      for (uint32_t i = 0; i < nCvecs; i++)
+        {
+          NS_TEST_EXPECT_MSG_EQ (m_syns[i], startTimes[i], names[source] << " connection vector " << i
+                                 << " should start at its start time");
+        }
+    }
 
-  NS_TEST_ASSERT_MSG_EQ (FileCompare ("scratch/out.txt","src/tmix/test/ref.txt"),true, "Files don't match");
+  // Swap two connection vectors: the lazy mode must refuse to run them
+  // out of order.  NS_FATAL_ERROR aborts, so this runs in a child.
+  std::string unsortedFilename = CreateTempDirFilename ("unsorted.ns");
+  std::string logFilename = CreateTempDirFilename ("unsorted.log");
+  std::string unsorted = text.str ();
+  std::string::size_type second = unsorted.find ("S ", 1);
+  std::string::size_type third = unsorted.find ("S ", second + 1);
+  unsorted = unsorted.substr (second, third - second) + unsorted.substr (0, second) + unsorted.substr (third);
+  out.open (unsortedFilename.c_str ());
+  out << unsorted;
+  out.close ();
+  pid_t pid = fork ();
+  NS_TEST_ASSERT_MSG_NE (pid, -1, "Could not fork");
+  if (pid == 0)
+    {
+      if (!freopen (logFilename.c_str (), "w", stderr))
+        {
+          _exit (1);
+        }
+      RunLazy (unsortedFilename);
+      _exit (0);
+    }
+  int status;
+  waitpid (pid, &status, 0);
+  bool aborted = WIFSIGNALED (status) && WTERMSIG (status) == SIGABRT;
+  NS_TEST_EXPECT_MSG_EQ (aborted, true, "Unsorted connection vectors should abort the simulation");
+  std::ifstream log (logFilename.c_str ());
+  std::string logText ((std::istreambuf_iterator<char> (log)), std::istreambuf_iterator<char> ());
+  NS_TEST_EXPECT_MSG_NE (logText.find ("not sorted by start time"), std::string::npos,
+                         "Abort should report the unsorted connection vectors");
 
+  remove (textFilename.c_str ());
+  remove (binaryFilename.c_str ());
+  remove (unsortedFilename.c_str ());
+  remove (logFilename.c_str ());
 }
 
 //***********************************************************************//
@@ -211,9 +1080,13 @@ public:
 TmixTestSuite::TmixTestSuite ()
   : TestSuite ("tmix", UNIT)
 {
-  AddTestCase (new TmixTopologyTest, TestCase::QUICK);
   AddTestCase (new TmixCvecParseTest, TestCase::QUICK);
-  AddTestCase (new TmixTrafficTest, TestCase::QUICK);
+  AddTestCase (new TmixBinaryCvecTest, TestCase::QUICK);
+  AddTestCase (new TmixPortRecyclingTest, TestCase::QUICK);
+  AddTestCase (new TmixConnectionFailureTest, TestCase::QUICK);
+  AddTestCase (new TmixLargeAduTest, TestCase::QUICK);
+  AddTestCase (new TmixWorkerPoolTest, TestCase::QUICK);
+  AddTestCase (new TmixLazyTest, TestCase::QUICK);
 }
 
 static TmixTestSuite tmixTestSuite;
@@ -25,6 +25,7 @@
 #include "ns3/packet.h"
 #include "ns3/socket.h"
 #include "ns3/unused.h"
+#include "ns3/simulator.h"
 #include "queue-disc.h"
 
 namespace ns3 {
@@ -68,6 +69,18 @@ QueueDiscItem::SetTxQueueIndex (uint8_t txq)
   m_txq = txq;
 }
 
+Time
+QueueDiscItem::GetTimeStamp (void) const
+{
+  return m_tstamp;
+}
+
+void
+QueueDiscItem::SetTimeStamp (Time t)
+{
+  m_tstamp = t;
+}
+
 void
 QueueDiscItem::Print (std::ostream& os) const
 {
@@ -456,6 +469,7 @@ QueueDisc::Enqueue (Ptr<QueueDiscItem> item)
   m_nBytes += item->GetPacketSize ();
   m_nTotalReceivedPackets++;
   m_nTotalReceivedBytes += item->GetPacketSize ();
+  item->SetTimeStamp (Simulator::Now ());
 
   NS_LOG_LOGIC ("m_traceEnqueue (p)");
   m_traceEnqueue (item);
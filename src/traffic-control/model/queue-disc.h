@@ -24,6 +24,7 @@
 #include "ns3/traced-value.h"
 #include <ns3/queue.h>
 #include "ns3/net-device.h"
+#include "ns3/nstime.h"
 #include <vector>
 #include "packet-filter.h"
 
@@ -38,7 +39,8 @@ class QueueDisc;
  * QueueDiscItem is the abstract base class for items that are stored in a queue
  * disc. It is derived from QueueItem (which only consists of a Ptr<Packet>)
  * to additionally store the destination MAC address, the
- * L3 protocol number and the transmission queue index,
+ * L3 protocol number, the transmission queue index and the time the
+ * item was enqueued in the root queue disc,
  */
 class QueueDiscItem : public QueueItem {
 public:
@@ -76,6 +78,21 @@ public:
    */
   void SetTxQueueIndex (uint8_t txq);
 
+  /**
+   * \brief Get the timestamp included in this item
+   * \return the time at which the item was enqueued in a queue disc.
+   */
+  Time GetTimeStamp (void) const;
+
+  /**
+   * \brief Set the timestamp included in this item
+   *
+   * Called by QueueDisc::Enqueue, so that the sojourn time of an item can
+   * be computed on dequeue without tagging the packet.
+   * \param t the timestamp to store in this item.
+   */
+  void SetTimeStamp (Time t);
+
   /**
    * \brief Add the header to the packet
    *
@@ -115,6 +132,7 @@ private:
   Address m_address;      //!< MAC destination address
   uint16_t m_protocol;    //!< L3 Protocol number
   uint8_t m_txq;          //!< Transmission queue index
+  Time m_tstamp;          //!< Timestamp when the packet was enqueued
 };
 
 
@@ -0,0 +1 @@
+$ns_ at 1.0 "$node_(0) setdest 25 0 5"
\ No newline at end of file
@@ -21,6 +21,7 @@
 #include "ns3/system-wall-clock-ms.h"
 #include "ns3/packet.h"
 #include "ns3/packet-metadata.h"
+#include "ns3/packet-memory.h"
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -360,5 +361,8 @@ int main (int argc, char *argv[])
   runBench (&benchFragment, n, minIterations, "Fragmentation and concatenation");
   runBench (&benchByteTags, n, minIterations, "Benchmark byte tags");
 
+  std::cout << "Packet memory pools:" << std::endl;
+  PacketMemory::PrintStats (std::cout);
+
   return 0;
 }
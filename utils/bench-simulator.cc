@@ -158,7 +158,7 @@ GetRandomStream (std::string filename)
         {
           if (*input >> value) 
             {
-              uint64_t ns = (uint64_t) (value * 1000000000);
+              uint64_t ns = (uint64_t) (value * 1000000000 + 0.5);
               nsValues.push_back (ns);
             } 
           else 
@@ -186,6 +186,8 @@ int main (int argc, char *argv[])
   bool schedHeap = false;
   bool schedList = false;
   bool schedMap  = true;
+  bool schedQuad = false;
+  bool pool      = true;
 
   uint32_t pop   =  100000;
   uint32_t total = 1000000;
@@ -200,11 +202,19 @@ int main (int argc, char *argv[])
              "  an ascii file, given by the --file=\"<filename>\" argument,\n"
              "  or standard input, by the argument --file=\"-\"\n"
              "In the case of either --file form, the input is expected\n"
-             "to be ascii, giving the relative event times in ns.");
+             "to be ascii, giving the relative event times in seconds.\n"
+             "\n"
+             "Such a file is written by ns3::RecordingScheduler, which records\n"
+             "the events of any simulation program, for example a scenario of\n"
+             "the evaluation suite:\n"
+             "  --SchedulerType=ns3::RecordingScheduler\n"
+             "  --ns3::RecordingScheduler::FileName=<filename>");
   cmd.AddValue ("cal",   "use CalendarSheduler",          schedCal);
   cmd.AddValue ("heap",  "use HeapScheduler",             schedHeap);
   cmd.AddValue ("list",  "use ListSheduler",              schedList);
   cmd.AddValue ("map",   "use MapScheduler (default)",    schedMap);
+  cmd.AddValue ("quad",  "use FourAryHeapScheduler",      schedQuad);
+  cmd.AddValue ("pool",  "reuse event memory (default true)", pool);
   cmd.AddValue ("debug", "enable debugging output",       g_debug);
   cmd.AddValue ("pop",   "event population size (default 1E5)",         pop);
   cmd.AddValue ("total", "total number of events to run (default 1E6)", total);
@@ -219,7 +229,9 @@ int main (int argc, char *argv[])
   if (schedCal)  { factory.SetTypeId ("ns3::CalendarScheduler"); }
   if (schedHeap) { factory.SetTypeId ("ns3::HeapScheduler");     }
   if (schedList) { factory.SetTypeId ("ns3::ListScheduler");     }  
+  if (schedQuad) { factory.SetTypeId ("ns3::FourAryHeapScheduler"); }
   Simulator::SetScheduler (factory);
+  EventMemory::Enable (pool);
 
   LOGME (std::setprecision (g_fwidth - 6));
   DEB ("debugging is ON");
@@ -228,6 +240,7 @@ int main (int argc, char *argv[])
   LOGME ("population: " << pop);
   LOGME ("total events: " << total);
   LOGME ("runs: " << runs);
+  LOGME ("event memory pooling: " << (pool ? "on" : "off"));
   
   Bench *bench = new Bench (pop, total);
   bench->SetRandomStream (GetRandomStream (filename));
@@ -270,6 +283,9 @@ int main (int argc, char *argv[])
     }
 
   LOG ("");
+  std::cout << g_me << "event memory: ";
+  EventMemory::PrintStats (std::cout);
+  std::cout << std::endl;
   return 0;
 
   Simulator::Destroy ();
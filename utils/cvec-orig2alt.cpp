@@ -237,7 +237,8 @@ int main (int argc, char *argv[])
       fout << "A " << accTime << " 0 0\n";
     }
 
-//print FIN if no time delay given
+//print FIN if no time delay given; only the last connection of the file
+//gets one (see endOfTrace in Tmix::ParseOriginalConnectionVector)
   if (time == 0 && initTime == 0 && accTime == 0 && dir.compare (""))
     {
       fout << dir << " 1 0 0\n";